@@ -25,6 +25,14 @@ pub fn build(b: *std.Build) !void {
         .optimize = optimize,
     });
 
+    // Renders the benchmark scenes headless, numbers are only comparable between runs of the same optimize mode
+    const bench = b.addExecutable(.{
+        .name = "vulkan-bench",
+        .root_source_file = .{ .path = "src/bench.zig" },
+        .target = target,
+        .optimize = optimize,
+    });
+
     const scene_module = b.addModule("scene", .{
         .root_source_file = .{ .path = "src/main.zig" },
         .imports = &.{
@@ -39,6 +47,7 @@ pub fn build(b: *std.Build) !void {
     while (scene_iter.next()) |e| {
         exe.root_module.addImport(e.key_ptr.*, e.value_ptr.*);
         unit_tests.root_module.addImport(e.key_ptr.*, e.value_ptr.*);
+        bench.root_module.addImport(e.key_ptr.*, e.value_ptr.*);
     }
 
     // const vulkan = b.dependency("vulkan", .{ .target = target, .optimize = optimize });
@@ -48,8 +57,11 @@ pub fn build(b: *std.Build) !void {
     unit_tests.linkLibC();
     exe.linkLibCpp();
     unit_tests.linkLibCpp();
+    bench.linkLibC();
+    bench.linkLibCpp();
 
     @import("stb").addPathsToModule(&exe.root_module);
+    @import("stb").addPathsToModule(&bench.root_module);
 
     buildFramework(b, optimize);
 
@@ -57,18 +69,35 @@ pub fn build(b: *std.Build) !void {
 
     switch (root_target.os.tag) {
         .windows => {
-            compileShaders(b);
+            const shaders = compileShaders(b);
+            exe.root_module.addImport("shaders", shaders);
+            unit_tests.root_module.addImport("shaders", shaders);
+            bench.root_module.addImport("shaders", shaders);
+
             const imgui = b.dependency("imgui", .{ .target = target,.optimize = optimize });
             exe.linkLibrary(imgui.artifact("imgui"));
 
             const sdl = b.dependency("sdl", .{ .target = target, .optimize = optimize });
             exe.linkLibrary(sdl.artifact("sdl"));
+            bench.linkLibrary(sdl.artifact("sdl"));
 
             vulkan.addToCompileStep(b, target, exe);
+            vulkan.addToCompileStep(b, target, bench);
 
             // exe.addIncludePath(.{ .path = "thirdparty/vma"});
             // unit_tests.addIncludePath(.{ .path = "thirdparty/vma"});
         },
+        .linux => {
+            // Headless only, renders offscreen through whatever Vulkan driver is installed, lavapipe included
+            const shaders = compileShaders(b);
+            exe.root_module.addImport("shaders", shaders);
+            unit_tests.root_module.addImport("shaders", shaders);
+            bench.root_module.addImport("shaders", shaders);
+
+            exe.linkSystemLibrary("vulkan");
+            unit_tests.linkSystemLibrary("vulkan");
+            bench.linkSystemLibrary("vulkan");
+        },
         .macos => {
             exe.root_module.addImport("objc", b.dependency("objc", .{
                 .target = target,
@@ -101,6 +130,14 @@ pub fn build(b: *std.Build) !void {
     const run_step = b.step("run", "Run the app");
     run_step.dependOn(&run_cmd.step);
 
+    const bench_cmd = b.addRunArtifact(bench);
+    if (b.args) |args| {
+        bench_cmd.addArgs(args);
+    }
+
+    const bench_step = b.step("bench", "Render the benchmark scenes headless and print the results as JSON");
+    bench_step.dependOn(&bench_cmd.step);
+
     const run_unit_tests = b.addRunArtifact(unit_tests);
     const test_step = b.step("test", "Run unit tests");
     test_step.dependOn(&run_unit_tests.step);
@@ -205,36 +242,74 @@ fn buildFramework(b: *std.Build, optimize: std.builtin.OptimizeMode) void {
     lib_step.dependOn(xcframework.step);
 }
 
-fn compileShaders(b: *std.Build) void {
+/// Compile every GLSL shader to SPIR-V and return a generated `shaders` module that embeds the binaries. Each
+/// shader is exposed as a 4 byte aligned slice named after its file, `shader.vert.glsl` becomes `shader_vert`.
+fn compileShaders(b: *std.Build) *std.Build.Module {
     const shaders_dir = if (@hasDecl(@TypeOf(b.build_root.handle), "openIterableDir"))
         b.build_root.handle.openIterableDir("shaders", .{}) catch @panic("Failed to open shaders iterable directory")
     else std.fs.cwd().openDir("shaders", .{ .iterate = true }) catch @panic("Failed to open shaders directory");
 
+    // Sorted so the generated source only changes when the set of shaders does
+    var names = std.ArrayList([]const u8).init(b.allocator);
     var dir_iterator = shaders_dir.iterate();
     while(dir_iterator.next() catch @panic("cannot iterate directory")) |item| {
         if (item.kind == .file) {
             const extension = std.fs.path.extension(item.name);
             if (std.mem.eql(u8, extension, ".glsl")) {
                 const basename = std.fs.path.basename(item.name);
-                const name = basename[0..basename.len - extension.len];
+                names.append(b.dupe(basename[0..basename.len - extension.len])) catch @panic("Out of memory");
+            }
+        }
+    }
+    std.mem.sort([]const u8, names.items, {}, struct {
+        fn lessThan(_: void, lhs: []const u8, rhs: []const u8) bool {
+            return std.mem.lessThan(u8, lhs, rhs);
+        }
+    }.lessThan);
 
-                std.debug.print("Compiling shader: {s}\n", .{item.name});
-                
-                const validator_cmd = b.addSystemCommand(&.{ "glslangValidator"});
+    const generated = b.addWriteFiles();
+    var source = std.ArrayList(u8).init(b.allocator);
+    const source_writer = source.writer();
+    source_writer.writeAll("//! SPIR-V of every shader in `shaders/`, generated by `compileShaders` in build.zig\n\n") catch @panic("Out of memory");
 
-                const source_path = std.fmt.allocPrint(b.allocator, "shaders/{s}.glsl", .{name}) catch @panic("Failed to create sourc e path");
-                validator_cmd.addArg("-V");
-                validator_cmd.addFileArg(.{ .path = source_path});
-                
-                const output_path = std.fmt.allocPrint(b.allocator, "shaders/{s}.spv", .{name}) catch @panic("Failed to create output path");
-                validator_cmd.addArg("-o");
-                const out_file = validator_cmd.addOutputFileArg(output_path);
+    var decls = std.ArrayList([]const u8).init(b.allocator);
+    for (names.items) |name| {
+        std.debug.print("Compiling shader: {s}.glsl\n", .{name});
 
-                validator_cmd.stdio = .zig_test;
+        const validator_cmd = b.addSystemCommand(&.{ "glslangValidator"});
 
-                const install_shader = b.addInstallFileWithDir(out_file, .prefix, output_path);
-                b.getInstallStep().dependOn(&install_shader.step);
-            }
-        }
+        const source_path = std.fmt.allocPrint(b.allocator, "shaders/{s}.glsl", .{name}) catch @panic("Failed to create source path");
+        validator_cmd.addArg("-V");
+        validator_cmd.addFileArg(.{ .path = source_path});
+
+        const output_path = std.fmt.allocPrint(b.allocator, "shaders/{s}.spv", .{name}) catch @panic("Failed to create output path");
+        validator_cmd.addArg("-o");
+        const out_file = validator_cmd.addOutputFileArg(output_path);
+
+        validator_cmd.stdio = .zig_test;
+
+        const spirv_name = std.fmt.allocPrint(b.allocator, "{s}.spv", .{name}) catch @panic("Failed to create SPIR-V name");
+        _ = generated.addCopyFile(out_file, spirv_name);
+
+        const decl = b.dupe(name);
+        std.mem.replaceScalar(u8, decl, '.', '_');
+        decls.append(decl) catch @panic("Out of memory");
+
+        // Dereferencing the embedded array copies it into a declaration with the alignment SPIR-V words need
+        source_writer.print("const {s}_spirv align(4) = @embedFile(\"{s}\").*;\n", .{ decl, spirv_name }) catch @panic("Out of memory");
+        source_writer.print("pub const {s}: []align(4) const u8 = &{s}_spirv;\n\n", .{ decl, decl }) catch @panic("Out of memory");
+    }
+
+    source_writer.writeAll("pub const Name = enum {\n") catch @panic("Out of memory");
+    for (decls.items) |decl| {
+        source_writer.print("    {s},\n", .{decl}) catch @panic("Out of memory");
     }
-}
\ No newline at end of file
+    source_writer.writeAll("};\n\npub fn spirv(name: Name) []align(4) const u8 {\n    return switch (name) {\n") catch @panic("Out of memory");
+    for (decls.items) |decl| {
+        source_writer.print("        .{s} => {s},\n", .{ decl, decl }) catch @panic("Out of memory");
+    }
+    source_writer.writeAll("    };\n}\n") catch @panic("Out of memory");
+
+    const root_source_file = generated.add("shaders.zig", source.items);
+    return b.createModule(.{ .root_source_file = root_source_file });
+}
@@ -0,0 +1,214 @@
+const std = @import("std");
+const zmath = @import("zmath");
+const mesh = @import("mesh.zig");
+const transform = @import("transform.zig");
+const testing = std.testing;
+
+/// Number of bounds tested together by `cullSpheres`
+pub const CULL_LANES = 8;
+const Lanes = zmath.F32x8;
+
+/// Box around a mesh in mesh space
+pub const AABB = struct {
+    min: [3]f32,
+    max: [3]f32,
+
+    pub fn fromVertices(vertices: []const mesh.Vertex) AABB {
+        if (vertices.len == 0) {
+            return .{ .min = .{ 0, 0, 0 }, .max = .{ 0, 0, 0 } };
+        }
+
+        var min = vertices[0].position;
+        var max = vertices[0].position;
+        for (vertices[1..]) |vertex| {
+            min = @min(min, vertex.position);
+            max = @max(max, vertex.position);
+        }
+        return .{ .min = min, .max = max };
+    }
+};
+
+/// Sphere around a mesh in mesh space
+pub const BoundingSphere = struct {
+    center: [3]f32,
+    radius: f32,
+
+    /// Sphere around the center of the vertices' bounding box, loose but cheap and stable
+    pub fn fromVertices(vertices: []const mesh.Vertex, box: AABB) BoundingSphere {
+        const min: @Vector(3, f32) = box.min;
+        const max: @Vector(3, f32) = box.max;
+        const center = (min + max) * @as(@Vector(3, f32), @splat(0.5));
+
+        var radius_squared: f32 = 0;
+        for (vertices) |vertex| {
+            const offset = vertex.position - center;
+            radius_squared = @max(radius_squared, @reduce(.Add, offset * offset));
+        }
+
+        return .{ .center = center, .radius = @sqrt(radius_squared) };
+    }
+};
+
+/// Result of the frustum culling system, renderers skip entities that are not visible
+pub const Visible = struct {
+    value: bool = true,
+};
+
+/// Camera frustum in world space, updated once a frame from the camera
+pub const Frustum = struct {
+    /// Normalized left, right, bottom, top, near and far planes, the normals point inside. The default
+    /// planes contain everything.
+    planes: [6][4]f32 = [_][4]f32{.{ 0, 0, 0, 1 }} ** 6,
+
+    /// zmath multiplies row vectors, so clip space components are dot products with the columns of the matrix.
+    pub fn init(view_projection: zmath.Mat) Frustum {
+        const columns = zmath.transpose(view_projection);
+        const planes = [6]zmath.Vec{
+            columns[3] + columns[0],
+            columns[3] - columns[0],
+            columns[3] + columns[1],
+            columns[3] - columns[1],
+            // Depth is in [0, 1]
+            columns[2],
+            columns[3] - columns[2],
+        };
+
+        var frustum = Frustum{};
+        for (planes, &frustum.planes) |plane, *out| {
+            const length = zmath.length3(plane)[0];
+            out.* = zmath.vecToArr4(plane / zmath.splat(zmath.Vec, length));
+        }
+        return frustum;
+    }
+
+    pub fn containsSphere(self: *const Frustum, center: [3]f32, radius: f32) bool {
+        for (self.planes) |plane| {
+            const distance = plane[0] * center[0] + plane[1] * center[1] + plane[2] * center[2] + plane[3];
+            if (distance < -radius) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+/// Test the spheres against the frustum `CULL_LANES` at a time. The spheres are moved into world space by
+/// their transforms, the radius grows with the largest axis scale so the test stays conservative.
+pub fn cullSpheres(frustum: *const Frustum, spheres: []const BoundingSphere, transforms: []const transform.Transform, visible: []Visible) void {
+    std.debug.assert(spheres.len == transforms.len and spheres.len == visible.len);
+
+    var start: usize = 0;
+    while (start < spheres.len) : (start += CULL_LANES) {
+        const count = @min(CULL_LANES, spheres.len - start);
+
+        // Transpose the batch so every lane holds one sphere, unused lanes stay zero
+        var local = std.mem.zeroes([4][CULL_LANES]f32);
+        var model = std.mem.zeroes([4][3][CULL_LANES]f32);
+        for (0..count) |lane| {
+            const sphere = spheres[start + lane];
+            const matrix = transforms[start + lane].value;
+            local[0][lane] = sphere.center[0];
+            local[1][lane] = sphere.center[1];
+            local[2][lane] = sphere.center[2];
+            local[3][lane] = sphere.radius;
+
+            for (0..4) |row| {
+                for (0..3) |column| {
+                    model[row][column][lane] = matrix[row][column];
+                }
+            }
+        }
+
+        const x: Lanes = local[0];
+        const y: Lanes = local[1];
+        const z: Lanes = local[2];
+
+        var center: [3]Lanes = undefined;
+        for (&center, 0..) |*out, column| {
+            const row_x: Lanes = model[0][column];
+            const row_y: Lanes = model[1][column];
+            const row_z: Lanes = model[2][column];
+            const row_w: Lanes = model[3][column];
+            out.* = x * row_x + y * row_y + z * row_z + row_w;
+        }
+
+        var scale_squared = zmath.splat(Lanes, 0);
+        for (0..3) |row| {
+            const axis_x: Lanes = model[row][0];
+            const axis_y: Lanes = model[row][1];
+            const axis_z: Lanes = model[row][2];
+            scale_squared = @max(scale_squared, axis_x * axis_x + axis_y * axis_y + axis_z * axis_z);
+        }
+        const radius = @as(Lanes, local[3]) * @sqrt(scale_squared);
+
+        var nearest = zmath.splat(Lanes, std.math.inf(f32));
+        for (frustum.planes) |plane| {
+            const distance = center[0] * zmath.splat(Lanes, plane[0]) +
+                center[1] * zmath.splat(Lanes, plane[1]) +
+                center[2] * zmath.splat(Lanes, plane[2]) +
+                zmath.splat(Lanes, plane[3]);
+            nearest = @min(nearest, distance + radius);
+        }
+
+        const inside: [CULL_LANES]bool = nearest >= zmath.splat(Lanes, 0);
+        for (visible[start .. start + count], inside[0..count]) |*out, is_inside| {
+            out.value = is_inside;
+        }
+    }
+}
+
+test "BoundingSphere encloses every vertex" {
+    const vertex = mesh.Vertex{ .position = .{ 0, 0, 0 }, .color = .{ 0, 0, 0 }, .normal = .{ 0, 0, 1 }, .uv = .{ 0, 0 } };
+    var vertices = [_]mesh.Vertex{ vertex, vertex, vertex };
+    vertices[0].position = .{ -1, 0, 0 };
+    vertices[1].position = .{ 3, 0, 0 };
+    vertices[2].position = .{ 1, 2, 0 };
+
+    const box = AABB.fromVertices(&vertices);
+    try testing.expectEqual([3]f32{ -1, 0, 0 }, box.min);
+    try testing.expectEqual([3]f32{ 3, 2, 0 }, box.max);
+
+    const sphere = BoundingSphere.fromVertices(&vertices, box);
+    try testing.expectEqual([3]f32{ 1, 1, 0 }, sphere.center);
+    try testing.expectApproxEqAbs(@as(f32, @sqrt(5.0)), sphere.radius, 0.0001);
+}
+
+test "Frustum keeps spheres in front of the camera" {
+    const view = zmath.lookAtRh(.{ 0, 0, 0, 1 }, .{ 0, 0, -1, 1 }, .{ 0, 1, 0, 0 });
+    const projection = zmath.perspectiveFovRh(0.5 * std.math.pi, 1, 0.1, 100);
+    const frustum = Frustum.init(zmath.mul(view, projection));
+
+    try testing.expect(frustum.containsSphere(.{ 0, 0, -5 }, 1));
+    try testing.expect(!frustum.containsSphere(.{ 0, 0, 5 }, 1));
+    try testing.expect(!frustum.containsSphere(.{ 20, 0, -5 }, 1));
+    try testing.expect(!frustum.containsSphere(.{ 0, 0, -200 }, 1));
+
+    // Straddling the right plane still counts as visible
+    try testing.expect(frustum.containsSphere(.{ 5.5, 0, -5 }, 1));
+}
+
+test "cullSpheres matches the scalar test across a partial batch" {
+    const view = zmath.lookAtRh(.{ 0, 0, 0, 1 }, .{ 0, 0, -1, 1 }, .{ 0, 1, 0, 0 });
+    const projection = zmath.perspectiveFovRh(0.5 * std.math.pi, 1, 0.1, 100);
+    const frustum = Frustum.init(zmath.mul(view, projection));
+
+    var spheres: [CULL_LANES + 3]BoundingSphere = undefined;
+    var transforms: [CULL_LANES + 3]transform.Transform = undefined;
+    var visible: [CULL_LANES + 3]Visible = undefined;
+    for (&spheres, &transforms, 0..) |*sphere, *t, i| {
+        sphere.* = .{ .center = .{ 0, 0, 0 }, .radius = 1 };
+        t.* = .{ .value = zmath.translation(@as(f32, @floatFromInt(i)) * 3 - 15, 0, -5) };
+    }
+
+    cullSpheres(&frustum, &spheres, &transforms, &visible);
+    for (transforms, visible) |t, v| {
+        try testing.expectEqual(frustum.containsSphere(.{ t.value[3][0], t.value[3][1], t.value[3][2] }, 1), v.value);
+    }
+    try testing.expect(visible[5].value);
+    try testing.expect(!visible[0].value);
+
+    // Scaling grows the radius enough to reach back into the frustum
+    transforms[0].value = zmath.mul(zmath.scaling(10, 10, 10), transforms[0].value);
+    cullSpheres(&frustum, spheres[0..1], transforms[0..1], visible[0..1]);
+    try testing.expect(visible[0].value);
+}
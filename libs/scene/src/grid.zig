@@ -0,0 +1,53 @@
+const std = @import("std");
+const testing = std.testing;
+
+/// Singleton that fills the world with a cube of mesh entities at start up, for benchmarks and stress tests
+pub const GridScene = struct {
+    entity_count: u32,
+    /// Distinct meshes the entities cycle through, entities sharing a mesh are drawn instanced
+    mesh_count: u32 = 8,
+    /// Distance between neighbouring entities
+    spacing: f32 = 1.5,
+    /// Distance from the origin to the first layer of the cube, along -z where the default camera looks
+    depth: f32 = 4,
+};
+
+/// Entities along one edge of the smallest cube that holds `count` entities
+pub fn gridSide(count: u32) u32 {
+    var side: u32 = 1;
+    while (@as(u64, side) * side * side < count) {
+        side += 1;
+    }
+    return side;
+}
+
+/// Position of the entity at `index`, rows run along x, columns along y and layers away from the camera. The cube
+/// is centred on the z axis so the camera looks down its middle.
+pub fn gridPosition(grid: GridScene, side: u32, index: u32) [3]f32 {
+    const x = index % side;
+    const y = (index / side) % side;
+    const z = index / (side * side);
+    const half = @as(f32, @floatFromInt(side - 1)) / 2;
+
+    return .{
+        (@as(f32, @floatFromInt(x)) - half) * grid.spacing,
+        (@as(f32, @floatFromInt(y)) - half) * grid.spacing,
+        -grid.depth - @as(f32, @floatFromInt(z)) * grid.spacing,
+    };
+}
+
+test "gridSide fits the entity count" {
+    try testing.expectEqual(@as(u32, 1), gridSide(1));
+    try testing.expectEqual(@as(u32, 10), gridSide(1_000));
+    try testing.expectEqual(@as(u32, 11), gridSide(1_001));
+    try testing.expectEqual(@as(u32, 100), gridSide(1_000_000));
+}
+
+test "gridPosition centres each layer on the z axis" {
+    const grid = GridScene{ .entity_count = 27, .spacing = 2, .depth = 4 };
+    const side = gridSide(grid.entity_count);
+
+    try testing.expectEqual([3]f32{ -2, -2, -4 }, gridPosition(grid, side, 0));
+    try testing.expectEqual([3]f32{ 0, 0, -4 }, gridPosition(grid, side, 4));
+    try testing.expectEqual([3]f32{ 2, 2, -8 }, gridPosition(grid, side, 26));
+}
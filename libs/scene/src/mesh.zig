@@ -1,3 +1,4 @@
+const ecs = @import("flecs");
 const zmath = @import("zmath");
 
 pub const Vertex = struct {
@@ -7,8 +8,13 @@ pub const Vertex = struct {
     uv: @Vector(2, f32),
 };
 
-pub const UBO = struct {
+/// Per-object data read by the vertex shader from the object storage buffer, laid out to match std430
+pub const ObjectData = extern struct {
     model: zmath.Mat,
+    normal: zmath.Mat,
+    /// Slot of the object's texture in the bindless texture table
+    texture_index: u32 = 0,
+    padding: [3]u32 = .{ 0, 0, 0 },
 };
 
 pub const Mesh = struct {
@@ -17,4 +23,10 @@ pub const Mesh = struct {
     texture_id: u32,
 };
 
-pub const UpdateBuffer = struct {};
\ No newline at end of file
+pub const UpdateBuffer = struct {};
+
+/// The mesh slices are owned by another entity and are not freed with this one. Entities borrowing from the same
+/// owner share its geometry on the GPU.
+pub const BorrowedMesh = struct {
+    owner: ecs.entity_t,
+};
\ No newline at end of file
@@ -3,4 +3,6 @@ pub usingnamespace @import("transform.zig");
 pub usingnamespace @import("camera.zig");
 pub usingnamespace @import("input.zig");
 pub usingnamespace @import("light.zig");
+pub usingnamespace @import("bounds.zig");
+pub usingnamespace @import("grid.zig");
 pub usingnamespace @import("scene.zig");
\ No newline at end of file
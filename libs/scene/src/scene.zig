@@ -4,6 +4,8 @@ const ecs = @import("flecs");
 const zmath = @import("zmath");
 const mesh = @import("mesh.zig");
 const transform = @import("transform.zig");
+const bounds = @import("bounds.zig");
+const grid = @import("grid.zig");
 const ux = @import("input.zig");
 const Camera = @import("camera.zig").Camera;
 const Perspective = @import("camera.zig").Perspective;
@@ -314,6 +316,90 @@ fn simpleSceneSetUp(it: *ecs.iter_t) callconv(.C) void {
     });
 }
 
+/// Spawn the entities of a `GridScene`. Each mesh is owned by an entity that is never drawn, the grid entities
+/// borrow its slices, so the engine uploads every mesh once and draws the entities sharing it as instances.
+fn gridSceneSetUp(it: *ecs.iter_t) callconv(.C) void {
+    std.debug.print("Start up: {s}\n", .{ecs.get_name(it.world, it.system).?});
+    const allocator = ecs.singleton_get(it.world, core.Allocator).?;
+    const grid_scene = ecs.singleton_get(it.world, grid.GridScene).?.*;
+
+    const indices = [_]u32{
+        0, 1, 2,
+        2, 3, 0,
+    };
+
+    const mesh_count = @max(grid_scene.mesh_count, 1);
+    const meshes = allocator.alloc.alloc(mesh.Mesh, mesh_count) catch @panic("Out of memory");
+    defer allocator.alloc.free(meshes);
+    const owners = allocator.alloc.alloc(ecs.entity_t, mesh_count) catch @panic("Out of memory");
+    defer allocator.alloc.free(owners);
+
+    for (meshes, owners, 0..) |*m, *owner, k| {
+        const size = 0.2 + 0.05 * @as(f32, @floatFromInt(k % 4));
+        const shade = @as(f32, @floatFromInt(k)) / @as(f32, @floatFromInt(mesh_count));
+        const vertices = [_]mesh.Vertex{
+            .{ .position = .{ -size, size, 0.0 }, .color = .{ 1, shade, 0 }, .normal = .{ 0, 0, 1 }, .uv = .{ 1, 1 } },
+            .{ .position = .{ -size, -size, 0.0 }, .color = .{ 0, 1, shade }, .normal = .{ 0, 0, 1 }, .uv = .{ 1, 0 } },
+            .{ .position = .{ size, -size, 0.0 }, .color = .{ shade, 0, 1 }, .normal = .{ 0, 0, 1 }, .uv = .{ 0, 0 } },
+            .{ .position = .{ size, size, 0.0 }, .color = .{ 1, 1, shade }, .normal = .{ 0, 0, 1 }, .uv = .{ 0, 1 } },
+        };
+
+        m.* = .{
+            .vertices = allocator.alloc.dupe(mesh.Vertex, vertices[0..]) catch @panic("Out of memory"),
+            .indices = allocator.alloc.dupe(u32, indices[0..]) catch @panic("Out of memory"),
+            .texture_id = 0,
+        };
+
+        owner.* = ecs.new_id(it.world);
+        _ = ecs.set(it.world, owner.*, mesh.Mesh, m.*);
+    }
+
+    const side = grid.gridSide(grid_scene.entity_count);
+    for (0..grid_scene.entity_count) |i| {
+        const index = @as(u32, @intCast(i));
+        const position = grid.gridPosition(grid_scene, side, index);
+
+        const entity = ecs.new_id(it.world);
+        _ = ecs.add(it.world, entity, mesh.UpdateBuffer);
+        _ = ecs.set(it.world, entity, mesh.BorrowedMesh, .{ .owner = owners[index % mesh_count] });
+        _ = ecs.set(it.world, entity, mesh.Mesh, meshes[index % mesh_count]);
+        _ = ecs.set(it.world, entity, transform.Speed, .{ .value = 10 + @as(f32, @floatFromInt(index % 5)) * 10 });
+        _ = ecs.set(it.world, entity, transform.Transform, .{
+            .value = zmath.translation(position[0], position[1], position[2]),
+        });
+    }
+    std.debug.print("Grid scene: {d} entities, {d} meshes\n", .{ grid_scene.entity_count, mesh_count });
+}
+
+fn computeMeshBounds(it: *ecs.iter_t) callconv(.C) void {
+    const meshes = ecs.field(it, mesh.Mesh, 1).?;
+
+    for (meshes, it.entities()) |m, e| {
+        const box = bounds.AABB.fromVertices(m.vertices);
+        _ = ecs.set(it.world, e, bounds.AABB, box);
+        _ = ecs.set(it.world, e, bounds.BoundingSphere, bounds.BoundingSphere.fromVertices(m.vertices, box));
+        _ = ecs.set(it.world, e, bounds.Visible, .{});
+    }
+}
+
+fn updateFrustum(it: *ecs.iter_t) callconv(.C) void {
+    const cameras = ecs.field(it, Camera, 1).?;
+    const frustums = ecs.field(it, bounds.Frustum, 2).?;
+
+    for (cameras) |camera| {
+        frustums[0] = bounds.Frustum.init(zmath.mul(camera.view, camera.projection));
+    }
+}
+
+fn cullBounds(it: *ecs.iter_t) callconv(.C) void {
+    const spheres = ecs.field(it, bounds.BoundingSphere, 1).?;
+    const transforms = ecs.field(it, transform.Transform, 2).?;
+    const visibles = ecs.field(it, bounds.Visible, 3).?;
+    const frustums = ecs.field(it, bounds.Frustum, 4).?;
+
+    bounds.cullSpheres(&frustums[0], spheres, transforms, visibles);
+}
+
 fn cleanUpMeshAllocations(it: *ecs.iter_t) callconv(.C) void {
     std.debug.print("Clean up: {s}\n", .{ecs.get_name(it.world, it.system).?});
     const allocator = ecs.singleton_get(it.world, core.Allocator).?;
@@ -348,8 +434,17 @@ pub fn init(world: *ecs.world_t) void {
     ecs.COMPONENT(world, transform.Transform);
     ecs.COMPONENT(world, transform.Speed);
     ecs.COMPONENT(world, Perspective);
+    ecs.COMPONENT(world, bounds.AABB);
+    ecs.COMPONENT(world, bounds.BoundingSphere);
+    ecs.COMPONENT(world, bounds.Visible);
+    ecs.COMPONENT(world, bounds.Frustum);
     ecs.TAG(world, CameraController);
     ecs.TAG(world, mesh.UpdateBuffer);
+    ecs.COMPONENT(world, mesh.BorrowedMesh);
+    ecs.COMPONENT(world, grid.GridScene);
+
+    // Everything is visible until a camera updates the frustum
+    _ = ecs.singleton_set(world, bounds.Frustum, .{});
 
     var camera_desc = ecs.system_desc_t{};
     camera_desc.callback = createCamera;
@@ -369,6 +464,15 @@ pub fn init(world: *ecs.world_t) void {
     };
     ecs.SYSTEM(world, "SimpleSceneSetUp", ecs.OnStart, &simple_scene_desc);
 
+    // Only runs when the application set the `GridScene` singleton
+    var grid_scene_desc = ecs.system_desc_t{};
+    grid_scene_desc.callback = gridSceneSetUp;
+    grid_scene_desc.query.filter.terms[0] = .{
+        .id = ecs.id(grid.GridScene),
+        .src = .{ .id = ecs.id(grid.GridScene) },
+    };
+    ecs.SYSTEM(world, "GridSceneSetUp", ecs.OnStart, &grid_scene_desc);
+
     var update_camera_desc = ecs.system_desc_t{};
     update_camera_desc.callback = updateCamera;
     update_camera_desc.query.filter.terms[0] = .{
@@ -465,11 +569,68 @@ pub fn init(world: *ecs.world_t) void {
     };
     ecs.SYSTEM(world, "SpinTransform", ecs.OnUpdate, &spin_transform_desc);
 
+    var compute_mesh_bounds_desc = ecs.system_desc_t{};
+    compute_mesh_bounds_desc.callback = computeMeshBounds;
+    compute_mesh_bounds_desc.query.filter.terms[0] = .{
+        .id = ecs.id(mesh.Mesh),
+        .inout = ecs.inout_kind_t.In,
+    };
+    compute_mesh_bounds_desc.query.filter.terms[1] = .{
+        .id = ecs.id(bounds.BoundingSphere),
+        .inout = ecs.inout_kind_t.InOutNone,
+        .oper = ecs.oper_kind_t.Not,
+    };
+    ecs.SYSTEM(world, "ComputeMeshBounds", ecs.PostLoad, &compute_mesh_bounds_desc);
+
+    // Both run after the camera and the transforms have been updated for the frame
+    var update_frustum_desc = ecs.system_desc_t{};
+    update_frustum_desc.callback = updateFrustum;
+    update_frustum_desc.query.filter.terms[0] = .{
+        .id = ecs.id(Camera),
+        .inout = ecs.inout_kind_t.In,
+    };
+    update_frustum_desc.query.filter.terms[1] = .{
+        .id = ecs.id(bounds.Frustum),
+        .inout = ecs.inout_kind_t.Out,
+        .src = .{
+            .id = ecs.id(bounds.Frustum),
+        },
+    };
+    ecs.SYSTEM(world, "UpdateFrustum", ecs.OnUpdate, &update_frustum_desc);
+
+    var cull_bounds_desc = ecs.system_desc_t{};
+    cull_bounds_desc.callback = cullBounds;
+    cull_bounds_desc.query.filter.terms[0] = .{
+        .id = ecs.id(bounds.BoundingSphere),
+        .inout = ecs.inout_kind_t.In,
+    };
+    cull_bounds_desc.query.filter.terms[1] = .{
+        .id = ecs.id(transform.Transform),
+        .inout = ecs.inout_kind_t.In,
+    };
+    cull_bounds_desc.query.filter.terms[2] = .{
+        .id = ecs.id(bounds.Visible),
+        .inout = ecs.inout_kind_t.Out,
+    };
+    cull_bounds_desc.query.filter.terms[3] = .{
+        .id = ecs.id(bounds.Frustum),
+        .inout = ecs.inout_kind_t.In,
+        .src = .{
+            .id = ecs.id(bounds.Frustum),
+        },
+    };
+    ecs.SYSTEM(world, "CullBounds", ecs.OnUpdate, &cull_bounds_desc);
+
     var clean_up_mesh_allocations_desc = ecs.system_desc_t{};
     clean_up_mesh_allocations_desc.callback = cleanUpMeshAllocations;
     clean_up_mesh_allocations_desc.query.filter.terms[0] = .{
         .id = ecs.id(mesh.Mesh),
         .inout = ecs.inout_kind_t.InOut,
     };
+    clean_up_mesh_allocations_desc.query.filter.terms[1] = .{
+        .id = ecs.id(mesh.BorrowedMesh),
+        .inout = ecs.inout_kind_t.InOutNone,
+        .oper = ecs.oper_kind_t.Not,
+    };
     ecs.SYSTEM(world, "CleanUpMeshAllocations", ecs.id(core.OnStop), &clean_up_mesh_allocations_desc);
 }
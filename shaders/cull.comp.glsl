@@ -0,0 +1,70 @@
+#version 460
+
+layout(local_size_x = 64) in;
+
+struct ObjectData {
+    mat4 model;
+    mat4 normal;
+    uint textureIndex;
+};
+
+struct CullInput {
+    vec4 sphere;
+    uint batch;
+    uint objectIndex;
+    uint padding0;
+    uint padding1;
+};
+
+struct DrawCommand {
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Objects {
+    ObjectData objects[];
+} objectBuffer;
+
+layout(std430, set = 0, binding = 1) readonly buffer Inputs {
+    CullInput inputs[];
+} inputBuffer;
+
+// Instance counts start at zero, every visible instance claims the next slot of its batch
+layout(std430, set = 0, binding = 2) buffer Commands {
+    DrawCommand commands[];
+} commandBuffer;
+
+layout(std430, set = 0, binding = 3) writeonly buffer Visible {
+    uint indices[];
+} visibleBuffer;
+
+layout(push_constant) uniform Cull {
+    vec4 planes[6];
+    uint instanceCount;
+} cull;
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= cull.instanceCount) {
+        return;
+    }
+
+    CullInput item = inputBuffer.inputs[index];
+    mat4 model = objectBuffer.objects[item.objectIndex].model;
+
+    vec3 center = (model * vec4(item.sphere.xyz, 1.0)).xyz;
+    float scale = max(length(model[0].xyz), max(length(model[1].xyz), length(model[2].xyz)));
+    float radius = item.sphere.w * scale;
+
+    for (int i = 0; i < 6; i++) {
+        if (dot(cull.planes[i].xyz, center) + cull.planes[i].w < -radius) {
+            return;
+        }
+    }
+
+    uint slot = atomicAdd(commandBuffer.commands[item.batch].instanceCount, 1);
+    visibleBuffer.indices[commandBuffer.commands[item.batch].firstInstance + slot] = item.objectIndex;
+}
@@ -10,23 +10,35 @@ layout(set = 0, binding = 0) uniform Camera {
     mat4 projection;
 } camera;
 
-// layout(set = 0, binding = 1) uniform UBO {
-//     mat4 model;
-// } ubo;
-
-layout(push_constant) uniform UBO {
+struct ObjectData {
     mat4 model;
-} ubo;
+    mat4 normal;
+    uint textureIndex;
+};
+
+// The dynamic offsets select the frame
+layout(std430, set = 3, binding = 0) readonly buffer Objects {
+    ObjectData objects[];
+} objectBuffer;
+
+// Object index of every drawn instance, compacted by the cull pass
+layout(std430, set = 3, binding = 1) readonly buffer Visible {
+    uint indices[];
+} visibleBuffer;
 
 layout(location = 0) out vec3 fragCol;
 layout(location = 1) out vec2 fragUV;
 layout(location = 2) out vec3 fragNormal;
+// Only read by the bindless fragment shader
+layout(location = 3) flat out uint fragTextureIndex;
 
 void main() {
-    gl_Position = camera.projection * camera.view * ubo.model * vec4(pos, 1.0);
+    ObjectData object = objectBuffer.objects[visibleBuffer.indices[gl_InstanceIndex]];
+    gl_Position = camera.projection * camera.view * object.model * vec4(pos, 1.0);
     // gl_Position = vec4(pos, 1.0);
     fragCol = col;
     fragUV = uv;
 
-    fragNormal = mat3(transpose(inverse(ubo.model))) * normal;
+    fragNormal = mat3(object.normal) * normal;
+    fragTextureIndex = object.textureIndex;
 }
\ No newline at end of file
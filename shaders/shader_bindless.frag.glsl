@@ -0,0 +1,30 @@
+#version 460
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(location = 0) in vec3 fragCol;
+layout(location = 1) in vec2 fragUV;
+layout(location = 2) in vec3 fragNormal;
+layout(location = 3) flat in uint fragTextureIndex;
+
+layout(set = 1, binding = 0) uniform Light {
+    vec3 color;
+    vec3 direction;
+    float ambientIntensity;
+    float diffuseIntensity;
+} light;
+
+// Every texture of the device, partially bound and indexed per instance
+layout(set = 2, binding = 0) uniform sampler2D textures[];
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    vec4 ambientColor = vec4(light.color, 1.0) * light.ambientIntensity;
+
+    // A.B = |A| * |B| * cos(theta), since we normalize A and B, it is 1 * 1 * cos(theta) = cos(theta)
+    vec3 lightDir = normalize(-light.direction.xyz);
+    float diffuseFactor = max(dot(fragNormal, lightDir), 0.0f);
+    vec4 diffuseColor = vec4(light.color, 1.0) * light.diffuseIntensity * diffuseFactor;
+
+    outColor = texture(textures[nonuniformEXT(fragTextureIndex)], fragUV) * (ambientColor + diffuseColor);
+}
\ No newline at end of file
@@ -3,8 +3,12 @@ const core = @import("core");
 const ecs = @import("flecs");
 const scene = @import("scene");
 const c = @import("clibs.zig");
+const trace = @import("trace.zig");
 const log = std.log.scoped(.app);
 
+/// Key that starts a CPU trace capture of the next few frames
+const CAPTURE_KEY = scene.KEY_T;
+
 pub fn cleanUpInput(it: *ecs.iter_t) callconv(.C) void {
     const input = ecs.singleton_get(it.world, scene.Input).?;
     const allocator = ecs.singleton_get(it.world, core.Allocator).?;
@@ -23,6 +27,8 @@ pub fn init(world: *ecs.world_t, allocator: std.mem.Allocator) !void {
     _ = ecs.singleton_set(world, core.CanvasSize, .{ .width = 800, .height = 600 });
 
     const keys = allocator.alloc(scene.KeyState, scene.KEY_COUNT) catch @panic( "OOM!");
+    // Nothing resets them without a window to read events from
+    @memset(keys, .{});
     _ = ecs.singleton_set(world, scene.Input, .{
         .keys = keys,
         .mouse = std.mem.zeroInit(scene.MouseState, .{}),
@@ -42,11 +48,26 @@ pub fn init(world: *ecs.world_t, allocator: std.mem.Allocator) !void {
 pub fn run(world: *ecs.world_t) void {
     _ = ecs.enable(world, ecs.id(core.OnStop), false);
 
+    // Every module has registered its systems by now
+    const allocator = ecs.singleton_get(world, core.Allocator).?;
+    var tracer: trace.Tracer = undefined;
+    tracer.init(allocator.alloc, .{});
+    defer tracer.deinit();
+    tracer.instrument(world) catch |err| {
+        std.debug.print("Failed to instrument systems: {}\n", .{err});
+    };
+
     var alive = true;
     while (alive) {
+        const frame = trace.begin("Frame");
         alive = ecs.progress(world, 0);
+        frame.end();
+        tracer.endFrame(world);
+
         if (!alive) {
             std.debug.print("Quitting...\n", .{});
+        } else if (ecs.singleton_get(world, scene.Input).?.keys[CAPTURE_KEY].pressed) {
+            tracer.requestCapture();
         }
     }
 }
\ No newline at end of file
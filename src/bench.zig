@@ -0,0 +1,335 @@
+//! Renders generated grid scenes of increasing size on a headless device and reports what their frames cost as
+//! JSON on stdout. Run through `zig build bench`, ideally with `-Doptimize=ReleaseFast`, and compare the output
+//! against a baseline run to measure a change to the engine's hot paths.
+//!
+//! ```
+//! zig build bench -Doptimize=ReleaseFast -- --sizes 1000,10000 --frames 120 --out bench.json
+//! ```
+
+const std = @import("std");
+const builtin = @import("builtin");
+const ecs = @import("flecs");
+const core = @import("core");
+const scene = @import("scene");
+const app = @import("app.zig");
+const vulkan_eng = @import("./vulkan/engine.zig");
+const vkgp = @import("./vulkan/profiler.zig");
+const testing = std.testing;
+
+pub const SCENE_SIZES = [_]u32{ 1_000, 10_000, 100_000, 1_000_000 };
+pub const DEFAULT_WARMUP_FRAMES: u32 = 30;
+pub const DEFAULT_FRAMES: u32 = 300;
+
+const SceneAllocator = std.heap.GeneralPurposeAllocator(.{ .enable_memory_limit = true });
+
+pub const BenchOpts = struct {
+    sizes: []const u32 = &SCENE_SIZES,
+    /// Frames rendered before measuring, the meshes are uploaded and the pipelines warmed during them
+    warmup_frames: u32 = DEFAULT_WARMUP_FRAMES,
+    frames: u32 = DEFAULT_FRAMES,
+    /// Also write the report to this file
+    out_path: ?[]const u8 = null,
+};
+
+/// Cost of one scene. Times are means over the measured frames, the byte counts cover the whole run.
+pub const SceneReport = struct {
+    entities: u32,
+    frame_ms: f64,
+    fps: f64,
+    /// CPU time of the OnUpdate and OnStore phases
+    update_ms: f64,
+    store_ms: f64,
+    /// Zero when the device cannot write timestamps
+    gpu_frame_ms: f64,
+    /// Draw calls of the last measured frame
+    draw_calls: u32,
+    bytes_uploaded: u64,
+    peak_host_bytes: usize,
+    peak_device_bytes: u64,
+};
+
+pub const Report = struct {
+    optimize: []const u8,
+    warmup_frames: u32,
+    frames: u32,
+    scenes: []const SceneReport,
+};
+
+/// CPU time of one phase, between a system declared ahead of every other system of the phase and one after them
+const PhaseClock = struct {
+    started_at: i128 = 0,
+    total_ns: u64 = 0,
+};
+
+/// Filled in by the bench systems while a scene runs
+const SceneRun = struct {
+    gpa: *SceneAllocator,
+    update: PhaseClock = .{},
+    store: PhaseClock = .{},
+    samples: u32 = 0,
+    gpu_resolved: u64 = 0,
+    gpu_ms: f64 = 0,
+    gpu_frames: u32 = 0,
+    draw_calls: u32 = 0,
+    bytes_uploaded: u64 = 0,
+    peak_host_bytes: usize = 0,
+    peak_device_bytes: u64 = 0,
+
+    /// Drop what the warm up frames measured, the peaks and byte counts keep covering them
+    fn resetTimings(self: *SceneRun) void {
+        self.update = .{};
+        self.store = .{};
+        self.gpu_ms = 0;
+        self.gpu_frames = 0;
+    }
+};
+
+pub fn main() !void {
+    var gpa = std.heap.GeneralPurposeAllocator(.{}){};
+    defer if (gpa.deinit() == .leak) {
+        @panic("Leaked memory");
+    };
+    const allocator = gpa.allocator();
+
+    const args = try std.process.argsAlloc(allocator);
+    defer std.process.argsFree(allocator, args);
+
+    var sizes = std.ArrayList(u32).init(allocator);
+    defer sizes.deinit();
+    const opts = parseArgs(args[1..], &sizes) catch |err| {
+        std.debug.print("Usage: vulkan-bench [--sizes 1000,10000] [--warmup N] [--frames N] [--out bench.json]\n", .{});
+        return err;
+    };
+
+    const scenes = try allocator.alloc(SceneReport, opts.sizes.len);
+    defer allocator.free(scenes);
+
+    for (opts.sizes, scenes) |size, *report| {
+        std.debug.print("Benchmarking {d} entities\n", .{size});
+        report.* = try runScene(size, opts);
+    }
+
+    const report = Report{
+        .optimize = @tagName(builtin.mode),
+        .warmup_frames = opts.warmup_frames,
+        .frames = opts.frames,
+        .scenes = scenes,
+    };
+
+    try writeReport(std.io.getStdOut().writer(), report);
+    if (opts.out_path) |path| {
+        const file = try std.fs.cwd().createFile(path, .{});
+        defer file.close();
+        try writeReport(file.writer(), report);
+    }
+}
+
+/// Render one grid scene in a world of its own, so no scene pays for what the previous one left behind
+fn runScene(entity_count: u32, opts: BenchOpts) !SceneReport {
+    var gpa = SceneAllocator{};
+    defer if (gpa.deinit() == .leak) {
+        std.debug.print("Scene of {d} entities leaked memory\n", .{entity_count});
+    };
+
+    const world = ecs.init();
+    defer _ = ecs.fini(world);
+
+    var run = SceneRun{ .gpa = &gpa };
+
+    try app.init(world, gpa.allocator());
+    _ = ecs.singleton_set(world, scene.GridScene, .{ .entity_count = entity_count });
+
+    // Declared ahead of every module so they open their phase, the matching stop systems are declared last
+    registerClock(world, "BenchStartUpdateSystem", ecs.OnUpdate, startPhase, &run.update);
+    registerClock(world, "BenchStartStoreSystem", ecs.OnStore, startPhase, &run.store);
+
+    scene.init(world);
+    vulkan_eng.init(world, .{
+        // The bench decides when to stop, a frame limit would tear the device down before the report is taken
+        .headless = .{ .frame_count = 0 },
+        // Every grid entity plus the handful the default scene spawns
+        .max_objects = entity_count + 64,
+    });
+
+    registerClock(world, "BenchStopUpdateSystem", ecs.OnUpdate, stopPhase, &run.update);
+    registerClock(world, "BenchStopStoreSystem", ecs.OnStore, stopPhase, &run.store);
+
+    var sample_desc = ecs.system_desc_t{};
+    sample_desc.callback = sampleFrame;
+    sample_desc.ctx = &run;
+    sample_desc.query.filter.terms[0] = .{ .id = ecs.id(vulkan_eng.RenderStats), .inout = ecs.inout_kind_t.In };
+    sample_desc.query.filter.terms[1] = .{ .id = ecs.id(vulkan_eng.Uploader), .inout = ecs.inout_kind_t.In };
+    sample_desc.query.filter.terms[2] = .{ .id = ecs.id(vulkan_eng.MemoryAllocator), .inout = ecs.inout_kind_t.In };
+    ecs.SYSTEM(world, "BenchSampleSystem", ecs.OnStore, &sample_desc);
+
+    ecs.enable(world, ecs.id(core.OnStop), false);
+
+    var update_ns: u64 = 0;
+    var store_ns: u64 = 0;
+    var frame_ns: u64 = 0;
+    for (0..opts.warmup_frames + opts.frames) |frame| {
+        if (frame == opts.warmup_frames) {
+            run.resetTimings();
+        }
+
+        const frame_start = std.time.nanoTimestamp();
+        if (!ecs.progress(world, 0)) {
+            return error.WorldStopped;
+        }
+
+        if (frame >= opts.warmup_frames) {
+            frame_ns += @as(u64, @intCast(@max(std.time.nanoTimestamp() - frame_start, 0)));
+            update_ns = run.update.total_ns;
+            store_ns = run.store.total_ns;
+        }
+    }
+
+    // Runs the OnStop systems, which destroy the device and quit the world
+    ecs.enable(world, ecs.id(core.OnStop), true);
+    _ = ecs.progress(world, 0);
+
+    if (run.samples == 0) {
+        return error.NoDeviceRendered;
+    }
+
+    return .{
+        .entities = entity_count,
+        .frame_ms = meanMs(frame_ns, opts.frames),
+        .fps = if (frame_ns > 0) @as(f64, @floatFromInt(opts.frames)) * std.time.ns_per_s / @as(f64, @floatFromInt(frame_ns)) else 0,
+        .update_ms = meanMs(update_ns, opts.frames),
+        .store_ms = meanMs(store_ns, opts.frames),
+        .gpu_frame_ms = if (run.gpu_frames > 0) run.gpu_ms / @as(f64, @floatFromInt(run.gpu_frames)) else 0,
+        .draw_calls = run.draw_calls,
+        .bytes_uploaded = run.bytes_uploaded,
+        .peak_host_bytes = run.peak_host_bytes,
+        .peak_device_bytes = run.peak_device_bytes,
+    };
+}
+
+fn registerClock(world: *ecs.world_t, name: [*:0]const u8, phase: ecs.entity_t, callback: ecs.iter_action_t, clock: *PhaseClock) void {
+    var desc = ecs.system_desc_t{};
+    desc.callback = callback;
+    desc.ctx = clock;
+    ecs.SYSTEM(world, name, phase, &desc);
+}
+
+fn startPhase(it: *ecs.iter_t) callconv(.C) void {
+    const clock: *PhaseClock = @ptrCast(@alignCast(it.ctx.?));
+    clock.started_at = std.time.nanoTimestamp();
+}
+
+fn stopPhase(it: *ecs.iter_t) callconv(.C) void {
+    const clock: *PhaseClock = @ptrCast(@alignCast(it.ctx.?));
+    clock.total_ns += @as(u64, @intCast(@max(std.time.nanoTimestamp() - clock.started_at, 0)));
+}
+
+/// Runs after the frame was submitted, the draw list and uploads of the frame are final by then
+fn sampleFrame(it: *ecs.iter_t) callconv(.C) void {
+    const run: *SceneRun = @ptrCast(@alignCast(it.ctx.?));
+    const render_stats = ecs.field(it, vulkan_eng.RenderStats, 1).?;
+    const uploaders = ecs.field(it, vulkan_eng.Uploader, 2).?;
+    const memory_allocators = ecs.field(it, vulkan_eng.MemoryAllocator, 3).?;
+
+    for (render_stats, uploaders, memory_allocators) |stats, uploader, memory_allocator| {
+        run.samples += 1;
+        run.draw_calls = stats.binds.sorted.draws;
+        run.bytes_uploaded = uploader.handle.bytes_uploaded;
+        run.peak_device_bytes = @max(run.peak_device_bytes, memory_allocator.handle.stats().bytes_reserved);
+    }
+    run.peak_host_bytes = @max(run.peak_host_bytes, run.gpa.total_requested_bytes);
+
+    // Timings resolve a few frames late, only count each resolved frame once
+    const timings = ecs.singleton_get(it.world, vulkan_eng.GpuTimings).?;
+    if (timings.frame != run.gpu_resolved) {
+        run.gpu_resolved = timings.frame;
+        if (timings.get(vkgp.FRAME_SCOPE)) |ms| {
+            run.gpu_ms += ms;
+            run.gpu_frames += 1;
+        }
+    }
+}
+
+fn meanMs(total_ns: u64, frames: u32) f64 {
+    if (frames == 0) {
+        return 0;
+    }
+    return @as(f64, @floatFromInt(total_ns)) / @as(f64, @floatFromInt(frames)) / std.time.ns_per_ms;
+}
+
+fn writeReport(writer: anytype, report: Report) !void {
+    try std.json.stringify(report, .{ .whitespace = .indent_2 }, writer);
+    try writer.writeByte('\n');
+}
+
+/// Scene sizes given with `--sizes` are appended to `sizes`, which must outlive the options
+fn parseArgs(args: []const []const u8, sizes: *std.ArrayList(u32)) !BenchOpts {
+    var opts = BenchOpts{};
+    var i: usize = 0;
+    while (i < args.len) : (i += 1) {
+        const arg = args[i];
+        if (i + 1 == args.len) {
+            return error.MissingValue;
+        }
+        i += 1;
+        const value = args[i];
+
+        if (std.mem.eql(u8, arg, "--sizes")) {
+            var tokens = std.mem.tokenizeScalar(u8, value, ',');
+            while (tokens.next()) |token| {
+                try sizes.append(try std.fmt.parseInt(u32, token, 10));
+            }
+            opts.sizes = sizes.items;
+        } else if (std.mem.eql(u8, arg, "--warmup")) {
+            opts.warmup_frames = try std.fmt.parseInt(u32, value, 10);
+        } else if (std.mem.eql(u8, arg, "--frames")) {
+            opts.frames = try std.fmt.parseInt(u32, value, 10);
+        } else if (std.mem.eql(u8, arg, "--out")) {
+            opts.out_path = value;
+        } else {
+            return error.UnknownArgument;
+        }
+    }
+    return opts;
+}
+
+test "parseArgs overrides the defaults" {
+    var sizes = std.ArrayList(u32).init(testing.allocator);
+    defer sizes.deinit();
+
+    const defaults = try parseArgs(&.{}, &sizes);
+    try testing.expectEqualSlices(u32, &SCENE_SIZES, defaults.sizes);
+
+    const opts = try parseArgs(&.{ "--sizes", "10,200", "--frames", "5", "--out", "bench.json" }, &sizes);
+    try testing.expectEqualSlices(u32, &.{ 10, 200 }, opts.sizes);
+    try testing.expectEqual(@as(u32, 5), opts.frames);
+    try testing.expectEqual(DEFAULT_WARMUP_FRAMES, opts.warmup_frames);
+    try testing.expectEqualStrings("bench.json", opts.out_path.?);
+
+    try testing.expectError(error.MissingValue, parseArgs(&.{"--frames"}, &sizes));
+    try testing.expectError(error.UnknownArgument, parseArgs(&.{ "--fps", "60" }, &sizes));
+}
+
+test "writeReport emits one object per scene" {
+    const scenes = [_]SceneReport{.{
+        .entities = 1_000,
+        .frame_ms = 2,
+        .fps = 500,
+        .update_ms = 0.5,
+        .store_ms = 1,
+        .gpu_frame_ms = 1.5,
+        .draw_calls = 8,
+        .bytes_uploaded = 4096,
+        .peak_host_bytes = 1 << 20,
+        .peak_device_bytes = 1 << 24,
+    }};
+
+    var json = std.ArrayList(u8).init(testing.allocator);
+    defer json.deinit();
+    try writeReport(json.writer(), .{ .optimize = "Debug", .warmup_frames = 1, .frames = 2, .scenes = &scenes });
+
+    const parsed = try std.json.parseFromSlice(Report, testing.allocator, json.items, .{});
+    defer parsed.deinit();
+    try testing.expectEqual(@as(usize, 1), parsed.value.scenes.len);
+    try testing.expectEqual(@as(u32, 1_000), parsed.value.scenes[0].entities);
+    try testing.expectEqual(@as(u64, 4096), parsed.value.scenes[0].bytes_uploaded);
+}
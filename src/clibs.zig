@@ -18,6 +18,9 @@
 
 const builtin = @import("builtin");
 
+/// SDL is only built on Windows, everywhere else the engine runs headless
+pub const has_sdl = builtin.os.tag == .windows;
+
 pub usingnamespace @cImport({
     // @cInclude("imgui/cimgui.h");
     
@@ -28,5 +31,8 @@ pub usingnamespace @cImport({
         @cInclude("SDL2/SDL_vulkan.h");
         @cInclude("vulkan/vulkan.h");
         @cInclude("vma/vk_mem_alloc.h");
+    } else if (builtin.os.tag == .linux) {
+        @cInclude("stb_image.h");
+        @cInclude("vulkan/vulkan.h");
     }
 });
\ No newline at end of file
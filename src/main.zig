@@ -17,13 +17,27 @@ pub fn main() !void {
     const world = ecs.init();
     defer _ = ecs.fini(world);
     
+    const args = try std.process.argsAlloc(gpa.allocator());
+    defer std.process.argsFree(gpa.allocator(), args);
+    const headless = parseHeadless(args[1..]) catch |err| {
+        std.debug.print("Usage: vulkan-experiments [--headless] [--frames N] [--readback out.ppm]\n", .{});
+        return err;
+    };
+
     try app.init(world, gpa.allocator());
-    sdl.init(world);
+    if (comptime c.has_sdl) {
+        if (headless == null) {
+            sdl.init(world);
+        }
+    }
     scene.init(world);
 
     if (builtin.os.tag == .windows) {
         std.debug.print("Windows {}\n", .{c.ImGuiWindowFlags});
-        vulkan_eng.init(world);
+        vulkan_eng.init(world, .{ .headless = headless });
+    } else if (builtin.os.tag == .linux) {
+        // No window system to present to, always render offscreen
+        vulkan_eng.init(world, .{ .headless = headless orelse .{} });
     } else if (builtin.os.tag == .macos) {
         // std.debug.print("MacOS verision at least 14: {}\n", .{macosVersionAtLeast(15, 0, 0)});
         
@@ -35,6 +49,42 @@ pub fn main() !void {
 
 }
 
+/// Headless options from the command line, null unless `--headless` was passed. `--frames` and `--readback` imply it.
+fn parseHeadless(args: []const []const u8) !?vulkan_eng.Headless {
+    var headless: ?vulkan_eng.Headless = null;
+    var i: usize = 0;
+    while (i < args.len) : (i += 1) {
+        const arg = args[i];
+        if (std.mem.eql(u8, arg, "--headless")) {
+            if (headless == null) headless = .{};
+        } else if (std.mem.eql(u8, arg, "--frames")) {
+            i += 1;
+            if (i == args.len) return error.MissingValue;
+            if (headless == null) headless = .{};
+            headless.?.frame_count = try std.fmt.parseInt(u32, args[i], 10);
+        } else if (std.mem.eql(u8, arg, "--readback")) {
+            i += 1;
+            if (i == args.len) return error.MissingValue;
+            if (headless == null) headless = .{};
+            headless.?.readback_path = args[i];
+        } else {
+            return error.UnknownArgument;
+        }
+    }
+    return headless;
+}
+
+test "parseHeadless reads frame count and readback path" {
+    try testing.expectEqual(@as(?vulkan_eng.Headless, null), try parseHeadless(&.{}));
+
+    const headless = (try parseHeadless(&.{ "--headless", "--frames", "10", "--readback", "frame.ppm" })).?;
+    try testing.expectEqual(@as(u32, 10), headless.frame_count);
+    try testing.expectEqualStrings("frame.ppm", headless.readback_path.?);
+
+    try testing.expectError(error.MissingValue, parseHeadless(&.{"--frames"}));
+    try testing.expectError(error.UnknownArgument, parseHeadless(&.{"--fullscreen"}));
+}
+
 // pub fn macosVersionAtLeast(major: i64, minor: i64, patch: i64) bool {
 //     // Get the objc class from the runtime
 //     const NSProcessInfo = objc.getClass("NSProcessInfo").?;
@@ -57,4 +107,5 @@ pub fn main() !void {
 
 test {
     testing.refAllDecls(@This());
+    _ = @import("bench.zig");
 }
\ No newline at end of file
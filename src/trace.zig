@@ -0,0 +1,317 @@
+const std = @import("std");
+const ecs = @import("flecs");
+const testing = std.testing;
+
+const log = std.log.scoped(.trace);
+
+/// Tag every flecs system carries, not re-exported by the bindings
+extern const EcsSystem: ecs.entity_t;
+
+pub const DEFAULT_ZONES_PER_THREAD: u32 = 1 << 16;
+pub const DEFAULT_CAPTURE_FRAMES: u32 = 120;
+pub const DEFAULT_CAPTURE_PATH = "trace.json";
+
+/// Span of CPU time on one thread, either a system or a named zone
+const Zone = struct {
+    /// System entity, zero for a named zone
+    system: ecs.entity_t = 0,
+    /// Must outlive the capture, in practice a literal
+    name: []const u8 = "",
+    begin_ns: u64,
+    end_ns: u64,
+    frame: u64,
+};
+
+/// Zones of one thread. Only the owning thread appends, so recording never takes a lock. The exporter reads the
+/// buffers from the main thread between frames, after every worker of the frame has been joined.
+const ThreadBuffer = struct {
+    thread_id: std.Thread.Id,
+    zones: []Zone,
+    len: usize = 0,
+    /// Zones that did not fit, the capture is cut short rather than overwriting its start
+    dropped: usize = 0,
+    next: ?*ThreadBuffer = null,
+};
+
+pub const TracerOpts = struct {
+    zones_per_thread: u32 = DEFAULT_ZONES_PER_THREAD,
+    /// Frames one capture covers
+    capture_frames: u32 = DEFAULT_CAPTURE_FRAMES,
+    capture_path: []const u8 = DEFAULT_CAPTURE_PATH,
+};
+
+/// Tracer the instrumented systems and zones record into, a system's run action has no other way to reach it
+var active: ?*Tracer = null;
+/// Bumped for every tracer so a thread does not keep appending to the buffer of a previous one
+var generation: u32 = 0;
+threadlocal var local_buffer: ?*ThreadBuffer = null;
+threadlocal var local_generation: u32 = 0;
+
+/// Records CPU zones of every flecs system and of any code wrapped in `begin`/`end`, and writes a capture of a few
+/// frames as Chrome trace JSON that chrome://tracing and Perfetto open. Recording is off outside a capture, an
+/// instrumented system then costs two timestamps.
+pub const Tracer = struct {
+    allocator: std.mem.Allocator,
+    opts: TracerOpts,
+    origin: i128,
+    /// Guards the list of thread buffers, taken once per thread and never while recording
+    mutex: std.Thread.Mutex = .{},
+    buffers: ?*ThreadBuffer = null,
+    generation: u32,
+    frame: u64 = 0,
+    recording: bool = false,
+    capture_remaining: u32 = 0,
+
+    /// The tracer must stay at the same address until `deinit`, the instrumented systems reach it through a global
+    pub fn init(self: *Tracer, a: std.mem.Allocator, opts: TracerOpts) void {
+        generation +%= 1;
+        self.* = .{
+            .allocator = a,
+            .opts = opts,
+            .origin = std.time.nanoTimestamp(),
+            .generation = generation,
+        };
+        active = self;
+    }
+
+    pub fn deinit(self: *Tracer) void {
+        if (active == self) {
+            active = null;
+        }
+
+        var buffer = self.buffers;
+        while (buffer) |b| {
+            buffer = b.next;
+            self.allocator.free(b.zones);
+            self.allocator.destroy(b);
+        }
+    }
+
+    /// Wrap the run action of every system registered so far. Call once every module has been initialised, systems
+    /// that set their own run action are overwritten. Also turns on flecs' own per system time accounting.
+    pub fn instrument(self: *Tracer, world: *ecs.world_t) !void {
+        ecs.measure_system_time(world, true);
+
+        var filter_desc = ecs.filter_desc_t{};
+        filter_desc.terms[0] = .{ .id = EcsSystem };
+        const filter = try ecs.filter_init(world, &filter_desc);
+        defer ecs.filter_fini(filter);
+
+        // Collected first, updating a system while its table is being iterated would move it
+        var systems = std.ArrayList(ecs.entity_t).init(self.allocator);
+        defer systems.deinit();
+
+        var it = ecs.filter_iter(world, filter);
+        while (ecs.filter_next(&it)) {
+            try systems.appendSlice(it.entities());
+        }
+
+        for (systems.items) |system| {
+            var desc = ecs.system_desc_t{};
+            desc.entity = system;
+            desc.run = runInstrumented;
+            _ = ecs.system_init(world, &desc);
+        }
+        log.info("Instrumented {d} systems", .{systems.items.len});
+    }
+
+    /// Start recording for `opts.capture_frames` frames, the capture is written once they have elapsed
+    pub fn requestCapture(self: *Tracer) void {
+        if (self.recording) {
+            return;
+        }
+
+        // No other thread records between frames, the buffers can be emptied in place
+        var buffer = self.buffers;
+        while (buffer) |b| : (buffer = b.next) {
+            b.len = 0;
+            b.dropped = 0;
+        }
+        self.capture_remaining = self.opts.capture_frames;
+        self.recording = true;
+        log.info("Capturing {d} frames", .{self.capture_remaining});
+    }
+
+    /// Call after every frame, writes the capture when its last frame has been recorded
+    pub fn endFrame(self: *Tracer, world: *ecs.world_t) void {
+        self.frame += 1;
+        if (!self.recording) {
+            return;
+        }
+
+        self.capture_remaining -|= 1;
+        if (self.capture_remaining > 0) {
+            return;
+        }
+
+        self.recording = false;
+        self.writeCapture(world, self.opts.capture_path) catch |err| {
+            std.debug.print("Failed to write trace capture: {}\n", .{err});
+            return;
+        };
+        log.info("Trace written to {s}", .{self.opts.capture_path});
+    }
+
+    pub fn writeCapture(self: *Tracer, world: ?*ecs.world_t, path: []const u8) !void {
+        const file = try std.fs.cwd().createFile(path, .{});
+        defer file.close();
+
+        var buffered = std.io.bufferedWriter(file.writer());
+        try self.writeChromeTrace(world, buffered.writer());
+        try buffered.flush();
+    }
+
+    /// Stream every recorded zone as a complete event. System zones are named after their entity, which needs the
+    /// world, without it they fall back to the entity id.
+    pub fn writeChromeTrace(self: *Tracer, world: ?*ecs.world_t, writer: anytype) !void {
+        try writer.writeAll("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+        var first = true;
+        var buffer = self.buffers;
+        while (buffer) |b| : (buffer = b.next) {
+            const tid = b.thread_id;
+            if (!first) try writer.writeAll(",\n");
+            first = false;
+            try writer.print("{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{d},\"args\":{{\"name\":\"thread {d}\"}}}}", .{ tid, tid });
+
+            for (b.zones[0..b.len]) |zone| {
+                try writer.writeAll(",\n{\"name\":");
+                if (zone.system != 0) {
+                    const system_name = if (world) |w| ecs.get_name(w, zone.system) else null;
+                    if (system_name) |name| {
+                        try std.json.stringify(std.mem.span(name), .{}, writer);
+                    } else {
+                        try writer.print("\"system {d}\"", .{zone.system});
+                    }
+                } else {
+                    try std.json.stringify(zone.name, .{}, writer);
+                }
+
+                // Chrome traces count in microseconds
+                try writer.print(",\"cat\":\"{s}\",\"ph\":\"X\",\"ts\":{d:.3},\"dur\":{d:.3},\"pid\":1,\"tid\":{d},\"args\":{{\"frame\":{d}}}}}", .{
+                    if (zone.system != 0) "system" else "zone",
+                    toMicroseconds(zone.begin_ns),
+                    toMicroseconds(zone.end_ns -| zone.begin_ns),
+                    tid,
+                    zone.frame,
+                });
+            }
+
+            if (b.dropped > 0) {
+                log.warn("Thread {d} dropped {d} zones, raise zones_per_thread", .{ tid, b.dropped });
+            }
+        }
+
+        try writer.writeAll("\n]}\n");
+    }
+
+    fn now(self: *const Tracer) u64 {
+        return @as(u64, @intCast(@max(std.time.nanoTimestamp() - self.origin, 0)));
+    }
+
+    fn threadBuffer(self: *Tracer) ?*ThreadBuffer {
+        if (local_buffer != null and local_generation == self.generation) {
+            return local_buffer;
+        }
+
+        const zones = self.allocator.alloc(Zone, self.opts.zones_per_thread) catch return null;
+        const buffer = self.allocator.create(ThreadBuffer) catch {
+            self.allocator.free(zones);
+            return null;
+        };
+        buffer.* = .{ .thread_id = std.Thread.getCurrentId(), .zones = zones };
+
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        buffer.next = self.buffers;
+        self.buffers = buffer;
+
+        local_buffer = buffer;
+        local_generation = self.generation;
+        return buffer;
+    }
+
+    fn record(self: *Tracer, zone: Zone) void {
+        const buffer = self.threadBuffer() orelse return;
+        if (buffer.len == buffer.zones.len) {
+            buffer.dropped += 1;
+            return;
+        }
+        buffer.zones[buffer.len] = zone;
+        buffer.len += 1;
+    }
+};
+
+/// Open zone, `end` records it on the calling thread
+pub const ZoneScope = struct {
+    name: []const u8,
+    system: ecs.entity_t = 0,
+    begin_ns: u64 = 0,
+
+    pub fn end(self: ZoneScope) void {
+        const tracer = active orelse return;
+        if (!tracer.recording) {
+            return;
+        }
+        tracer.record(.{
+            .system = self.system,
+            .name = self.name,
+            .begin_ns = self.begin_ns,
+            .end_ns = tracer.now(),
+            .frame = tracer.frame,
+        });
+    }
+};
+
+/// Time a block of code on the calling thread, `name` must outlive the capture
+pub fn begin(name: []const u8) ZoneScope {
+    const tracer = active orelse return .{ .name = name };
+    return .{ .name = name, .begin_ns = if (tracer.recording) tracer.now() else 0 };
+}
+
+/// Run action of every instrumented system, the same iteration flecs does without one wrapped in a zone
+fn runInstrumented(it: *ecs.iter_t) callconv(.C) void {
+    var zone = begin("");
+    zone.system = it.system;
+
+    if (it.field_count == 0) {
+        it.callback(it);
+        ecs.iter_fini(it);
+    } else {
+        while (ecs.iter_next(it)) {
+            it.callback(it);
+        }
+    }
+
+    zone.end();
+}
+
+fn toMicroseconds(ns: u64) f64 {
+    return @as(f64, @floatFromInt(ns)) / std.time.ns_per_us;
+}
+
+test "Tracer writes recorded zones as Chrome trace events" {
+    var tracer: Tracer = undefined;
+    tracer.init(testing.allocator, .{ .zones_per_thread = 4, .capture_frames = 1 });
+    defer tracer.deinit();
+
+    // Outside a capture nothing is recorded
+    begin("ignored").end();
+
+    tracer.requestCapture();
+    const zone = begin("UpdateCamera");
+    zone.end();
+
+    var json = std.ArrayList(u8).init(testing.allocator);
+    defer json.deinit();
+    try tracer.writeChromeTrace(null, json.writer());
+
+    const parsed = try std.json.parseFromSlice(std.json.Value, testing.allocator, json.items, .{});
+    defer parsed.deinit();
+
+    const events = parsed.value.object.get("traceEvents").?.array.items;
+    try testing.expectEqual(@as(usize, 2), events.len);
+    try testing.expectEqualStrings("thread_name", events[0].object.get("name").?.string);
+    try testing.expectEqualStrings("UpdateCamera", events[1].object.get("name").?.string);
+    try testing.expectEqualStrings("X", events[1].object.get("ph").?.string);
+}
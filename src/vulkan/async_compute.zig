@@ -0,0 +1,151 @@
+const std = @import("std");
+const c = @import("../clibs.zig");
+const vke = @import("./error.zig");
+const testing = std.testing;
+
+/// Timestamps every frame writes, the compute ones on the compute queue and the graphics ones on the graphics queue
+pub const Query = enum(u32) {
+    compute_begin,
+    compute_end,
+    graphics_begin,
+    graphics_end,
+};
+
+const QUERIES_PER_FRAME: u32 = std.meta.fields(Query).len;
+
+/// Span of GPU work in timestamp ticks
+pub const Interval = struct {
+    begin: u64,
+    end: u64,
+
+    pub fn length(self: Interval) u64 {
+        return self.end -| self.begin;
+    }
+
+    /// Ticks both intervals were running
+    pub fn overlap(self: Interval, other: Interval) u64 {
+        const begin = @max(self.begin, other.begin);
+        const end = @min(self.end, other.end);
+        return end -| begin;
+    }
+};
+
+/// Last resolved frame, in milliseconds. Compute of a frame is submitted while the graphics work of the previous
+/// frame is still running, so the overlap is measured against the previous frame's graphics.
+pub const Timings = struct {
+    compute_ms: f32 = 0,
+    graphics_ms: f32 = 0,
+    overlap_ms: f32 = 0,
+};
+
+/// Timestamp query pool with one range of `Query` per frame in flight. Each queue resets its own queries in the
+/// command buffer that writes them, results are read back once the frame's timeline value has been reached.
+pub const OverlapTimer = struct {
+    pool: c.VkQueryPool,
+    /// Nanoseconds per tick
+    period: f32,
+    /// Frames whose compute queries were written since the last resolve, the others have no results to read
+    dispatched: []bool,
+    allocator: std.mem.Allocator,
+    previous_graphics: ?Interval = null,
+    timings: Timings = .{},
+
+    pub fn init(a: std.mem.Allocator, device: c.VkDevice, frame_count: u32, period: f32) !OverlapTimer {
+        const create_info = std.mem.zeroInit(c.VkQueryPoolCreateInfo, .{
+            .sType = c.VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .queryType = c.VK_QUERY_TYPE_TIMESTAMP,
+            .queryCount = frame_count * QUERIES_PER_FRAME,
+        });
+
+        var pool: c.VkQueryPool = undefined;
+        try vke.checkResult(c.vkCreateQueryPool(device, &create_info, null, &pool));
+        errdefer c.vkDestroyQueryPool(device, pool, null);
+
+        const dispatched = try a.alloc(bool, frame_count);
+        @memset(dispatched, false);
+
+        return .{
+            .pool = pool,
+            .period = period,
+            .dispatched = dispatched,
+            .allocator = a,
+        };
+    }
+
+    pub fn deinit(self: *OverlapTimer, device: c.VkDevice) void {
+        c.vkDestroyQueryPool(device, self.pool, null);
+        self.allocator.free(self.dispatched);
+    }
+
+    /// Reset the frame's queries of one queue, recorded ahead of the first `write` into the same command buffer
+    pub fn reset(self: *const OverlapTimer, command_buffer: c.VkCommandBuffer, frame_index: u32, first: Query, last: Query) void {
+        const begin = queryIndex(frame_index, first);
+        c.vkCmdResetQueryPool(command_buffer, self.pool, begin, queryIndex(frame_index, last) - begin + 1);
+    }
+
+    pub fn write(self: *const OverlapTimer, command_buffer: c.VkCommandBuffer, frame_index: u32, query: Query, stage: c.VkPipelineStageFlagBits) void {
+        c.vkCmdWriteTimestamp(command_buffer, stage, self.pool, queryIndex(frame_index, query));
+    }
+
+    /// Mark the frame's compute queries as written, a frame that dispatched nothing has no overlap to measure
+    pub fn dispatch(self: *OverlapTimer, frame_index: u32) void {
+        self.dispatched[frame_index] = true;
+    }
+
+    /// Read the frame's timestamps into `timings`. Only call once the frame's timeline value has been reached.
+    pub fn resolve(self: *OverlapTimer, device: c.VkDevice, frame_index: u32) void {
+        if (!self.dispatched[frame_index]) {
+            return;
+        }
+        self.dispatched[frame_index] = false;
+
+        var ticks: [QUERIES_PER_FRAME]u64 = undefined;
+        const result = c.vkGetQueryPoolResults(device, self.pool, queryIndex(frame_index, .compute_begin), QUERIES_PER_FRAME, @sizeOf(@TypeOf(ticks)), &ticks, @sizeOf(u64), c.VK_QUERY_RESULT_64_BIT);
+        if (result != c.VK_SUCCESS) {
+            return;
+        }
+
+        const compute = Interval{ .begin = ticks[@intFromEnum(Query.compute_begin)], .end = ticks[@intFromEnum(Query.compute_end)] };
+        const graphics = Interval{ .begin = ticks[@intFromEnum(Query.graphics_begin)], .end = ticks[@intFromEnum(Query.graphics_end)] };
+        self.timings = measure(compute, graphics, self.previous_graphics, self.period);
+        self.previous_graphics = graphics;
+    }
+};
+
+fn queryIndex(frame_index: u32, query: Query) u32 {
+    return frame_index * QUERIES_PER_FRAME + @intFromEnum(query);
+}
+
+fn measure(compute: Interval, graphics: Interval, previous_graphics: ?Interval, period: f32) Timings {
+    const overlap = if (previous_graphics) |previous| compute.overlap(previous) + compute.overlap(graphics) else compute.overlap(graphics);
+    return .{
+        .compute_ms = toMilliseconds(compute.length(), period),
+        .graphics_ms = toMilliseconds(graphics.length(), period),
+        .overlap_ms = toMilliseconds(overlap, period),
+    };
+}
+
+fn toMilliseconds(ticks: u64, period: f32) f32 {
+    return @as(f32, @floatFromInt(ticks)) * period / std.time.ns_per_ms;
+}
+
+test "Interval overlap is zero for disjoint intervals" {
+    const a = Interval{ .begin = 10, .end = 20 };
+    const b = Interval{ .begin = 15, .end = 40 };
+    const d = Interval{ .begin = 30, .end = 40 };
+
+    try testing.expectEqual(@as(u64, 5), a.overlap(b));
+    try testing.expectEqual(@as(u64, 5), b.overlap(a));
+    try testing.expectEqual(@as(u64, 0), a.overlap(d));
+}
+
+test "measure counts compute running beside the previous and current graphics" {
+    const compute = Interval{ .begin = 100, .end = 300 };
+    const previous = Interval{ .begin = 0, .end = 150 };
+    const graphics = Interval{ .begin = 250, .end = 500 };
+
+    const timings = measure(compute, graphics, previous, 1_000_000);
+    try testing.expectApproxEqAbs(@as(f32, 200), timings.compute_ms, 0.001);
+    try testing.expectApproxEqAbs(@as(f32, 250), timings.graphics_ms, 0.001);
+    try testing.expectApproxEqAbs(@as(f32, 100), timings.overlap_ms, 0.001);
+}
@@ -0,0 +1,126 @@
+const std = @import("std");
+const c = @import("../clibs.zig");
+const vke = @import("./error.zig");
+const testing = std.testing;
+
+/// Most textures the table asks for, devices with a lower update-after-bind limit get a smaller table
+pub const MAX_BINDLESS_TEXTURES: u32 = 16 * 1024;
+
+/// One descriptor set holding every texture of the device in a partially bound array. Shaders index it with the
+/// texture index of the instance, so switching textures between draws binds nothing. Slots are written as
+/// textures load, update-after-bind lets that happen while earlier frames still use the set.
+pub const TextureTable = struct {
+    layout: c.VkDescriptorSetLayout,
+    pool: c.VkDescriptorPool,
+    set: c.VkDescriptorSet,
+    capacity: u32,
+    count: u32 = 0,
+
+    pub fn init(device: c.VkDevice, device_limit: u32) !TextureTable {
+        const capacity = tableCapacity(device_limit);
+
+        const binding = std.mem.zeroInit(c.VkDescriptorSetLayoutBinding, .{
+            .binding = 0,
+            .descriptorType = c.VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            .descriptorCount = capacity,
+            .stageFlags = c.VK_SHADER_STAGE_FRAGMENT_BIT,
+        });
+
+        const binding_flags: c.VkDescriptorBindingFlags = c.VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | c.VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT;
+        const binding_flags_info = std.mem.zeroInit(c.VkDescriptorSetLayoutBindingFlagsCreateInfo, .{
+            .sType = c.VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+            .bindingCount = 1,
+            .pBindingFlags = &binding_flags,
+        });
+
+        const layout_info = std.mem.zeroInit(c.VkDescriptorSetLayoutCreateInfo, .{
+            .sType = c.VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+            .pNext = &binding_flags_info,
+            .flags = c.VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT,
+            .bindingCount = 1,
+            .pBindings = &binding,
+        });
+
+        var layout: c.VkDescriptorSetLayout = undefined;
+        try vke.checkResult(c.vkCreateDescriptorSetLayout(device, &layout_info, null, &layout));
+        errdefer c.vkDestroyDescriptorSetLayout(device, layout, null);
+
+        const pool_size = std.mem.zeroInit(c.VkDescriptorPoolSize, .{
+            .type = c.VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            .descriptorCount = capacity,
+        });
+
+        const pool_info = std.mem.zeroInit(c.VkDescriptorPoolCreateInfo, .{
+            .sType = c.VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+            .flags = c.VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
+            .poolSizeCount = 1,
+            .pPoolSizes = &pool_size,
+            .maxSets = 1,
+        });
+
+        var pool: c.VkDescriptorPool = undefined;
+        try vke.checkResult(c.vkCreateDescriptorPool(device, &pool_info, null, &pool));
+        errdefer c.vkDestroyDescriptorPool(device, pool, null);
+
+        const alloc_info = std.mem.zeroInit(c.VkDescriptorSetAllocateInfo, .{
+            .sType = c.VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .descriptorPool = pool,
+            .descriptorSetCount = 1,
+            .pSetLayouts = &layout,
+        });
+
+        var set: c.VkDescriptorSet = undefined;
+        try vke.checkResult(c.vkAllocateDescriptorSets(device, &alloc_info, &set));
+
+        return .{
+            .layout = layout,
+            .pool = pool,
+            .set = set,
+            .capacity = capacity,
+        };
+    }
+
+    /// Destroying the pool frees the set
+    pub fn deinit(self: *TextureTable, device: c.VkDevice) void {
+        c.vkDestroyDescriptorPool(device, self.pool, null);
+        c.vkDestroyDescriptorSetLayout(device, self.layout, null);
+    }
+
+    /// Write the texture into the next free slot and return its index, the index shaders sample it with
+    pub fn add(self: *TextureTable, device: c.VkDevice, image_view: c.VkImageView, sampler: c.VkSampler) !u32 {
+        if (self.count == self.capacity) {
+            return error.TextureTableFull;
+        }
+
+        const image_info = std.mem.zeroInit(c.VkDescriptorImageInfo, .{
+            .imageLayout = c.VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            .imageView = image_view,
+            .sampler = sampler,
+        });
+
+        const write = std.mem.zeroInit(c.VkWriteDescriptorSet, .{
+            .sType = c.VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = self.set,
+            .dstBinding = 0,
+            .dstArrayElement = self.count,
+            .descriptorType = c.VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            .descriptorCount = 1,
+            .pImageInfo = &image_info,
+        });
+        c.vkUpdateDescriptorSets(device, 1, &write, 0, null);
+
+        self.count += 1;
+        return self.count - 1;
+    }
+};
+
+/// Size of the texture array, the smaller of what the renderer wants and what the device allows
+pub fn tableCapacity(device_limit: u32) u32 {
+    return @max(@min(MAX_BINDLESS_TEXTURES, device_limit), 1);
+}
+
+test "tableCapacity stays within the device limit" {
+    try testing.expectEqual(MAX_BINDLESS_TEXTURES, tableCapacity(std.math.maxInt(u32)));
+    try testing.expectEqual(@as(u32, 500), tableCapacity(500));
+    try testing.expectEqual(@as(u32, 1), tableCapacity(0));
+}
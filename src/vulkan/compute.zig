@@ -1,25 +1,76 @@
 const std = @import("std");
 const c = @import("../clibs.zig");
+const vke = @import ("./error.zig");
 const shader = @import("./shader.zig");
+const data = @import("data.zig");
 
-const ComputePipelineOpts = struct {
+const Pipeline = data.Pipeline;
+
+pub const ComputePipelineOpts = struct {
     device: c.VkDevice,
-    queue_family_index: u32,
-    allocator: std.mem.Allocator,
+    shaders: *shader.ShaderRegistry,
+    shader: shader.Name,
+    set_layouts: []const c.VkDescriptorSetLayout,
+    /// Size of the push constant block visible to the compute stage, zero for none
+    push_constant_size: u32 = 0,
+    pipeline_cache: c.VkPipelineCache = null,
 };
 
-fn createBackgroundPipeline(_: std.mem.Allocator, _: ComputePipelineOpts) void {
-    // const gradient_shader = try shader.createShaderModule(a, opts.device, "zig-out/shaders/gradient.comp.spv");
+pub fn createComputePipeline(opts: ComputePipelineOpts) !Pipeline {
+    const compute_shader = try opts.shaders.get(opts.shader);
+
+    const push_constant_range = c.VkPushConstantRange{
+        .stageFlags = c.VK_SHADER_STAGE_COMPUTE_BIT,
+        .offset = 0,
+        .size = opts.push_constant_size,
+    };
+
+    const pipeline_layout_create_info = std.mem.zeroInit(c.VkPipelineLayoutCreateInfo, .{
+        .sType = c.VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = @as(u32, @intCast(opts.set_layouts.len)),
+        .pSetLayouts = opts.set_layouts.ptr,
+        .pushConstantRangeCount = @as(u32, if (opts.push_constant_size > 0) 1 else 0),
+        .pPushConstantRanges = if (opts.push_constant_size > 0) &push_constant_range else null,
+    });
+
+    var pipeline_layout: c.VkPipelineLayout = undefined;
+    try vke.checkResult(c.vkCreatePipelineLayout(opts.device, &pipeline_layout_create_info, null, &pipeline_layout));
+    errdefer c.vkDestroyPipelineLayout(opts.device, pipeline_layout, null);
+
+    const stage_create_info = std.mem.zeroInit(c.VkPipelineShaderStageCreateInfo, .{
+        .sType = c.VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+        .stage = c.VK_SHADER_STAGE_COMPUTE_BIT,
+        .module = compute_shader,
+        .pName = "main",
+    });
+
+    const pipeline_create_info = std.mem.zeroInit(c.VkComputePipelineCreateInfo, .{
+        .sType = c.VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .stage = stage_create_info,
+        .layout = pipeline_layout,
+    });
 
-    // const pipeline_layout_create_info = c.VkPipelineLayoutCreateInfo{
-    //     .sType = c.VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-    //     .setLayoutCount = 0,
-    //     .pSetLayouts = null,
-    //     .pushConstantRangeCount = 0,
-    //     .pPushConstantRanges = null,
-    // };
+    var pipeline: c.VkPipeline = undefined;
+    try vke.checkResult(c.vkCreateComputePipelines(opts.device, opts.pipeline_cache, 1, &pipeline_create_info, null, &pipeline));
+
+    return .{
+        .handle = pipeline,
+        .layout = pipeline_layout,
+    };
 }
 
-fn clear() void {
+pub fn destroyComputePipeline(device: c.VkDevice, pipeline: Pipeline) void {
+    c.vkDestroyPipeline(device, pipeline.handle, null);
+    c.vkDestroyPipelineLayout(device, pipeline.layout, null);
+}
 
-}
\ No newline at end of file
+/// Number of work groups needed to cover `count` invocations
+pub fn groupCount(count: u32, group_size: u32) u32 {
+    return (count + group_size - 1) / group_size;
+}
+
+test "groupCount rounds up to whole work groups" {
+    try std.testing.expectEqual(@as(u32, 0), groupCount(0, 64));
+    try std.testing.expectEqual(@as(u32, 1), groupCount(64, 64));
+    try std.testing.expectEqual(@as(u32, 2), groupCount(65, 64));
+}
@@ -0,0 +1,167 @@
+const std = @import("std");
+const c = @import("../clibs.zig");
+const vke = @import("./error.zig");
+const vkcp = @import("./compute.zig");
+const data = @import("data.zig");
+const shader = @import("./shader.zig");
+
+/// Matches `local_size_x` in `shaders/cull.comp.glsl`
+pub const GROUP_SIZE: u32 = 64;
+
+/// Stages that read what the cull pass writes, the compacted commands and the visible list
+pub const WAIT_STAGES: c.VkPipelineStageFlags = c.VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | c.VK_PIPELINE_STAGE_VERTEX_SHADER_BIT;
+
+/// One entry per instance, written next to the instance's object data
+pub const CullInput = extern struct {
+    /// Bounding sphere in mesh space, xyz is the center and w the radius
+    sphere: [4]f32,
+    /// Index of the instance's indirect command
+    batch: u32,
+    /// Index of the instance's `scene.ObjectData`
+    object_index: u32,
+    padding: [2]u32 = .{ 0, 0 },
+};
+
+pub const CullPushConstants = extern struct {
+    planes: [6][4]f32,
+    instance_count: u32,
+    padding: [3]u32 = .{ 0, 0, 0 },
+};
+
+/// Buffers bound to the cull shader, each is read with a dynamic offset that selects the frame
+pub const CullBuffers = struct {
+    objects: c.VkBuffer,
+    objects_range: u64,
+    inputs: c.VkBuffer,
+    inputs_range: u64,
+    commands: c.VkBuffer,
+    commands_range: u64,
+    visible: c.VkBuffer,
+    visible_range: u64,
+};
+
+pub const CullPassOpts = struct {
+    device: c.VkDevice,
+    descriptor_pool: c.VkDescriptorPool,
+    shaders: *shader.ShaderRegistry,
+    buffers: CullBuffers,
+    pipeline_cache: c.VkPipelineCache = null,
+};
+
+/// Compute pass that tests every instance against the camera frustum. Visible instances are appended to their
+/// batch's indirect command and their object index is written to the visible list the vertex shader reads.
+pub const CullPass = struct {
+    pipeline: data.Pipeline,
+    set_layout: c.VkDescriptorSetLayout,
+    descriptor_set: c.VkDescriptorSet,
+
+    pub fn init(opts: CullPassOpts) !CullPass {
+        const set_layout = try createCullDescriptorSetLayout(opts.device);
+        errdefer c.vkDestroyDescriptorSetLayout(opts.device, set_layout, null);
+
+        const pipeline = try createCullPipeline(opts.device, opts.shaders, set_layout, opts.pipeline_cache);
+        errdefer vkcp.destroyComputePipeline(opts.device, pipeline);
+
+        const alloc_info = std.mem.zeroInit(c.VkDescriptorSetAllocateInfo, .{
+            .sType = c.VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .descriptorPool = opts.descriptor_pool,
+            .descriptorSetCount = 1,
+            .pSetLayouts = &set_layout,
+        });
+
+        var descriptor_set: c.VkDescriptorSet = undefined;
+        try vke.checkResult(c.vkAllocateDescriptorSets(opts.device, &alloc_info, &descriptor_set));
+
+        const buffers = opts.buffers;
+        const buffer_infos = [_]c.VkDescriptorBufferInfo{
+            .{ .buffer = buffers.objects, .offset = 0, .range = buffers.objects_range },
+            .{ .buffer = buffers.inputs, .offset = 0, .range = buffers.inputs_range },
+            .{ .buffer = buffers.commands, .offset = 0, .range = buffers.commands_range },
+            .{ .buffer = buffers.visible, .offset = 0, .range = buffers.visible_range },
+        };
+
+        var writes: [buffer_infos.len]c.VkWriteDescriptorSet = undefined;
+        for (&writes, &buffer_infos, 0..) |*write, *buffer_info, binding| {
+            write.* = std.mem.zeroInit(c.VkWriteDescriptorSet, .{
+                .sType = c.VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = descriptor_set,
+                .dstBinding = @as(u32, @intCast(binding)),
+                .dstArrayElement = 0,
+                .descriptorType = c.VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+                .descriptorCount = 1,
+                .pBufferInfo = buffer_info,
+            });
+        }
+        c.vkUpdateDescriptorSets(opts.device, @as(u32, writes.len), &writes, 0, null);
+
+        return .{
+            .pipeline = pipeline,
+            .set_layout = set_layout,
+            .descriptor_set = descriptor_set,
+        };
+    }
+
+    /// The descriptor set is returned to the pool when the pool is destroyed
+    pub fn deinit(self: *CullPass, device: c.VkDevice) void {
+        vkcp.destroyComputePipeline(device, self.pipeline);
+        c.vkDestroyDescriptorSetLayout(device, self.set_layout, null);
+    }
+
+    /// Record the dispatch followed by the barrier that makes the compacted commands visible to the draws.
+    /// `offsets` are the dynamic offsets of the objects, inputs, commands and visible buffers in that order.
+    pub fn record(self: *const CullPass, command_buffer: c.VkCommandBuffer, offsets: [4]u32, push_constants: *const CullPushConstants) void {
+        self.dispatch(command_buffer, offsets, push_constants);
+
+        const barrier = std.mem.zeroInit(c.VkMemoryBarrier, .{
+            .sType = c.VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = c.VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = c.VK_ACCESS_INDIRECT_COMMAND_READ_BIT | c.VK_ACCESS_SHADER_READ_BIT,
+        });
+        c.vkCmdPipelineBarrier(command_buffer, c.VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, WAIT_STAGES, 0, 1, &barrier, 0, null, 0, null);
+    }
+
+    /// Record the dispatch alone, for a compute queue. The draw stages do not exist there, the graphics submission
+    /// waiting on the compute timeline at `WAIT_STAGES` takes the place of the barrier.
+    pub fn dispatch(self: *const CullPass, command_buffer: c.VkCommandBuffer, offsets: [4]u32, push_constants: *const CullPushConstants) void {
+        c.vkCmdBindPipeline(command_buffer, c.VK_PIPELINE_BIND_POINT_COMPUTE, self.pipeline.handle);
+        c.vkCmdBindDescriptorSets(command_buffer, c.VK_PIPELINE_BIND_POINT_COMPUTE, self.pipeline.layout, 0, 1, &self.descriptor_set, @as(u32, offsets.len), &offsets);
+        c.vkCmdPushConstants(command_buffer, self.pipeline.layout, c.VK_SHADER_STAGE_COMPUTE_BIT, 0, @sizeOf(CullPushConstants), push_constants);
+        c.vkCmdDispatch(command_buffer, vkcp.groupCount(push_constants.instance_count, GROUP_SIZE), 1, 1);
+    }
+};
+
+/// Also used to rebuild the pipeline when the shader is reloaded, the set layout is kept
+pub fn createCullPipeline(device: c.VkDevice, shaders: *shader.ShaderRegistry, set_layout: c.VkDescriptorSetLayout, pipeline_cache: c.VkPipelineCache) !data.Pipeline {
+    const set_layouts = [_]c.VkDescriptorSetLayout{ set_layout };
+    return vkcp.createComputePipeline(.{
+        .device = device,
+        .shaders = shaders,
+        .shader = .cull_comp,
+        .set_layouts = &set_layouts,
+        .push_constant_size = @sizeOf(CullPushConstants),
+        .pipeline_cache = pipeline_cache,
+    });
+}
+
+pub fn createCullDescriptorSetLayout(device: c.VkDevice) !c.VkDescriptorSetLayout {
+    var bindings: [4]c.VkDescriptorSetLayoutBinding = undefined;
+    for (&bindings, 0..) |*binding, i| {
+        binding.* = std.mem.zeroInit(c.VkDescriptorSetLayoutBinding, .{
+            .binding = @as(u32, @intCast(i)),
+            .descriptorType = c.VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+            .descriptorCount = 1,
+            .stageFlags = c.VK_SHADER_STAGE_COMPUTE_BIT,
+            .pImmutableSamplers = null,
+        });
+    }
+
+    const layout_info = std.mem.zeroInit(c.VkDescriptorSetLayoutCreateInfo, .{
+        .sType = c.VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = @as(u32, bindings.len),
+        .pBindings = &bindings,
+    });
+
+    var layout: c.VkDescriptorSetLayout = undefined;
+    try vke.checkResult(c.vkCreateDescriptorSetLayout(device, &layout_info, null, &layout));
+    return layout;
+}
@@ -1,7 +1,6 @@
 const std = @import("std");
 const vke = @import("./error.zig");
 const c = @import("../clibs.zig");
-const vkb = @import ("./buffer.zig");
 const vkd = @import ("./device.zig");
 const scene = @import("scene");
 const testing = std.testing;
@@ -10,41 +9,21 @@ pub const DescriptorSetLayout = struct {
     handle: c.VkDescriptorSetLayout,
 };
 
-pub const UniformBufferOpts = struct {
-    physical_device: c.VkPhysicalDevice,
-    device: c.VkDevice,
-    buffer_count: u32,
-    model_memory_alignment: usize,
-    light_memory_alignment: usize,
-    max_objects: u32,
-};
-
-pub const BufferSet = struct {
-    camera: vkb.Buffer = undefined,
-    light: vkb.Buffer = undefined,
-    // model: UniformBuffer = undefined,
-
-    pub fn deleteAndFree(self: BufferSet, device: c.VkDevice) void {
-        self.camera.deleteAndFree(device);
-        self.light.deleteAndFree(device);
-        // self.model.deleteAndFree(device);
-    }
-};
-
 pub const DescriptorPool = struct {
     handle: c.VkDescriptorPool,
 };
 
+/// Both sets point at the whole uniform ring, the frame's data is selected with dynamic offsets
 pub const DescriptorSets = struct {
-    view_projection_pipeline1: []c.VkDescriptorSet = undefined,
-    view_projection_pipeline2: []c.VkDescriptorSet = undefined,
-    light_sets: []c.VkDescriptorSet = undefined,
+    camera: c.VkDescriptorSet = null,
+    light: c.VkDescriptorSet = null,
+    objects: c.VkDescriptorSet = null,
 };
 
 pub fn createCameraDescriptorSetLayout(device: c.VkDevice) !DescriptorSetLayout {
     const camera_binding_info = std.mem.zeroInit(c.VkDescriptorSetLayoutBinding, .{
         .binding = 0,
-        .descriptorType = c.VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+        .descriptorType = c.VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
         .descriptorCount = 1,
         .stageFlags = c.VK_SHADER_STAGE_VERTEX_BIT,
         .pImmutableSamplers = null,
@@ -65,23 +44,14 @@ pub fn createCameraDescriptorSetLayout(device: c.VkDevice) !DescriptorSetLayout
 
 // This creates the descriptor set layout for the uniform buffer that will be used in the vertex shader.
 pub fn createLightDescriptorSetLayout(device: c.VkDevice) !DescriptorSetLayout {
-    // const model_binding_info = std.mem.zeroInit(c.VkDescriptorSetLayoutBinding, .{
-    //     .binding = 1,
-    //     .descriptorType = c.VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
-    //     .descriptorCount = 1,
-    //     .stageFlags = c.VK_SHADER_STAGE_VERTEX_BIT,
-    //     .pImmutableSamplers = null,
-    // });
-
     const light_binding_info = std.mem.zeroInit(c.VkDescriptorSetLayoutBinding, .{
         .binding = 0,
-        .descriptorType = c.VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+        .descriptorType = c.VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
         .descriptorCount = 1,
         .stageFlags = c.VK_SHADER_STAGE_FRAGMENT_BIT,
         .pImmutableSamplers = null,
     });
 
-    // const bindings = [_]c.VkDescriptorSetLayoutBinding{ camera_binding_info, model_binding_info};
     const bindings = [_]c.VkDescriptorSetLayoutBinding{ light_binding_info };
 
     var layout_info = std.mem.zeroInit(c.VkDescriptorSetLayoutCreateInfo, .{
@@ -95,16 +65,26 @@ pub fn createLightDescriptorSetLayout(device: c.VkDevice) !DescriptorSetLayout {
     return DescriptorSetLayout{ .handle = layout };
 }
 
-pub fn createSamplerDescriptorSetLayout(device: c.VkDevice) !DescriptorSetLayout {
-    const sampler_binding_info = std.mem.zeroInit(c.VkDescriptorSetLayoutBinding, .{
+// The per-object data is a storage buffer of `scene.ObjectData`, the dynamic offsets select the frame. The vertex
+// shader looks up the object index in the visible list with the instance index.
+pub fn createObjectDescriptorSetLayout(device: c.VkDevice) !DescriptorSetLayout {
+    const object_binding_info = std.mem.zeroInit(c.VkDescriptorSetLayoutBinding, .{
         .binding = 0,
-        .descriptorType = c.VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+        .descriptorType = c.VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
         .descriptorCount = 1,
-        .stageFlags = c.VK_SHADER_STAGE_FRAGMENT_BIT,
+        .stageFlags = c.VK_SHADER_STAGE_VERTEX_BIT,
         .pImmutableSamplers = null,
     });
 
-    const bindings: [1]c.VkDescriptorSetLayoutBinding = .{ sampler_binding_info };
+    const visible_binding_info = std.mem.zeroInit(c.VkDescriptorSetLayoutBinding, .{
+        .binding = 1,
+        .descriptorType = c.VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+        .descriptorCount = 1,
+        .stageFlags = c.VK_SHADER_STAGE_VERTEX_BIT,
+        .pImmutableSamplers = null,
+    });
+
+    const bindings = [_]c.VkDescriptorSetLayoutBinding{ object_binding_info, visible_binding_info };
 
     var layout_info = std.mem.zeroInit(c.VkDescriptorSetLayoutCreateInfo, .{
         .sType = c.VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
@@ -117,94 +97,51 @@ pub fn createSamplerDescriptorSetLayout(device: c.VkDevice) !DescriptorSetLayout
     return DescriptorSetLayout{ .handle = layout };
 }
 
-/// This creates the uniform buffers and allocates the memory for them based on the number frame buffers
-/// that will be used. You own the returned buffers and must free them when done.
-pub fn createUniformBuffers(a: std.mem.Allocator, opts: UniformBufferOpts) ![]BufferSet {
-    var buffer_set: []BufferSet = try a.alloc(BufferSet, opts.buffer_count);
-
-    // const model_buffer_size = opts.model_memory_alignment * opts.max_objects;
-
-    const buffer_size = @sizeOf(scene.Camera);
-    const light_buffer_size = opts.light_memory_alignment * opts.max_objects;
-    for (0..opts.buffer_count) |i| {
-       
-        const buffer = try vkb.createBuffer(.{
-            .physical_device = opts.physical_device,
-            .device = opts.device,
-            .buffer_size = buffer_size,
-            .buffer_usage = c.VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-            .buffer_properties = c.VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | c.VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        });
+pub fn createSamplerDescriptorSetLayout(device: c.VkDevice) !DescriptorSetLayout {
+    const sampler_binding_info = std.mem.zeroInit(c.VkDescriptorSetLayoutBinding, .{
+        .binding = 0,
+        .descriptorType = c.VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+        .descriptorCount = 1,
+        .stageFlags = c.VK_SHADER_STAGE_FRAGMENT_BIT,
+        .pImmutableSamplers = null,
+    });
 
-        buffer_set[i].camera = .{
-            .handle = buffer.handle,
-            .memory = buffer.memory,
-        };
-
-        const light_buffer = try vkb.createBuffer(.{
-            .physical_device = opts.physical_device,
-            .device = opts.device,
-            .buffer_size = light_buffer_size,
-            .buffer_usage = c.VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-            .buffer_properties = c.VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | c.VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        });
+    const bindings: [1]c.VkDescriptorSetLayoutBinding = .{ sampler_binding_info };
 
-        buffer_set[i].light = .{
-            .handle = light_buffer.handle,
-            .memory = light_buffer.memory,
-        };
-
-        // var model_buffer_handle: c.VkBuffer = undefined;
-        // var model_buffer_memory: c.VkDeviceMemory = undefined;
-        // const model_buffer = .{
-        //     .handle = @as([*c]c.VkBuffer, @ptrCast(&model_buffer_handle)),
-        //     .memory = @as([*c]c.VkDeviceMemory, @ptrCast(&model_buffer_memory)),
-        // };
-
-        // try vkb.createBuffer(&model_buffer, .{
-        //     .physical_device = opts.physical_device,
-        //     .device = opts.device,
-        //     .buffer_size = model_buffer_size,
-        //     .buffer_usage = c.VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-        //     .buffer_properties = c.VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | c.VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        // });
-
-        // buffer_set[i].model = .{
-        //     .handle = model_buffer.handle.*,
-        //     .memory = model_buffer.memory.*,
-        // };
-    }
+    var layout_info = std.mem.zeroInit(c.VkDescriptorSetLayoutCreateInfo, .{
+        .sType = c.VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = @as(u32, bindings.len),
+        .pBindings = &bindings,
+    });
 
-    return buffer_set;
+    var layout: c.VkDescriptorSetLayout = undefined;
+    try vke.checkResult(c.vkCreateDescriptorSetLayout(device, &layout_info, null, &layout));
+    return DescriptorSetLayout{ .handle = layout };
 }
 
-pub fn createDescriptorPool(device: c.VkDevice, buffer_count: u32) !DescriptorPool {
-    const camera_pool_sizes = std.mem.zeroInit(c.VkDescriptorPoolSize, .{
-        .type = c.VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-        .descriptorCount = buffer_count * 2,
+pub fn createDescriptorPool(device: c.VkDevice) !DescriptorPool {
+    // One dynamic descriptor for the camera and one for the light
+    const uniform_pool_sizes = std.mem.zeroInit(c.VkDescriptorPoolSize, .{
+        .type = c.VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+        .descriptorCount = 2,
     });
 
-    const light_pool_sizes = std.mem.zeroInit(c.VkDescriptorPoolSize, .{
-        .type = c.VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-        .descriptorCount = buffer_count,
+    // Two for the object set and four for the cull set
+    const storage_pool_sizes = std.mem.zeroInit(c.VkDescriptorPoolSize, .{
+        .type = c.VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+        .descriptorCount = 6,
     });
 
-    // const model_pool_sizes = std.mem.zeroInit(c.VkDescriptorPoolSize, .{
-    //     .type = c.VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
-    //     .descriptorCount = buffer_count,
-    // });
-
     const pool_sizes = [_]c.VkDescriptorPoolSize{ 
-        camera_pool_sizes,
-        light_pool_sizes, 
+        uniform_pool_sizes,
+        storage_pool_sizes,
     };
 
-    const max_sets = camera_pool_sizes.descriptorCount + light_pool_sizes.descriptorCount;
     const pool_info = std.mem.zeroInit(c.VkDescriptorPoolCreateInfo, .{
         .sType = c.VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
         .poolSizeCount = @as(u32, pool_sizes.len),
         .pPoolSizes = &pool_sizes,
-        .maxSets = max_sets,
+        .maxSets = 4,
     });
 
     var pool: c.VkDescriptorPool = undefined;
@@ -231,126 +168,87 @@ pub fn createSamplerDescriptorPool(device: c.VkDevice, max_objects: u32) !Descri
     return .{ .handle = pool };
 }
 
-pub fn createDescriptorSets(a: std.mem.Allocator, buffer_count: u32, device: c.VkDevice, descriptor_pool: c.VkDescriptorPool, descriptor_set_layout: c.VkDescriptorSetLayout, light_descriptor_set_layout: c.VkDescriptorSetLayout, buffer_set: []BufferSet, light_uniform_alignment: u64) !DescriptorSets {
-    var view_projection_layouts = try a.alloc(c.VkDescriptorSetLayout, buffer_count);
-    defer a.free(view_projection_layouts);
+pub const DescriptorSetsOpts = struct {
+    device: c.VkDevice,
+    descriptor_pool: c.VkDescriptorPool,
+    camera_set_layout: c.VkDescriptorSetLayout,
+    light_set_layout: c.VkDescriptorSetLayout,
+    object_set_layout: c.VkDescriptorSetLayout,
+    uniform_buffer: c.VkBuffer,
+    object_buffer: c.VkBuffer,
+    /// Size of one frame's region of the object buffer
+    object_range: u64,
+    visible_buffer: c.VkBuffer,
+    visible_range: u64,
+};
 
-    for (0..view_projection_layouts.len) |i| {
-        view_projection_layouts[i] = descriptor_set_layout;
-    }
-    var alloc_info = std.mem.zeroInit(c.VkDescriptorSetAllocateInfo, .{
+pub fn createDescriptorSets(opts: DescriptorSetsOpts) !DescriptorSets {
+    const device = opts.device;
+    const layouts = [_]c.VkDescriptorSetLayout{ opts.camera_set_layout, opts.light_set_layout, opts.object_set_layout };
+    const alloc_info = std.mem.zeroInit(c.VkDescriptorSetAllocateInfo, .{
         .sType = c.VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-        .descriptorPool = descriptor_pool,
-        .descriptorSetCount = buffer_count,
-        .pSetLayouts = view_projection_layouts.ptr,
+        .descriptorPool = opts.descriptor_pool,
+        .descriptorSetCount = @as(u32, layouts.len),
+        .pSetLayouts = &layouts,
     });
 
-    const view_projection_pipeline1_sets = try a.alloc(c.VkDescriptorSet, buffer_count);
-    try vke.checkResult(c.vkAllocateDescriptorSets(device, &alloc_info, view_projection_pipeline1_sets.ptr));
-
-    for (view_projection_pipeline1_sets, 0..) |set, i| {
-        const camera_buffer_info = std.mem.zeroInit(c.VkDescriptorBufferInfo, .{
-            .buffer = buffer_set[i].camera.handle,
-            .offset = 0,
-            .range = @sizeOf(scene.Camera),
-        });
-
-        const camera_set_writes = std.mem.zeroInit(c.VkWriteDescriptorSet, .{
-            .sType = c.VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-            .dstSet = set,
-            .dstBinding = 0,
-            .dstArrayElement = 0,
-            .descriptorType = c.VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-            .descriptorCount = 1,
-            .pBufferInfo = &camera_buffer_info,
-        });
-
-        const descriptor_writes = [_]c.VkWriteDescriptorSet{ camera_set_writes };
-        c.vkUpdateDescriptorSets(device, @as(u32, descriptor_writes.len), &descriptor_writes, 0, null);
-    }
-
-    const view_projection_pipeline2_sets = try a.alloc(c.VkDescriptorSet, buffer_count);
-    try vke.checkResult(c.vkAllocateDescriptorSets(device, &alloc_info, view_projection_pipeline2_sets.ptr));
+    var sets: [3]c.VkDescriptorSet = undefined;
+    try vke.checkResult(c.vkAllocateDescriptorSets(device, &alloc_info, &sets));
 
-    for (view_projection_pipeline2_sets, 0..) |set, i| {
-        const camera_buffer_info = std.mem.zeroInit(c.VkDescriptorBufferInfo, .{
-            .buffer = buffer_set[i].camera.handle,
-            .offset = 0,
-            .range = @sizeOf(scene.Camera),
-        });
-
-        const camera_set_writes = std.mem.zeroInit(c.VkWriteDescriptorSet, .{
-            .sType = c.VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-            .dstSet = set,
-            .dstBinding = 0,
-            .dstArrayElement = 0,
-            .descriptorType = c.VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-            .descriptorCount = 1,
-            .pBufferInfo = &camera_buffer_info,
-        });
+    const camera_buffer_info = std.mem.zeroInit(c.VkDescriptorBufferInfo, .{
+        .buffer = opts.uniform_buffer,
+        .offset = 0,
+        .range = @sizeOf(scene.Camera),
+    });
 
-        const descriptor_writes = [_]c.VkWriteDescriptorSet{ camera_set_writes };
-        c.vkUpdateDescriptorSets(device, @as(u32, descriptor_writes.len), &descriptor_writes, 0, null);
-    }
+    const light_buffer_info = std.mem.zeroInit(c.VkDescriptorBufferInfo, .{
+        .buffer = opts.uniform_buffer,
+        .offset = 0,
+        .range = @sizeOf(scene.Light),
+    });
 
-    var light_layouts = try a.alloc(c.VkDescriptorSetLayout, buffer_count);
-    defer a.free(light_layouts);
-    for (0..light_layouts.len) |i| {
-        light_layouts[i] = light_descriptor_set_layout;
-    }
+    const object_buffer_infos = [_]c.VkDescriptorBufferInfo{
+        .{ .buffer = opts.object_buffer, .offset = 0, .range = opts.object_range },
+        .{ .buffer = opts.visible_buffer, .offset = 0, .range = opts.visible_range },
+    };
 
-    var light_alloc_info = std.mem.zeroInit(c.VkDescriptorSetAllocateInfo, .{
-        .sType = c.VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-        .descriptorPool = descriptor_pool,
-        .descriptorSetCount = buffer_count,
-        .pSetLayouts = light_layouts.ptr,
+    const camera_set_writes = std.mem.zeroInit(c.VkWriteDescriptorSet, .{
+        .sType = c.VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = sets[0],
+        .dstBinding = 0,
+        .dstArrayElement = 0,
+        .descriptorType = c.VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+        .descriptorCount = 1,
+        .pBufferInfo = &camera_buffer_info,
     });
 
-    const light_sets = try a.alloc(c.VkDescriptorSet, buffer_count);
-    try vke.checkResult(c.vkAllocateDescriptorSets(device, &light_alloc_info, light_sets.ptr));
-
-    for (light_sets, 0..) |set, i| {
-        const light_buffer_info = std.mem.zeroInit(c.VkDescriptorBufferInfo, .{
-            .buffer = buffer_set[i].light.handle,
-            .offset = 0,
-            .range = light_uniform_alignment,
-        });
+    const light_set_writes = std.mem.zeroInit(c.VkWriteDescriptorSet, .{
+        .sType = c.VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = sets[1],
+        .dstBinding = 0,
+        .dstArrayElement = 0,
+        .descriptorType = c.VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+        .descriptorCount = 1,
+        .pBufferInfo = &light_buffer_info,
+    });
 
-        const light_set_writes = std.mem.zeroInit(c.VkWriteDescriptorSet, .{
-            .sType = c.VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-            .dstSet = set,
-            .dstBinding = 0,
-            .dstArrayElement = 0,
-            .descriptorType = c.VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-            .descriptorCount = 1,
-            .pBufferInfo = &light_buffer_info,
-        });
+    const object_set_writes = std.mem.zeroInit(c.VkWriteDescriptorSet, .{
+        .sType = c.VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = sets[2],
+        .dstBinding = 0,
+        .dstArrayElement = 0,
+        .descriptorType = c.VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+        .descriptorCount = @as(u32, object_buffer_infos.len),
+        .pBufferInfo = &object_buffer_infos,
+    });
 
-        // const model_buffer_info = std.mem.zeroInit(c.VkDescriptorBufferInfo, .{
-        //     .buffer = buffer_set[i].model.handle,
-        //     .offset = 0,
-        //     .range = model_memory_alignment,
-        // });
-
-        // const model_set_writes = std.mem.zeroInit(c.VkWriteDescriptorSet, .{
-        //     .sType = c.VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-        //     .dstSet = set,
-        //     .dstBinding = 1,
-        //     .dstArrayElement = 0,
-        //     .descriptorType = c.VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
-        //     .descriptorCount = 1,
-        //     .pBufferInfo = &model_buffer_info,
-        // });
-
-        // const descriptor_writes = [_]c.VkWriteDescriptorSet{ camera_set_writes, model_set_writes };
-        const descriptor_writes = [_]c.VkWriteDescriptorSet{ light_set_writes };
-        c.vkUpdateDescriptorSets(device, @as(u32, descriptor_writes.len), &descriptor_writes, 0, null);
-    }
+    const descriptor_writes = [_]c.VkWriteDescriptorSet{ camera_set_writes, light_set_writes, object_set_writes };
+    c.vkUpdateDescriptorSets(device, @as(u32, descriptor_writes.len), &descriptor_writes, 0, null);
 
     return .{
-        .view_projection_pipeline1 = view_projection_pipeline1_sets,
-        .view_projection_pipeline2 = view_projection_pipeline2_sets,
-        .light_sets = light_sets,    
+        .camera = sets[0],
+        .light = sets[1],
+        .objects = sets[2],
     };
 }
 
@@ -2,6 +2,7 @@ const std = @import("std");
 const vke = @import("./error.zig");
 const c = @import("../clibs.zig");
 const vks = @import("./swapchain.zig");
+const testing = std.testing;
 
 const log = std.log.scoped(.vulkan_device);
 
@@ -10,6 +11,19 @@ pub const PhysicalDevice = struct {
     queue_indices: QueueFamilyIndices = undefined,
     use_render_pass: bool = false,
     min_uniform_buffer_offset_alignment: u64 = 0,
+    min_storage_buffer_offset_alignment: u64 = 0,
+    /// Several draws per indirect call with a non zero first instance
+    supports_multi_draw_indirect: bool = false,
+    /// The draw count of an indirect call can be read from a buffer
+    supports_draw_indirect_count: bool = false,
+    /// Partially bound, update-after-bind texture arrays indexed per instance
+    supports_bindless: bool = false,
+    /// Most sampled images a single update-after-bind set may hold
+    max_bindless_textures: u32 = 0,
+    /// Every graphics and compute queue can write timestamps
+    supports_timestamps: bool = false,
+    /// Nanoseconds per timestamp tick
+    timestamp_period: f32 = 0,
 };
 
 pub const PhysicalDeviceOpts = struct {
@@ -21,11 +35,25 @@ pub const Device = struct {
     handle: c.VkDevice = null,
     graphics_queue: c.VkQueue = null,
     presentation_queue: c.VkQueue = null,
+    /// Queue of the transfer family, the graphics queue when the device has no dedicated one
+    transfer_queue: c.VkQueue = null,
+    /// Queue of the async compute family, the graphics queue when the device has no separate one
+    compute_queue: c.VkQueue = null,
 };
 
 pub const QueueFamilyIndices = struct {
     graphics_queue_location: u32 = undefined,
     presentation_queue_location: u32 = undefined,
+    transfer_queue_location: u32 = undefined,
+    compute_queue_location: u32 = undefined,
+
+    pub fn hasDedicatedTransfer(self: QueueFamilyIndices) bool {
+        return self.transfer_queue_location != self.graphics_queue_location;
+    }
+
+    pub fn hasAsyncCompute(self: QueueFamilyIndices) bool {
+        return self.compute_queue_location != self.graphics_queue_location;
+    }
 
     fn isValid(self: QueueFamilyIndices) bool {
         return self.graphics_queue_location >= 0 and self.presentation_queue_location >= 0;
@@ -45,6 +73,8 @@ pub fn createLogicalDevice(alloc: std.mem.Allocator, physical_device: PhysicalDe
     var queue_family_indices = std.AutoArrayHashMapUnmanaged(u32, void){};
     try queue_family_indices.put(arena, physical_device.queue_indices.graphics_queue_location, {});
     try queue_family_indices.put(arena, physical_device.queue_indices.presentation_queue_location, {});
+    try queue_family_indices.put(arena, physical_device.queue_indices.transfer_queue_location, {});
+    try queue_family_indices.put(arena, physical_device.queue_indices.compute_queue_location, {});
 
     var queue_create_infos = std.ArrayListUnmanaged(c.VkDeviceQueueCreateInfo){};
     try queue_create_infos.ensureTotalCapacity(arena, queue_family_indices.count());
@@ -60,18 +90,40 @@ pub fn createLogicalDevice(alloc: std.mem.Allocator, physical_device: PhysicalDe
         }));
     }
 
-    const device_features = std.mem.zeroInit(c.VkPhysicalDeviceFeatures, .{
-        .samplerAnisotropy = c.VK_TRUE,
+    const vk_true = c.VK_TRUE;
+    const vk_false = c.VK_FALSE;
+
+    var features_1_2 = std.mem.zeroInit(c.VkPhysicalDeviceVulkan12Features, .{
+        .sType = c.VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+        .drawIndirectCount = if (physical_device.supports_draw_indirect_count) vk_true else vk_false,
+        // Core since 1.2, every frame, upload and compute submission signals a timeline
+        .timelineSemaphore = vk_true,
+        .runtimeDescriptorArray = if (physical_device.supports_bindless) vk_true else vk_false,
+        .descriptorBindingPartiallyBound = if (physical_device.supports_bindless) vk_true else vk_false,
+        .descriptorBindingSampledImageUpdateAfterBind = if (physical_device.supports_bindless) vk_true else vk_false,
+        .shaderSampledImageArrayNonUniformIndexing = if (physical_device.supports_bindless) vk_true else vk_false,
     });
+
+    // Features are chained through pNext so the 1.2 features can be enabled alongside the core ones
+    var device_features = std.mem.zeroInit(c.VkPhysicalDeviceFeatures2, .{
+        .sType = c.VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+        .features = std.mem.zeroInit(c.VkPhysicalDeviceFeatures, .{
+            .samplerAnisotropy = c.VK_TRUE,
+            .multiDrawIndirect = if (physical_device.supports_multi_draw_indirect) vk_true else vk_false,
+            .drawIndirectFirstInstance = if (physical_device.supports_multi_draw_indirect) vk_true else vk_false,
+        }),
+    });
+    device_features.pNext = &features_1_2;
     
     const device_create_info = std.mem.zeroInit(c.VkDeviceCreateInfo, .{
         .sType = c.VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+        .pNext = &device_features,
         .queueCreateInfoCount = @as(u32, @intCast(queue_create_infos.items.len)),
         .pQueueCreateInfos = queue_create_infos.items.ptr,
         .enabledExtensionCount = @as(u32, @intCast(required_extensions.len)),
         .ppEnabledExtensionNames = required_extensions.ptr,
         .enabledLayerCount = 0,
-        .pEnabledFeatures = &device_features,
+        .pEnabledFeatures = null,
     });
 
     var device: c.VkDevice = undefined;
@@ -83,13 +135,22 @@ pub fn createLogicalDevice(alloc: std.mem.Allocator, physical_device: PhysicalDe
     var presentation_queue: c.VkQueue = undefined;
     c.vkGetDeviceQueue(device, physical_device.queue_indices.presentation_queue_location, 0, &presentation_queue);
 
+    var transfer_queue: c.VkQueue = undefined;
+    c.vkGetDeviceQueue(device, physical_device.queue_indices.transfer_queue_location, 0, &transfer_queue);
+
+    var compute_queue: c.VkQueue = undefined;
+    c.vkGetDeviceQueue(device, physical_device.queue_indices.compute_queue_location, 0, &compute_queue);
+
     return .{
         .handle = device,
         .graphics_queue = graphics_queue,
         .presentation_queue = presentation_queue,
+        .transfer_queue = transfer_queue,
+        .compute_queue = compute_queue,
     };
 }
 
+/// A null surface picks a device for headless rendering, which is never asked to present
 pub fn getPhysicalDevice(alloc: std.mem.Allocator, instance: c.VkInstance, surface: c.VkSurfaceKHR, required_extensions: []const [*c]const u8) !PhysicalDevice {
     var device_count: u32 = undefined;
     try vke.checkResult(c.vkEnumeratePhysicalDevices(instance, &device_count, null));
@@ -119,6 +180,10 @@ pub fn getPhysicalDevice(alloc: std.mem.Allocator, instance: c.VkInstance, surfa
         }
     };
 
+    if (physical_device.handle == null) {
+        return error.NoSuitableDevice;
+    }
+
     var features_1_3 = std.mem.zeroInit(c.VkPhysicalDeviceVulkan13Features, .{
         .sType = c.VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES,
     });
@@ -154,9 +219,34 @@ pub fn getPhysicalDevice(alloc: std.mem.Allocator, instance: c.VkInstance, surfa
         return error.MissingFeatureSamplerAnisotropy;
     }
 
-    var device_properties: c.VkPhysicalDeviceProperties = undefined;
-    c.vkGetPhysicalDeviceProperties(physical_device.handle, &device_properties);
+    // Optional, the renderer falls back to direct draws without them
+    physical_device.supports_multi_draw_indirect = physical_features.features.multiDrawIndirect == c.VK_TRUE and physical_features.features.drawIndirectFirstInstance == c.VK_TRUE;
+    physical_device.supports_draw_indirect_count = physical_device.supports_multi_draw_indirect and features_1_2.drawIndirectCount == c.VK_TRUE;
+
+    physical_device.supports_bindless = features_1_2.runtimeDescriptorArray == c.VK_TRUE and
+        features_1_2.descriptorBindingPartiallyBound == c.VK_TRUE and
+        features_1_2.descriptorBindingSampledImageUpdateAfterBind == c.VK_TRUE and
+        features_1_2.shaderSampledImageArrayNonUniformIndexing == c.VK_TRUE;
+
+    var properties_1_2 = std.mem.zeroInit(c.VkPhysicalDeviceVulkan12Properties, .{
+        .sType = c.VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES,
+    });
+    var properties = std.mem.zeroInit(c.VkPhysicalDeviceProperties2, .{
+        .sType = c.VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+        .pNext = &properties_1_2,
+    });
+    c.vkGetPhysicalDeviceProperties2(physical_device.handle, &properties);
+
+    const device_properties = properties.properties;
     physical_device.min_uniform_buffer_offset_alignment = device_properties.limits.minUniformBufferOffsetAlignment;
+    physical_device.min_storage_buffer_offset_alignment = device_properties.limits.minStorageBufferOffsetAlignment;
+    physical_device.supports_timestamps = device_properties.limits.timestampComputeAndGraphics == c.VK_TRUE;
+    physical_device.timestamp_period = device_properties.limits.timestampPeriod;
+    physical_device.max_bindless_textures = @min(
+        properties_1_2.maxDescriptorSetUpdateAfterBindSampledImages,
+        properties_1_2.maxPerStageDescriptorUpdateAfterBindSampledImages,
+        properties_1_2.maxPerStageDescriptorUpdateAfterBindSamplers,
+    );
 
     return physical_device;
 }
@@ -179,8 +269,13 @@ fn getQueueFamilies(alloc: std.mem.Allocator, device: c.VkPhysicalDevice, surfac
             indices.graphics_queue_location = index;
         }
 
+        // Without a surface nothing is presented, the presentation queue is the graphics one
         var presentation_support: c.VkBool32 = 0;
-        try vke.checkResult(c.vkGetPhysicalDeviceSurfaceSupportKHR(device, index, surface, &presentation_support));
+        if (surface != null) {
+            try vke.checkResult(c.vkGetPhysicalDeviceSurfaceSupportKHR(device, index, surface, &presentation_support));
+        } else if (queue_family.queueFlags & c.VK_QUEUE_GRAPHICS_BIT != 0) {
+            presentation_support = c.VK_TRUE;
+        }
         if (queue_family.queueCount > 0 and presentation_support == c.VK_TRUE) {
             indices.presentation_queue_location = @intCast(index);
         }
@@ -190,9 +285,47 @@ fn getQueueFamilies(alloc: std.mem.Allocator, device: c.VkPhysicalDevice, surfac
         }
     }
 
+    indices.transfer_queue_location = selectTransferFamily(queue_families, indices.graphics_queue_location);
+    if (indices.hasDedicatedTransfer()) {
+        log.info("Dedicated transfer queue family: {d}", .{indices.transfer_queue_location});
+    }
+
+    indices.compute_queue_location = selectComputeFamily(queue_families, indices.graphics_queue_location);
+    if (indices.hasAsyncCompute()) {
+        log.info("Async compute queue family: {d}", .{indices.compute_queue_location});
+    }
+
     return indices;
 }
 
+/// A family that can only copy maps to the copy engines and runs beside graphics work. Without one, uploads
+/// share the graphics family.
+fn selectTransferFamily(queue_families: []const c.VkQueueFamilyProperties, graphics_family: u32) u32 {
+    for (queue_families, 0..) |queue_family, i| {
+        const flags = queue_family.queueFlags;
+        const transfer_only = flags & c.VK_QUEUE_TRANSFER_BIT != 0 and flags & (c.VK_QUEUE_GRAPHICS_BIT | c.VK_QUEUE_COMPUTE_BIT) == 0;
+        if (queue_family.queueCount > 0 and transfer_only) {
+            return @intCast(i);
+        }
+    }
+
+    return graphics_family;
+}
+
+/// A compute family without graphics is scheduled beside the graphics queue, its dispatches fill the gaps the
+/// graphics work leaves. Without one, compute is recorded into the graphics queue.
+fn selectComputeFamily(queue_families: []const c.VkQueueFamilyProperties, graphics_family: u32) u32 {
+    for (queue_families, 0..) |queue_family, i| {
+        const flags = queue_family.queueFlags;
+        const compute_only = flags & c.VK_QUEUE_COMPUTE_BIT != 0 and flags & c.VK_QUEUE_GRAPHICS_BIT == 0;
+        if (queue_family.queueCount > 0 and compute_only) {
+            return @intCast(i);
+        }
+    }
+
+    return graphics_family;
+}
+
 fn checkDeviceExtensionSupport(alloc: std.mem.Allocator, device: c.VkPhysicalDevice, required_extensions: []const [*c]const u8) !bool {
     var arena_alloc = std.heap.ArenaAllocator.init(alloc);
     defer arena_alloc.deinit();
@@ -201,26 +334,26 @@ fn checkDeviceExtensionSupport(alloc: std.mem.Allocator, device: c.VkPhysicalDev
     var extension_count: u32 = 0;
     try vke.checkResult(c.vkEnumerateDeviceExtensionProperties(device, null, &extension_count, null));
 
-    if (extension_count == 0) return false;
+    if (extension_count == 0) return required_extensions.len == 0;
 
     const extensions = try arena.alloc(c.VkExtensionProperties, extension_count);
     try vke.checkResult(c.vkEnumerateDeviceExtensionProperties(device, null, &extension_count, extensions.ptr));
 
-    var has_extension = false;
+    // A headless device requires no extensions at all
     for (required_extensions) |required_extension| {
-        for (extensions) |extension| {
+        const has_extension = for (extensions) |extension| {
             const extension_name: [*c]const u8 = @ptrCast(extension.extensionName[0..]);
             if (std.mem.eql(u8, std.mem.span(required_extension), std.mem.span(extension_name))) {
-                has_extension = true;
+                break true;
             }
-        }
+        } else false;
 
         if (!has_extension) {
             return false;
         }
     }
 
-    return has_extension;
+    return true;
 }
 
 fn isDeviceSuitable(alloc: std.mem.Allocator, device: c.VkPhysicalDevice, surface: c.VkSurfaceKHR, required_extensions: []const [*c]const u8) !DeviceQueueResult {
@@ -231,10 +364,12 @@ fn isDeviceSuitable(alloc: std.mem.Allocator, device: c.VkPhysicalDevice, surfac
     defer arena_state.deinit();
     const arena = arena_state.allocator();
 
-    const swapchain_details = try vks.SwapchainDetails.createAlloc(arena, device, surface);
-    defer swapchain_details.deinit(arena);
-    if (swapchain_details.surface_formats.len == 0 or swapchain_details.presentation_modes.len == 0) {
-        return . { .invalid = {} };
+    if (surface != null) {
+        const swapchain_details = try vks.SwapchainDetails.createAlloc(arena, device, surface);
+        defer swapchain_details.deinit(arena);
+        if (swapchain_details.surface_formats.len == 0 or swapchain_details.presentation_modes.len == 0) {
+            return . { .invalid = {} };
+        }
     }
 
     const extensions_supported = try checkDeviceExtensionSupport(alloc, device, required_extensions);
@@ -243,4 +378,22 @@ fn isDeviceSuitable(alloc: std.mem.Allocator, device: c.VkPhysicalDevice, surfac
     } else {
         return . { .invalid = {} };
     }
-}
\ No newline at end of file
+}
+
+test "selectTransferFamily prefers a transfer only family" {
+    const graphics = std.mem.zeroInit(c.VkQueueFamilyProperties, .{ .queueFlags = c.VK_QUEUE_GRAPHICS_BIT | c.VK_QUEUE_COMPUTE_BIT | c.VK_QUEUE_TRANSFER_BIT, .queueCount = 1 });
+    const compute = std.mem.zeroInit(c.VkQueueFamilyProperties, .{ .queueFlags = c.VK_QUEUE_COMPUTE_BIT | c.VK_QUEUE_TRANSFER_BIT, .queueCount = 2 });
+    const transfer = std.mem.zeroInit(c.VkQueueFamilyProperties, .{ .queueFlags = c.VK_QUEUE_TRANSFER_BIT, .queueCount = 1 });
+
+    try testing.expectEqual(@as(u32, 2), selectTransferFamily(&.{ graphics, compute, transfer }, 0));
+    try testing.expectEqual(@as(u32, 0), selectTransferFamily(&.{ graphics, compute }, 0));
+}
+
+test "selectComputeFamily prefers a compute family without graphics" {
+    const graphics = std.mem.zeroInit(c.VkQueueFamilyProperties, .{ .queueFlags = c.VK_QUEUE_GRAPHICS_BIT | c.VK_QUEUE_COMPUTE_BIT | c.VK_QUEUE_TRANSFER_BIT, .queueCount = 1 });
+    const compute = std.mem.zeroInit(c.VkQueueFamilyProperties, .{ .queueFlags = c.VK_QUEUE_COMPUTE_BIT | c.VK_QUEUE_TRANSFER_BIT, .queueCount = 2 });
+    const transfer = std.mem.zeroInit(c.VkQueueFamilyProperties, .{ .queueFlags = c.VK_QUEUE_TRANSFER_BIT, .queueCount = 1 });
+
+    try testing.expectEqual(@as(u32, 1), selectComputeFamily(&.{ graphics, compute, transfer }, 0));
+    try testing.expectEqual(@as(u32, 0), selectComputeFamily(&.{ graphics, transfer }, 0));
+}
@@ -0,0 +1,433 @@
+const std = @import("std");
+const c = @import("../clibs.zig");
+const scene = @import("scene");
+const zmath = @import("zmath");
+const vkg = @import("./geometry.zig");
+const vkcl = @import("./cull.zig");
+const testing = std.testing;
+
+/// Entities that resolve to the same key are drawn together with one instanced call
+pub const BatchKey = struct {
+    first_index: u32,
+    index_count: u32,
+    vertex_offset: i32,
+    texture_id: u32,
+
+    pub fn init(range: vkg.MeshRange, texture_id: u32) BatchKey {
+        return .{
+            .first_index = range.first_index,
+            .index_count = range.index_count,
+            .vertex_offset = range.vertex_offset,
+            .texture_id = texture_id,
+        };
+    }
+};
+
+pub const Batch = struct {
+    key: BatchKey,
+    first_instance: u32,
+    instance_count: u32,
+    /// Distance of the nearest instance in front of the camera
+    depth: f32 = std.math.inf(f32),
+};
+
+/// Farthest depth that still orders batches, anything beyond sorts as if it were at this distance
+pub const MAX_SORT_DEPTH: f32 = 1000;
+
+/// Packed order of a batch, the most expensive state change sits in the highest bits so sorting by the key groups
+/// by pipeline first, then texture. Every mesh lives in the geometry arena, switching meshes binds nothing, so
+/// within a texture the batches are drawn front to back and the mesh only breaks ties.
+pub const SortKey = packed struct(u64) {
+    /// Low bits of the mesh's first index, meshes that collide still draw correctly, only less grouped
+    mesh: u20,
+    depth: u24,
+    texture: u16,
+    /// Every batch uses the graphics pipeline today, the bits keep room for material pipelines
+    pipeline: u4 = 0,
+
+    pub fn init(batch: Batch) SortKey {
+        const depth = std.math.clamp(batch.depth, 0, MAX_SORT_DEPTH) / MAX_SORT_DEPTH;
+        return .{
+            .depth = @as(u24, @intFromFloat(depth * std.math.maxInt(u24))),
+            .mesh = @as(u20, @truncate(batch.key.first_index)),
+            .texture = @as(u16, @truncate(batch.key.texture_id)),
+        };
+    }
+};
+
+/// Binds a frame needs, `naive` rebinds everything for every instance, `sorted` is what the sorted list records
+pub const BindCounts = struct {
+    pipelines: u32 = 0,
+    descriptor_sets: u32 = 0,
+    vertex_buffers: u32 = 0,
+    draws: u32 = 0,
+};
+
+pub const BindStats = struct {
+    naive: BindCounts = .{},
+    sorted: BindCounts = .{},
+};
+
+/// Consecutive batches that use the same texture, recorded as one indirect draw. A bindless list is a single run.
+pub const Run = struct {
+    texture_id: u32,
+    first_batch: u32,
+    batch_count: u32,
+};
+
+const Instance = struct {
+    batch: u32,
+    model: zmath.Mat,
+    bounds: [4]f32,
+};
+
+/// Collects the drawable entities of a frame and groups them by mesh and texture. The grouping is a counting
+/// sort, the instances of a batch end up contiguous in the object buffer so each batch is a single draw.
+/// Batches are radix sorted by their `SortKey`, so the batches of a texture form a run for indirect submission.
+pub const DrawList = struct {
+    allocator: std.mem.Allocator,
+    lookup: std.AutoHashMapUnmanaged(BatchKey, u32) = .{},
+    batches: std.ArrayListUnmanaged(Batch) = .{},
+    instances: std.ArrayListUnmanaged(Instance) = .{},
+    runs: std.ArrayListUnmanaged(Run) = .{},
+    sorted: std.ArrayListUnmanaged(Batch) = .{},
+    remap: std.ArrayListUnmanaged(u32) = .{},
+    keys: std.ArrayListUnmanaged(u64) = .{},
+    scratch_keys: std.ArrayListUnmanaged(u64) = .{},
+    scratch_indices: std.ArrayListUnmanaged(u32) = .{},
+    /// Plane whose signed distance is an instance's depth, the near plane of the camera frustum
+    depth_plane: [4]f32 = .{ 0, 0, 0, 0 },
+    /// Textures are indexed per instance, so batches are not split into runs by texture
+    bindless: bool = false,
+
+    pub fn init(a: std.mem.Allocator) DrawList {
+        return .{ .allocator = a };
+    }
+
+    pub fn deinit(self: *DrawList) void {
+        self.lookup.deinit(self.allocator);
+        self.batches.deinit(self.allocator);
+        self.instances.deinit(self.allocator);
+        self.runs.deinit(self.allocator);
+        self.sorted.deinit(self.allocator);
+        self.remap.deinit(self.allocator);
+        self.keys.deinit(self.allocator);
+        self.scratch_keys.deinit(self.allocator);
+        self.scratch_indices.deinit(self.allocator);
+    }
+
+    /// Clear the previous frame while keeping the memory around
+    pub fn reset(self: *DrawList) void {
+        self.lookup.clearRetainingCapacity();
+        self.batches.clearRetainingCapacity();
+        self.instances.clearRetainingCapacity();
+        self.runs.clearRetainingCapacity();
+    }
+
+    pub fn add(self: *DrawList, key: BatchKey, model: zmath.Mat, bounds: [4]f32) !void {
+        const entry = try self.lookup.getOrPut(self.allocator, key);
+        if (!entry.found_existing) {
+            entry.value_ptr.* = @as(u32, @intCast(self.batches.items.len));
+            try self.batches.append(self.allocator, .{ .key = key, .first_instance = 0, .instance_count = 0 });
+        }
+
+        const batch = &self.batches.items[entry.value_ptr.*];
+        const plane = self.depth_plane;
+        batch.instance_count += 1;
+        batch.depth = @min(batch.depth, plane[0] * model[3][0] + plane[1] * model[3][1] + plane[2] * model[3][2] + plane[3]);
+        try self.instances.append(self.allocator, .{ .batch = entry.value_ptr.*, .model = model, .bounds = bounds });
+    }
+
+    pub fn instanceCount(self: *const DrawList) usize {
+        return self.instances.items.len;
+    }
+
+    /// Scatter the instances into `objects` grouped by batch. `first` is the index of `objects[0]` as seen by the
+    /// shader, it is added to every batch's first instance. When `cull_inputs` is given it receives the bounds of
+    /// every instance in the same order for the GPU culling pass.
+    pub fn build(self: *DrawList, objects: []scene.ObjectData, first: u32, cull_inputs: ?[]vkcl.CullInput) !void {
+        std.debug.assert(objects.len == self.instances.items.len);
+        try self.sortByKey();
+
+        var next = first;
+        for (self.batches.items) |*batch| {
+            batch.first_instance = next;
+            next += batch.instance_count;
+        }
+
+        // Reuse the counts as write cursors, they are restored by the scatter below
+        for (self.batches.items) |*batch| {
+            batch.instance_count = 0;
+        }
+
+        for (self.instances.items) |instance| {
+            const batch_index = self.remap.items[instance.batch];
+            const batch = &self.batches.items[batch_index];
+            const slot = batch.first_instance - first + batch.instance_count;
+            objects[slot] = .{
+                .model = instance.model,
+                .normal = zmath.transpose(zmath.inverse(instance.model)),
+                .texture_index = batch.key.texture_id,
+            };
+
+            if (cull_inputs) |inputs| {
+                inputs[slot] = .{
+                    .sphere = instance.bounds,
+                    .batch = batch_index,
+                    .object_index = first + slot,
+                };
+            }
+            batch.instance_count += 1;
+        }
+    }
+
+    /// Write one indexed indirect command per batch, in batch order. With `culled` the instance counts start at
+    /// zero and are filled in by the culling pass.
+    pub fn writeIndirect(self: *const DrawList, commands: []c.VkDrawIndexedIndirectCommand, culled: bool) void {
+        std.debug.assert(commands.len == self.batches.items.len);
+
+        for (self.batches.items, commands) |batch, *command| {
+            command.* = .{
+                .indexCount = batch.key.index_count,
+                .instanceCount = if (culled) 0 else batch.instance_count,
+                .firstIndex = batch.key.first_index,
+                .vertexOffset = batch.key.vertex_offset,
+                .firstInstance = batch.first_instance,
+            };
+        }
+    }
+
+    /// Write the number of batches in each run, the count buffer of `vkCmdDrawIndexedIndirectCount`
+    pub fn writeRunCounts(self: *const DrawList, counts: []u32) void {
+        std.debug.assert(counts.len == self.runs.items.len);
+
+        for (self.runs.items, counts) |run, *count| {
+            count.* = run.batch_count;
+        }
+    }
+
+    /// Binds recorded for the batches as built, each recording chunk binds the pipeline and geometry once more
+    pub fn bindStats(self: *const DrawList, indirect: bool) BindStats {
+        const instance_count = @as(u32, @intCast(self.instances.items.len));
+        const run_count = @as(u32, @intCast(self.runs.items.len));
+        return .{
+            .naive = .{
+                .pipelines = @intFromBool(instance_count > 0),
+                .descriptor_sets = instance_count,
+                .vertex_buffers = instance_count,
+                .draws = instance_count,
+            },
+            .sorted = .{
+                .pipelines = @intFromBool(run_count > 0),
+                .descriptor_sets = run_count,
+                .vertex_buffers = @intFromBool(run_count > 0),
+                .draws = if (indirect) run_count else @as(u32, @intCast(self.batches.items.len)),
+            },
+        };
+    }
+
+    fn sortByKey(self: *DrawList) !void {
+        const count = self.batches.items.len;
+        try self.remap.resize(self.allocator, count);
+        try self.keys.resize(self.allocator, count);
+        try self.scratch_keys.resize(self.allocator, count);
+        try self.scratch_indices.resize(self.allocator, count);
+        for (self.remap.items, self.keys.items, self.batches.items, 0..) |*index, *key, batch, i| {
+            index.* = @as(u32, @intCast(i));
+            var sort_key = SortKey.init(batch);
+            if (self.bindless) {
+                sort_key.texture = 0;
+            }
+            key.* = @bitCast(sort_key);
+        }
+
+        radixSort(self.keys.items, self.remap.items, self.scratch_keys.items, self.scratch_indices.items);
+
+        // remap holds the sorted order, turn it into old index -> new index while building the sorted list
+        try self.sorted.resize(self.allocator, count);
+        for (self.remap.items, 0..) |old, new| {
+            self.sorted.items[new] = self.batches.items[old];
+        }
+        for (self.sorted.items, 0..) |batch, new| {
+            self.remap.items[self.lookup.get(batch.key).?] = @as(u32, @intCast(new));
+        }
+        std.mem.swap(std.ArrayListUnmanaged(Batch), &self.batches, &self.sorted);
+
+        self.runs.clearRetainingCapacity();
+        for (self.batches.items, 0..) |batch, i| {
+            const texture_id = if (self.bindless) 0 else batch.key.texture_id;
+            if (self.runs.items.len > 0 and self.runs.items[self.runs.items.len - 1].texture_id == texture_id) {
+                self.runs.items[self.runs.items.len - 1].batch_count += 1;
+                continue;
+            }
+
+            try self.runs.append(self.allocator, .{
+                .texture_id = texture_id,
+                .first_batch = @as(u32, @intCast(i)),
+                .batch_count = 1,
+            });
+        }
+    }
+};
+
+/// Stable LSD radix sort of `keys` carrying `values` along, a byte per pass. Passes where every key shares the
+/// byte are skipped, so keys that only use their high bits cost a few passes. The scratch slices must be as long
+/// as the keys.
+pub fn radixSort(keys: []u64, values: []u32, scratch_keys: []u64, scratch_values: []u32) void {
+    std.debug.assert(keys.len == values.len and keys.len == scratch_keys.len and keys.len == scratch_values.len);
+
+    var source_keys = keys;
+    var source_values = values;
+    var target_keys = scratch_keys;
+    var target_values = scratch_values;
+
+    var shift: u6 = 0;
+    while (true) : (shift += 8) {
+        var offsets = [_]u32{0} ** 256;
+        for (source_keys) |key| {
+            offsets[@as(u8, @truncate(key >> shift))] += 1;
+        }
+
+        if (std.mem.indexOfScalar(u32, &offsets, @as(u32, @intCast(keys.len))) == null) {
+            var total: u32 = 0;
+            for (&offsets) |*offset| {
+                const digit_count = offset.*;
+                offset.* = total;
+                total += digit_count;
+            }
+
+            for (source_keys, source_values) |key, value| {
+                const slot = &offsets[@as(u8, @truncate(key >> shift))];
+                target_keys[slot.*] = key;
+                target_values[slot.*] = value;
+                slot.* += 1;
+            }
+
+            std.mem.swap([]u64, &source_keys, &target_keys);
+            std.mem.swap([]u32, &source_values, &target_values);
+        }
+
+        if (shift == 56) {
+            break;
+        }
+    }
+
+    if (source_keys.ptr != keys.ptr) {
+        @memcpy(keys, source_keys);
+        @memcpy(values, source_values);
+    }
+}
+
+test "radixSort is stable and matches a comparison sort" {
+    var prng = std.rand.DefaultPrng.init(7);
+    const random = prng.random();
+
+    var keys: [300]u64 = undefined;
+    var values: [300]u32 = undefined;
+    for (&keys, &values, 0..) |*key, *value, i| {
+        // Few distinct keys so stability is exercised
+        key.* = @as(u64, random.intRangeLessThan(u8, 0, 16)) << 40 | random.intRangeLessThan(u8, 0, 4);
+        value.* = @as(u32, @intCast(i));
+    }
+
+    var scratch_keys: [300]u64 = undefined;
+    var scratch_values: [300]u32 = undefined;
+    radixSort(&keys, &values, &scratch_keys, &scratch_values);
+
+    for (keys[1..], values[1..], keys[0 .. keys.len - 1], values[0 .. values.len - 1]) |key, value, previous_key, previous_value| {
+        try testing.expect(previous_key <= key);
+        if (previous_key == key) {
+            try testing.expect(previous_value < value);
+        }
+    }
+}
+
+test "DrawList groups instances that share a mesh and texture" {
+    var list = DrawList.init(testing.allocator);
+    defer list.deinit();
+
+    const cube = BatchKey{ .first_index = 0, .index_count = 36, .vertex_offset = 0, .texture_id = 0 };
+    const quad = BatchKey{ .first_index = 36, .index_count = 6, .vertex_offset = 24, .texture_id = 0 };
+
+    try list.add(cube, zmath.translation(1, 0, 0), .{ 0, 0, 0, 1 });
+    try list.add(quad, zmath.translation(2, 0, 0), .{ 0, 0, 0, 1 });
+    try list.add(cube, zmath.translation(3, 0, 0), .{ 0, 0, 0, 1 });
+
+    var objects: [3]scene.ObjectData = undefined;
+    try list.build(&objects, 10, null);
+
+    try testing.expectEqual(@as(usize, 2), list.batches.items.len);
+    try testing.expectEqual(@as(u32, 10), list.batches.items[0].first_instance);
+    try testing.expectEqual(@as(u32, 2), list.batches.items[0].instance_count);
+    try testing.expectEqual(@as(u32, 12), list.batches.items[1].first_instance);
+    try testing.expectEqual(@as(u32, 1), list.batches.items[1].instance_count);
+
+    try testing.expectEqual(@as(f32, 1), objects[0].model[3][0]);
+    try testing.expectEqual(@as(f32, 3), objects[1].model[3][0]);
+    try testing.expectEqual(@as(f32, 2), objects[2].model[3][0]);
+}
+
+test "DrawList orders batches by texture into runs" {
+    var list = DrawList.init(testing.allocator);
+    defer list.deinit();
+
+    const floor = BatchKey{ .first_index = 0, .index_count = 6, .vertex_offset = 0, .texture_id = 1 };
+    const cube = BatchKey{ .first_index = 6, .index_count = 36, .vertex_offset = 4, .texture_id = 0 };
+    const crate = BatchKey{ .first_index = 42, .index_count = 36, .vertex_offset = 28, .texture_id = 1 };
+
+    try list.add(floor, zmath.translation(1, 0, 0), .{ 0, 0, 0, 1 });
+    try list.add(cube, zmath.translation(2, 0, 0), .{ 0, 0, 0, 1 });
+    try list.add(crate, zmath.translation(3, 0, 0), .{ 0, 0, 0, 1 });
+    try list.add(floor, zmath.translation(4, 0, 0), .{ 0, 0, 0, 1 });
+
+    var objects: [4]scene.ObjectData = undefined;
+    var inputs: [4]vkcl.CullInput = undefined;
+    try list.build(&objects, 0, &inputs);
+
+    try testing.expectEqual(@as(usize, 2), list.runs.items.len);
+    try testing.expectEqual(@as(u32, 0), list.runs.items[0].texture_id);
+    try testing.expectEqual(@as(u32, 1), list.runs.items[0].batch_count);
+    try testing.expectEqual(@as(u32, 1), list.runs.items[1].texture_id);
+    try testing.expectEqual(@as(u32, 2), list.runs.items[1].batch_count);
+
+    // The cube's single instance is written first, followed by both floors
+    try testing.expectEqual(@as(f32, 2), objects[0].model[3][0]);
+    try testing.expectEqual(@as(u32, 2), list.batches.items[1].instance_count);
+    try testing.expectEqual(@as(u32, 3), list.batches.items[2].first_instance);
+
+    var commands: [3]c.VkDrawIndexedIndirectCommand = undefined;
+    list.writeIndirect(&commands, false);
+    try testing.expectEqual(@as(u32, 36), commands[0].indexCount);
+    try testing.expectEqual(@as(u32, 1), commands[1].firstInstance);
+
+    // Both floors point back at the floor batch
+    try testing.expectEqual(@as(u32, 1), inputs[1].batch);
+    try testing.expectEqual(@as(u32, 1), inputs[2].batch);
+    try testing.expectEqual(@as(u32, 2), inputs[2].object_index);
+}
+
+test "DrawList sorts the batches of a texture front to back" {
+    var list = DrawList.init(testing.allocator);
+    defer list.deinit();
+    // Depth along -z, as seen by a camera at the origin looking down -z
+    list.depth_plane = .{ 0, 0, -1, 0 };
+
+    const far = BatchKey{ .first_index = 0, .index_count = 36, .vertex_offset = 0, .texture_id = 0 };
+    const near = BatchKey{ .first_index = 36, .index_count = 36, .vertex_offset = 24, .texture_id = 0 };
+    try list.add(far, zmath.translation(0, 0, -50), .{ 0, 0, 0, 1 });
+    try list.add(far, zmath.translation(0, 0, -40), .{ 0, 0, 0, 1 });
+    try list.add(near, zmath.translation(0, 0, -5), .{ 0, 0, 0, 1 });
+
+    var objects: [3]scene.ObjectData = undefined;
+    try list.build(&objects, 0, null);
+
+    try testing.expectEqual(@as(u32, 36), list.batches.items[0].key.first_index);
+    try testing.expectEqual(@as(f32, 5), list.batches.items[0].depth);
+    // The far batch is as near as its nearest instance
+    try testing.expectEqual(@as(f32, 40), list.batches.items[1].depth);
+
+    const stats = list.bindStats(false);
+    try testing.expectEqual(@as(u32, 3), stats.naive.descriptor_sets);
+    try testing.expectEqual(@as(u32, 1), stats.sorted.descriptor_sets);
+    try testing.expectEqual(@as(u32, 2), stats.sorted.draws);
+}
@@ -14,10 +14,26 @@ const vkr = @import("render_pass.zig");
 const vkb = @import("buffer.zig");
 const vkds = @import("descriptor_set.zig");
 const vkt = @import("texture.zig");
+const vkm = @import("memory.zig");
+const vku = @import("upload.zig");
+const vkg = @import("geometry.zig");
+const vkun = @import("uniform.zig");
+const vkdl = @import("draw_list.zig");
+const vkcl = @import("cull.zig");
+const vkrc = @import("recorder.zig");
+const vkpc = @import("pipeline_cache.zig");
+const vksh = @import("shader.zig");
+const vkhr = @import("hot_reload.zig");
+const vkbl = @import("bindless.zig");
+const vkfr = @import("frame.zig");
+const vkpa = @import("pacing.zig");
+const vkac = @import("async_compute.zig");
+const vkgp = @import("profiler.zig");
+const vkos = @import("offscreen.zig");
 const scene = @import("scene");
+const zmath = @import("zmath");
 
 const MAX_OBJECTS = 1000;
-const MAX_FRAME_DRAWS = 3;
 const ONE_SECOND = 1_000_000_000;
 
 const Device = struct {
@@ -29,6 +45,97 @@ const Device = struct {
 
 const DeviceAlignment = struct {
     min_uniform_buffer_offset_alignment: u64,
+    min_storage_buffer_offset_alignment: u64,
+};
+
+/// Loaded from disk when the device is created and written back when it is destroyed
+pub const PipelineCache = struct {
+    handle: c.VkPipelineCache,
+    warm: bool,
+};
+
+/// Shader modules of the embedded SPIR-V, shared by every pipeline of the device
+pub const ShaderModules = struct {
+    handle: *vksh.ShaderRegistry,
+};
+
+/// Every texture of the device in one descriptor set, only present when the device supports descriptor indexing.
+/// Without it each texture gets its own set from the sampler pool.
+pub const TextureTable = struct {
+    handle: *vkbl.TextureTable,
+};
+
+pub const MemoryAllocator = struct {
+    handle: *vkm.DeviceAllocator,
+};
+
+pub const Uploader = struct {
+    handle: *vku.UploadBatcher,
+};
+
+pub const GeometryBuffers = struct {
+    handle: *vkg.GeometryArena,
+};
+
+/// Where the entity's mesh lives inside the device's geometry arena
+pub const MeshRange = vkg.MeshRange;
+
+/// Batches of the current frame, rebuilt every frame from the drawable entities of the device
+pub const DrawList = struct {
+    handle: *vkdl.DrawList,
+};
+
+/// Binds of the last frame's draw list, against what rebinding for every instance would have cost
+pub const RenderStats = struct {
+    binds: vkdl.BindStats = .{},
+};
+
+pub const DrawMode = enum {
+    /// One `vkCmdDrawIndexed` per batch
+    direct,
+    /// One `vkCmdDrawIndexedIndirect` per texture run
+    indirect,
+    /// As indirect, with the draw count read from a buffer so the GPU can compact the commands
+    indirect_count,
+};
+
+/// How the batches are submitted, defaults to the best mode the device supports and can be lowered at runtime
+pub const DrawSubmission = struct {
+    mode: DrawMode,
+    /// Let the cull compute pass fill in the instance counts, requires one of the indirect modes
+    gpu_culling: bool = false,
+};
+
+pub const CullPipeline = struct {
+    pass: vkcl.CullPass,
+};
+
+/// Present on a device with a compute family separate from graphics. The cull pass is submitted to it ahead of
+/// the frame's graphics work and overlaps with the tail of the previous frame.
+pub const AsyncCompute = struct {
+    /// Null when the device cannot write timestamps on every queue
+    timer: ?*vkac.OverlapTimer,
+};
+
+/// GPU time of the last resolved frame on the compute and graphics queues and how long both were busy at once
+pub const ComputeTimings = vkac.Timings;
+
+/// Timestamp queries around the passes of the graphics submission, only present when the device can write them
+pub const GpuProfiler = struct {
+    handle: *vkgp.GpuProfiler,
+};
+
+/// Singleton with the GPU milliseconds of every pass of the last resolved frame
+pub const GpuTimings = vkgp.GpuTimings;
+
+/// Rebuilds the pipelines in the background when their shader sources change
+pub const ShaderReload = struct {
+    handle: *vkhr.ShaderReloader,
+};
+
+/// Added to an entity whose buffers have been recorded on the upload batcher, removed once the batch has retired
+pub const PendingUpload = struct {
+    ticket: u64,
 };
 
 const DeviceEntity = struct {
@@ -42,11 +149,15 @@ const Surface = struct {
 const Queue = struct {
     graphics: c.VkQueue,
     presentation: c.VkQueue,
+    transfer: c.VkQueue,
+    compute: c.VkQueue,
 };
 
 const QueueIndex = struct {
     graphics: u32,
     presentation: u32,
+    transfer: u32,
+    compute: u32,
 };
 
 const Swapchain = struct {
@@ -55,6 +166,34 @@ const Swapchain = struct {
     format: c.VkFormat,
 };
 
+/// Images the frames render into, the swapchain's or a headless device's offscreen ones
+const RenderTarget = struct {
+    extent: c.VkExtent2D,
+    format: c.VkFormat,
+    /// Layout the render pass leaves the color image in, for presenting it or copying it out
+    final_layout: c.VkImageLayout,
+};
+
+/// Present on a headless device in place of the surface, swapchain and presentation
+const Offscreen = struct {
+    /// Null until the offscreen targets have been created
+    targets: ?*vkos.OffscreenTargets = null,
+    frame_limit: u32,
+    readback_path: ?[]const u8,
+    frames_rendered: u32 = 0,
+    first_frame_at: i128 = 0,
+    last_frame_at: i128 = 0,
+};
+
+/// Singleton the application sets to change how frames are presented, the swapchain follows at the next frame
+pub const PresentPolicy = vks.PresentPolicy;
+
+/// Policy the current swapchain was created with and the pacer timing its frames
+const Presentation = struct {
+    applied: vks.PresentPolicy,
+    pacer: vkpa.FramePacer = .{},
+};
+
 const BufferCount = struct {
     count: u32,
 };
@@ -71,17 +210,32 @@ pub const RenderPass = struct {
 pub const DepthImage = struct {
     image: c.VkImage,
     image_view: c.VkImageView,
-    memory: c.VkDeviceMemory,
+    allocation: vkm.Allocation,
 };
 
 pub const DescriptorSetLayout = struct {
     camera_handle: c.VkDescriptorSetLayout,
     light_handle: c.VkDescriptorSetLayout,
     sampler_handle: c.VkDescriptorSetLayout,
+    object_handle: c.VkDescriptorSetLayout,
 };
 
-pub const UniformBuffers = struct {
-    buffers: []vkds.BufferSet
+/// Per-frame uniform, object and indirect rings and the offsets written into them this frame
+pub const FrameUniforms = struct {
+    ring: *vkun.UniformRing,
+    objects: *vkun.UniformRing,
+    indirect: *vkun.UniformRing,
+    /// Bounds of every instance, read by the cull pass
+    cull_inputs: *vkun.UniformRing,
+    /// Object index of every drawn instance, written by the cull pass or by the CPU when culling is off
+    visible: *vkun.UniformRing,
+    camera_offset: u32 = 0,
+    light_offset: u32 = 0,
+    /// Byte offsets of this frame's indirect commands and run counts
+    command_offset: u32 = 0,
+    count_offset: u32 = 0,
+    instance_count: u32 = 0,
+    frustum: [6][4]f32 = undefined,
 };
 
 pub const DescriptorPool = struct {
@@ -90,9 +244,9 @@ pub const DescriptorPool = struct {
 };
 
 pub const DescriptorSets = struct {
-    view_projection_pipeline1_sets: []c.VkDescriptorSet,
-    view_projection_pipeline2_sets: []c.VkDescriptorSet,
-    light_sets: []c.VkDescriptorSet,
+    camera_set: c.VkDescriptorSet,
+    light_set: c.VkDescriptorSet,
+    object_set: c.VkDescriptorSet,
     // grid_set: c.VkDescriptorSet,
 };
 
@@ -107,41 +261,67 @@ pub const Framebuffers = struct {
     handles: []c.VkFramebuffer,
 };
 
-pub const CommandBuffers = struct {
-    handles: []c.VkCommandBuffer,
+/// Startup options of the Vulkan engine
+pub const EngineOpts = struct {
+    /// Frames the CPU may record ahead of the GPU. Fewer frames lower the input latency, more frames let the CPU
+    /// and GPU overlap when either side stalls.
+    frames_in_flight: u32 = vkfr.DEFAULT_FRAMES_IN_FLIGHT,
+    /// Initial presentation policy, replace the `PresentPolicy` singleton to change it later
+    present: vks.PresentPolicy = .{},
+    /// Render offscreen without a window or surface instead, the only mode on platforms without SDL
+    headless: ?Headless = null,
+    /// Objects a frame can draw, sizes the per-frame object, cull and indirect buffers
+    max_objects: u32 = MAX_OBJECTS,
 };
 
-pub const CommandPool = struct {
-    handle: c.VkCommandPool,
+/// Singleton holding the options of a headless device
+pub const Headless = struct {
+    width: u32 = 800,
+    height: u32 = 600,
+    /// Frames rendered before the world stops, zero keeps rendering until something else stops it
+    frame_count: u32 = 300,
+    /// Where the last frame is written as a binary PPM when the world stops, nothing is read back without it
+    readback_path: ?[]const u8 = null,
+    /// Needs the Khronos validation layer to be installed
+    validation: bool = false,
 };
 
-pub const ImageAvailableSemaphores = struct {
-    handles: []c.VkSemaphore,
+/// Singleton holding the number of frames in flight, fixed for the lifetime of the world
+pub const FramesInFlight = struct {
+    count: u32,
 };
 
-pub const RenderFinishedSemaphores = struct {
-    handles: []c.VkSemaphore,
+/// Singleton holding the number of objects a frame can draw, fixed for the lifetime of the world
+pub const ObjectCapacity = struct {
+    count: u32,
 };
 
-pub const DrawFences = struct {
-    handles: []c.VkFence,
+/// Command pool, primary command buffer and scratch memory of every frame in flight, indexed by `CurrentFrame`
+pub const Frames = struct {
+    handle: *vkfr.FrameContexts,
 };
 
-pub const VertexBuffer = struct {
-    buffer: c.VkBuffer,
-    memory: c.VkDeviceMemory,
-    count: u32,
+/// Records the draws of a frame into secondary command buffers across worker threads
+pub const Recorder = struct {
+    handle: *vkrc.CommandRecorder,
 };
 
-pub const IndexBuffer = struct {
-    buffer: c.VkBuffer,
-    memory: c.VkDeviceMemory,
-    count: u32,
+pub const ImageAvailableSemaphores = struct {
+    handles: []c.VkSemaphore,
+};
+
+pub const RenderFinishedSemaphores = struct {
+    handles: []c.VkSemaphore,
+};
+
+/// Timeline semaphore of every queue, owned by the device entity
+pub const Timelines = struct {
+    handle: *vksync.QueueTimelines,
 };
 
 pub const Texture = struct {
     image: c.VkImage,
-    memory: c.VkDeviceMemory,
+    allocation: vkm.Allocation,
     image_view: c.VkImageView,
     sampler: c.VkSampler,
 };
@@ -158,10 +338,6 @@ pub const ImageIndex = struct {
     index: u32,
 };
 
-pub const LightTransferSpace = struct {
-    values: []scene.Light,
-};
-
 const vk_alloc_callbacks: ?*c.VkAllocationCallbacks = null;
 
 /// Create the device and its associated surface
@@ -182,57 +358,301 @@ fn createDevice(it: *ecs.iter_t) callconv(.C) void {
         };
         const physical_device = vkd.getPhysicalDevice(allocator.alloc, instance.handle, surface, &required_device_extensions) catch |err| {
             std.debug.print("Failed to find a suitable GPU: {}\n", .{err});
+            c.vkDestroySurfaceKHR(instance.handle, surface, null);
+            destroyInstance(instance.handle, instance.debug_messenger);
             return;
         };
         const device = vkd.createLogicalDevice(allocator.alloc, physical_device, &required_device_extensions) catch |err| {
             std.debug.print("Failed to create logical device: {}\n", .{err});
+            c.vkDestroySurfaceKHR(instance.handle, surface, null);
+            destroyInstance(instance.handle, instance.debug_messenger);
             return;
         };
 
-        const new_entity = ecs.new_entity(it.world, "VulkanDevice");
-        _ = ecs.set(it.world, new_entity, Device, .{ 
-            .instance = instance.handle, 
-            .physical = physical_device.handle, 
-            .logical = device.handle, 
-            .debug_messenger = instance.debug_messenger 
-        });
-
+        const new_entity = setUpDevice(it.world, instance, physical_device, device, .{ .width = window.width, .height = window.height }) catch |err| {
+            std.debug.print("Failed to set up device: {}\n", .{err});
+            c.vkDestroyDevice(device.handle, null);
+            c.vkDestroySurfaceKHR(instance.handle, surface, null);
+            destroyInstance(instance.handle, instance.debug_messenger);
+            return;
+        };
         _ = ecs.set(it.world, new_entity, Surface, .{ .handle = surface });
-        _ = ecs.set(it.world, new_entity, core.CanvasSize, . { .width = window.width, .height = window.height });
-        _ = ecs.set(it.world, new_entity, DeviceAlignment, .{ .min_uniform_buffer_offset_alignment = physical_device.min_uniform_buffer_offset_alignment });
-        _ = ecs.set(it.world, new_entity, QueueIndex, .{ 
-            .graphics = physical_device.queue_indices.graphics_queue_location,
-            .presentation = physical_device.queue_indices.presentation_queue_location,
-        });
-        _ = ecs.set(it.world, new_entity, Queue, .{ 
-            .graphics = device.graphics_queue,
-            .presentation = device.presentation_queue,
-        });
     }
 }
 
+/// Create a device without a surface that renders into offscreen images, runs without a window system or GPU as
+/// long as a software driver such as lavapipe is installed
+fn createHeadlessDevice(it: *ecs.iter_t) callconv(.C) void {
+    std.debug.print("Start up: {s}\n", .{ecs.get_name(it.world, it.system).?});
+    const allocator = ecs.singleton_get(it.world, core.Allocator).?;
+    const headless = ecs.singleton_get(it.world, Headless).?;
+
+    const instance = vki.createHeadlessInstance(allocator.alloc, headless.validation) catch |err| {
+        std.debug.print("Failed to create headless instance: {}\n", .{err});
+        return;
+    };
+
+    const physical_device = vkd.getPhysicalDevice(allocator.alloc, instance.handle, null, &.{}) catch |err| {
+        std.debug.print("Failed to find a suitable GPU: {}\n", .{err});
+        destroyInstance(instance.handle, instance.debug_messenger);
+        return;
+    };
+    const device = vkd.createLogicalDevice(allocator.alloc, physical_device, &.{}) catch |err| {
+        std.debug.print("Failed to create logical device: {}\n", .{err});
+        destroyInstance(instance.handle, instance.debug_messenger);
+        return;
+    };
+
+    var properties: c.VkPhysicalDeviceProperties = undefined;
+    c.vkGetPhysicalDeviceProperties(physical_device.handle, &properties);
+    std.debug.print("Headless device: {s}, {d}x{d}\n", .{ std.mem.sliceTo(&properties.deviceName, 0), headless.width, headless.height });
+
+    const new_entity = setUpDevice(it.world, instance, physical_device, device, .{
+        .width = @as(c_int, @intCast(headless.width)),
+        .height = @as(c_int, @intCast(headless.height)),
+    }) catch |err| {
+        std.debug.print("Failed to set up device: {}\n", .{err});
+        c.vkDestroyDevice(device.handle, null);
+        destroyInstance(instance.handle, instance.debug_messenger);
+        return;
+    };
+    _ = ecs.set(it.world, new_entity, Offscreen, .{
+        .frame_limit = headless.frame_count,
+        .readback_path = headless.readback_path,
+    });
+}
+
+/// Create everything the device entity owns apart from its surface, shared by the windowed and headless devices.
+/// On failure nothing it created is left behind, the caller still owns the device and instance.
+fn setUpDevice(world: *ecs.world_t, instance: vki.Instance, physical_device: vkd.PhysicalDevice, device: vkd.Device, canvas_size: core.CanvasSize) !ecs.entity_t {
+    const allocator = ecs.singleton_get(world, core.Allocator).?;
+    const frames_in_flight = ecs.singleton_get(world, FramesInFlight).?.count;
+
+    const memory_allocator = allocator.alloc.create(vkm.DeviceAllocator) catch |err| {
+        std.debug.print("Failed to create memory allocator: {}\n", .{err});
+        return err;
+    };
+    memory_allocator.* = vkm.DeviceAllocator.init(allocator.alloc, physical_device.handle, device.handle, .{});
+    errdefer {
+        memory_allocator.deinit();
+        allocator.alloc.destroy(memory_allocator);
+    }
+
+    const shader_registry = allocator.alloc.create(vksh.ShaderRegistry) catch |err| {
+        std.debug.print("Failed to create shader registry: {}\n", .{err});
+        return err;
+    };
+    shader_registry.* = vksh.ShaderRegistry.init(device.handle);
+    errdefer {
+        shader_registry.deinit();
+        allocator.alloc.destroy(shader_registry);
+    }
+
+    const pipeline_cache = vkpc.loadPipelineCache(allocator.alloc, physical_device.handle, device.handle, vkpc.DEFAULT_CACHE_PATH) catch |err| {
+        std.debug.print("Failed to create pipeline cache: {}\n", .{err});
+        return err;
+    };
+    errdefer c.vkDestroyPipelineCache(device.handle, pipeline_cache.handle, null);
+
+    const timelines = allocator.alloc.create(vksync.QueueTimelines) catch |err| {
+        std.debug.print("Failed to allocate timelines: {}\n", .{err});
+        return err;
+    };
+    errdefer allocator.alloc.destroy(timelines);
+    timelines.* = vksync.QueueTimelines.init(device.handle) catch |err| {
+        std.debug.print("Failed to create timelines: {}\n", .{err});
+        return err;
+    };
+    errdefer timelines.deinit(device.handle);
+
+    const async_compute: ?AsyncCompute = if (physical_device.queue_indices.hasAsyncCompute()) blk: {
+        if (!physical_device.supports_timestamps) {
+            break :blk .{ .timer = null };
+        }
+
+        const timer = allocator.alloc.create(vkac.OverlapTimer) catch |err| {
+            std.debug.print("Failed to allocate overlap timer: {}\n", .{err});
+            return err;
+        };
+        timer.* = vkac.OverlapTimer.init(allocator.alloc, device.handle, frames_in_flight, physical_device.timestamp_period) catch |err| {
+            std.debug.print("Failed to create overlap timer: {}\n", .{err});
+            allocator.alloc.destroy(timer);
+            return err;
+        };
+        break :blk .{ .timer = timer };
+    } else null;
+    errdefer if (async_compute) |compute| {
+        if (compute.timer) |timer| {
+            timer.deinit(device.handle);
+            allocator.alloc.destroy(timer);
+        }
+    }
+
+    const profiler = if (physical_device.supports_timestamps) blk: {
+        const gpu_profiler = allocator.alloc.create(vkgp.GpuProfiler) catch |err| {
+            std.debug.print("Failed to allocate GPU profiler: {}\n", .{err});
+            return err;
+        };
+        gpu_profiler.* = vkgp.GpuProfiler.init(allocator.alloc, device.handle, frames_in_flight, physical_device.timestamp_period) catch |err| {
+            std.debug.print("Failed to create GPU profiler: {}\n", .{err});
+            allocator.alloc.destroy(gpu_profiler);
+            return err;
+        };
+        break :blk gpu_profiler;
+    } else null;
+    errdefer if (profiler) |gpu_profiler| {
+        gpu_profiler.deinit();
+        allocator.alloc.destroy(gpu_profiler);
+    }
+
+    const texture_table = if (physical_device.supports_bindless) blk: {
+        const table = allocator.alloc.create(vkbl.TextureTable) catch |err| {
+            std.debug.print("Failed to allocate texture table: {}\n", .{err});
+            return err;
+        };
+        table.* = vkbl.TextureTable.init(device.handle, physical_device.max_bindless_textures) catch |err| {
+            std.debug.print("Failed to create texture table: {}\n", .{err});
+            allocator.alloc.destroy(table);
+            return err;
+        };
+        std.debug.print("Bindless textures: {d} slots\n", .{table.capacity});
+        break :blk table;
+    } else null;
+    errdefer if (texture_table) |table| {
+        table.deinit(device.handle);
+        allocator.alloc.destroy(table);
+    }
+
+    const new_entity = ecs.new_entity(world, "VulkanDevice");
+    _ = ecs.set(world, new_entity, Device, .{ 
+        .instance = instance.handle, 
+        .physical = physical_device.handle, 
+        .logical = device.handle, 
+        .debug_messenger = instance.debug_messenger 
+    });
+
+    _ = ecs.set(world, new_entity, MemoryAllocator, .{ .handle = memory_allocator });
+    _ = ecs.set(world, new_entity, ShaderModules, .{ .handle = shader_registry });
+    _ = ecs.set(world, new_entity, PipelineCache, .{ .handle = pipeline_cache.handle, .warm = pipeline_cache.warm });
+    _ = ecs.set(world, new_entity, Timelines, .{ .handle = timelines });
+    if (profiler) |gpu_profiler| {
+        _ = ecs.set(world, new_entity, GpuProfiler, .{ .handle = gpu_profiler });
+    }
+    if (async_compute) |compute| {
+        _ = ecs.set(world, new_entity, AsyncCompute, compute);
+        _ = ecs.set(world, new_entity, ComputeTimings, .{});
+    }
+    if (texture_table) |table| {
+        _ = ecs.set(world, new_entity, TextureTable, .{ .handle = table });
+    }
+    _ = ecs.set(world, new_entity, core.CanvasSize, canvas_size);
+    _ = ecs.set(world, new_entity, DeviceAlignment, .{
+        .min_uniform_buffer_offset_alignment = physical_device.min_uniform_buffer_offset_alignment,
+        .min_storage_buffer_offset_alignment = physical_device.min_storage_buffer_offset_alignment,
+    });
+    _ = ecs.set(world, new_entity, QueueIndex, .{ 
+        .graphics = physical_device.queue_indices.graphics_queue_location,
+        .presentation = physical_device.queue_indices.presentation_queue_location,
+        .transfer = physical_device.queue_indices.transfer_queue_location,
+        .compute = physical_device.queue_indices.compute_queue_location,
+    });
+    _ = ecs.set(world, new_entity, Queue, .{ 
+        .graphics = device.graphics_queue,
+        .presentation = device.presentation_queue,
+        .transfer = device.transfer_queue,
+        .compute = device.compute_queue,
+    });
+
+    const draw_mode: DrawMode = if (physical_device.supports_draw_indirect_count) .indirect_count else if (physical_device.supports_multi_draw_indirect) .indirect else .direct;
+    _ = ecs.set(world, new_entity, DrawSubmission, .{ .mode = draw_mode, .gpu_culling = draw_mode != .direct });
+    return new_entity;
+}
+
 /// Destroy the device and its associated surface, this will also destroy the instance
 fn destroyDevice(it: *ecs.iter_t) callconv(.C) void {
     std.debug.print("Shut down: {s}\n", .{ecs.get_name(it.world, it.system).?});
+    const allocator = ecs.singleton_get(it.world, core.Allocator).?;
     const devices = ecs.field(it, Device, 1).?;
-    const surfaces = ecs.field(it, Surface, 2).?;
+    const surfaces = ecs.field(it, Surface, 2);
+    const memory_allocators = ecs.field(it, MemoryAllocator, 3).?;
+    const pipeline_caches = ecs.field(it, PipelineCache, 4).?;
+    const shader_modules = ecs.field(it, ShaderModules, 5).?;
+    const texture_tables = ecs.field(it, TextureTable, 6);
+    const timelines = ecs.field(it, Timelines, 7).?;
+    const async_computes = ecs.field(it, AsyncCompute, 8);
+    const profilers = ecs.field(it, GpuProfiler, 9);
 
     for (0..it.count()) |i| {
         const device = devices[i];
-        const surface = surfaces[i];
+        const memory_allocator = memory_allocators[i];
+        const pipeline_cache = pipeline_caches[i];
 
-        c.vkDestroySurfaceKHR(device.instance, surface.handle, null);
-        c.vkDestroyDevice(device.logical, null);
-        if (device.debug_messenger != null) {
-            const destroyFn = vki.getDestroyDebugUtilsMessengerFn(device.instance).?;
-            destroyFn(device.instance, device.debug_messenger, vk_alloc_callbacks);
+        vkpc.savePipelineCache(allocator.alloc, device.physical, device.logical, pipeline_cache.handle, vkpc.DEFAULT_CACHE_PATH) catch |err| {
+            std.debug.print("Failed to save pipeline cache: {}\n", .{err});
+        };
+        c.vkDestroyPipelineCache(device.logical, pipeline_cache.handle, null);
+
+        shader_modules[i].handle.deinit();
+        allocator.alloc.destroy(shader_modules[i].handle);
+
+        if (texture_tables) |tables| {
+            tables[i].handle.deinit(device.logical);
+            allocator.alloc.destroy(tables[i].handle);
+        }
+
+        timelines[i].handle.deinit(device.logical);
+        allocator.alloc.destroy(timelines[i].handle);
+
+        if (profilers) |gpu_profilers| {
+            const timings = ecs.singleton_get(it.world, GpuTimings).?;
+            for (timings.slice()) |pass| {
+                std.debug.print("GPU pass {s}: {d:.3} ms in the last frame\n", .{ pass.name, pass.ms });
+            }
+            gpu_profilers[i].handle.deinit();
+            allocator.alloc.destroy(gpu_profilers[i].handle);
+        }
+
+        if (async_computes) |computes| {
+            if (computes[i].timer) |timer| {
+                std.debug.print("Async compute: {d:.3} ms compute, {d:.3} ms graphics, {d:.3} ms overlapped in the last frame\n", .{
+                    timer.timings.compute_ms,
+                    timer.timings.graphics_ms,
+                    timer.timings.overlap_ms,
+                });
+                timer.deinit(device.logical);
+                allocator.alloc.destroy(timer);
+            }
+        }
+
+        const stats = memory_allocator.handle.stats();
+        std.debug.print("Device memory: {d} pages, {d} live allocations, {d}/{d} bytes used, {d} vkAllocateMemory calls\n", .{
+            stats.page_count,
+            stats.allocation_count,
+            stats.bytes_used,
+            stats.bytes_reserved,
+            stats.device_allocations,
+        });
+        memory_allocator.handle.deinit();
+        allocator.alloc.destroy(memory_allocator.handle);
+
+        if (surfaces) |surface| {
+            c.vkDestroySurfaceKHR(device.instance, surface[i].handle, null);
         }
-        c.vkDestroyInstance(device.instance, null);
+        c.vkDestroyDevice(device.logical, null);
+        destroyInstance(device.instance, device.debug_messenger);
     }
 
     ecs.quit(it.world);
 }
 
+fn destroyInstance(instance: c.VkInstance, debug_messenger: c.VkDebugUtilsMessengerEXT) void {
+    if (debug_messenger != null) {
+        const destroyFn = vki.getDestroyDebugUtilsMessengerFn(instance).?;
+        destroyFn(instance, debug_messenger, vk_alloc_callbacks);
+    }
+    c.vkDestroyInstance(instance, null);
+}
+
 /// Create the swapchain and its associated image assets
 fn createSwapchain(it: *ecs.iter_t) callconv(.C) void {
     std.debug.print("Start up: {s}\n", .{ecs.get_name(it.world, it.system).?});
@@ -242,24 +662,28 @@ fn createSwapchain(it: *ecs.iter_t) callconv(.C) void {
     const surfaces = ecs.field(it, Surface, 2).?;
     const queue_indexes = ecs.field(it, QueueIndex, 3).?;
     const canvas_sizes = ecs.field(it, core.CanvasSize, 4).?;
+    const memory_allocators = ecs.field(it, MemoryAllocator, 5).?;
+    const policy = ecs.singleton_get(it.world, PresentPolicy).?.*;
 
     for (0..it.count()) |i| {
         const device = devices[i];
         const surface = surfaces[i];
         const queue_index = queue_indexes[i];
         const canvas_size = canvas_sizes[i];
+        const memory_allocator = memory_allocators[i];
 
         const swapchain = vks.createSwapchain(allocator.alloc, device.physical, device.logical, surface.handle, .{
             .graphics_queue_index = queue_index.graphics,
             .presentation_queue_index = queue_index.presentation,
             .window_height = @intCast(canvas_size.width),
             .window_width = @intCast(canvas_size.height),
+            .policy = policy,
         }) catch |err| {
             std.debug.print("Failed to create swapchain: {}\n", .{err});
             return;
         };
 
-        const depth_image = vks.createDepthBufferImage(device.physical, device.logical, swapchain.image_extent) catch |err| {
+        const depth_image = vks.createDepthBufferImage(device.physical, memory_allocator.handle, device.logical, swapchain.image_extent) catch |err| {
             std.debug.print("Failed to create depth image: {}\n", .{err});
             return;
         };
@@ -269,6 +693,11 @@ fn createSwapchain(it: *ecs.iter_t) callconv(.C) void {
             .extent = swapchain.image_extent,
             .format = swapchain.surface_format.format,
         });
+        _ = ecs.set(it.world, it.entities()[i], RenderTarget, .{
+            .extent = swapchain.image_extent,
+            .format = swapchain.surface_format.format,
+            .final_layout = c.VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+        });
         _ = ecs.set(it.world, it.entities()[i], ImageAssets, .{ 
             .images = swapchain.images, 
             .image_views = swapchain.image_views,
@@ -276,9 +705,10 @@ fn createSwapchain(it: *ecs.iter_t) callconv(.C) void {
         _ = ecs.set(it.world, it.entities()[i], DepthImage, .{ 
             .image = depth_image.image, 
             .image_view = depth_image.image_view, 
-            .memory = depth_image.memory,
+            .allocation = depth_image.allocation,
         });
         _ = ecs.set(it.world, it.entities()[i], BufferCount, .{ .count = @as(u32, @intCast(swapchain.images.len)) });
+        _ = ecs.set(it.world, it.entities()[i], Presentation, .{ .applied = policy });
         ecs.enable_id(it.world, it.entities()[i], ecs.id(core.CanvasSize), false);
     }
 }
@@ -292,16 +722,18 @@ fn destroySwapchain(it: *ecs.iter_t) callconv(.C) void {
     const swapchains = ecs.field(it, Swapchain, 2).?;
     const image_assets = ecs.field(it, ImageAssets, 3).?;
     const depth_images = ecs.field(it, DepthImage, 4).?;
+    const memory_allocators = ecs.field(it, MemoryAllocator, 5).?;
 
     for (0..it.count()) |i| {
         const device = devices[i];
         const swapchain = swapchains[i];
         const assets = image_assets[i];
         const depth_image = depth_images[i];
+        const memory_allocator = memory_allocators[i];
 
         c.vkDestroyImageView(device.logical, depth_image.image_view, null);
         c.vkDestroyImage(device.logical, depth_image.image, null);
-        c.vkFreeMemory(device.logical, depth_image.memory, null);
+        memory_allocator.handle.free(depth_image.allocation);
 
         for (assets.image_views) |image_view| {
             c.vkDestroyImageView(device.logical, image_view, null);
@@ -315,33 +747,122 @@ fn destroySwapchain(it: *ecs.iter_t) callconv(.C) void {
     }
 }
 
+/// Create the offscreen color images and depth image a headless device renders into, the stand-in for its swapchain
+fn createOffscreenTargets(it: *ecs.iter_t) callconv(.C) void {
+    std.debug.print("Start up: {s}\n", .{ecs.get_name(it.world, it.system).?});
+    const allocator = ecs.singleton_get(it.world, core.Allocator).?;
+    const frames_in_flight = ecs.singleton_get(it.world, FramesInFlight).?.count;
+
+    const devices = ecs.field(it, Device, 1).?;
+    const offscreens = ecs.field(it, Offscreen, 2).?;
+    const canvas_sizes = ecs.field(it, core.CanvasSize, 3).?;
+    const memory_allocators = ecs.field(it, MemoryAllocator, 4).?;
+
+    for (0..it.count()) |i| {
+        const device = devices[i];
+        const memory_allocator = memory_allocators[i];
+        const extent = c.VkExtent2D{
+            .width = @as(u32, @intCast(canvas_sizes[i].width)),
+            .height = @as(u32, @intCast(canvas_sizes[i].height)),
+        };
+
+        const targets = allocator.alloc.create(vkos.OffscreenTargets) catch |err| {
+            std.debug.print("Failed to allocate offscreen targets: {}\n", .{err});
+            return;
+        };
+        // One image per frame in flight, the frame index doubles as the image index
+        targets.* = vkos.OffscreenTargets.init(allocator.alloc, memory_allocator.handle, device.logical, extent, frames_in_flight) catch |err| {
+            std.debug.print("Failed to create offscreen targets: {}\n", .{err});
+            allocator.alloc.destroy(targets);
+            return;
+        };
+
+        const depth_image = vks.createDepthBufferImage(device.physical, memory_allocator.handle, device.logical, extent) catch |err| {
+            std.debug.print("Failed to create depth image: {}\n", .{err});
+            targets.deinit(device.logical, memory_allocator.handle);
+            allocator.alloc.destroy(targets);
+            return;
+        };
+
+        offscreens[i].targets = targets;
+        _ = ecs.set(it.world, it.entities()[i], RenderTarget, .{
+            .extent = extent,
+            .format = vkos.COLOR_FORMAT,
+            .final_layout = vkos.FINAL_LAYOUT,
+        });
+        // Borrowed from the targets, which free them
+        _ = ecs.set(it.world, it.entities()[i], ImageAssets, .{
+            .images = targets.images,
+            .image_views = targets.image_views,
+        });
+        _ = ecs.set(it.world, it.entities()[i], DepthImage, .{
+            .image = depth_image.image,
+            .image_view = depth_image.image_view,
+            .allocation = depth_image.allocation,
+        });
+        _ = ecs.set(it.world, it.entities()[i], BufferCount, .{ .count = frames_in_flight });
+        ecs.enable_id(it.world, it.entities()[i], ecs.id(core.CanvasSize), false);
+    }
+}
+
+fn destroyOffscreenTargets(it: *ecs.iter_t) callconv(.C) void {
+    std.debug.print("Shut down: {s}\n", .{ecs.get_name(it.world, it.system).?});
+    const allocator = ecs.singleton_get(it.world, core.Allocator).?;
+
+    const devices = ecs.field(it, Device, 1).?;
+    const offscreens = ecs.field(it, Offscreen, 2).?;
+    const depth_images = ecs.field(it, DepthImage, 3).?;
+    const memory_allocators = ecs.field(it, MemoryAllocator, 4).?;
+
+    for (0..it.count()) |i| {
+        const device = devices[i];
+        const depth_image = depth_images[i];
+        const memory_allocator = memory_allocators[i];
+
+        c.vkDestroyImageView(device.logical, depth_image.image_view, null);
+        c.vkDestroyImage(device.logical, depth_image.image, null);
+        memory_allocator.handle.free(depth_image.allocation);
+
+        if (offscreens[i].targets) |targets| {
+            targets.deinit(device.logical, memory_allocator.handle);
+            allocator.alloc.destroy(targets);
+            offscreens[i].targets = null;
+        }
+
+        ecs.remove(it.world, it.entities()[i], ImageAssets);
+    }
+}
+
 fn createRenderPass(it: *ecs.iter_t) callconv(.C) void {
     std.debug.print("Start up: {s}\n", .{ecs.get_name(it.world, it.system).?});
     const allocator = ecs.singleton_get(it.world, core.Allocator).?;
     const devices = ecs.field(it, Device, 1).?;
-    const swapchains = ecs.field(it, Swapchain, 2).?;
+    const render_targets = ecs.field(it, RenderTarget, 2).?;
     const buffer_counts = ecs.field(it, BufferCount, 3).?;
     const device_alignments = ecs.field(it, DeviceAlignment, 4).?;
     const depth_images = ecs.field(it, DepthImage, 5).?;
     const images_assets = ecs.field(it, ImageAssets, 6).?;
+    const memory_allocators = ecs.field(it, MemoryAllocator, 7).?;
+    const pipeline_caches = ecs.field(it, PipelineCache, 8).?;
+    const shader_modules = ecs.field(it, ShaderModules, 9).?;
+    const texture_tables = ecs.field(it, TextureTable, 10);
+    const queue_indices = ecs.field(it, QueueIndex, 11).?;
+    const frames_in_flight = ecs.singleton_get(it.world, FramesInFlight).?.count;
+    const max_objects = ecs.singleton_get(it.world, ObjectCapacity).?.count;
 
     for (it.entities(), 0..it.count()) |e, i| {
         const device = devices[i];
         const device_alignment = device_alignments[i];
-        const swapchain = swapchains[i];
+        // The rings the cull pass reads and writes are shared with the async compute queue instead of handed over every frame
+        const shared_families = [2]u32{ queue_indices[i].graphics, queue_indices[i].compute };
+        const compute_sharing: []const u32 = if (queue_indices[i].compute != queue_indices[i].graphics) &shared_families else &.{};
+        const render_target = render_targets[i];
         const buffer_count = buffer_counts[i];
         const depth_image = depth_images[i];
         const image_assets = images_assets[i];
+        const memory_allocator = memory_allocators[i];
 
-        const model_uniform_alignment = vkds.padWithBufferOffset(@sizeOf(scene.UBO), device_alignment.min_uniform_buffer_offset_alignment);
-        const light_uniform_alignment = vkds.padWithBufferOffset(@sizeOf(scene.Light), device_alignment.min_uniform_buffer_offset_alignment);
-
-        const light_transfer_space = vkds.allocateTransferSpace(allocator.alloc, device_alignment.min_uniform_buffer_offset_alignment, 1000, scene.Light) catch |err| {
-            std.debug.print("Failed to allocate light transfer space: {}\n", .{err});
-            return;
-        };
-
-        const render_pass = vkr.createRenderPass(device.physical, device.logical, swapchain.format) catch |err| {
+        const render_pass = vkr.createRenderPass(device.physical, device.logical, render_target.format, render_target.final_layout) catch |err| {
             std.debug.print("Failed to create render pass: {}\n", .{err});
             return;
         };
@@ -362,8 +883,13 @@ fn createRenderPass(it: *ecs.iter_t) callconv(.C) void {
             return;
         };
 
+        const object_descriptor_set_layout = vkds.createObjectDescriptorSetLayout(device.logical) catch |err| {
+            std.debug.print("Failed to create object descriptor set layout: {}\n", .{err});
+            return;
+        };
+
         // Descriptor Pools
-        const descriptor_pool = vkds.createDescriptorPool(device.logical, buffer_count.count) catch |err| {
+        const descriptor_pool = vkds.createDescriptorPool(device.logical) catch |err| {
             std.debug.print("Failed to create descriptor pool: {}\n", .{err});
             return;
         };
@@ -373,57 +899,181 @@ fn createRenderPass(it: *ecs.iter_t) callconv(.C) void {
             return;
         };
 
-        // Uniform Buffers
-        const uniform_buffers = vkds.createUniformBuffers(allocator.alloc, .{
-            .physical_device = device.physical,
+        // Uniform Ring, one region per frame in flight that stays mapped for the lifetime of the device
+        const uniform_ring = allocator.alloc.create(vkun.UniformRing) catch |err| {
+            std.debug.print("Failed to allocate uniform ring: {}\n", .{err});
+            return;
+        };
+
+        uniform_ring.* = vkun.UniformRing.init(.{
+            .allocator = memory_allocator.handle,
+            .device = device.logical,
+            .frame_count = frames_in_flight,
+            .min_offset_alignment = device_alignment.min_uniform_buffer_offset_alignment,
+        }) catch |err| {
+            std.debug.print("Failed to create uniform ring: {}\n", .{err});
+            return;
+        };
+
+        // Object Ring, a packed array of `scene.ObjectData` per frame that the vertex shader indexes by instance
+        const object_ring = allocator.alloc.create(vkun.UniformRing) catch |err| {
+            std.debug.print("Failed to allocate object ring: {}\n", .{err});
+            return;
+        };
+
+        object_ring.* = vkun.UniformRing.init(.{
+            .allocator = memory_allocator.handle,
+            .device = device.logical,
+            .frame_count = frames_in_flight,
+            .min_offset_alignment = device_alignment.min_storage_buffer_offset_alignment,
+            .frame_size = @as(u64, max_objects) * @sizeOf(scene.ObjectData),
+            .usage = c.VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            .queue_families = compute_sharing,
+        }) catch |err| {
+            std.debug.print("Failed to create object ring: {}\n", .{err});
+            return;
+        };
+
+        // Indirect Ring, the commands of every batch followed by the batch count of every texture run
+        const indirect_ring = allocator.alloc.create(vkun.UniformRing) catch |err| {
+            std.debug.print("Failed to allocate indirect ring: {}\n", .{err});
+            return;
+        };
+
+        indirect_ring.* = vkun.UniformRing.init(.{
+            .allocator = memory_allocator.handle,
+            .device = device.logical,
+            .frame_count = frames_in_flight,
+            // The commands are also bound as a storage buffer for the cull pass
+            .min_offset_alignment = @max(device_alignment.min_storage_buffer_offset_alignment, @alignOf(c.VkDrawIndexedIndirectCommand)),
+            .frame_size = @as(u64, max_objects) * (@sizeOf(c.VkDrawIndexedIndirectCommand) + @sizeOf(u32)),
+            .usage = c.VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | c.VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            .queue_families = compute_sharing,
+        }) catch |err| {
+            std.debug.print("Failed to create indirect ring: {}\n", .{err});
+            return;
+        };
+
+        const cull_input_ring = allocator.alloc.create(vkun.UniformRing) catch |err| {
+            std.debug.print("Failed to allocate cull input ring: {}\n", .{err});
+            return;
+        };
+
+        cull_input_ring.* = vkun.UniformRing.init(.{
+            .allocator = memory_allocator.handle,
+            .device = device.logical,
+            .frame_count = frames_in_flight,
+            .min_offset_alignment = device_alignment.min_storage_buffer_offset_alignment,
+            .frame_size = @as(u64, max_objects) * @sizeOf(vkcl.CullInput),
+            .usage = c.VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            .queue_families = compute_sharing,
+        }) catch |err| {
+            std.debug.print("Failed to create cull input ring: {}\n", .{err});
+            return;
+        };
+
+        const visible_ring = allocator.alloc.create(vkun.UniformRing) catch |err| {
+            std.debug.print("Failed to allocate visible ring: {}\n", .{err});
+            return;
+        };
+
+        visible_ring.* = vkun.UniformRing.init(.{
+            .allocator = memory_allocator.handle,
             .device = device.logical,
-            .buffer_count = buffer_count.count,
-            .model_memory_alignment = model_uniform_alignment,
-            .light_memory_alignment = light_uniform_alignment,
-            .max_objects = MAX_OBJECTS,
+            .frame_count = frames_in_flight,
+            .min_offset_alignment = device_alignment.min_storage_buffer_offset_alignment,
+            .frame_size = @as(u64, max_objects) * @sizeOf(u32),
+            .usage = c.VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            .queue_families = compute_sharing,
         }) catch |err| {
-            std.debug.print("Failed to create uniform buffers: {}\n", .{err});
+            std.debug.print("Failed to create visible ring: {}\n", .{err});
+            return;
+        };
+
+        const draw_list = allocator.alloc.create(vkdl.DrawList) catch |err| {
+            std.debug.print("Failed to allocate draw list: {}\n", .{err});
             return;
         };
+        draw_list.* = vkdl.DrawList.init(allocator.alloc);
+        draw_list.bindless = texture_tables != null;
+
+        // The bindless fragment shader samples the texture table in place of the per texture set
+        const texture_set_layout = if (texture_tables) |tables| tables[i].handle.layout else sampler_descriptor_set_layout.handle;
+        const fragment_shader: vksh.Name = if (texture_tables != null) .shader_bindless_frag else .shader_frag;
 
-        
         // Descriptor Sets
-        const descriptor_sets = vkds.createDescriptorSets(allocator.alloc, buffer_count.count, device.logical, descriptor_pool.handle, camera_descriptor_set_layout.handle, light_descriptor_set_layout.handle, uniform_buffers, light_uniform_alignment) catch |err| {
+        const descriptor_sets = vkds.createDescriptorSets(.{
+            .device = device.logical,
+            .descriptor_pool = descriptor_pool.handle,
+            .camera_set_layout = camera_descriptor_set_layout.handle,
+            .light_set_layout = light_descriptor_set_layout.handle,
+            .object_set_layout = object_descriptor_set_layout.handle,
+            .uniform_buffer = uniform_ring.buffer.handle,
+            .object_buffer = object_ring.buffer.handle,
+            .object_range = object_ring.frame_size,
+            .visible_buffer = visible_ring.buffer.handle,
+            .visible_range = visible_ring.frame_size,
+        }) catch |err| {
             std.debug.print("Failed to create descriptor sets: {}\n", .{err});
             return;
         };
 
-        const push_constant_range = c.VkPushConstantRange{
-            .stageFlags = c.VK_SHADER_STAGE_VERTEX_BIT,
-            .offset = 0,
-            .size = @sizeOf(scene.Transform),
+        // Creation time shows how much shader compilation the pipeline cache saved
+        const pipeline_start = std.time.nanoTimestamp();
+
+        const cull_pass = vkcl.CullPass.init(.{
+            .device = device.logical,
+            .shaders = shader_modules[i].handle,
+            .descriptor_pool = descriptor_pool.handle,
+            .pipeline_cache = pipeline_caches[i].handle,
+            .buffers = .{
+                .objects = object_ring.buffer.handle,
+                .objects_range = object_ring.frame_size,
+                .inputs = cull_input_ring.buffer.handle,
+                .inputs_range = cull_input_ring.frame_size,
+                .commands = indirect_ring.buffer.handle,
+                .commands_range = @as(u64, max_objects) * @sizeOf(c.VkDrawIndexedIndirectCommand),
+                .visible = visible_ring.buffer.handle,
+                .visible_range = visible_ring.frame_size,
+            },
+        }) catch |err| {
+            std.debug.print("Failed to create cull pass: {}\n", .{err});
+            return;
         };
 
-        const set_layouts = [_]c.VkDescriptorSetLayout{ camera_descriptor_set_layout.handle, light_descriptor_set_layout.handle, sampler_descriptor_set_layout.handle };
-        const pipeline = vkp.createGraphicsPipeline(allocator.alloc, .{
+        const set_layouts = [_]c.VkDescriptorSetLayout{ camera_descriptor_set_layout.handle, light_descriptor_set_layout.handle, texture_set_layout, object_descriptor_set_layout.handle };
+        const pipeline = vkp.createGraphicsPipeline(.{
             .device = device.logical,
-            .swapchain_extent = swapchain.extent,
+            .shaders = shader_modules[i].handle,
+            .swapchain_extent = render_target.extent,
             .render_pass = render_pass.handle,
-            .push_constant_range = push_constant_range,
+            .pipeline_cache = pipeline_caches[i].handle,
+            .fragment = fragment_shader,
         }, set_layouts) catch |err| {
             std.debug.print("Failed to create graphics pipeline: {}\n", .{err});
             return;
         };
 
         const grid_set_layouts = [_]c.VkDescriptorSetLayout{ camera_descriptor_set_layout.handle };
-        const grid_pipeline = vkp.createGridPipeline(allocator.alloc, .{
+        const grid_pipeline = vkp.createGridPipeline(.{
             .device = device.logical,
-            .swapchain_extent = swapchain.extent,
+            .shaders = shader_modules[i].handle,
+            .swapchain_extent = render_target.extent,
             .render_pass = render_pass.handle,
-            .push_constant_range = push_constant_range,
+            .pipeline_cache = pipeline_caches[i].handle,
         }, grid_set_layouts) catch |err| {
             std.debug.print("Failed to create grid pipeline: {}\n", .{err});
             return;
         };
 
+        std.debug.print("Pipelines created in {d:.2} ms ({s} pipeline cache)\n", .{
+            @as(f64, @floatFromInt(std.time.nanoTimestamp() - pipeline_start)) / std.time.ns_per_ms,
+            if (pipeline_caches[i].warm) "warm" else "cold",
+        });
+
         const swapchain_framebuffers = vks.createFramebuffer2(allocator.alloc, .{
             .device = device.logical,
-            .extent = swapchain.extent,
+            .extent = render_target.extent,
             .image_views = image_assets.image_views,
             .image_count = buffer_count.count,
             .render_pass = render_pass.handle,
@@ -437,13 +1087,23 @@ fn createRenderPass(it: *ecs.iter_t) callconv(.C) void {
         _ = ecs.set(it.world, e, DescriptorSetLayout, .{ 
             .camera_handle = camera_descriptor_set_layout.handle, 
             .light_handle = light_descriptor_set_layout.handle,
-            .sampler_handle = sampler_descriptor_set_layout.handle});
-        _ = ecs.set(it.world, e, UniformBuffers, .{ .buffers = uniform_buffers });
+            .sampler_handle = sampler_descriptor_set_layout.handle,
+            .object_handle = object_descriptor_set_layout.handle});
+        _ = ecs.set(it.world, e, FrameUniforms, .{ 
+            .ring = uniform_ring, 
+            .objects = object_ring, 
+            .indirect = indirect_ring,
+            .cull_inputs = cull_input_ring,
+            .visible = visible_ring,
+        });
+        _ = ecs.set(it.world, e, CullPipeline, .{ .pass = cull_pass });
+        _ = ecs.set(it.world, e, DrawList, .{ .handle = draw_list });
+        _ = ecs.set(it.world, e, RenderStats, .{});
         _ = ecs.set(it.world, e, DescriptorPool, .{ .handle = descriptor_pool.handle, .sampler_handle = sampler_descriptor_pool.handle});
         _ = ecs.set(it.world, e, DescriptorSets, .{ 
-            .view_projection_pipeline1_sets = descriptor_sets.view_projection_pipeline1,
-            .view_projection_pipeline2_sets = descriptor_sets.view_projection_pipeline2,
-            .light_sets = descriptor_sets.light_sets,
+            .camera_set = descriptor_sets.camera,
+            .light_set = descriptor_sets.light,
+            .object_set = descriptor_sets.objects,
         });
         _ = ecs.set(it.world, e, Pipeline, .{ 
             .graphics_handle = pipeline.handle, 
@@ -451,10 +1111,28 @@ fn createRenderPass(it: *ecs.iter_t) callconv(.C) void {
             .grid_handle = grid_pipeline.handle,
             .grid_layout = grid_pipeline.layout,
         });
+        const shader_reloader = allocator.alloc.create(vkhr.ShaderReloader) catch |err| {
+            std.debug.print("Failed to allocate shader reloader: {}\n", .{err});
+            return;
+        };
+        shader_reloader.* = vkhr.ShaderReloader.init(allocator.alloc, shader_modules[i].handle, .{
+            .device = device.logical,
+            .render_pass = render_pass.handle,
+            .swapchain_extent = render_target.extent,
+            .pipeline_cache = pipeline_caches[i].handle,
+            .graphics_layouts = set_layouts,
+            .graphics_fragment = fragment_shader,
+            .grid_layouts = grid_set_layouts,
+            .cull_layout = cull_pass.set_layout,
+        });
+        shader_reloader.start() catch |err| {
+            std.debug.print("Failed to start shader reloader: {}\n", .{err});
+        };
+
+        _ = ecs.set(it.world, e, ShaderReload, .{ .handle = shader_reloader });
         _ = ecs.set(it.world, e, Framebuffers, .{ .handles = swapchain_framebuffers.handles });
         _ = ecs.set(it.world, e, CurrentFrame, .{ .index = 0 });
         _ = ecs.set(it.world, e, ImageIndex, .{ .index = 0 });
-        _ = ecs.set(it.world, e, LightTransferSpace, .{ .values = light_transfer_space });
     } 
 }
 
@@ -465,17 +1143,22 @@ fn destroyRenderPass(it: *ecs.iter_t) callconv(.C) void {
     const devices = ecs.field(it, Device, 1).?;
     const render_passes = ecs.field(it, RenderPass, 2).?;
     const descriptor_set_layouts = ecs.field(it, DescriptorSetLayout, 3).?;
-    const uniform_buffers = ecs.field(it, UniformBuffers, 4).?;
+    const frame_uniforms = ecs.field(it, FrameUniforms, 4).?;
     const descriptor_pools = ecs.field(it, DescriptorPool, 5).?;
-    const descriptor_sets = ecs.field(it, DescriptorSets, 6).?;
-    const pipelines = ecs.field(it, Pipeline, 7).?;
-    const framebuffers = ecs.field(it, Framebuffers, 8).?;
-    const light_transfer_spaces = ecs.field(it, LightTransferSpace, 9).?;
+    const pipelines = ecs.field(it, Pipeline, 6).?;
+    const framebuffers = ecs.field(it, Framebuffers, 7).?;
+    const memory_allocators = ecs.field(it, MemoryAllocator, 8).?;
+    const draw_lists = ecs.field(it, DrawList, 9).?;
+    const cull_pipelines = ecs.field(it, CullPipeline, 10).?;
+    const shader_reloads = ecs.field(it, ShaderReload, 11).?;
 
     for (0..it.count()) |i| {
         const device = devices[i];
+        const memory_allocator = memory_allocators[i];
 
-        allocator.alloc.free(light_transfer_spaces[i].values);
+        // Joins the watcher before the pipelines it rebuilds from go away
+        shader_reloads[i].handle.deinit();
+        allocator.alloc.destroy(shader_reloads[i].handle);
 
         for (framebuffers[i].handles) |handle| {
             c.vkDestroyFramebuffer(device.logical, handle, null);
@@ -484,22 +1167,29 @@ fn destroyRenderPass(it: *ecs.iter_t) callconv(.C) void {
         c.vkDestroyPipeline(device.logical, pipelines[i].graphics_handle, null);
         c.vkDestroyPipeline(device.logical, pipelines[i].grid_handle, null);
 
-        for (uniform_buffers[i].buffers) |uniform_buffer| {
-            uniform_buffer.deleteAndFree(device.logical);
-        }
-        allocator.alloc.free(uniform_buffers[i].buffers);
+        frame_uniforms[i].ring.deinit(device.logical, memory_allocator.handle);
+        allocator.alloc.destroy(frame_uniforms[i].ring);
+        frame_uniforms[i].objects.deinit(device.logical, memory_allocator.handle);
+        allocator.alloc.destroy(frame_uniforms[i].objects);
+        frame_uniforms[i].indirect.deinit(device.logical, memory_allocator.handle);
+        allocator.alloc.destroy(frame_uniforms[i].indirect);
+        frame_uniforms[i].cull_inputs.deinit(device.logical, memory_allocator.handle);
+        allocator.alloc.destroy(frame_uniforms[i].cull_inputs);
+        frame_uniforms[i].visible.deinit(device.logical, memory_allocator.handle);
+        allocator.alloc.destroy(frame_uniforms[i].visible);
+        cull_pipelines[i].pass.deinit(device.logical);
+        draw_lists[i].handle.deinit();
+        allocator.alloc.destroy(draw_lists[i].handle);
 
         c.vkDestroyDescriptorPool(device.logical, descriptor_pools[i].handle, null);
         c.vkDestroyDescriptorPool(device.logical, descriptor_pools[i].sampler_handle, null);
-        allocator.alloc.free(descriptor_sets[i].view_projection_pipeline1_sets);
-        allocator.alloc.free(descriptor_sets[i].view_projection_pipeline2_sets);
-        allocator.alloc.free(descriptor_sets[i].light_sets);
 
         c.vkDestroyPipelineLayout(device.logical, pipelines[i].graphics_layout, null);
         c.vkDestroyPipelineLayout(device.logical, pipelines[i].grid_layout, null);
         c.vkDestroyDescriptorSetLayout(device.logical, descriptor_set_layouts[i].camera_handle, null);
         c.vkDestroyDescriptorSetLayout(device.logical, descriptor_set_layouts[i].light_handle, null);
         c.vkDestroyDescriptorSetLayout(device.logical, descriptor_set_layouts[i].sampler_handle, null);
+        c.vkDestroyDescriptorSetLayout(device.logical, descriptor_set_layouts[i].object_handle, null);
 
         c.vkDestroyRenderPass(device.logical, render_passes[i].handle, null);
     }
@@ -510,43 +1200,55 @@ fn createCommandBuffers(it: *ecs.iter_t) callconv(.C) void {
     const allocator = ecs.singleton_get(it.world, core.Allocator).?;
     const devices = ecs.field(it, Device, 1).?;
     const queue = ecs.field(it, QueueIndex, 2).?;
-    const buffer_counts = ecs.field(it, BufferCount, 3).?;
+    const frames_in_flight = ecs.singleton_get(it.world, FramesInFlight).?.count;
 
     for (0..it.count()) |i| {
         const device = devices[i];
         const queue_index = queue[i];
-        const buffer_count = buffer_counts[i];
 
-        const graphics_command_pool = vkc.createCommandPool(device.logical, queue_index.graphics) catch |err| {
-            std.debug.print("Failed to create command pool: {}\n", .{err});
+        const frames = allocator.alloc.create(vkfr.FrameContexts) catch |err| {
+            std.debug.print("Failed to allocate frame contexts: {}\n", .{err});
             return;
         };
-
-        const command_buffers = vkc.createCommandBuffers(allocator.alloc, device.logical, graphics_command_pool.handle, buffer_count.count) catch |err| {
-            std.debug.print("Failed to create command buffers: {}\n", .{err});
+        frames.* = vkfr.FrameContexts.init(allocator.alloc, .{
+            .device = device.logical,
+            .queue_family_index = queue_index.graphics,
+            .compute_queue_family_index = if (queue_index.compute != queue_index.graphics) queue_index.compute else null,
+            .frame_count = frames_in_flight,
+        }) catch |err| {
+            std.debug.print("Failed to create frame contexts: {}\n", .{err});
+            allocator.alloc.destroy(frames);
             return;
         };
 
-        const image_available_semaphores = vksync.createSemaphores(allocator.alloc, device.logical, MAX_FRAME_DRAWS) catch |err| {
-            std.debug.print("Failed to create image available semaphores: {}\n", .{err});
+        const recorder = allocator.alloc.create(vkrc.CommandRecorder) catch |err| {
+            std.debug.print("Failed to allocate command recorder: {}\n", .{err});
+            return;
+        };
+        recorder.init(allocator.alloc, .{
+            .device = device.logical,
+            .queue_family_index = queue_index.graphics,
+            .frame_count = frames_in_flight,
+        }) catch |err| {
+            std.debug.print("Failed to create command recorder: {}\n", .{err});
+            allocator.alloc.destroy(recorder);
             return;
         };
 
-        const render_finished_semaphores = vksync.createSemaphores(allocator.alloc, device.logical, MAX_FRAME_DRAWS) catch |err| {
-            std.debug.print("Failed to create render finished semaphores: {}\n", .{err});
+        const image_available_semaphores = vksync.createSemaphores(allocator.alloc, device.logical, frames_in_flight) catch |err| {
+            std.debug.print("Failed to create image available semaphores: {}\n", .{err});
             return;
         };
 
-        const draw_fences = vksync.createFences(allocator.alloc, device.logical, MAX_FRAME_DRAWS) catch |err| {
-            std.debug.print("Failed to create draw fences: {}\n", .{err});
+        const render_finished_semaphores = vksync.createSemaphores(allocator.alloc, device.logical, frames_in_flight) catch |err| {
+            std.debug.print("Failed to create render finished semaphores: {}\n", .{err});
             return;
         };
 
-        _ = ecs.set(it.world, it.entities()[i], CommandPool, .{ .handle = graphics_command_pool.handle });
-        _ = ecs.set(it.world, it.entities()[i], CommandBuffers, .{ .handles = command_buffers.handles });
+        _ = ecs.set(it.world, it.entities()[i], Frames, .{ .handle = frames });
+        _ = ecs.set(it.world, it.entities()[i], Recorder, .{ .handle = recorder });
         _ = ecs.set(it.world, it.entities()[i], ImageAvailableSemaphores, .{ .handles = image_available_semaphores.handles });
         _ = ecs.set(it.world, it.entities()[i], RenderFinishedSemaphores, .{ .handles = render_finished_semaphores.handles });
-        _ = ecs.set(it.world, it.entities()[i], DrawFences, .{ .handles = draw_fences.handles });
     }
 }
 
@@ -554,32 +1256,28 @@ fn destroyCommandBuffers(it: *ecs.iter_t) callconv(.C) void {
     std.debug.print("Shut down: {s}\n", .{ecs.get_name(it.world, it.system).?});
     const allocator = ecs.singleton_get(it.world, core.Allocator).?;
     const devices = ecs.field(it, Device, 1).?;
-    const command_pools = ecs.field(it, CommandPool, 2).?;
-    const command_buffers = ecs.field(it, CommandBuffers, 3).?;
-    const image_available_semaphores = ecs.field(it, ImageAvailableSemaphores, 4).?;
-    const render_finished_semaphores = ecs.field(it, RenderFinishedSemaphores, 5).?;
-    const draw_fences = ecs.field(it, DrawFences, 6).?;
+    const frames = ecs.field(it, Frames, 2).?;
+    const image_available_semaphores = ecs.field(it, ImageAvailableSemaphores, 3).?;
+    const render_finished_semaphores = ecs.field(it, RenderFinishedSemaphores, 4).?;
+    const recorders = ecs.field(it, Recorder, 5).?;
 
     for (0..it.count()) |i| {
         const device = devices[i];
-        const command_pool = command_pools[i];
-        const command_buffer = command_buffers[i];
         const image_available_semaphore = image_available_semaphores[i];
         const render_finished_semaphore = render_finished_semaphores[i];
-        const draw_fence = draw_fences[i];
 
-        for (0..MAX_FRAME_DRAWS) |j| {
-            c.vkDestroyFence(device.logical, draw_fence.handles[j], null);
+        for (0..frames[i].handle.count()) |j| {
             c.vkDestroySemaphore(device.logical, image_available_semaphore.handles[j], null);
             c.vkDestroySemaphore(device.logical, render_finished_semaphore.handles[j], null);
         }
 
-        c.vkDestroyCommandPool(device.logical, command_pool.handle, null);
-        // TODO: Do I need to destroy these buffers?
-        allocator.alloc.free(command_buffer.handles);
+        recorders[i].handle.deinit();
+        allocator.alloc.destroy(recorders[i].handle);
+
+        frames[i].handle.deinit();
+        allocator.alloc.destroy(frames[i].handle);
         allocator.alloc.free(image_available_semaphore.handles);
         allocator.alloc.free(render_finished_semaphore.handles);
-        allocator.alloc.free(draw_fence.handles);
     }
 }
 
@@ -587,11 +1285,11 @@ fn destroyCommandBuffers(it: *ecs.iter_t) callconv(.C) void {
 fn createMeshBuffers(it: *ecs.iter_t) callconv(.C) void {
     std.debug.print("Update Mesh System: {s}\n", .{ecs.get_name(it.world, it.system).?});
     const meshes = ecs.field(it, scene.Mesh, 1).?;
+    const borrowed_meshes = ecs.field(it, scene.BorrowedMesh, 4);
 
     var device_query_desc = ecs.filter_desc_t{};
-    device_query_desc.terms[0] = .{ .id = ecs.id(Device), .inout = ecs.inout_kind_t.In };
-    device_query_desc.terms[1] = .{ .id = ecs.id(Queue), .inout = ecs.inout_kind_t.In };
-    device_query_desc.terms[2] = .{ .id = ecs.id(CommandPool), .inout = ecs.inout_kind_t.In };
+    device_query_desc.terms[0] = .{ .id = ecs.id(Uploader), .inout = ecs.inout_kind_t.In };
+    device_query_desc.terms[1] = .{ .id = ecs.id(GeometryBuffers), .inout = ecs.inout_kind_t.In };
     const filter = ecs.filter_init(it.world, &device_query_desc) catch |err| {
         std.debug.print("Failed to create device query: {}\n", .{err});
         return;
@@ -601,63 +1299,184 @@ fn createMeshBuffers(it: *ecs.iter_t) callconv(.C) void {
     var query_iter = ecs.filter_iter(it.world, filter);
     while (ecs.filter_next(&query_iter)) {
         for(query_iter.entities()) |e| {
-            const device = ecs.get(query_iter.world, e, Device).?;
-            const queue = ecs.get(query_iter.world, e, Queue).?;
-            const command_pool = ecs.get(query_iter.world, e, CommandPool).?;
+            const uploader = ecs.get(query_iter.world, e, Uploader).?;
+            const geometry = ecs.get(query_iter.world, e, GeometryBuffers).?;
 
             for (0..it.count()) |i| {
                 const mesh = meshes[i];
-                var buffer = vkb.createVertexBuffer(mesh.vertices, .{
-                    .device = device.logical,
-                    .physical_device = device.physical,
-                    .transfer_queue = queue.graphics,
-                    .transfer_command_pool = command_pool.handle
-                }) catch |err| {
-                    std.debug.print("Failed to create vertex buffer: {}\n", .{err});
-                    return;
-                };
-
-                // const buffer_entity = ecs.new_id(it.world);
-                _ = ecs.set(it.world, it.entities()[i], VertexBuffer, .{ .buffer = buffer.vertex_buffer, .memory = buffer.vertex_memory, .count = @as(u32, @intCast(mesh.vertices.len)) });
+                const entity = it.entities()[i];
+                const source = if (borrowed_meshes) |borrowed| borrowed[i].owner else entity;
 
-                vkb.createIndexBuffer(mesh.indices, .{
-                    .device = device.logical,
-                    .physical_device = device.physical,
-                    .transfer_queue = queue.graphics,
-                    .transfer_command_pool = command_pool.handle
-                }, &buffer) catch |err| {
-                    std.debug.print("Failed to create index buffer: {}\n", .{err});
+                // The mesh is flagged again after its range was set, its data changed and has to go out again
+                const previous = if (ecs.get(it.world, entity, MeshRange)) |range| range.* else null;
+                const range = geometry.handle.upload(uploader.handle, source, mesh.vertices, mesh.indices, previous != null) catch |err| {
+                    std.debug.print("Failed to upload mesh: {}\n", .{err});
                     return;
                 };
-                _ = ecs.set(it.world, it.entities()[i], IndexBuffer, .{ .buffer = buffer.index_buffer, .memory = buffer.index_memory, .count = @as(u32, @intCast(mesh.indices.len)) });
+
+                // Replacing the range does not fire UnSet, the old one is released here instead
+                if (previous) |previous_range| {
+                    releaseRange(it.world, entity, previous_range);
+                }
+                _ = ecs.set(it.world, entity, MeshRange, range);
                 _ = ecs.set(it.world, it.entities()[i], DeviceEntity, .{ .entity = e });
 
-                ecs.remove(it.world, it.entities()[i], scene.UpdateBuffer);
+                // UpdateBuffer is cleared by the retire system once the copy has actually completed
+                _ = ecs.set(it.world, it.entities()[i], PendingUpload, .{ .ticket = uploader.handle.pendingTicket() });
             }
 
         }
     }   
 }
 
-fn destroyMeshBuffers(it: *ecs.iter_t) callconv(.C) void {
+/// Submit every upload recorded this frame in a single batch and retire the batches the transfer timeline has passed
+fn submitUploads(it: *ecs.iter_t) callconv(.C) void {
+    const uploaders = ecs.field(it, Uploader, 1).?;
+
+    for (uploaders) |uploader| {
+        _ = uploader.handle.flush() catch |err| {
+            std.debug.print("Failed to submit uploads: {}\n", .{err});
+            return;
+        };
+
+        _ = uploader.handle.retire() catch |err| {
+            std.debug.print("Failed to retire uploads: {}\n", .{err});
+            return;
+        };
+    }
+}
+
+fn retireUploads(it: *ecs.iter_t) callconv(.C) void {
+    const pending_uploads = ecs.field(it, PendingUpload, 1).?;
+    const device_entities = ecs.field(it, DeviceEntity, 2).?;
+
+    for (pending_uploads, device_entities, it.entities()) |pending_upload, device_entity, e| {
+        const uploader = ecs.get(it.world, device_entity.entity, Uploader).?;
+        if (!uploader.handle.isComplete(pending_upload.ticket)) {
+            continue;
+        }
+
+        ecs.remove(it.world, e, PendingUpload);
+        ecs.remove(it.world, e, scene.UpdateBuffer);
+    }
+}
+
+fn createUploader(it: *ecs.iter_t) callconv(.C) void {
+    std.debug.print("Start up: {s}\n", .{ecs.get_name(it.world, it.system).?});
+    const allocator = ecs.singleton_get(it.world, core.Allocator).?;
+    const devices = ecs.field(it, Device, 1).?;
+    const queues = ecs.field(it, Queue, 2).?;
+    const queue_indices = ecs.field(it, QueueIndex, 3).?;
+    const memory_allocators = ecs.field(it, MemoryAllocator, 4).?;
+    const timelines = ecs.field(it, Timelines, 5).?;
+
+    for (devices, queues, queue_indices, memory_allocators, timelines, it.entities()) |device, queue, queue_index, memory_allocator, timeline, e| {
+        const uploader = allocator.alloc.create(vku.UploadBatcher) catch |err| {
+            std.debug.print("Failed to allocate upload batcher: {}\n", .{err});
+            return;
+        };
+
+        uploader.* = vku.UploadBatcher.init(allocator.alloc, .{
+            .allocator = memory_allocator.handle,
+            .device = device.logical,
+            .queue = queue.transfer,
+            .queue_family_index = queue_index.transfer,
+            .dst_queue_family_index = queue_index.graphics,
+            .timeline = &timeline.handle.transfer,
+        }) catch |err| {
+            std.debug.print("Failed to create upload batcher: {}\n", .{err});
+            allocator.alloc.destroy(uploader);
+            return;
+        };
+
+        _ = ecs.set(it.world, e, Uploader, .{ .handle = uploader });
+    }
+}
+
+fn destroyUploader(it: *ecs.iter_t) callconv(.C) void {
     std.debug.print("Shut down: {s}\n", .{ecs.get_name(it.world, it.system).?});
-    const vertex_buffers = ecs.field(it, VertexBuffer, 1).?;
-    const index_buffers = ecs.field(it, IndexBuffer, 2).?;
-    const device_entities = ecs.field(it, DeviceEntity, 3).?;
+    const allocator = ecs.singleton_get(it.world, core.Allocator).?;
+    const uploaders = ecs.field(it, Uploader, 1).?;
+    const memory_allocators = ecs.field(it, MemoryAllocator, 2).?;
 
-    for (0..it.count()) |i| {
-        const vertex_buffer = vertex_buffers[i];
-        const index_buffer = index_buffers[i];
-        const device_entity = device_entities[i];
+    for (uploaders, memory_allocators) |uploader, memory_allocator| {
+        uploader.handle.deinit(memory_allocator.handle);
+        allocator.alloc.destroy(uploader.handle);
+    }
+}
+
+fn createGeometry(it: *ecs.iter_t) callconv(.C) void {
+    std.debug.print("Start up: {s}\n", .{ecs.get_name(it.world, it.system).?});
+    const allocator = ecs.singleton_get(it.world, core.Allocator).?;
+    const devices = ecs.field(it, Device, 1).?;
+    const memory_allocators = ecs.field(it, MemoryAllocator, 2).?;
+
+    for (devices, memory_allocators, it.entities()) |device, memory_allocator, e| {
+        const geometry = allocator.alloc.create(vkg.GeometryArena) catch |err| {
+            std.debug.print("Failed to allocate geometry arena: {}\n", .{err});
+            return;
+        };
+
+        geometry.* = vkg.GeometryArena.init(allocator.alloc, .{
+            .allocator = memory_allocator.handle,
+            .device = device.logical,
+        }) catch |err| {
+            std.debug.print("Failed to create geometry arena: {}\n", .{err});
+            allocator.alloc.destroy(geometry);
+            return;
+        };
 
-        const device = ecs.get(it.world, device_entity.entity, Device).?;
+        _ = ecs.set(it.world, e, GeometryBuffers, .{ .handle = geometry });
+    }
+}
 
+fn destroyGeometry(it: *ecs.iter_t) callconv(.C) void {
+    std.debug.print("Shut down: {s}\n", .{ecs.get_name(it.world, it.system).?});
+    const allocator = ecs.singleton_get(it.world, core.Allocator).?;
+    const devices = ecs.field(it, Device, 1).?;
+    const geometries = ecs.field(it, GeometryBuffers, 2).?;
+    const memory_allocators = ecs.field(it, MemoryAllocator, 3).?;
+
+    for (devices, geometries, memory_allocators, it.entities()) |device, geometry, memory_allocator, e| {
         _ = c.vkDeviceWaitIdle(device.logical);
 
-        c.vkDestroyBuffer(device.logical, vertex_buffer.buffer, null);
-        c.vkFreeMemory(device.logical, vertex_buffer.memory, null);
-        c.vkDestroyBuffer(device.logical, index_buffer.buffer, null);
-        c.vkFreeMemory(device.logical, index_buffer.memory, null);
+        geometry.handle.deinit(device.logical, memory_allocator.handle);
+        allocator.alloc.destroy(geometry.handle);
+
+        // Mesh entities that are deleted after this point have nothing left to hand back
+        ecs.remove(it.world, e, GeometryBuffers);
+    }
+}
+
+/// Return the mesh's range to the arena when the mesh entity is deleted or its range is removed. Frames already
+/// submitted may still draw from it, so it is only reused once the graphics timeline has passed them.
+fn releaseMeshRange(it: *ecs.iter_t) callconv(.C) void {
+    const ranges = ecs.field(it, MeshRange, 1).?;
+
+    for (ranges, it.entities()) |range, e| {
+        releaseRange(it.world, e, range);
+    }
+}
+
+fn releaseRange(world: *ecs.world_t, e: ecs.entity_t, range: MeshRange) void {
+    const device_entity = ecs.get(world, e, DeviceEntity) orelse return;
+    if (!ecs.is_alive(world, device_entity.entity)) {
+        return;
+    }
+
+    const geometry = ecs.get(world, device_entity.entity, GeometryBuffers) orelse return;
+    const timelines = ecs.get(world, device_entity.entity, Timelines) orelse return;
+    geometry.handle.retire(range, timelines.handle.graphics.submitted);
+}
+
+/// Hand the released mesh ranges whose frames have finished back to the arena. Runs after the frame's timeline
+/// value has been waited on.
+fn collectMeshRanges(it: *ecs.iter_t) callconv(.C) void {
+    const geometries = ecs.field(it, GeometryBuffers, 1).?;
+    const timelines = ecs.field(it, Timelines, 2).?;
+
+    for (geometries, timelines) |geometry, timeline| {
+        geometry.handle.collect(timeline.handle.graphics.completed);
     }
 }
 
@@ -665,35 +1484,47 @@ fn simpleTextureSetUp(it: *ecs.iter_t) callconv(.C) void {
     std.debug.print("Start up: {s}\n", .{ecs.get_name(it.world, it.system).?});
     const allocator = ecs.singleton_get(it.world, core.Allocator).?;
     const devices = ecs.field(it, Device, 1).?;
-    const queues = ecs.field(it, Queue, 2).?;
-    const command_pools = ecs.field(it, CommandPool, 3).?;
-    const descriptor_pools = ecs.field(it, DescriptorPool, 4).?;
-    const descriptor_set_layouts = ecs.field(it, DescriptorSetLayout, 5).?;
+    const uploaders = ecs.field(it, Uploader, 2).?;
+    const descriptor_pools = ecs.field(it, DescriptorPool, 3).?;
+    const descriptor_set_layouts = ecs.field(it, DescriptorSetLayout, 4).?;
+    const memory_allocators = ecs.field(it, MemoryAllocator, 5).?;
+    const texture_tables = ecs.field(it, TextureTable, 6);
 
-    for (devices, queues, command_pools, descriptor_pools, descriptor_set_layouts, it.entities()) |device, queue, command_pool, descriptor_pool, descriptor_set_layout, e| {
+    for (devices, uploaders, descriptor_pools, descriptor_set_layouts, memory_allocators, it.entities(), 0..) |device, uploader, descriptor_pool, descriptor_set_layout, memory_allocator, e, i| {
         const sample_image = vkt.loadImageFromFile("assets/sample_floor.png", .{
+            .allocator = memory_allocator.handle,
             .physical_device = device.physical,
             .device = device.logical,
-            .transfer_queue = queue.graphics,
-            .command_pool = command_pool.handle,
+            .uploader = uploader.handle,
         }) catch |err| {
             std.debug.print("Failed to load image: {}\n", .{err});
             return;
         };
 
-        const texture_sampler = vkt.createTextureSampler(device.logical) catch |err| {
+        const texture_sampler = vkt.createTextureSampler(device.logical, sample_image.mip_levels) catch |err| {
             std.debug.print("Failed to create texture sampler: {}\n", .{err});
             return;
         };
 
-        const sampler_image_view = vkt.createTextureImageView(allocator.alloc, device.logical, sample_image.handle, descriptor_pool.sampler_handle, descriptor_set_layout.sampler_handle, texture_sampler) catch |err| {
+        // The texture's slot in the table matches its `scene.Mesh.texture_id`, textures are added in load order
+        const sampler_image_view = if (texture_tables) |tables| blk: {
+            const image_view = vks.createImageView(device.logical, sample_image.handle, c.VK_FORMAT_R8G8B8A8_UNORM, c.VK_IMAGE_ASPECT_COLOR_BIT, sample_image.mip_levels) catch |err| {
+                std.debug.print("Failed to create texture image view: {}\n", .{err});
+                return;
+            };
+            _ = tables[i].handle.add(device.logical, image_view, texture_sampler) catch |err| {
+                std.debug.print("Failed to add texture to the texture table: {}\n", .{err});
+                return;
+            };
+            break :blk vkt.SamplerImageView{ .image_view = image_view, .descriptor_sets = &.{} };
+        } else vkt.createTextureImageView(allocator.alloc, device.logical, sample_image, descriptor_pool.sampler_handle, descriptor_set_layout.sampler_handle, texture_sampler) catch |err| {
             std.debug.print("Failed to create texture image view: {}\n", .{err});
             return;
         };
     
         _ = ecs.set(it.world, e, Texture, .{ 
             .image = sample_image.handle, 
-            .memory = sample_image.memory, 
+            .allocation = sample_image.allocation,
             .image_view = sampler_image_view.image_view, 
             .sampler = texture_sampler 
         });
@@ -707,8 +1538,9 @@ fn destroySimpleTexture(it : *ecs.iter_t) callconv(.C) void {
     const textures = ecs.field(it, Texture, 1).?;
     const sampler_descriptor_sets = ecs.field(it, SamplerDescriptorSets, 2).?;
     const devices = ecs.field(it, Device, 3).?;
+    const memory_allocators = ecs.field(it, MemoryAllocator, 4).?;
 
-    for (textures, sampler_descriptor_sets, devices) |texture, descriptor, device| {
+    for (textures, sampler_descriptor_sets, devices, memory_allocators) |texture, descriptor, device, memory_allocator| {
         // for (sampler_descriptor_sets) |descriptor_set| {
         //     c.vkFreeDescriptorSets(device.logical, descriptor_set, 1, &descriptor_set);
         // }
@@ -716,34 +1548,130 @@ fn destroySimpleTexture(it : *ecs.iter_t) callconv(.C) void {
         c.vkDestroySampler(device.logical, texture.sampler, null);
         c.vkDestroyImageView(device.logical, texture.image_view, null);
         c.vkDestroyImage(device.logical, texture.image, null);
-        c.vkFreeMemory(device.logical, texture.memory, null);
+        memory_allocator.handle.free(texture.allocation);
+    }
+}
+
+/// Hold back the start of the frame, before input is read, by the time the pacer expects it to wait on the GPU
+fn paceFrame(it: *ecs.iter_t) callconv(.C) void {
+    const presentations = ecs.field(it, Presentation, 1).?;
+
+    for (0..it.count()) |i| {
+        if (!presentations[i].applied.pacing) {
+            continue;
+        }
+
+        const delay = presentations[i].pacer.frameDelay();
+        if (delay > 0) {
+            std.time.sleep(delay);
+        }
+    }
+}
+
+/// Recreate the swapchain when the `PresentPolicy` singleton no longer matches the one it was created with. The
+/// old swapchain is handed to the new one, so the switch happens between two frames without restarting.
+fn applyPresentPolicy(it: *ecs.iter_t) callconv(.C) void {
+    const allocator = ecs.singleton_get(it.world, core.Allocator).?;
+    const policy = ecs.singleton_get(it.world, PresentPolicy).?.*;
+
+    const devices = ecs.field(it, Device, 1).?;
+    const surfaces = ecs.field(it, Surface, 2).?;
+    const queue_indexes = ecs.field(it, QueueIndex, 3).?;
+    const swapchains = ecs.field(it, Swapchain, 4).?;
+    const image_assets = ecs.field(it, ImageAssets, 5).?;
+    const depth_images = ecs.field(it, DepthImage, 6).?;
+    const render_passes = ecs.field(it, RenderPass, 7).?;
+    const framebuffers = ecs.field(it, Framebuffers, 8).?;
+    const buffer_counts = ecs.field(it, BufferCount, 9).?;
+    const presentations = ecs.field(it, Presentation, 10).?;
+
+    for (0..it.count()) |i| {
+        const presentation = &presentations[i];
+        if (!policy.needsNewSwapchain(presentation.applied)) {
+            if (policy.pacing != presentation.applied.pacing) {
+                presentation.pacer.reset();
+            }
+            presentation.applied = policy;
+            continue;
+        }
+
+        const device = devices[i];
+
+        // Framebuffers and image views of the old swapchain may still be in use by frames in flight
+        vke.checkResult(c.vkDeviceWaitIdle(device.logical)) catch |err| {
+            std.debug.print("Failed to wait for device idle: {}\n", .{err});
+            return;
+        };
+
+        const swapchain = vks.createSwapchain(allocator.alloc, device.physical, device.logical, surfaces[i].handle, .{
+            .graphics_queue_index = queue_indexes[i].graphics,
+            .presentation_queue_index = queue_indexes[i].presentation,
+            .window_width = swapchains[i].extent.width,
+            .window_height = swapchains[i].extent.height,
+            .policy = policy,
+            .old_swapchain = swapchains[i].handle,
+        }) catch |err| {
+            std.debug.print("Failed to recreate swapchain: {}\n", .{err});
+            return;
+        };
+
+        const swapchain_framebuffers = vks.createFramebuffer2(allocator.alloc, .{
+            .device = device.logical,
+            .extent = swapchain.image_extent,
+            .image_views = swapchain.image_views,
+            .image_count = @as(u32, @intCast(swapchain.images.len)),
+            .render_pass = render_passes[i].handle,
+            .depth_image_view = depth_images[i].image_view,
+        }) catch |err| {
+            std.debug.print("Failed to recreate framebuffers: {}\n", .{err});
+            return;
+        };
+
+        for (framebuffers[i].handles) |handle| {
+            c.vkDestroyFramebuffer(device.logical, handle, null);
+        }
+        allocator.alloc.free(framebuffers[i].handles);
+        for (image_assets[i].image_views) |image_view| {
+            c.vkDestroyImageView(device.logical, image_view, null);
+        }
+        allocator.alloc.free(image_assets[i].images);
+        allocator.alloc.free(image_assets[i].image_views);
+        c.vkDestroySwapchainKHR(device.logical, swapchains[i].handle, null);
+
+        swapchains[i].handle = swapchain.handle;
+        image_assets[i] = .{ .images = swapchain.images, .image_views = swapchain.image_views };
+        framebuffers[i] = .{ .handles = swapchain_framebuffers.handles };
+        buffer_counts[i] = .{ .count = @as(u32, @intCast(swapchain.images.len)) };
+        presentation.applied = policy;
+        presentation.pacer.reset();
+
+        std.debug.print("Present policy: {s}, {d} swapchain images, pacing {s}\n", .{
+            @tagName(policy.mode),
+            swapchain.images.len,
+            if (policy.pacing) "on" else "off",
+        });
     }
 }
 
 fn assignNextImage(it: *ecs.iter_t) callconv(.C) void {
     const devices = ecs.field(it, Device, 1).?;
     const image_available_semaphores = ecs.field(it, ImageAvailableSemaphores, 2).?;
-    const draw_fences = ecs.field(it, DrawFences, 3).?;
+    const timelines = ecs.field(it, Timelines, 3).?;
     const swapchains = ecs.field(it, Swapchain, 4).?;
     const current_frames = ecs.field(it, CurrentFrame, 5).?;
-
+    const frames = ecs.field(it, Frames, 7).?;
+    const presentations = ecs.field(it, Presentation, 8).?;
 
     for (0..it.count()) |i| {
         const device = devices[i];
         const image_available_semaphore = image_available_semaphores[i];
-        const draw_fence = draw_fences[i];
         const swapchain = swapchains[i];
         const current_frame = current_frames[i];
+        const wait_start = std.time.nanoTimestamp();
 
-        vke.checkResult(c.vkWaitForFences(device.logical, 1, &draw_fence.handles[current_frame.index], c.VK_TRUE, ONE_SECOND)) catch |err| {
-            std.debug.print("Failed to wait for fence: {}\n", .{err});
+        if (!waitForFrame(device, timelines[i].handle, frames[i].handle, current_frame.index)) {
             return;
-        };
-
-        vke.checkResult(c.vkResetFences(device.logical, 1, &draw_fence.handles[current_frame.index])) catch |err| {
-            std.debug.print("Failed to reset draw fence: {}\n", .{err});
-            return;
-        };
+        }
 
         var image_index: u32 = undefined;
         vke.checkResult(c.vkAcquireNextImageKHR(device.logical, swapchain.handle, ONE_SECOND, image_available_semaphore.handles[current_frame.index], null, &image_index)) catch |err| {
@@ -751,29 +1679,161 @@ fn assignNextImage(it: *ecs.iter_t) callconv(.C) void {
             return;
         };
 
+        // Resetting the frame context is the only work since wait_start, the rest was spent blocked on the GPU
+        const acquired_at = std.time.nanoTimestamp();
+        presentations[i].pacer.acquired(acquired_at, @as(u64, @intCast(@max(acquired_at - wait_start, 0))));
+
         _ = ecs.set(it.world, it.entities()[i], ImageIndex, .{ .index = image_index });
     }
 }
 
+/// Headless stand-in for acquiring a swapchain image, each frame in flight renders into its own offscreen image
+fn assignOffscreenImage(it: *ecs.iter_t) callconv(.C) void {
+    const devices = ecs.field(it, Device, 1).?;
+    const timelines = ecs.field(it, Timelines, 2).?;
+    const current_frames = ecs.field(it, CurrentFrame, 3).?;
+    const frames = ecs.field(it, Frames, 4).?;
+
+    for (0..it.count()) |i| {
+        const current_frame = current_frames[i];
+        if (!waitForFrame(devices[i], timelines[i].handle, frames[i].handle, current_frame.index)) {
+            return;
+        }
+
+        _ = ecs.set(it.world, it.entities()[i], ImageIndex, .{ .index = current_frame.index });
+    }
+}
+
+/// Wait until the GPU is done with the frame's previous submission and reset its context, false when it failed
+fn waitForFrame(device: Device, timelines: *vksync.QueueTimelines, frames: *vkfr.FrameContexts, frame_index: u32) bool {
+    const frame_value = frames.get(frame_index).timeline_value;
+    timelines.graphics.wait(device.logical, frame_value, ONE_SECOND) catch |err| {
+        std.debug.print("Failed to wait for graphics timeline: {}\n", .{err});
+        return false;
+    };
+
+    // Nothing the frame recorded or allocated last time around is in use anymore
+    _ = frames.begin(frame_index) catch |err| {
+        std.debug.print("Failed to reset frame context: {}\n", .{err});
+        return false;
+    };
+    return true;
+}
+
+/// Submit the frame's cull pass to the async compute queue as soon as the draw list is built, so it runs while
+/// the CPU records the graphics work and the GPU finishes the previous frame. The graphics submission waits on the
+/// compute timeline before reading the compacted commands.
+fn dispatchCompute(it: *ecs.iter_t) callconv(.C) void {
+    const devices = ecs.field(it, Device, 1).?;
+    const frames = ecs.field(it, Frames, 2).?;
+    const frame_uniforms = ecs.field(it, FrameUniforms, 3).?;
+    const draw_submissions = ecs.field(it, DrawSubmission, 4).?;
+    const cull_pipelines = ecs.field(it, CullPipeline, 5).?;
+    const current_frames = ecs.field(it, CurrentFrame, 6).?;
+    const timelines = ecs.field(it, Timelines, 7).?;
+    const queues = ecs.field(it, Queue, 8).?;
+    const async_computes = ecs.field(it, AsyncCompute, 9).?;
+
+    for (0..it.count()) |i| {
+        const frame_index = current_frames[i].index;
+        const frame = frames[i].handle.get(frame_index);
+        const frame_uniform = frame_uniforms[i];
+        const timer = async_computes[i].timer;
+
+        // The frame's graphics value has been reached, so have the timestamps it wrote last time around
+        if (timer) |t| {
+            t.resolve(devices[i].logical, frame_index);
+            _ = ecs.set(it.world, it.entities()[i], ComputeTimings, t.timings);
+        }
+
+        if (!draw_submissions[i].gpu_culling or draw_submissions[i].mode == .direct or frame_uniform.instance_count == 0) {
+            continue;
+        }
+
+        const command_buffer = frame.compute_command_buffer;
+        const buffer_begin_info = c.VkCommandBufferBeginInfo{
+            .sType = c.VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = c.VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        };
+        vke.checkResult(c.vkBeginCommandBuffer(command_buffer, &buffer_begin_info)) catch |err| {
+            std.debug.print("Failed to begin compute command buffer: {}\n", .{err});
+            return;
+        };
+
+        if (timer) |t| {
+            t.reset(command_buffer, frame_index, .compute_begin, .compute_end);
+            t.write(command_buffer, frame_index, .compute_begin, c.VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+        }
+
+        const push_constants = vkcl.CullPushConstants{
+            .planes = frame_uniform.frustum,
+            .instance_count = frame_uniform.instance_count,
+        };
+        const offsets = [4]u32{ frame_uniform.objects.frameOffset(), frame_uniform.cull_inputs.frameOffset(), frame_uniform.command_offset, frame_uniform.visible.frameOffset() };
+        cull_pipelines[i].pass.dispatch(command_buffer, offsets, &push_constants);
+
+        if (timer) |t| {
+            t.write(command_buffer, frame_index, .compute_end, c.VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+        }
+
+        vke.checkResult(c.vkEndCommandBuffer(command_buffer)) catch |err| {
+            std.debug.print("Failed to end compute command buffer: {}\n", .{err});
+            return;
+        };
+
+        // Nothing to wait for, the rings were last read by this frame's previous graphics submission which has completed
+        const timeline = timelines[i].handle;
+        const compute_value = timeline.compute.submitted + 1;
+        const timeline_info = std.mem.zeroInit(c.VkTimelineSemaphoreSubmitInfo, .{
+            .sType = c.VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+            .signalSemaphoreValueCount = 1,
+            .pSignalSemaphoreValues = &compute_value,
+        });
+
+        const submit_info = std.mem.zeroInit(c.VkSubmitInfo, .{
+            .sType = c.VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = &timeline_info,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &command_buffer,
+            .signalSemaphoreCount = 1,
+            .pSignalSemaphores = &timeline.compute.handle,
+        });
+
+        vke.checkResult(c.vkQueueSubmit(queues[i].compute, 1, &submit_info, null)) catch |err| {
+            std.debug.print("Failed to submit compute queue: {}\n", .{err});
+            return;
+        };
+        frame.compute_wait = timeline.compute.next();
+        if (timer) |t| {
+            t.dispatch(frame_index);
+        }
+    }
+}
+
 fn beginCommands(it: *ecs.iter_t) callconv(.C) void {
     const image_indices = ecs.field(it, ImageIndex, 1).?;
-    const command_buffers = ecs.field(it, CommandBuffers, 2).?;
+    const frames = ecs.field(it, Frames, 2).?;
     const render_passes = ecs.field(it, RenderPass, 3).?;
-    const swapchains = ecs.field(it, Swapchain, 4).?;
+    const render_targets = ecs.field(it, RenderTarget, 4).?;
     const framebuffers = ecs.field(it, Framebuffers, 5).?;
-    const pipelines = ecs.field(it, Pipeline, 6).?;
-    const descriptor_sets_refs = ecs.field(it, DescriptorSets, 7).?;
+    const frame_uniforms = ecs.field(it, FrameUniforms, 6).?;
+    const draw_submissions = ecs.field(it, DrawSubmission, 7).?;
+    const cull_pipelines = ecs.field(it, CullPipeline, 8).?;
+    const current_frames = ecs.field(it, CurrentFrame, 9).?;
+    const uploaders = ecs.field(it, Uploader, 10).?;
+    const async_computes = ecs.field(it, AsyncCompute, 11);
+    const profilers = ecs.field(it, GpuProfiler, 12);
 
     for (0..it.count()) |i| {
         const image_index = image_indices[i];
-        const command_buffer_refs = command_buffers[i];
         const render_pass = render_passes[i];
-        const swapchain = swapchains[i];
+        const render_target = render_targets[i];
         const framebuffer_refs = framebuffers[i];
-        const pipeline = pipelines[i];
-        const descriptor_sets_ref = descriptor_sets_refs[i];
 
-        const buffer_begin_info = c.VkCommandBufferBeginInfo{ .sType = c.VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+        const buffer_begin_info = c.VkCommandBufferBeginInfo{
+            .sType = c.VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = c.VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        };
         const color_clear_value = c.VkClearValue{ .color = .{ .float32 = [_]f32{ 0.0, 0.0, 0.0, 1.0 } } };
         const depth_clear_value = c.VkClearValue{ .depthStencil = .{ .depth = 1.0, .stencil = 0 } };
 
@@ -790,84 +1850,224 @@ fn beginCommands(it: *ecs.iter_t) callconv(.C) void {
                     .x = 0,
                     .y = 0,
                 },
-                .extent = swapchain.extent,
+                .extent = render_target.extent,
             },
             .clearValueCount = @as(u32, @intCast(clear_values.len)),
             .pClearValues = &clear_values,
         };
 
-        const command_buffer = command_buffer_refs.handles[image_index.index];
+        const frame = frames[i].handle.get(current_frames[i].index);
+        const command_buffer = frame.command_buffer;
         vke.checkResult(c.vkBeginCommandBuffer(command_buffer, &buffer_begin_info)) catch |err| {
             std.debug.print("Failed to begin command buffer: {}\n", .{err});
             return;
         };
 
-        render_pass_begin_info.framebuffer = framebuffer_refs.handles[image_index.index];
-        c.vkCmdBeginRenderPass(command_buffer, &render_pass_begin_info, c.VK_SUBPASS_CONTENTS_INLINE);
+        // The frame's graphics value has been reached, read last time's timestamps before the queries are reset
+        const profiler = if (profilers) |gpu_profilers| gpu_profilers[i].handle else null;
+        if (profiler) |gpu_profiler| {
+            var timings = ecs.singleton_get(it.world, GpuTimings).?.*;
+            if (gpu_profiler.resolve(current_frames[i].index, &timings)) {
+                _ = ecs.singleton_set(it.world, GpuTimings, timings);
+            }
+            gpu_profiler.beginFrame(command_buffer, current_frames[i].index);
+        }
 
-        c.vkCmdBindPipeline(command_buffer, c.VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.grid_handle);
+        // Take ownership of what the transfer queue finished uploading before anything reads it
+        frame.transfer_wait = uploaders[i].handle.recordAcquires(command_buffer);
 
-        const descriptor_sets = [_]c.VkDescriptorSet{ descriptor_sets_ref.view_projection_pipeline2_sets[image_index.index] };
-        c.vkCmdBindDescriptorSets(command_buffer, c.VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.grid_layout, 0, @as(u32, @intCast(descriptor_sets.len)), &descriptor_sets, 0, null);
+        const async_compute = if (async_computes) |computes| computes[i] else null;
+        if (async_compute) |compute| {
+            if (compute.timer) |timer| {
+                timer.reset(command_buffer, current_frames[i].index, .graphics_begin, .graphics_end);
+                timer.write(command_buffer, current_frames[i].index, .graphics_begin, c.VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+            }
+        }
 
-        c.vkCmdDraw(command_buffer, 6, 1, 0, 0);
-        
+        // Culling runs outside the render pass, its barrier orders the compacted commands before the draws. With
+        // async compute it has already been submitted to the compute queue.
+        const frame_uniform = frame_uniforms[i];
+        if (async_compute == null and draw_submissions[i].gpu_culling and draw_submissions[i].mode != .direct and frame_uniform.instance_count > 0) {
+            const push_constants = vkcl.CullPushConstants{
+                .planes = frame_uniform.frustum,
+                .instance_count = frame_uniform.instance_count,
+            };
+            const offsets = [4]u32{ frame_uniform.objects.frameOffset(), frame_uniform.cull_inputs.frameOffset(), frame_uniform.command_offset, frame_uniform.visible.frameOffset() };
+            const scope = if (profiler) |gpu_profiler| gpu_profiler.begin(command_buffer, current_frames[i].index, "cull") else null;
+            cull_pipelines[i].pass.record(command_buffer, offsets, &push_constants);
+            if (scope) |s| {
+                s.end(command_buffer);
+            }
+        }
 
-        c.vkCmdBindPipeline(command_buffer, c.VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.graphics_handle);
+        // Everything inside the render pass is recorded into secondary command buffers
+        render_pass_begin_info.framebuffer = framebuffer_refs.handles[image_index.index];
+        c.vkCmdBeginRenderPass(command_buffer, &render_pass_begin_info, c.VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
     }
 }
 
-fn vertexAndIndexCommands(it: *ecs.iter_t) callconv(.C) void {
-    const vertex_buffers = ecs.field(it, VertexBuffer, 1).?;
-    const index_buffers = ecs.field(it, IndexBuffer, 2).?;
-    const device_entities = ecs.field(it, DeviceEntity, 3).?;
-    const transforms = ecs.field(it, scene.Transform, 4).?;
-
-    // TODO: Separate out the texture index into its own component
-    const meshes = ecs.field(it, scene.Mesh, 5).?;
+/// Read-only view of the frame shared by the threads recording the draw list
+const DrawContext = struct {
+    list: *const vkdl.DrawList,
+    frame_uniform: *const FrameUniforms,
+    descriptor_sets: DescriptorSets,
+    sampler_sets: []c.VkDescriptorSet,
+    pipeline: Pipeline,
+    geometry: *const vkg.GeometryArena,
+    mode: DrawMode,
+    /// Timed from the secondary command buffers, the primary cannot write timestamps inside the render pass
+    grid_scope: ?vkgp.Scope,
+    mesh_scope: ?vkgp.Scope,
+    last_chunk: u32,
+};
 
-    for (vertex_buffers, index_buffers, transforms, meshes, device_entities) |vertex_buffer, index_buffer, transform, mesh, device_entity| {
-        const command_buffers = ecs.get(it.world, device_entity.entity, CommandBuffers).?;
-        const image_index = ecs.get(it.world, device_entity.entity, ImageIndex).?;
-        const descriptor_set_refs = ecs.get(it.world, device_entity.entity, DescriptorSets).?;
-        const pipeline = ecs.get(it.world, device_entity.entity, Pipeline).?;
-        const sampler_descriptor_sets = ecs.get(it.world, device_entity.entity, SamplerDescriptorSets).?;
-         
-        const command_buffer = command_buffers.handles[image_index.index];
+/// Split the draw list across the recorder's threads and execute the secondary command buffers from the
+/// primary one. Direct draws are split by batch, the indirect modes by texture run.
+fn vertexAndIndexCommands(it: *ecs.iter_t) callconv(.C) void {
+    const frames = ecs.field(it, Frames, 1).?;
+    const image_indices = ecs.field(it, ImageIndex, 2).?;
+    const descriptor_sets_refs = ecs.field(it, DescriptorSets, 3).?;
+    const pipelines = ecs.field(it, Pipeline, 4).?;
+    const sampler_descriptor_sets_refs = ecs.field(it, SamplerDescriptorSets, 5).?;
+    const frame_uniforms = ecs.field(it, FrameUniforms, 6).?;
+    const draw_lists = ecs.field(it, DrawList, 7).?;
+    const draw_submissions = ecs.field(it, DrawSubmission, 8).?;
+    const render_passes = ecs.field(it, RenderPass, 9).?;
+    const framebuffers = ecs.field(it, Framebuffers, 10).?;
+    const geometries = ecs.field(it, GeometryBuffers, 11).?;
+    const current_frames = ecs.field(it, CurrentFrame, 12).?;
+    const recorders = ecs.field(it, Recorder, 13).?;
+    const texture_tables = ecs.field(it, TextureTable, 14);
+    const profilers = ecs.field(it, GpuProfiler, 15);
 
-        const v_buffers = [_]c.VkBuffer{
-            vertex_buffer.buffer,
+    for (0..it.count()) |i| {
+        const image_index = image_indices[i].index;
+        const command_buffer = frames[i].handle.get(current_frames[i].index).command_buffer;
+        const list = draw_lists[i].handle;
+        const profiler = if (profilers) |gpu_profilers| gpu_profilers[i].handle else null;
+        const total = if (draw_submissions[i].mode == .direct) list.batches.items.len else list.runs.items.len;
+
+        const context = DrawContext{
+            .list = list,
+            .frame_uniform = &frame_uniforms[i],
+            .descriptor_sets = descriptor_sets_refs[i],
+            // A bindless list is a single run, it binds the table in place of a texture's set
+            .sampler_sets = if (texture_tables) |tables| @as(*[1]c.VkDescriptorSet, &tables[i].handle.set) else sampler_descriptor_sets_refs[i].sets,
+            .pipeline = pipelines[i],
+            .geometry = geometries[i].handle,
+            .mode = draw_submissions[i].mode,
+            .grid_scope = if (profiler) |gpu_profiler| gpu_profiler.reserve(current_frames[i].index, "grid") else null,
+            .mesh_scope = if (profiler) |gpu_profiler| gpu_profiler.reserve(current_frames[i].index, "meshes") else null,
+            .last_chunk = recorders[i].handle.chunkCountFor(@as(u32, @intCast(total))) - 1,
         };
 
-        const offsets = [_]c.VkDeviceSize{
-            0,
+        const secondaries = recorders[i].handle.record(current_frames[i].index, .{
+            .render_pass = render_passes[i].handle,
+            .framebuffer = framebuffers[i].handles[image_index],
+        }, @as(u32, @intCast(total)), &context, recordDrawChunk) catch |err| {
+            std.debug.print("Failed to record draw commands: {}\n", .{err});
+            return;
         };
 
-        c.vkCmdBindVertexBuffers(command_buffer, 0, 1, &v_buffers, &offsets);
-        c.vkCmdBindIndexBuffer(command_buffer, index_buffer.buffer, 0, c.VK_INDEX_TYPE_UINT32);
-        c.vkCmdPushConstants(command_buffer, pipeline.graphics_layout, c.VK_SHADER_STAGE_VERTEX_BIT, 0, @sizeOf(scene.Transform), &transform.value);
+        c.vkCmdExecuteCommands(command_buffer, @as(u32, @intCast(secondaries.len)), secondaries.ptr);
+    }
+}
+
+/// Record one chunk of the draw list, runs that straddle two chunks bind their descriptor sets in both
+fn recordDrawChunk(context: *const DrawContext, command_buffer: c.VkCommandBuffer, range: vkrc.Range, chunk_index: u32) void {
+    const frame_uniform = context.frame_uniform;
+    const list = context.list;
+    const pipeline = context.pipeline;
+
+    // The grid is drawn first so it stays behind the meshes regardless of how the list is split
+    if (chunk_index == 0) {
+        if (context.grid_scope) |scope| scope.begin(command_buffer);
+        c.vkCmdBindPipeline(command_buffer, c.VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.grid_handle);
+
+        const grid_sets = [_]c.VkDescriptorSet{ context.descriptor_sets.camera_set };
+        const grid_offsets = [_]u32{ frame_uniform.camera_offset };
+        c.vkCmdBindDescriptorSets(command_buffer, c.VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.grid_layout, 0, @as(u32, @intCast(grid_sets.len)), &grid_sets, @as(u32, @intCast(grid_offsets.len)), &grid_offsets);
+        c.vkCmdDraw(command_buffer, 6, 1, 0, 0);
+        if (context.grid_scope) |scope| scope.end(command_buffer);
+        if (context.mesh_scope) |scope| scope.begin(command_buffer);
+    }
+
+    // The secondaries execute in chunk order, the last one closes the meshes even when it has nothing to draw
+    defer if (chunk_index == context.last_chunk) {
+        if (context.mesh_scope) |scope| scope.end(command_buffer);
+    }
+
+    if (range.begin == range.end) {
+        return;
+    }
+
+    c.vkCmdBindPipeline(command_buffer, c.VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.graphics_handle);
+
+    // Every mesh lives in the same arena so the geometry is bound once per command buffer
+    context.geometry.bind(command_buffer);
+
+    const indirect_buffer = frame_uniform.indirect.buffer.handle;
 
-        // const descriptor_sets = [_]c.VkDescriptorSet{ descriptor_set_refs.sets[image_index.index], sampler_descriptor_sets.sets[mesh.texture_id] };
-        const descriptor_sets = [_]c.VkDescriptorSet{ descriptor_set_refs.view_projection_pipeline1_sets[image_index.index], descriptor_set_refs.light_sets[image_index.index], sampler_descriptor_sets.sets[mesh.texture_id] };
+    // Offsets are consumed in set order, one per dynamic descriptor
+    const dynamic_offsets = [_]u32{ frame_uniform.camera_offset, frame_uniform.light_offset, frame_uniform.objects.frameOffset(), frame_uniform.visible.frameOffset() };
 
-        // const dynamic_offset = @as(u32, @intCast(self.model_uniform_alignment * j));
-        // c.vkCmdBindDescriptorSets(command_buffer, c.VK_PIPELINE_BIND_POINT_GRAPHICS, self.pipeline_layout, 0, 1, &self.descriptor_sets[current_index], 1, &dynamic_offset);
-        c.vkCmdBindDescriptorSets(command_buffer, c.VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.graphics_layout, 0, @as(u32, @intCast(descriptor_sets.len)), &descriptor_sets, 0, null);
-        c.vkCmdDrawIndexed(command_buffer, index_buffer.count, 1, 0, 0, 0);
+    // Camera, light and objects stay bound across runs, only the texture set changes between them
+    var sets_bound = false;
+    for (list.runs.items, 0..) |run, run_index| {
+        const run_end = run.first_batch + run.batch_count;
+        const first = if (context.mode == .direct) @max(run.first_batch, range.begin) else run.first_batch;
+        const last = if (context.mode == .direct) @min(run_end, range.end) else run_end;
+        if (context.mode == .direct and first >= last) {
+            continue;
+        }
+        if (context.mode != .direct and (run_index < range.begin or run_index >= range.end)) {
+            continue;
+        }
+
+        if (sets_bound) {
+            c.vkCmdBindDescriptorSets(command_buffer, c.VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.graphics_layout, 2, 1, &context.sampler_sets[run.texture_id], 0, null);
+        } else {
+            const descriptor_sets = [_]c.VkDescriptorSet{ context.descriptor_sets.camera_set, context.descriptor_sets.light_set, context.sampler_sets[run.texture_id], context.descriptor_sets.object_set };
+            c.vkCmdBindDescriptorSets(command_buffer, c.VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.graphics_layout, 0, @as(u32, @intCast(descriptor_sets.len)), &descriptor_sets, @as(u32, @intCast(dynamic_offsets.len)), &dynamic_offsets);
+            sets_bound = true;
+        }
+
+        const command_offset = frame_uniform.command_offset + run.first_batch * @sizeOf(c.VkDrawIndexedIndirectCommand);
+        switch (context.mode) {
+            .direct => {
+                for (list.batches.items[first..last]) |batch| {
+                    c.vkCmdDrawIndexed(command_buffer, batch.key.index_count, batch.instance_count, batch.key.first_index, batch.key.vertex_offset, batch.first_instance);
+                }
+            },
+            .indirect => {
+                c.vkCmdDrawIndexedIndirect(command_buffer, indirect_buffer, command_offset, run.batch_count, @sizeOf(c.VkDrawIndexedIndirectCommand));
+            },
+            .indirect_count => {
+                const count_offset = frame_uniform.count_offset + @as(u32, @intCast(run_index)) * @sizeOf(u32);
+                c.vkCmdDrawIndexedIndirectCount(command_buffer, indirect_buffer, command_offset, indirect_buffer, count_offset, run.batch_count, @sizeOf(c.VkDrawIndexedIndirectCommand));
+            },
+        }
     }
 }
 
 fn endCommands(it: *ecs.iter_t) callconv(.C) void {
-    const command_buffers = ecs.field(it, CommandBuffers, 1).?;
-    const image_indices = ecs.field(it, ImageIndex, 2).?;
+    const frames = ecs.field(it, Frames, 1).?;
+    const current_frames = ecs.field(it, CurrentFrame, 2).?;
+    const async_computes = ecs.field(it, AsyncCompute, 3);
+    const profilers = ecs.field(it, GpuProfiler, 4);
 
     for (0..it.count()) |i| {
-        const command_buffer_refs = command_buffers[i];
-        const image_index = image_indices[i];
-
-        const command_buffer = command_buffer_refs.handles[image_index.index];
+        const command_buffer = frames[i].handle.get(current_frames[i].index).command_buffer;
 
         c.vkCmdEndRenderPass(command_buffer);
+        if (profilers) |gpu_profilers| {
+            gpu_profilers[i].handle.endFrame(command_buffer, current_frames[i].index);
+        }
+        if (async_computes) |computes| {
+            if (computes[i].timer) |timer| {
+                timer.write(command_buffer, current_frames[i].index, .graphics_end, c.VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+            }
+        }
         vke.checkResult(c.vkEndCommandBuffer(command_buffer)) catch |err| {
             std.debug.print("Failed to end command buffer: {}\n", .{err});
             return;
@@ -875,141 +2075,380 @@ fn endCommands(it: *ecs.iter_t) callconv(.C) void {
     }
 }
 
-fn bindCameraMemory(it: *ecs.iter_t) callconv(.C) void {
-    const cameras = ecs.field(it, scene.Camera, 1).?;
-    const lights = ecs.field(it, scene.Light, 2).?;
+/// Swap in pipelines the shader reloader rebuilt. Runs after the frame's timeline value has been waited on, the
+/// pipelines being replaced are kept until the graphics timeline passes the last frame that recorded them.
+fn swapReloadedPipelines(it: *ecs.iter_t) callconv(.C) void {
+    const shader_reloads = ecs.field(it, ShaderReload, 1).?;
+    const pipelines = ecs.field(it, Pipeline, 2).?;
+    const cull_pipelines = ecs.field(it, CullPipeline, 3).?;
+    const timelines = ecs.field(it, Timelines, 4).?;
 
-    var device_query_desc = ecs.filter_desc_t{};
-    device_query_desc.terms[0] = .{ .id = ecs.id(Device), .inout = ecs.inout_kind_t.In };
-    device_query_desc.terms[1] = .{ .id = ecs.id(ImageIndex), .inout = ecs.inout_kind_t.In };
-    device_query_desc.terms[2] = .{ .id = ecs.id(UniformBuffers), .inout = ecs.inout_kind_t.In };
-    device_query_desc.terms[3] = .{ .id = ecs.id(DeviceAlignment), .inout = ecs.inout_kind_t.In };
-    device_query_desc.terms[4] = .{ .id = ecs.id(LightTransferSpace), .inout = ecs.inout_kind_t.In };
-
-    const filter = ecs.filter_init(it.world, &device_query_desc) catch |err| {
-        std.debug.print("Failed to create device query: {}\n", .{err});
-        return;
-    };
-    defer ecs.filter_fini(filter);
+    for (0..it.count()) |i| {
+        const reloader = shader_reloads[i].handle;
+        const graphics_timeline = &timelines[i].handle.graphics;
+        defer reloader.collect(graphics_timeline.completed);
+
+        const rebuilt = reloader.takeReload() orelse continue;
+        if (rebuilt.get(.graphics)) |graphics| {
+            reloader.retire(.{ .handle = pipelines[i].graphics_handle, .layout = pipelines[i].graphics_layout }, graphics_timeline.submitted);
+            pipelines[i].graphics_handle = graphics.handle;
+            pipelines[i].graphics_layout = graphics.layout;
+        }
+        if (rebuilt.get(.grid)) |grid| {
+            reloader.retire(.{ .handle = pipelines[i].grid_handle, .layout = pipelines[i].grid_layout }, graphics_timeline.submitted);
+            pipelines[i].grid_handle = grid.handle;
+            pipelines[i].grid_layout = grid.layout;
+        }
+        if (rebuilt.get(.cull)) |cull| {
+            reloader.retire(cull_pipelines[i].pass.pipeline, graphics_timeline.submitted);
+            cull_pipelines[i].pass.pipeline = cull;
+        }
+    }
+}
 
-    var query_iter = ecs.filter_iter(it.world, filter);
-    while (ecs.filter_next(&query_iter)) {
-        for(query_iter.entities()) |e| {
-            const device = ecs.get(query_iter.world, e, Device).?;
-            const image_index = ecs.get(query_iter.world, e, ImageIndex).?;
-            const uniform_buffers = ecs.get(query_iter.world, e, UniformBuffers).?;
-            const device_alignment = ecs.get(query_iter.world, e, DeviceAlignment).?;
-            const light_transfer_space = ecs.get(query_iter.world, e, LightTransferSpace).?;
+/// Write the camera and light for the frame into the uniform ring. The ring stays mapped, so this is a plain
+/// memcpy and the resulting dynamic offsets are stored for the command recording systems.
+fn bindCameraMemory(it: *ecs.iter_t) callconv(.C) void {
+    const frame_uniforms = ecs.field(it, FrameUniforms, 1).?;
+    const current_frames = ecs.field(it, CurrentFrame, 2).?;
+    const camera_query: *ecs.query_t = @ptrCast(it.ctx.?);
+
+    for (frame_uniforms, current_frames) |*frame_uniform, current_frame| {
+        // The frame's timeline value was waited on when the image was acquired
+        frame_uniform.ring.beginFrame(current_frame.index);
+        frame_uniform.objects.beginFrame(current_frame.index);
+        frame_uniform.indirect.beginFrame(current_frame.index);
+        frame_uniform.cull_inputs.beginFrame(current_frame.index);
+        frame_uniform.visible.beginFrame(current_frame.index);
+
+        var query_iter = ecs.query_iter(it.world, camera_query);
+        while (ecs.query_next(&query_iter)) {
+            const cameras = ecs.field(&query_iter, scene.Camera, 1).?;
+            const lights = ecs.field(&query_iter, scene.Light, 2).?;
+
+            for (cameras, lights) |*camera, *light| {
+                frame_uniform.camera_offset = frame_uniform.ring.push(scene.Camera, camera) catch |err| {
+                    std.debug.print("Failed to write camera uniform: {}\n", .{err});
+                    return;
+                };
 
-            for (0..it.count()) |i| {
-                const camera_buffer = uniform_buffers.buffers[image_index.index].camera;
-                var data: ?*align(@alignOf(u32)) anyopaque = undefined;
-                vke.checkResult(c.vkMapMemory(device.logical, camera_buffer.memory, 0, @sizeOf(scene.Camera), 0, &data)) catch |err| {
-                    std.debug.print("Failed to map camera memory: {}\n", .{err});
+                frame_uniform.light_offset = frame_uniform.ring.push(scene.Light, light) catch |err| {
+                    std.debug.print("Failed to write light uniform: {}\n", .{err});
                     return;
                 };
 
-                const camera = cameras[i];
-                @memcpy(@as([*]u8, @ptrCast(data)), std.mem.asBytes(&camera));
-                c.vkUnmapMemory(device.logical, camera_buffer.memory);
+                frame_uniform.frustum = scene.Frustum.init(zmath.mul(camera.view, camera.projection)).planes;
+            }
+        }
+    }
+}
 
-                // const model_buffer = self.uniform_buffers[image_index].model;
-        
-                // var object_data: ?*align(@alignOf(scene.UBO)) anyopaque = undefined;
-                // var i: usize = 0;
-                // while (i < self.meshes.len): (i += 1) {
-                //     const this_model = &self.model_transfer_space[i];
-                //     this_model.* = self.meshes[i].model;
-                // }
+/// Group the drawable entities of the device by mesh and texture and write their object data into the frame's
+/// object buffer, each group ends up contiguous so it can be drawn with a single instanced call.
+fn buildDrawList(it: *ecs.iter_t) callconv(.C) void {
+    const draw_lists = ecs.field(it, DrawList, 1).?;
+    const frame_uniforms = ecs.field(it, FrameUniforms, 2).?;
+    const draw_submissions = ecs.field(it, DrawSubmission, 3).?;
+    const render_stats = ecs.field(it, RenderStats, 4).?;
+    const drawable_query: *ecs.query_t = @ptrCast(it.ctx.?);
+
+    for (draw_lists, frame_uniforms, draw_submissions, render_stats, it.entities()) |draw_list, *frame_uniform, draw_submission, *stats, e| {
+        const list = draw_list.handle;
+        list.reset();
+        // Batches are drawn front to back by their distance to the near plane
+        list.depth_plane = frame_uniform.frustum[4];
+
+        var query_iter = ecs.query_iter(it.world, drawable_query);
+        while (ecs.query_next(&query_iter)) {
+            const mesh_ranges = ecs.field(&query_iter, MeshRange, 1).?;
+            // TODO: Separate out the texture index into its own component
+            const meshes = ecs.field(&query_iter, scene.Mesh, 2).?;
+            const transforms = ecs.field(&query_iter, scene.Transform, 3).?;
+            const device_entities = ecs.field(&query_iter, DeviceEntity, 4).?;
+            // Entities without bounds are never culled
+            const visibles = ecs.field(&query_iter, scene.Visible, 5);
+
+            for (mesh_ranges, meshes, transforms, device_entities, 0..) |mesh_range, mesh, transform, device_entity, i| {
+                if (device_entity.entity != e) {
+                    continue;
+                }
+
+                if (visibles) |visible| {
+                    if (!visible[i].value) {
+                        continue;
+                    }
+                }
+
+                list.add(vkdl.BatchKey.init(mesh_range, mesh.texture_id), transform.value, mesh_range.bounds) catch |err| {
+                    std.debug.print("Failed to add to draw list: {}\n", .{err});
+                    return;
+                };
+            }
+        }
 
-                // const copy_size = self.model_uniform_alignment * self.meshes.len;
-                // try vke.checkResult(c.vkMapMemory(self.device, model_buffer.memory, 0, copy_size, 0, &object_data));
-                // @memcpy(@as([*]scene.UBO, @ptrCast(object_data)), self.model_transfer_space[0..copy_size]);
-                // c.vkUnmapMemory(self.device, model_buffer.memory);
+        const culled = draw_submission.gpu_culling and draw_submission.mode != .direct;
+        const instance_count = list.instanceCount();
+        frame_uniform.instance_count = 0;
 
-                // TODO: Save alignment alongside buffer
-                var object_data: ?*align(@alignOf(scene.Light)) anyopaque = undefined;
-                const light_alignment = vkds.padWithBufferOffset(@sizeOf(scene.Light), device_alignment.min_uniform_buffer_offset_alignment);
+        const objects = frame_uniform.objects.pushArray(scene.ObjectData, instance_count) catch |err| {
+            std.debug.print("Failed to write object data: {}\n", .{err});
+            list.reset();
+            return;
+        };
 
-                const light = lights[i];
-                const this_light = &light_transfer_space.values[0];
-                this_light.* = light;
+        const cull_inputs = if (culled) frame_uniform.cull_inputs.pushArray(vkcl.CullInput, instance_count) catch |err| {
+            std.debug.print("Failed to write cull inputs: {}\n", .{err});
+            list.reset();
+            return;
+        } else null;
 
+        list.build(objects.items, objects.first, if (cull_inputs) |inputs| inputs.items else null) catch |err| {
+            std.debug.print("Failed to build draw list: {}\n", .{err});
+            list.reset();
+            return;
+        };
+        stats.binds = list.bindStats(draw_submission.mode != .direct);
 
-                const light_buffer = uniform_buffers.buffers[image_index.index].light;
-                vke.checkResult(c.vkMapMemory(device.logical, light_buffer.memory, 0, light_alignment, 0, &object_data)) catch |err| {
-                    std.debug.print("Failed to map light memory: {}\n", .{err});
-                    return;
-                };
+        const visible = frame_uniform.visible.pushArray(u32, instance_count) catch |err| {
+            std.debug.print("Failed to reserve visible list: {}\n", .{err});
+            list.reset();
+            return;
+        };
 
-                @memcpy(@as([*]scene.Light, @ptrCast(object_data)), light_transfer_space.values[0..light_alignment]);
-                c.vkUnmapMemory(device.logical, light_buffer.memory);
+        // Without the cull pass every instance is drawn and reads its own object
+        if (!culled) {
+            for (visible.items, 0..) |*index, k| {
+                index.* = objects.first + @as(u32, @intCast(k));
             }
         }
+        frame_uniform.instance_count = @as(u32, @intCast(instance_count));
+
+        if (draw_submission.mode == .direct) {
+            continue;
+        }
+
+        const commands = frame_uniform.indirect.pushArray(c.VkDrawIndexedIndirectCommand, list.batches.items.len) catch |err| {
+            std.debug.print("Failed to write indirect commands: {}\n", .{err});
+            list.reset();
+            return;
+        };
+        list.writeIndirect(commands.items, culled);
+        frame_uniform.command_offset = frame_uniform.indirect.frameOffset() + commands.first * @sizeOf(c.VkDrawIndexedIndirectCommand);
+
+        const counts = frame_uniform.indirect.pushArray(u32, list.runs.items.len) catch |err| {
+            std.debug.print("Failed to write indirect counts: {}\n", .{err});
+            list.reset();
+            return;
+        };
+        list.writeRunCounts(counts.items);
+        frame_uniform.count_offset = frame_uniform.indirect.frameOffset() + counts.first * @sizeOf(u32);
+    }
+}
+
+fn freeQuery(ctx: ?*anyopaque) callconv(.C) void {
+    if (ctx) |query| {
+        ecs.query_fini(@ptrCast(query));
     }
 }
 
 fn draw(it: *ecs.iter_t) callconv(.C) void {
-    const command_buffers = ecs.field(it, CommandBuffers, 1).?;
+    const frames = ecs.field(it, Frames, 1).?;
     const image_available_semaphores = ecs.field(it, ImageAvailableSemaphores, 2).?;
     const render_finished_semaphores = ecs.field(it, RenderFinishedSemaphores, 3).?;
-    const draw_fences = ecs.field(it, DrawFences, 4).?;
+    const timelines = ecs.field(it, Timelines, 4).?;
     const image_indices = ecs.field(it, ImageIndex, 5).?;
-    const swapchains = ecs.field(it, Swapchain, 6).?;
+    const swapchains = ecs.field(it, Swapchain, 6);
     const queues = ecs.field(it, Queue, 7).?;
     const current_frames = ecs.field(it, CurrentFrame, 8).?;
+    const presentations = ecs.field(it, Presentation, 9);
 
     for (0..it.count()) |i| {
-        const command_buffer_refs = command_buffers[i];
+        const frame_count = frames[i].handle.count();
         const image_available_semaphore = image_available_semaphores[i];
         const render_finished_semaphore = render_finished_semaphores[i];
-        const draw_fence = draw_fences[i];
+        const timeline = timelines[i].handle;
         const image_index = image_indices[i];
-        const swapchain = swapchains[i];
+        // A headless device has nothing to acquire or present
+        const swapchain = if (swapchains) |handles| handles[i] else null;
         const queue = queues[i];
         const current_frame = current_frames[i];
-
-        const wait_stages: [1]c.VkPipelineStageFlags = .{
+        const frame = frames[i].handle.get(current_frame.index);
+
+        // Binary semaphores for the swapchain, timeline values for everything else. The frame only waits for the
+        // uploads it acquired, which have usually completed already and make the wait free, and for its cull pass
+        // when that ran on the async compute queue.
+        const wait_semaphores = [3]c.VkSemaphore{
+            image_available_semaphore.handles[current_frame.index],
+            timeline.transfer.handle,
+            timeline.compute.handle,
+        };
+        const wait_values = [3]u64{ 0, frame.transfer_wait, frame.compute_wait };
+        const wait_stages = [3]c.VkPipelineStageFlags{
             c.VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            vku.TRANSFER_WAIT_STAGES,
+            vkcl.WAIT_STAGES,
+        };
+
+        const frame_value = timeline.graphics.submitted + 1;
+        const signal_semaphores = [2]c.VkSemaphore{
+            render_finished_semaphore.handles[current_frame.index],
+            timeline.graphics.handle,
         };
+        const signal_values = [2]u64{ 0, frame_value };
+
+        // Without a swapchain the binary semaphores at the front are left out
+        const first: usize = if (swapchain != null) 0 else 1;
+        const timeline_info = std.mem.zeroInit(c.VkTimelineSemaphoreSubmitInfo, .{
+            .sType = c.VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+            .waitSemaphoreValueCount = @as(u32, @intCast(wait_values.len - first)),
+            .pWaitSemaphoreValues = wait_values[first..].ptr,
+            .signalSemaphoreValueCount = @as(u32, @intCast(signal_values.len - first)),
+            .pSignalSemaphoreValues = signal_values[first..].ptr,
+        });
 
-        const submit_info = c.VkSubmitInfo{
+        const submit_info = std.mem.zeroInit(c.VkSubmitInfo, .{
             .sType = c.VK_STRUCTURE_TYPE_SUBMIT_INFO,
-            .waitSemaphoreCount = 1,
-            .pWaitSemaphores = &image_available_semaphore.handles[current_frame.index],
-            .pWaitDstStageMask = &wait_stages,
+            .pNext = &timeline_info,
+            .waitSemaphoreCount = @as(u32, @intCast(wait_semaphores.len - first)),
+            .pWaitSemaphores = wait_semaphores[first..].ptr,
+            .pWaitDstStageMask = wait_stages[first..].ptr,
             .commandBufferCount = 1,
-            .pCommandBuffers = &command_buffer_refs.handles[image_index.index],
-            .signalSemaphoreCount = 1,
-            .pSignalSemaphores = &render_finished_semaphore.handles[current_frame.index],
-        };
+            .pCommandBuffers = &frame.command_buffer,
+            .signalSemaphoreCount = @as(u32, @intCast(signal_semaphores.len - first)),
+            .pSignalSemaphores = signal_semaphores[first..].ptr,
+        });
 
-        vke.checkResult(c.vkQueueSubmit(queue.graphics, 1, &submit_info, draw_fence.handles[current_frame.index])) catch |err| {
+        vke.checkResult(c.vkQueueSubmit(queue.graphics, 1, &submit_info, null)) catch |err| {
             std.debug.print("Failed to submit queue: {}\n", .{err});
             return;
         };
+        frame.timeline_value = timeline.graphics.next();
+
+        if (swapchain) |presented| {
+            const present_info = c.VkPresentInfoKHR{
+                .sType = c.VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+                .waitSemaphoreCount = 1,
+                .pWaitSemaphores = &render_finished_semaphore.handles[current_frame.index],
+                .swapchainCount = 1,
+                .pSwapchains = &presented.handle,
+                .pImageIndices = &image_index.index,
+            };
+
+            vke.checkResult(c.vkQueuePresentKHR(queue.presentation, &present_info)) catch |err| {
+                std.debug.print("Failed to present queue: {}\n", .{err});
+                return;
+            };
+            if (presentations) |pacing| {
+                pacing[i].pacer.presented(std.time.nanoTimestamp());
+            }
+        }
+
+        _ = ecs.set(it.world, it.entities()[i], CurrentFrame, .{ .index = (current_frame.index + 1) % frame_count });
+    }
+}
+
+/// Count the frames a headless device submitted and stop the world once it reached its frame limit
+fn countOffscreenFrame(it: *ecs.iter_t) callconv(.C) void {
+    const offscreens = ecs.field(it, Offscreen, 1).?;
+
+    for (0..it.count()) |i| {
+        const offscreen = &offscreens[i];
+        const now = std.time.nanoTimestamp();
+        if (offscreen.frames_rendered == 0) {
+            offscreen.first_frame_at = now;
+        }
+        offscreen.last_frame_at = now;
+        offscreen.frames_rendered += 1;
+
+        if (offscreen.frame_limit > 0 and offscreen.frames_rendered >= offscreen.frame_limit) {
+            ecs.enable(it.world, ecs.id(core.OnStop), true);
+        }
+    }
+}
+
+/// Report the frame times of a headless run and write its last frame out, before anything it needs is torn down
+fn readBackOffscreen(it: *ecs.iter_t) callconv(.C) void {
+    std.debug.print("Shut down: {s}\n", .{ecs.get_name(it.world, it.system).?});
+    const allocator = ecs.singleton_get(it.world, core.Allocator).?;
+    const devices = ecs.field(it, Device, 1).?;
+    const offscreens = ecs.field(it, Offscreen, 2).?;
+    const images_assets = ecs.field(it, ImageAssets, 3).?;
+    const render_targets = ecs.field(it, RenderTarget, 4).?;
+    const queues = ecs.field(it, Queue, 5).?;
+    const frames = ecs.field(it, Frames, 6).?;
+    const current_frames = ecs.field(it, CurrentFrame, 7).?;
+    const memory_allocators = ecs.field(it, MemoryAllocator, 8).?;
+
+    for (0..it.count()) |i| {
+        const device = devices[i];
+        const offscreen = offscreens[i];
+
+        vke.checkResult(c.vkDeviceWaitIdle(device.logical)) catch |err| {
+            std.debug.print("Failed to wait for device idle: {}\n", .{err});
+            return;
+        };
+
+        if (offscreen.frames_rendered > 1) {
+            const elapsed = @as(f64, @floatFromInt(offscreen.last_frame_at - offscreen.first_frame_at));
+            const mean_ms = elapsed / @as(f64, @floatFromInt(offscreen.frames_rendered - 1)) / std.time.ns_per_ms;
+            std.debug.print("Rendered {d} offscreen frames, {d:.3} ms per frame\n", .{ offscreen.frames_rendered, mean_ms });
+        }
+
+        const path = offscreen.readback_path orelse continue;
+        if (offscreen.frames_rendered == 0) {
+            continue;
+        }
+
+        // The current frame is the next one to be rendered, the image before it holds the last finished frame
+        const frame_count = frames[i].handle.count();
+        const current_index = current_frames[i].index;
+        const last_index = (current_index + frame_count - 1) % frame_count;
 
-        const present_info = c.VkPresentInfoKHR{
-            .sType = c.VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
-            .waitSemaphoreCount = 1,
-            .pWaitSemaphores = &render_finished_semaphore.handles[current_frame.index],
-            .swapchainCount = 1,
-            .pSwapchains = &swapchain.handle,
-            .pImageIndices = &image_index.index,
+        // The device is idle, the next frame's command buffer is free to record the copy into
+        const frame = frames[i].handle.begin(current_index) catch |err| {
+            std.debug.print("Failed to reset frame context: {}\n", .{err});
+            return;
         };
 
-        vke.checkResult(c.vkQueuePresentKHR(queue.presentation, &present_info)) catch |err| {
-            std.debug.print("Failed to present queue: {}\n", .{err});
+        const extent = render_targets[i].extent;
+        const pixels = vkos.readBack(allocator.alloc, .{
+            .allocator = memory_allocators[i].handle,
+            .device = device.logical,
+            .queue = queues[i].graphics,
+            .command_buffer = frame.command_buffer,
+            .image = images_assets[i].images[last_index],
+            .extent = extent,
+        }) catch |err| {
+            std.debug.print("Failed to read back offscreen image: {}\n", .{err});
             return;
         };
+        defer allocator.alloc.free(pixels);
 
-        _ = ecs.set(it.world, it.entities()[i], CurrentFrame, .{ .index = (current_frame.index + 1) % MAX_FRAME_DRAWS });
+        vkos.writePpmFile(path, extent.width, extent.height, pixels) catch |err| {
+            std.debug.print("Failed to write {s}: {}\n", .{ path, err });
+            return;
+        };
+        std.debug.print("Wrote the last frame to {s}\n", .{path});
     }
 }
 
-pub fn init(world: *ecs.world_t) void {
+pub fn init(world: *ecs.world_t, opts: EngineOpts) void {
+    ecs.COMPONENT(world, FramesInFlight);
+    _ = ecs.singleton_set(world, FramesInFlight, .{ .count = vkfr.clampFramesInFlight(opts.frames_in_flight) });
+    ecs.COMPONENT(world, ObjectCapacity);
+    _ = ecs.singleton_set(world, ObjectCapacity, .{ .count = @max(opts.max_objects, 1) });
+    ecs.COMPONENT(world, PresentPolicy);
+    _ = ecs.singleton_set(world, PresentPolicy, opts.present);
+    ecs.COMPONENT(world, GpuTimings);
+    _ = ecs.singleton_set(world, GpuTimings, .{});
+
     ecs.COMPONENT(world, Device);
     ecs.COMPONENT(world, DeviceAlignment);
+    ecs.COMPONENT(world, MemoryAllocator);
+    ecs.COMPONENT(world, PipelineCache);
+    ecs.COMPONENT(world, ShaderModules);
+    ecs.COMPONENT(world, Uploader);
+    ecs.COMPONENT(world, PendingUpload);
     ecs.COMPONENT(world, DeviceEntity);
     ecs.COMPONENT(world, Surface);
     ecs.COMPONENT(world, Queue);
@@ -1017,31 +2456,54 @@ pub fn init(world: *ecs.world_t) void {
     ecs.COMPONENT(world, Swapchain);
     ecs.COMPONENT(world, ImageAssets);
     ecs.COMPONENT(world, BufferCount);
+    ecs.COMPONENT(world, Presentation);
     ecs.COMPONENT(world, DepthImage);
     ecs.COMPONENT(world, RenderPass);
     ecs.COMPONENT(world, DescriptorSetLayout);
-    ecs.COMPONENT(world, UniformBuffers);
+    ecs.COMPONENT(world, FrameUniforms);
     ecs.COMPONENT(world, DescriptorPool);
     ecs.COMPONENT(world, DescriptorSets);
     ecs.COMPONENT(world, Pipeline);
     ecs.COMPONENT(world, Framebuffers);
-    ecs.COMPONENT(world, CommandPool);
-    ecs.COMPONENT(world, CommandBuffers);
+    ecs.COMPONENT(world, Frames);
+    ecs.COMPONENT(world, Recorder);
     ecs.COMPONENT(world, ImageAvailableSemaphores);
     ecs.COMPONENT(world, RenderFinishedSemaphores);
-    ecs.COMPONENT(world, DrawFences);
-    ecs.COMPONENT(world, VertexBuffer);
-    ecs.COMPONENT(world, IndexBuffer);
+    ecs.COMPONENT(world, Timelines);
+    ecs.COMPONENT(world, GeometryBuffers);
+    ecs.COMPONENT(world, MeshRange);
+    ecs.COMPONENT(world, DrawList);
+    ecs.COMPONENT(world, DrawSubmission);
+    ecs.COMPONENT(world, CullPipeline);
+    ecs.COMPONENT(world, AsyncCompute);
+    ecs.COMPONENT(world, ComputeTimings);
+    ecs.COMPONENT(world, GpuProfiler);
+    ecs.COMPONENT(world, ShaderReload);
+    ecs.COMPONENT(world, RenderStats);
+    ecs.COMPONENT(world, TextureTable);
     ecs.COMPONENT(world, Texture);
     ecs.COMPONENT(world, SamplerDescriptorSets);
     ecs.COMPONENT(world, CurrentFrame);
     ecs.COMPONENT(world, ImageIndex);
-    ecs.COMPONENT(world, LightTransferSpace);
-
-    var device_desc = ecs.system_desc_t{};
-    device_desc.callback = createDevice;
-    device_desc.query.filter.terms[0] = .{ .id = ecs.id(sdl.Window), .inout = ecs.inout_kind_t.In };
-    ecs.SYSTEM(world, "VkStartDeviceSystem", ecs.OnStart, &device_desc);
+    ecs.COMPONENT(world, RenderTarget);
+    ecs.COMPONENT(world, Offscreen);
+    ecs.COMPONENT(world, Headless);
+
+    if (opts.headless) |headless| {
+        _ = ecs.singleton_set(world, Headless, headless);
+
+        var device_desc = ecs.system_desc_t{};
+        device_desc.callback = createHeadlessDevice;
+        device_desc.query.filter.terms[0] = .{ .id = ecs.id(Headless), .inout = ecs.inout_kind_t.In, .src = .{ .id = ecs.id(Headless) } };
+        ecs.SYSTEM(world, "VkStartDeviceSystem", ecs.OnStart, &device_desc);
+    } else if (comptime c.has_sdl) {
+        var device_desc = ecs.system_desc_t{};
+        device_desc.callback = createDevice;
+        device_desc.query.filter.terms[0] = .{ .id = ecs.id(sdl.Window), .inout = ecs.inout_kind_t.In };
+        ecs.SYSTEM(world, "VkStartDeviceSystem", ecs.OnStart, &device_desc);
+    } else {
+        @panic("Only headless rendering is supported without SDL");
+    }
 
     var swapchain_desc = ecs.system_desc_t{};
     swapchain_desc.callback = createSwapchain;
@@ -1049,45 +2511,106 @@ pub fn init(world: *ecs.world_t) void {
     swapchain_desc.query.filter.terms[1] = .{ .id = ecs.id(Surface), .inout = ecs.inout_kind_t.In };
     swapchain_desc.query.filter.terms[2] = .{ .id = ecs.id(QueueIndex), .inout = ecs.inout_kind_t.In };
     swapchain_desc.query.filter.terms[3] = .{ .id = ecs.id(core.CanvasSize), .inout = ecs.inout_kind_t.In };
+    swapchain_desc.query.filter.terms[4] = .{ .id = ecs.id(MemoryAllocator), .inout = ecs.inout_kind_t.In };
     ecs.SYSTEM(world, "VkStartSwapchainSystem", ecs.OnStart, &swapchain_desc);
 
+    var offscreen_desc = ecs.system_desc_t{};
+    offscreen_desc.callback = createOffscreenTargets;
+    offscreen_desc.query.filter.terms[0] = .{ .id = ecs.id(Device), .inout = ecs.inout_kind_t.In };
+    offscreen_desc.query.filter.terms[1] = .{ .id = ecs.id(Offscreen), .inout = ecs.inout_kind_t.InOut };
+    offscreen_desc.query.filter.terms[2] = .{ .id = ecs.id(core.CanvasSize), .inout = ecs.inout_kind_t.In };
+    offscreen_desc.query.filter.terms[3] = .{ .id = ecs.id(MemoryAllocator), .inout = ecs.inout_kind_t.In };
+    ecs.SYSTEM(world, "VkStartOffscreenSystem", ecs.OnStart, &offscreen_desc);
+
     var render_pass_desc = ecs.system_desc_t{};
     render_pass_desc.callback = createRenderPass;
     render_pass_desc.query.filter.terms[0] = .{ .id = ecs.id(Device), .inout = ecs.inout_kind_t.In };
-    render_pass_desc.query.filter.terms[1] = .{ .id = ecs.id(Swapchain), .inout = ecs.inout_kind_t.In };
+    render_pass_desc.query.filter.terms[1] = .{ .id = ecs.id(RenderTarget), .inout = ecs.inout_kind_t.In };
     render_pass_desc.query.filter.terms[2] = .{ .id = ecs.id(BufferCount), .inout = ecs.inout_kind_t.In };
     render_pass_desc.query.filter.terms[3] = .{ .id = ecs.id(DeviceAlignment), .inout = ecs.inout_kind_t.In };
     render_pass_desc.query.filter.terms[4] = .{ .id = ecs.id(DepthImage), .inout = ecs.inout_kind_t.In };
     render_pass_desc.query.filter.terms[5] = .{ .id = ecs.id(ImageAssets), .inout = ecs.inout_kind_t.In };
+    render_pass_desc.query.filter.terms[6] = .{ .id = ecs.id(MemoryAllocator), .inout = ecs.inout_kind_t.In };
+    render_pass_desc.query.filter.terms[7] = .{ .id = ecs.id(PipelineCache), .inout = ecs.inout_kind_t.In };
+    render_pass_desc.query.filter.terms[8] = .{ .id = ecs.id(ShaderModules), .inout = ecs.inout_kind_t.In };
+    render_pass_desc.query.filter.terms[9] = .{ .id = ecs.id(TextureTable), .inout = ecs.inout_kind_t.In, .oper = ecs.oper_kind_t.Optional };
+    render_pass_desc.query.filter.terms[10] = .{ .id = ecs.id(QueueIndex), .inout = ecs.inout_kind_t.In };
     ecs.SYSTEM(world, "VkStartRenderPassSystem", ecs.OnStart, &render_pass_desc);
 
     var command_buffer_desc = ecs.system_desc_t{};
     command_buffer_desc.callback = createCommandBuffers;
     command_buffer_desc.query.filter.terms[0] = .{ .id = ecs.id(Device), .inout = ecs.inout_kind_t.In };
     command_buffer_desc.query.filter.terms[1] = .{ .id = ecs.id(QueueIndex), .inout = ecs.inout_kind_t.In };
-    command_buffer_desc.query.filter.terms[2] = .{ .id = ecs.id(BufferCount), .inout = ecs.inout_kind_t.In };
     ecs.SYSTEM(world, "VkStartCommandBufferSystem", ecs.OnStart, &command_buffer_desc);
 
+    var upload_desc = ecs.system_desc_t{};
+    upload_desc.callback = createUploader;
+    upload_desc.query.filter.terms[0] = .{ .id = ecs.id(Device), .inout = ecs.inout_kind_t.In };
+    upload_desc.query.filter.terms[1] = .{ .id = ecs.id(Queue), .inout = ecs.inout_kind_t.In };
+    upload_desc.query.filter.terms[2] = .{ .id = ecs.id(QueueIndex), .inout = ecs.inout_kind_t.In };
+    upload_desc.query.filter.terms[3] = .{ .id = ecs.id(MemoryAllocator), .inout = ecs.inout_kind_t.In };
+    upload_desc.query.filter.terms[4] = .{ .id = ecs.id(Timelines), .inout = ecs.inout_kind_t.In };
+    ecs.SYSTEM(world, "VkStartUploadSystem", ecs.OnStart, &upload_desc);
+
+    var geometry_desc = ecs.system_desc_t{};
+    geometry_desc.callback = createGeometry;
+    geometry_desc.query.filter.terms[0] = .{ .id = ecs.id(Device), .inout = ecs.inout_kind_t.In };
+    geometry_desc.query.filter.terms[1] = .{ .id = ecs.id(MemoryAllocator), .inout = ecs.inout_kind_t.In };
+    ecs.SYSTEM(world, "VkStartGeometrySystem", ecs.OnStart, &geometry_desc);
+
     var texture_desc = ecs.system_desc_t{};
     texture_desc.callback = simpleTextureSetUp;
     texture_desc.query.filter.terms[0] = .{ .id = ecs.id(Device), .inout = ecs.inout_kind_t.In };
-    texture_desc.query.filter.terms[1] = .{ .id = ecs.id(Queue), .inout = ecs.inout_kind_t.In };
-    texture_desc.query.filter.terms[2] = .{ .id = ecs.id(CommandPool), .inout = ecs.inout_kind_t.In };
-    texture_desc.query.filter.terms[3] = .{ .id = ecs.id(DescriptorPool), .inout = ecs.inout_kind_t.In };
-    texture_desc.query.filter.terms[4] = .{ .id = ecs.id(DescriptorSetLayout), .inout = ecs.inout_kind_t.In };
+    texture_desc.query.filter.terms[1] = .{ .id = ecs.id(Uploader), .inout = ecs.inout_kind_t.In };
+    texture_desc.query.filter.terms[2] = .{ .id = ecs.id(DescriptorPool), .inout = ecs.inout_kind_t.In };
+    texture_desc.query.filter.terms[3] = .{ .id = ecs.id(DescriptorSetLayout), .inout = ecs.inout_kind_t.In };
+    texture_desc.query.filter.terms[4] = .{ .id = ecs.id(MemoryAllocator), .inout = ecs.inout_kind_t.In };
+    texture_desc.query.filter.terms[5] = .{ .id = ecs.id(TextureTable), .inout = ecs.inout_kind_t.In, .oper = ecs.oper_kind_t.Optional };
     ecs.SYSTEM(world, "VkStartTextureSystem", ecs.OnStart, &texture_desc);
 
+    var retire_upload_desc = ecs.system_desc_t{};
+    retire_upload_desc.callback = retireUploads;
+    retire_upload_desc.query.filter.terms[0] = .{ .id = ecs.id(PendingUpload), .inout = ecs.inout_kind_t.In };
+    retire_upload_desc.query.filter.terms[1] = .{ .id = ecs.id(DeviceEntity), .inout = ecs.inout_kind_t.In };
+    ecs.SYSTEM(world, "VkRetireUploadSystem", ecs.OnUpdate, &retire_upload_desc);
+
     var create_mesh_desc = ecs.system_desc_t{};
     create_mesh_desc.callback = createMeshBuffers;
     create_mesh_desc.query.filter.terms[0] = .{ .id = ecs.id(scene.Mesh), .inout = ecs.inout_kind_t.In };
     create_mesh_desc.query.filter.terms[1] = .{ .id = ecs.id(scene.UpdateBuffer), .inout = ecs.inout_kind_t.In };
+    create_mesh_desc.query.filter.terms[2] = .{ .id = ecs.id(PendingUpload), .inout = ecs.inout_kind_t.InOutNone, .oper = ecs.oper_kind_t.Not };
+    create_mesh_desc.query.filter.terms[3] = .{ .id = ecs.id(scene.BorrowedMesh), .inout = ecs.inout_kind_t.In, .oper = ecs.oper_kind_t.Optional };
     ecs.SYSTEM(world, "VkCreateMeshBufferSystem", ecs.OnUpdate, &create_mesh_desc);
 
+    var submit_upload_desc = ecs.system_desc_t{};
+    submit_upload_desc.callback = submitUploads;
+    submit_upload_desc.query.filter.terms[0] = .{ .id = ecs.id(Uploader), .inout = ecs.inout_kind_t.In };
+    ecs.SYSTEM(world, "VkSubmitUploadSystem", ecs.OnUpdate, &submit_upload_desc);
+
+    var pace_frame_desc = ecs.system_desc_t{};
+    pace_frame_desc.callback = paceFrame;
+    pace_frame_desc.query.filter.terms[0] = .{ .id = ecs.id(Presentation), .inout = ecs.inout_kind_t.In };
+    ecs.SYSTEM(world, "VkPaceFrameSystem", ecs.PreFrame, &pace_frame_desc);
+
+    var present_policy_desc = ecs.system_desc_t{};
+    present_policy_desc.callback = applyPresentPolicy;
+    present_policy_desc.query.filter.terms[0] = .{ .id = ecs.id(Device), .inout = ecs.inout_kind_t.In };
+    present_policy_desc.query.filter.terms[1] = .{ .id = ecs.id(Surface), .inout = ecs.inout_kind_t.In };
+    present_policy_desc.query.filter.terms[2] = .{ .id = ecs.id(QueueIndex), .inout = ecs.inout_kind_t.In };
+    present_policy_desc.query.filter.terms[3] = .{ .id = ecs.id(Swapchain), .inout = ecs.inout_kind_t.InOut };
+    present_policy_desc.query.filter.terms[4] = .{ .id = ecs.id(ImageAssets), .inout = ecs.inout_kind_t.InOut };
+    present_policy_desc.query.filter.terms[5] = .{ .id = ecs.id(DepthImage), .inout = ecs.inout_kind_t.In };
+    present_policy_desc.query.filter.terms[6] = .{ .id = ecs.id(RenderPass), .inout = ecs.inout_kind_t.In };
+    present_policy_desc.query.filter.terms[7] = .{ .id = ecs.id(Framebuffers), .inout = ecs.inout_kind_t.InOut };
+    present_policy_desc.query.filter.terms[8] = .{ .id = ecs.id(BufferCount), .inout = ecs.inout_kind_t.InOut };
+    present_policy_desc.query.filter.terms[9] = .{ .id = ecs.id(Presentation), .inout = ecs.inout_kind_t.InOut };
+    ecs.SYSTEM(world, "VkPresentPolicySystem", ecs.OnStore, &present_policy_desc);
+
     var assign_image_desc = ecs.system_desc_t{};
     assign_image_desc.callback = assignNextImage;
     assign_image_desc.query.filter.terms[0] = .{ .id = ecs.id(Device), .inout = ecs.inout_kind_t.In };
     assign_image_desc.query.filter.terms[1] = .{ .id = ecs.id(ImageAvailableSemaphores), .inout = ecs.inout_kind_t.In };
-    assign_image_desc.query.filter.terms[2] = .{ .id = ecs.id(DrawFences), .inout = ecs.inout_kind_t.In };
+    assign_image_desc.query.filter.terms[2] = .{ .id = ecs.id(Timelines), .inout = ecs.inout_kind_t.In };
     assign_image_desc.query.filter.terms[3] = .{ .id = ecs.id(Swapchain), .inout = ecs.inout_kind_t.In };
     assign_image_desc.query.filter.terms[4] = .{ .id = ecs.id(CurrentFrame), .inout = ecs.inout_kind_t.In };
     assign_image_desc.query.filter.terms[5] = .{ 
@@ -1098,74 +2621,195 @@ pub fn init(world: *ecs.world_t) void {
             .id = 0,
         }
     };
+    assign_image_desc.query.filter.terms[6] = .{ .id = ecs.id(Frames), .inout = ecs.inout_kind_t.In };
+    assign_image_desc.query.filter.terms[7] = .{ .id = ecs.id(Presentation), .inout = ecs.inout_kind_t.InOut };
     ecs.SYSTEM(world, "VkAssignImageSystem", ecs.OnStore, &assign_image_desc);
 
+    var assign_offscreen_desc = ecs.system_desc_t{};
+    assign_offscreen_desc.callback = assignOffscreenImage;
+    assign_offscreen_desc.query.filter.terms[0] = .{ .id = ecs.id(Device), .inout = ecs.inout_kind_t.In };
+    assign_offscreen_desc.query.filter.terms[1] = .{ .id = ecs.id(Timelines), .inout = ecs.inout_kind_t.In };
+    assign_offscreen_desc.query.filter.terms[2] = .{ .id = ecs.id(CurrentFrame), .inout = ecs.inout_kind_t.In };
+    assign_offscreen_desc.query.filter.terms[3] = .{ .id = ecs.id(Frames), .inout = ecs.inout_kind_t.In };
+    assign_offscreen_desc.query.filter.terms[4] = .{ .id = ecs.id(Offscreen), .inout = ecs.inout_kind_t.In };
+    ecs.SYSTEM(world, "VkAssignOffscreenImageSystem", ecs.OnStore, &assign_offscreen_desc);
+
+    var hot_reload_desc = ecs.system_desc_t{};
+    hot_reload_desc.callback = swapReloadedPipelines;
+    hot_reload_desc.query.filter.terms[0] = .{ .id = ecs.id(ShaderReload), .inout = ecs.inout_kind_t.In };
+    hot_reload_desc.query.filter.terms[1] = .{ .id = ecs.id(Pipeline), .inout = ecs.inout_kind_t.InOut };
+    hot_reload_desc.query.filter.terms[2] = .{ .id = ecs.id(CullPipeline), .inout = ecs.inout_kind_t.InOut };
+    hot_reload_desc.query.filter.terms[3] = .{ .id = ecs.id(Timelines), .inout = ecs.inout_kind_t.In };
+    ecs.SYSTEM(world, "VkHotReloadSystem", ecs.OnStore, &hot_reload_desc);
+
+    var collect_mesh_desc = ecs.system_desc_t{};
+    collect_mesh_desc.callback = collectMeshRanges;
+    collect_mesh_desc.query.filter.terms[0] = .{ .id = ecs.id(GeometryBuffers), .inout = ecs.inout_kind_t.In };
+    collect_mesh_desc.query.filter.terms[1] = .{ .id = ecs.id(Timelines), .inout = ecs.inout_kind_t.In };
+    ecs.SYSTEM(world, "VkCollectMeshRangeSystem", ecs.OnStore, &collect_mesh_desc);
+
+    // Cached once instead of building a filter every frame
+    var camera_query_desc = ecs.query_desc_t{};
+    camera_query_desc.filter.terms[0] = .{ .id = ecs.id(scene.Camera), .inout = ecs.inout_kind_t.In };
+    camera_query_desc.filter.terms[1] = .{ .id = ecs.id(scene.Light), .inout = ecs.inout_kind_t.In };
+    const camera_query = ecs.query_init(world, &camera_query_desc) catch |err| {
+        std.debug.print("Failed to create camera query: {}\n", .{err});
+        return;
+    };
+
+    var bind_camera_desc = ecs.system_desc_t{};
+    bind_camera_desc.callback = bindCameraMemory;
+    bind_camera_desc.ctx = camera_query;
+    bind_camera_desc.ctx_free = freeQuery;
+    bind_camera_desc.query.filter.terms[0] = .{ .id = ecs.id(FrameUniforms), .inout = ecs.inout_kind_t.InOut };
+    bind_camera_desc.query.filter.terms[1] = .{ .id = ecs.id(CurrentFrame), .inout = ecs.inout_kind_t.In };
+    ecs.SYSTEM(world, "VkBindCameraMemorySystem", ecs.OnStore, &bind_camera_desc);
+
+    var drawable_query_desc = ecs.query_desc_t{};
+    drawable_query_desc.filter.terms[0] = .{ .id = ecs.id(MeshRange), .inout = ecs.inout_kind_t.In };
+    drawable_query_desc.filter.terms[1] = .{ .id = ecs.id(scene.Mesh), .inout = ecs.inout_kind_t.In };
+    drawable_query_desc.filter.terms[2] = .{ .id = ecs.id(scene.Transform), .inout = ecs.inout_kind_t.In };
+    drawable_query_desc.filter.terms[3] = .{ .id = ecs.id(DeviceEntity), .inout = ecs.inout_kind_t.In };
+    drawable_query_desc.filter.terms[4] = .{ .id = ecs.id(scene.Visible), .inout = ecs.inout_kind_t.In, .oper = ecs.oper_kind_t.Optional };
+    // Meshes still in flight on the transfer queue are drawn once their batch has completed
+    drawable_query_desc.filter.terms[5] = .{ .id = ecs.id(PendingUpload), .inout = ecs.inout_kind_t.InOutNone, .oper = ecs.oper_kind_t.Not };
+    const drawable_query = ecs.query_init(world, &drawable_query_desc) catch |err| {
+        std.debug.print("Failed to create drawable query: {}\n", .{err});
+        return;
+    };
+
+    var build_draw_list_desc = ecs.system_desc_t{};
+    build_draw_list_desc.callback = buildDrawList;
+    build_draw_list_desc.ctx = drawable_query;
+    build_draw_list_desc.ctx_free = freeQuery;
+    build_draw_list_desc.query.filter.terms[0] = .{ .id = ecs.id(DrawList), .inout = ecs.inout_kind_t.InOut };
+    build_draw_list_desc.query.filter.terms[1] = .{ .id = ecs.id(FrameUniforms), .inout = ecs.inout_kind_t.InOut };
+    build_draw_list_desc.query.filter.terms[2] = .{ .id = ecs.id(DrawSubmission), .inout = ecs.inout_kind_t.In };
+    build_draw_list_desc.query.filter.terms[3] = .{ .id = ecs.id(RenderStats), .inout = ecs.inout_kind_t.Out };
+    ecs.SYSTEM(world, "VkBuildDrawListSystem", ecs.OnStore, &build_draw_list_desc);
+
+    var async_compute_desc = ecs.system_desc_t{};
+    async_compute_desc.callback = dispatchCompute;
+    async_compute_desc.query.filter.terms[0] = .{ .id = ecs.id(Device), .inout = ecs.inout_kind_t.In };
+    async_compute_desc.query.filter.terms[1] = .{ .id = ecs.id(Frames), .inout = ecs.inout_kind_t.In };
+    async_compute_desc.query.filter.terms[2] = .{ .id = ecs.id(FrameUniforms), .inout = ecs.inout_kind_t.In };
+    async_compute_desc.query.filter.terms[3] = .{ .id = ecs.id(DrawSubmission), .inout = ecs.inout_kind_t.In };
+    async_compute_desc.query.filter.terms[4] = .{ .id = ecs.id(CullPipeline), .inout = ecs.inout_kind_t.In };
+    async_compute_desc.query.filter.terms[5] = .{ .id = ecs.id(CurrentFrame), .inout = ecs.inout_kind_t.In };
+    async_compute_desc.query.filter.terms[6] = .{ .id = ecs.id(Timelines), .inout = ecs.inout_kind_t.In };
+    async_compute_desc.query.filter.terms[7] = .{ .id = ecs.id(Queue), .inout = ecs.inout_kind_t.In };
+    async_compute_desc.query.filter.terms[8] = .{ .id = ecs.id(AsyncCompute), .inout = ecs.inout_kind_t.In };
+    ecs.SYSTEM(world, "VkAsyncComputeSystem", ecs.OnStore, &async_compute_desc);
+
     var begin_commands_desc = ecs.system_desc_t{};
     begin_commands_desc.callback = beginCommands;
     begin_commands_desc.query.filter.terms[0] = .{ .id = ecs.id(ImageIndex), .inout = ecs.inout_kind_t.In };
-    begin_commands_desc.query.filter.terms[1] = .{ .id = ecs.id(CommandBuffers), .inout = ecs.inout_kind_t.In };
+    begin_commands_desc.query.filter.terms[1] = .{ .id = ecs.id(Frames), .inout = ecs.inout_kind_t.In };
     begin_commands_desc.query.filter.terms[2] = .{ .id = ecs.id(RenderPass), .inout = ecs.inout_kind_t.In };
-    begin_commands_desc.query.filter.terms[3] = .{ .id = ecs.id(Swapchain), .inout = ecs.inout_kind_t.In };
+    begin_commands_desc.query.filter.terms[3] = .{ .id = ecs.id(RenderTarget), .inout = ecs.inout_kind_t.In };
     begin_commands_desc.query.filter.terms[4] = .{ .id = ecs.id(Framebuffers), .inout = ecs.inout_kind_t.In };
-    begin_commands_desc.query.filter.terms[5] = .{ .id = ecs.id(Pipeline), .inout = ecs.inout_kind_t.In };
-    begin_commands_desc.query.filter.terms[6] = .{ .id = ecs.id(DescriptorSets), .inout = ecs.inout_kind_t.In };
+    begin_commands_desc.query.filter.terms[5] = .{ .id = ecs.id(FrameUniforms), .inout = ecs.inout_kind_t.In };
+    begin_commands_desc.query.filter.terms[6] = .{ .id = ecs.id(DrawSubmission), .inout = ecs.inout_kind_t.In };
+    begin_commands_desc.query.filter.terms[7] = .{ .id = ecs.id(CullPipeline), .inout = ecs.inout_kind_t.In };
+    begin_commands_desc.query.filter.terms[8] = .{ .id = ecs.id(CurrentFrame), .inout = ecs.inout_kind_t.In };
+    begin_commands_desc.query.filter.terms[9] = .{ .id = ecs.id(Uploader), .inout = ecs.inout_kind_t.In };
+    begin_commands_desc.query.filter.terms[10] = .{ .id = ecs.id(AsyncCompute), .inout = ecs.inout_kind_t.In, .oper = ecs.oper_kind_t.Optional };
+    begin_commands_desc.query.filter.terms[11] = .{ .id = ecs.id(GpuProfiler), .inout = ecs.inout_kind_t.In, .oper = ecs.oper_kind_t.Optional };
     ecs.SYSTEM(world, "VkBeginCommandsSystem", ecs.OnStore, &begin_commands_desc);
 
     var vertex_index_desc = ecs.system_desc_t{};
     vertex_index_desc.callback = vertexAndIndexCommands;
-    vertex_index_desc.query.filter.terms[0] = .{ .id = ecs.id(VertexBuffer), .inout = ecs.inout_kind_t.In };
-    vertex_index_desc.query.filter.terms[1] = .{ .id = ecs.id(IndexBuffer), .inout = ecs.inout_kind_t.In };
-    vertex_index_desc.query.filter.terms[2] = .{ .id = ecs.id(DeviceEntity), .inout = ecs.inout_kind_t.In };
-    vertex_index_desc.query.filter.terms[3] = .{ .id = ecs.id(scene.Transform), .inout = ecs.inout_kind_t.In };
-    vertex_index_desc.query.filter.terms[4] = .{ .id = ecs.id(scene.Mesh), .inout = ecs.inout_kind_t.In };
+    vertex_index_desc.query.filter.terms[0] = .{ .id = ecs.id(Frames), .inout = ecs.inout_kind_t.In };
+    vertex_index_desc.query.filter.terms[1] = .{ .id = ecs.id(ImageIndex), .inout = ecs.inout_kind_t.In };
+    vertex_index_desc.query.filter.terms[2] = .{ .id = ecs.id(DescriptorSets), .inout = ecs.inout_kind_t.In };
+    vertex_index_desc.query.filter.terms[3] = .{ .id = ecs.id(Pipeline), .inout = ecs.inout_kind_t.In };
+    vertex_index_desc.query.filter.terms[4] = .{ .id = ecs.id(SamplerDescriptorSets), .inout = ecs.inout_kind_t.In };
+    vertex_index_desc.query.filter.terms[5] = .{ .id = ecs.id(FrameUniforms), .inout = ecs.inout_kind_t.In };
+    vertex_index_desc.query.filter.terms[6] = .{ .id = ecs.id(DrawList), .inout = ecs.inout_kind_t.In };
+    vertex_index_desc.query.filter.terms[7] = .{ .id = ecs.id(DrawSubmission), .inout = ecs.inout_kind_t.In };
+    vertex_index_desc.query.filter.terms[8] = .{ .id = ecs.id(RenderPass), .inout = ecs.inout_kind_t.In };
+    vertex_index_desc.query.filter.terms[9] = .{ .id = ecs.id(Framebuffers), .inout = ecs.inout_kind_t.In };
+    vertex_index_desc.query.filter.terms[10] = .{ .id = ecs.id(GeometryBuffers), .inout = ecs.inout_kind_t.In };
+    vertex_index_desc.query.filter.terms[11] = .{ .id = ecs.id(CurrentFrame), .inout = ecs.inout_kind_t.In };
+    vertex_index_desc.query.filter.terms[12] = .{ .id = ecs.id(Recorder), .inout = ecs.inout_kind_t.In };
+    vertex_index_desc.query.filter.terms[13] = .{ .id = ecs.id(TextureTable), .inout = ecs.inout_kind_t.In, .oper = ecs.oper_kind_t.Optional };
+    vertex_index_desc.query.filter.terms[14] = .{ .id = ecs.id(GpuProfiler), .inout = ecs.inout_kind_t.In, .oper = ecs.oper_kind_t.Optional };
     ecs.SYSTEM(world, "VkVertexIndexCommandsSystem", ecs.OnStore, &vertex_index_desc);
 
     var end_commands_desc = ecs.system_desc_t{};
     end_commands_desc.callback = endCommands;
-    end_commands_desc.query.filter.terms[0] = .{ .id = ecs.id(CommandBuffers), .inout = ecs.inout_kind_t.In };
-    end_commands_desc.query.filter.terms[1] = .{ .id = ecs.id(ImageIndex), .inout = ecs.inout_kind_t.In };
+    end_commands_desc.query.filter.terms[0] = .{ .id = ecs.id(Frames), .inout = ecs.inout_kind_t.In };
+    end_commands_desc.query.filter.terms[1] = .{ .id = ecs.id(CurrentFrame), .inout = ecs.inout_kind_t.In };
+    end_commands_desc.query.filter.terms[2] = .{ .id = ecs.id(AsyncCompute), .inout = ecs.inout_kind_t.In, .oper = ecs.oper_kind_t.Optional };
+    end_commands_desc.query.filter.terms[3] = .{ .id = ecs.id(GpuProfiler), .inout = ecs.inout_kind_t.In, .oper = ecs.oper_kind_t.Optional };
     ecs.SYSTEM(world, "VkEndCommandsSystem", ecs.OnStore, &end_commands_desc);
 
-    var bind_camera_desc = ecs.system_desc_t{};
-    bind_camera_desc.callback = bindCameraMemory;
-    bind_camera_desc.query.filter.terms[0] = .{ .id = ecs.id(scene.Camera), .inout = ecs.inout_kind_t.In };
-    bind_camera_desc.query.filter.terms[1] = .{ .id = ecs.id(scene.Light), .inout = ecs.inout_kind_t.In };
-    ecs.SYSTEM(world, "VkBindCameraMemorySystem", ecs.OnStore, &bind_camera_desc);
-
     var draw_desc = ecs.system_desc_t{};
     draw_desc.callback = draw;
-    draw_desc.query.filter.terms[0] = .{ .id = ecs.id(CommandBuffers), .inout = ecs.inout_kind_t.In };
+    draw_desc.query.filter.terms[0] = .{ .id = ecs.id(Frames), .inout = ecs.inout_kind_t.In };
     draw_desc.query.filter.terms[1] = .{ .id = ecs.id(ImageAvailableSemaphores), .inout = ecs.inout_kind_t.In };
     draw_desc.query.filter.terms[2] = .{ .id = ecs.id(RenderFinishedSemaphores), .inout = ecs.inout_kind_t.In };
-    draw_desc.query.filter.terms[3] = .{ .id = ecs.id(DrawFences), .inout = ecs.inout_kind_t.In };
+    draw_desc.query.filter.terms[3] = .{ .id = ecs.id(Timelines), .inout = ecs.inout_kind_t.In };
     draw_desc.query.filter.terms[4] = .{ .id = ecs.id(ImageIndex), .inout = ecs.inout_kind_t.In };
-    draw_desc.query.filter.terms[5] = .{ .id = ecs.id(Swapchain), .inout = ecs.inout_kind_t.In };
+    draw_desc.query.filter.terms[5] = .{ .id = ecs.id(Swapchain), .inout = ecs.inout_kind_t.In, .oper = ecs.oper_kind_t.Optional };
     draw_desc.query.filter.terms[6] = .{ .id = ecs.id(Queue), .inout = ecs.inout_kind_t.In };
     draw_desc.query.filter.terms[7] = .{ .id = ecs.id(CurrentFrame), .inout = ecs.inout_kind_t.InOut };
+    draw_desc.query.filter.terms[8] = .{ .id = ecs.id(Presentation), .inout = ecs.inout_kind_t.InOut, .oper = ecs.oper_kind_t.Optional };
     ecs.SYSTEM(world, "VkDrawSystem", ecs.OnStore, &draw_desc);
 
-    var destroy_mesh_desc = ecs.system_desc_t{};
-    destroy_mesh_desc.callback = destroyMeshBuffers;
-    destroy_mesh_desc.query.filter.terms[0] = .{ .id = ecs.id(VertexBuffer), .inout = ecs.inout_kind_t.In };
-    destroy_mesh_desc.query.filter.terms[1] = .{ .id = ecs.id(IndexBuffer), .inout = ecs.inout_kind_t.In };
-    destroy_mesh_desc.query.filter.terms[2] = .{ .id = ecs.id(DeviceEntity), .inout = ecs.inout_kind_t.In };
-    ecs.SYSTEM(world, "VkDestroyMeshBufferSystem", ecs.id(core.OnStop), &destroy_mesh_desc);
+    var offscreen_frame_desc = ecs.system_desc_t{};
+    offscreen_frame_desc.callback = countOffscreenFrame;
+    offscreen_frame_desc.query.filter.terms[0] = .{ .id = ecs.id(Offscreen), .inout = ecs.inout_kind_t.InOut };
+    ecs.SYSTEM(world, "VkOffscreenFrameSystem", ecs.OnStore, &offscreen_frame_desc);
+
+    var release_mesh_desc = ecs.observer_desc_t{
+        .callback = releaseMeshRange,
+    };
+    release_mesh_desc.filter.terms[0] = .{ .id = ecs.id(MeshRange), .inout = ecs.inout_kind_t.In };
+    release_mesh_desc.events[0] = ecs.UnSet;
+    ecs.OBSERVER(world, "VkReleaseMeshRangeObserver", &release_mesh_desc);
+
+    // Declared ahead of every other OnStop system so the frame it reads back is still intact
+    var readback_desc = ecs.system_desc_t{};
+    readback_desc.callback = readBackOffscreen;
+    readback_desc.query.filter.terms[0] = .{ .id = ecs.id(Device), .inout = ecs.inout_kind_t.In };
+    readback_desc.query.filter.terms[1] = .{ .id = ecs.id(Offscreen), .inout = ecs.inout_kind_t.In };
+    readback_desc.query.filter.terms[2] = .{ .id = ecs.id(ImageAssets), .inout = ecs.inout_kind_t.In };
+    readback_desc.query.filter.terms[3] = .{ .id = ecs.id(RenderTarget), .inout = ecs.inout_kind_t.In };
+    readback_desc.query.filter.terms[4] = .{ .id = ecs.id(Queue), .inout = ecs.inout_kind_t.In };
+    readback_desc.query.filter.terms[5] = .{ .id = ecs.id(Frames), .inout = ecs.inout_kind_t.In };
+    readback_desc.query.filter.terms[6] = .{ .id = ecs.id(CurrentFrame), .inout = ecs.inout_kind_t.In };
+    readback_desc.query.filter.terms[7] = .{ .id = ecs.id(MemoryAllocator), .inout = ecs.inout_kind_t.In };
+    ecs.SYSTEM(world, "VkOffscreenReadbackSystem", ecs.id(core.OnStop), &readback_desc);
+
+    var destroy_geometry_desc = ecs.system_desc_t{};
+    destroy_geometry_desc.callback = destroyGeometry;
+    destroy_geometry_desc.query.filter.terms[0] = .{ .id = ecs.id(Device), .inout = ecs.inout_kind_t.In };
+    destroy_geometry_desc.query.filter.terms[1] = .{ .id = ecs.id(GeometryBuffers), .inout = ecs.inout_kind_t.In };
+    destroy_geometry_desc.query.filter.terms[2] = .{ .id = ecs.id(MemoryAllocator), .inout = ecs.inout_kind_t.In };
+    ecs.SYSTEM(world, "VkDestroyGeometrySystem", ecs.id(core.OnStop), &destroy_geometry_desc);
     
     var destroy_texture_desc = ecs.system_desc_t{};
     destroy_texture_desc.callback = destroySimpleTexture;
     destroy_texture_desc.query.filter.terms[0] = .{ .id = ecs.id(Texture), .inout = ecs.inout_kind_t.In };
     destroy_texture_desc.query.filter.terms[1] = .{ .id = ecs.id(SamplerDescriptorSets), .inout = ecs.inout_kind_t.In };
     destroy_texture_desc.query.filter.terms[2] = .{ .id = ecs.id(Device), .inout = ecs.inout_kind_t.In };
+    destroy_texture_desc.query.filter.terms[3] = .{ .id = ecs.id(MemoryAllocator), .inout = ecs.inout_kind_t.In };
     ecs.SYSTEM(world, "VkDestroyTextureSystem", ecs.id(core.OnStop), &destroy_texture_desc);
 
+    var destroy_upload_desc = ecs.system_desc_t{};
+    destroy_upload_desc.callback = destroyUploader;
+    destroy_upload_desc.query.filter.terms[0] = .{ .id = ecs.id(Uploader), .inout = ecs.inout_kind_t.In };
+    destroy_upload_desc.query.filter.terms[1] = .{ .id = ecs.id(MemoryAllocator), .inout = ecs.inout_kind_t.In };
+    ecs.SYSTEM(world, "VkDestroyUploadSystem", ecs.id(core.OnStop), &destroy_upload_desc);
+
     var destroy_command_buffer_desc = ecs.system_desc_t{};
     destroy_command_buffer_desc.callback = destroyCommandBuffers;
     destroy_command_buffer_desc.query.filter.terms[0] = .{ .id = ecs.id(Device), .inout = ecs.inout_kind_t.In };
-    destroy_command_buffer_desc.query.filter.terms[1] = .{ .id = ecs.id(CommandPool), .inout = ecs.inout_kind_t.In };
-    destroy_command_buffer_desc.query.filter.terms[2] = .{ .id = ecs.id(CommandBuffers), .inout = ecs.inout_kind_t.In };
-    destroy_command_buffer_desc.query.filter.terms[3] = .{ .id = ecs.id(ImageAvailableSemaphores), .inout = ecs.inout_kind_t.In };
-    destroy_command_buffer_desc.query.filter.terms[4] = .{ .id = ecs.id(RenderFinishedSemaphores), .inout = ecs.inout_kind_t.In };
-    destroy_command_buffer_desc.query.filter.terms[5] = .{ .id = ecs.id(DrawFences), .inout = ecs.inout_kind_t.In };
+    destroy_command_buffer_desc.query.filter.terms[1] = .{ .id = ecs.id(Frames), .inout = ecs.inout_kind_t.In };
+    destroy_command_buffer_desc.query.filter.terms[2] = .{ .id = ecs.id(ImageAvailableSemaphores), .inout = ecs.inout_kind_t.In };
+    destroy_command_buffer_desc.query.filter.terms[3] = .{ .id = ecs.id(RenderFinishedSemaphores), .inout = ecs.inout_kind_t.In };
+    destroy_command_buffer_desc.query.filter.terms[4] = .{ .id = ecs.id(Recorder), .inout = ecs.inout_kind_t.In };
     ecs.SYSTEM(world, "VkDestroyCommandBufferSystem", ecs.id(core.OnStop), &destroy_command_buffer_desc);
 
     var destroy_render_pass_desc = ecs.system_desc_t{};
@@ -1173,12 +2817,14 @@ pub fn init(world: *ecs.world_t) void {
     destroy_render_pass_desc.query.filter.terms[0] = .{ .id = ecs.id(Device), .inout = ecs.inout_kind_t.In };
     destroy_render_pass_desc.query.filter.terms[1] = .{ .id = ecs.id(RenderPass), .inout = ecs.inout_kind_t.In };
     destroy_render_pass_desc.query.filter.terms[2] = .{ .id = ecs.id(DescriptorSetLayout), .inout = ecs.inout_kind_t.In };
-    destroy_render_pass_desc.query.filter.terms[3] = .{ .id = ecs.id(UniformBuffers), .inout = ecs.inout_kind_t.In };
+    destroy_render_pass_desc.query.filter.terms[3] = .{ .id = ecs.id(FrameUniforms), .inout = ecs.inout_kind_t.In };
     destroy_render_pass_desc.query.filter.terms[4] = .{ .id = ecs.id(DescriptorPool), .inout = ecs.inout_kind_t.In };
-    destroy_render_pass_desc.query.filter.terms[5] = .{ .id = ecs.id(DescriptorSets), .inout = ecs.inout_kind_t.In };
-    destroy_render_pass_desc.query.filter.terms[6] = .{ .id = ecs.id(Pipeline), .inout = ecs.inout_kind_t.In };
-    destroy_render_pass_desc.query.filter.terms[7] = .{ .id = ecs.id(Framebuffers), .inout = ecs.inout_kind_t.In };
-    destroy_render_pass_desc.query.filter.terms[8] = .{ .id = ecs.id(LightTransferSpace), .inout = ecs.inout_kind_t.In };
+    destroy_render_pass_desc.query.filter.terms[5] = .{ .id = ecs.id(Pipeline), .inout = ecs.inout_kind_t.In };
+    destroy_render_pass_desc.query.filter.terms[6] = .{ .id = ecs.id(Framebuffers), .inout = ecs.inout_kind_t.In };
+    destroy_render_pass_desc.query.filter.terms[7] = .{ .id = ecs.id(MemoryAllocator), .inout = ecs.inout_kind_t.In };
+    destroy_render_pass_desc.query.filter.terms[8] = .{ .id = ecs.id(DrawList), .inout = ecs.inout_kind_t.In };
+    destroy_render_pass_desc.query.filter.terms[9] = .{ .id = ecs.id(CullPipeline), .inout = ecs.inout_kind_t.In };
+    destroy_render_pass_desc.query.filter.terms[10] = .{ .id = ecs.id(ShaderReload), .inout = ecs.inout_kind_t.In };
     ecs.SYSTEM(world, "VkDestroyRenderPassSystem", ecs.id(core.OnStop), &destroy_render_pass_desc);
 
     var destroy_swapchain_decs = ecs.system_desc_t{};
@@ -1187,11 +2833,27 @@ pub fn init(world: *ecs.world_t) void {
     destroy_swapchain_decs.query.filter.terms[1] = .{ .id = ecs.id(Swapchain), .inout = ecs.inout_kind_t.In };
     destroy_swapchain_decs.query.filter.terms[2] = .{ .id = ecs.id(ImageAssets), .inout = ecs.inout_kind_t.In };
     destroy_swapchain_decs.query.filter.terms[3] = .{ .id = ecs.id(DepthImage), .inout = ecs.inout_kind_t.In };
+    destroy_swapchain_decs.query.filter.terms[4] = .{ .id = ecs.id(MemoryAllocator), .inout = ecs.inout_kind_t.In };
     ecs.SYSTEM(world, "VkDestroySwapchainSystem", ecs.id(core.OnStop), &destroy_swapchain_decs);
 
+    var destroy_offscreen_desc = ecs.system_desc_t{};
+    destroy_offscreen_desc.callback = destroyOffscreenTargets;
+    destroy_offscreen_desc.query.filter.terms[0] = .{ .id = ecs.id(Device), .inout = ecs.inout_kind_t.In };
+    destroy_offscreen_desc.query.filter.terms[1] = .{ .id = ecs.id(Offscreen), .inout = ecs.inout_kind_t.InOut };
+    destroy_offscreen_desc.query.filter.terms[2] = .{ .id = ecs.id(DepthImage), .inout = ecs.inout_kind_t.In };
+    destroy_offscreen_desc.query.filter.terms[3] = .{ .id = ecs.id(MemoryAllocator), .inout = ecs.inout_kind_t.In };
+    ecs.SYSTEM(world, "VkDestroyOffscreenSystem", ecs.id(core.OnStop), &destroy_offscreen_desc);
+
     var destroy_decs = ecs.system_desc_t{};
     destroy_decs.callback = destroyDevice;
     destroy_decs.query.filter.terms[0] = .{ .id = ecs.id(Device), .inout = ecs.inout_kind_t.In };
-    destroy_decs.query.filter.terms[1] = .{ .id = ecs.id(Surface), .inout = ecs.inout_kind_t.In };
+    destroy_decs.query.filter.terms[1] = .{ .id = ecs.id(Surface), .inout = ecs.inout_kind_t.In, .oper = ecs.oper_kind_t.Optional };
+    destroy_decs.query.filter.terms[2] = .{ .id = ecs.id(MemoryAllocator), .inout = ecs.inout_kind_t.In };
+    destroy_decs.query.filter.terms[3] = .{ .id = ecs.id(PipelineCache), .inout = ecs.inout_kind_t.In };
+    destroy_decs.query.filter.terms[4] = .{ .id = ecs.id(ShaderModules), .inout = ecs.inout_kind_t.In };
+    destroy_decs.query.filter.terms[5] = .{ .id = ecs.id(TextureTable), .inout = ecs.inout_kind_t.In, .oper = ecs.oper_kind_t.Optional };
+    destroy_decs.query.filter.terms[6] = .{ .id = ecs.id(Timelines), .inout = ecs.inout_kind_t.In };
+    destroy_decs.query.filter.terms[7] = .{ .id = ecs.id(AsyncCompute), .inout = ecs.inout_kind_t.In, .oper = ecs.oper_kind_t.Optional };
+    destroy_decs.query.filter.terms[8] = .{ .id = ecs.id(GpuProfiler), .inout = ecs.inout_kind_t.In, .oper = ecs.oper_kind_t.Optional };
     ecs.SYSTEM(world, "VkDestroyDeviceSystem", ecs.id(core.OnStop), &destroy_decs);
 }
\ No newline at end of file
@@ -0,0 +1,148 @@
+const std = @import("std");
+const c = @import("../clibs.zig");
+const vke = @import("./error.zig");
+const testing = std.testing;
+
+pub const DEFAULT_FRAMES_IN_FLIGHT: u32 = 3;
+pub const MAX_FRAMES_IN_FLIGHT: u32 = 8;
+
+/// Everything a frame records into. None of it outlives the frame, so nothing is freed piece by piece, the whole
+/// context is reset once the graphics timeline has reached the frame's value.
+pub const FrameContext = struct {
+    command_pool: c.VkCommandPool,
+    /// Primary command buffer the frame is recorded into
+    command_buffer: c.VkCommandBuffer,
+    /// Graphics timeline value the frame's last submission signals
+    timeline_value: u64 = 0,
+    /// Transfer timeline value the frame's submission waits on, covers the uploads it acquired ownership of
+    transfer_wait: u64 = 0,
+    /// Pool and command buffer on the async compute family, null when compute shares the graphics queue
+    compute_pool: c.VkCommandPool = null,
+    compute_command_buffer: c.VkCommandBuffer = null,
+    /// Compute timeline value the frame's graphics submission waits on, zero when it dispatched nothing
+    compute_wait: u64 = 0,
+};
+
+pub const FrameContextsOpts = struct {
+    device: c.VkDevice,
+    queue_family_index: u32,
+    /// Family of the async compute queue, each frame gets a second pool on it when set
+    compute_queue_family_index: ?u32 = null,
+    frame_count: u32,
+};
+
+/// One context per frame in flight, indexed by `CurrentFrame`
+pub const FrameContexts = struct {
+    allocator: std.mem.Allocator,
+    device: c.VkDevice,
+    frames: []FrameContext,
+
+    pub fn init(a: std.mem.Allocator, opts: FrameContextsOpts) !FrameContexts {
+        const frames = try a.alloc(FrameContext, opts.frame_count);
+        errdefer a.free(frames);
+
+        var created: usize = 0;
+        errdefer {
+            for (frames[0..created]) |*frame| {
+                destroyFrame(opts.device, frame);
+            }
+        }
+
+        for (frames) |*frame| {
+            frame.* = try createFrame(opts.device, opts.queue_family_index);
+            created += 1;
+            if (opts.compute_queue_family_index) |compute_family| {
+                frame.compute_pool = try createCommandPool(opts.device, compute_family);
+                frame.compute_command_buffer = try allocateCommandBuffer(opts.device, frame.compute_pool);
+            }
+        }
+
+        return .{
+            .allocator = a,
+            .device = opts.device,
+            .frames = frames,
+        };
+    }
+
+    /// The device must be idle, destroying the pools frees their command buffers
+    pub fn deinit(self: *FrameContexts) void {
+        for (self.frames) |*frame| {
+            destroyFrame(self.device, frame);
+        }
+        self.allocator.free(self.frames);
+    }
+
+    pub fn count(self: *const FrameContexts) u32 {
+        return @as(u32, @intCast(self.frames.len));
+    }
+
+    pub fn get(self: *FrameContexts, frame_index: u32) *FrameContext {
+        return &self.frames[frame_index];
+    }
+
+    /// Reset the frame's command pools in one go. Only call once the frame's timeline value has been reached.
+    pub fn begin(self: *FrameContexts, frame_index: u32) !*FrameContext {
+        const frame = self.get(frame_index);
+        try vke.checkResult(c.vkResetCommandPool(self.device, frame.command_pool, 0));
+        if (frame.compute_pool != null) {
+            try vke.checkResult(c.vkResetCommandPool(self.device, frame.compute_pool, 0));
+        }
+        frame.compute_wait = 0;
+        return frame;
+    }
+};
+
+fn createFrame(device: c.VkDevice, queue_family_index: u32) !FrameContext {
+    const command_pool = try createCommandPool(device, queue_family_index);
+    errdefer c.vkDestroyCommandPool(device, command_pool, null);
+
+    const command_buffer = try allocateCommandBuffer(device, command_pool);
+
+    return .{
+        .command_pool = command_pool,
+        .command_buffer = command_buffer,
+    };
+}
+
+fn destroyFrame(device: c.VkDevice, frame: *FrameContext) void {
+    c.vkDestroyCommandPool(device, frame.command_pool, null);
+    if (frame.compute_pool != null) {
+        c.vkDestroyCommandPool(device, frame.compute_pool, null);
+    }
+}
+
+fn createCommandPool(device: c.VkDevice, queue_family_index: u32) !c.VkCommandPool {
+    const pool_create_info = std.mem.zeroInit(c.VkCommandPoolCreateInfo, .{
+        .sType = c.VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = c.VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+        .queueFamilyIndex = queue_family_index,
+    });
+
+    var command_pool: c.VkCommandPool = undefined;
+    try vke.checkResult(c.vkCreateCommandPool(device, &pool_create_info, null, &command_pool));
+    return command_pool;
+}
+
+fn allocateCommandBuffer(device: c.VkDevice, command_pool: c.VkCommandPool) !c.VkCommandBuffer {
+    const alloc_info = std.mem.zeroInit(c.VkCommandBufferAllocateInfo, .{
+        .sType = c.VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = command_pool,
+        .level = c.VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1,
+    });
+
+    var command_buffer: c.VkCommandBuffer = undefined;
+    try vke.checkResult(c.vkAllocateCommandBuffers(device, &alloc_info, &command_buffer));
+    return command_buffer;
+}
+
+/// One frame serializes the CPU and GPU, more than `MAX_FRAMES_IN_FLIGHT` only adds latency
+pub fn clampFramesInFlight(requested: u32) u32 {
+    return std.math.clamp(requested, 1, MAX_FRAMES_IN_FLIGHT);
+}
+
+test "clampFramesInFlight keeps at least one frame" {
+    try testing.expectEqual(@as(u32, 1), clampFramesInFlight(0));
+    try testing.expectEqual(@as(u32, 2), clampFramesInFlight(2));
+    try testing.expectEqual(MAX_FRAMES_IN_FLIGHT, clampFramesInFlight(100));
+}
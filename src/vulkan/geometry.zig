@@ -0,0 +1,195 @@
+const std = @import("std");
+const c = @import("../clibs.zig");
+const vkb = @import("./buffer.zig");
+const vkm = @import("./memory.zig");
+const vku = @import("./upload.zig");
+const scene = @import("scene");
+
+pub const DEFAULT_VERTEX_CAPACITY: u32 = 1 << 20;
+pub const DEFAULT_INDEX_CAPACITY: u32 = 1 << 22;
+
+pub const GeometryOpts = struct {
+    allocator: *vkm.DeviceAllocator,
+    device: c.VkDevice,
+    vertex_capacity: u32 = DEFAULT_VERTEX_CAPACITY,
+    index_capacity: u32 = DEFAULT_INDEX_CAPACITY,
+};
+
+/// Location of a mesh inside the geometry arena, the values map directly onto `vkCmdDrawIndexed`.
+pub const MeshRange = struct {
+    first_index: u32,
+    index_count: u32,
+    vertex_offset: i32,
+    vertex_count: u32,
+    /// Bounding sphere in mesh space, xyz is the center and w the radius
+    bounds: [4]f32 = .{ 0, 0, 0, 0 },
+};
+
+/// Identifies mesh data by the entity that owns it, entities borrowing the same mesh share one range
+pub const MeshSource = u64;
+
+/// A range that is in the arena, with the source it was uploaded from and the meshes using it
+const Resident = struct {
+    source: MeshSource,
+    refs: u32,
+    /// Upload batch that carried the range's data
+    ticket: u64,
+};
+
+const Retired = struct {
+    range: MeshRange,
+    /// Graphics timeline value of the last frame that could have drawn from the range
+    value: u64,
+};
+
+/// One device local vertex buffer and one index buffer shared by every mesh. Ranges are handed out by a
+/// free list counted in vertices and indices, so meshes can be added and removed while the app is running.
+pub const GeometryArena = struct {
+    allocator: std.mem.Allocator,
+    vertex_buffer: vkb.Buffer,
+    index_buffer: vkb.Buffer,
+    vertex_ranges: vkm.FreeList,
+    index_ranges: vkm.FreeList,
+    sources: std.AutoHashMapUnmanaged(MeshSource, MeshRange) = .{},
+    /// Every live range, keyed by its first index. Empty meshes are never uploaded, so no two ranges share one.
+    residents: std.AutoHashMapUnmanaged(u32, Resident) = .{},
+    /// Ranges nothing references anymore, handed back once the frames that drew from them have finished
+    retired: std.ArrayListUnmanaged(Retired) = .{},
+
+    pub fn init(a: std.mem.Allocator, opts: GeometryOpts) !GeometryArena {
+        const vertex_buffer = try vkb.createBuffer(.{
+            .allocator = opts.allocator,
+            .device = opts.device,
+            .buffer_size = @as(u64, opts.vertex_capacity) * @sizeOf(scene.Vertex),
+            .buffer_usage = c.VK_BUFFER_USAGE_TRANSFER_DST_BIT | c.VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+            .buffer_properties = c.VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        });
+        errdefer vertex_buffer.deleteAndFree(opts.device, opts.allocator);
+
+        const index_buffer = try vkb.createBuffer(.{
+            .allocator = opts.allocator,
+            .device = opts.device,
+            .buffer_size = @as(u64, opts.index_capacity) * @sizeOf(u32),
+            .buffer_usage = c.VK_BUFFER_USAGE_TRANSFER_DST_BIT | c.VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+            .buffer_properties = c.VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        });
+        errdefer index_buffer.deleteAndFree(opts.device, opts.allocator);
+
+        var vertex_ranges = try vkm.FreeList.init(a, opts.vertex_capacity);
+        errdefer vertex_ranges.deinit(a);
+
+        const index_ranges = try vkm.FreeList.init(a, opts.index_capacity);
+
+        return .{
+            .allocator = a,
+            .vertex_buffer = vertex_buffer,
+            .index_buffer = index_buffer,
+            .vertex_ranges = vertex_ranges,
+            .index_ranges = index_ranges,
+        };
+    }
+
+    /// The device must be idle
+    pub fn deinit(self: *GeometryArena, device: c.VkDevice, allocator: *vkm.DeviceAllocator) void {
+        self.vertex_buffer.deleteAndFree(device, allocator);
+        self.index_buffer.deleteAndFree(device, allocator);
+        self.vertex_ranges.deinit(self.allocator);
+        self.index_ranges.deinit(self.allocator);
+        self.sources.deinit(self.allocator);
+        self.residents.deinit(self.allocator);
+        self.retired.deinit(self.allocator);
+    }
+
+    /// Reserve a range for the mesh and queue the copy of its data on the upload batcher. A mesh that is already
+    /// resident is not uploaded again, its range is returned with one more reference so it can be instanced.
+    /// `refresh` asks for the data to be uploaded again because it changed, unless the batch being recorded already
+    /// carries it. Meshes still using the old range keep it until they are refreshed as well.
+    pub fn upload(self: *GeometryArena, uploader: *vku.UploadBatcher, source: MeshSource, vertices: []const scene.Vertex, indices: []const u32, refresh: bool) !MeshRange {
+        if (vertices.len == 0 or indices.len == 0) {
+            return error.EmptyMesh;
+        }
+
+        if (self.sources.get(source)) |range| {
+            const resident = self.residents.getPtr(range.first_index).?;
+            if (!refresh or resident.ticket == uploader.pendingTicket()) {
+                resident.refs += 1;
+                return range;
+            }
+        }
+
+        const vertex_offset = (try self.vertex_ranges.alloc(self.allocator, vertices.len, 1)) orelse return error.GeometryArenaFull;
+        errdefer self.vertex_ranges.free(self.allocator, vertex_offset, vertices.len) catch {};
+
+        const first_index = (try self.index_ranges.alloc(self.allocator, indices.len, 1)) orelse return error.GeometryArenaFull;
+        errdefer self.index_ranges.free(self.allocator, first_index, indices.len) catch {};
+
+        try uploader.uploadBuffer(std.mem.sliceAsBytes(vertices), self.vertex_buffer.handle, vertex_offset * @sizeOf(scene.Vertex));
+        try uploader.uploadBuffer(std.mem.sliceAsBytes(indices), self.index_buffer.handle, first_index * @sizeOf(u32));
+
+        const sphere = scene.BoundingSphere.fromVertices(vertices, scene.AABB.fromVertices(vertices));
+        const range = MeshRange{
+            .first_index = @as(u32, @intCast(first_index)),
+            .index_count = @as(u32, @intCast(indices.len)),
+            .vertex_offset = @as(i32, @intCast(vertex_offset)),
+            .vertex_count = @as(u32, @intCast(vertices.len)),
+            .bounds = .{ sphere.center[0], sphere.center[1], sphere.center[2], sphere.radius },
+        };
+
+        try self.residents.put(self.allocator, range.first_index, .{ .source = source, .refs = 1, .ticket = uploader.pendingTicket() });
+        errdefer _ = self.residents.remove(range.first_index);
+        try self.sources.put(self.allocator, source, range);
+        return range;
+    }
+
+    /// Drop one reference to the range. Once nothing uses it, it is no longer handed out to new meshes and goes back
+    /// to the arena when `collect` sees the graphics timeline pass `value`, the graphics timeline value of the last
+    /// submitted frame.
+    pub fn retire(self: *GeometryArena, range: MeshRange, value: u64) void {
+        const resident = self.residents.getPtr(range.first_index) orelse return;
+        resident.refs -= 1;
+        if (resident.refs > 0) {
+            return;
+        }
+
+        // A refresh may already have pointed the source at a newer range
+        if (self.sources.get(resident.source)) |current| {
+            if (current.first_index == range.first_index) {
+                _ = self.sources.remove(resident.source);
+            }
+        }
+        _ = self.residents.remove(range.first_index);
+        self.retired.append(self.allocator, .{ .range = range, .value = value }) catch |err| {
+            // Leaking the range is better than overwriting geometry a frame in flight still draws
+            std.debug.print("Failed to retire mesh range: {}\n", .{err});
+        };
+    }
+
+    /// Hand back the retired ranges whose frames have finished, `completed` is the graphics timeline value
+    pub fn collect(self: *GeometryArena, completed: u64) void {
+        var i: usize = 0;
+        while (i < self.retired.items.len) {
+            const retired = self.retired.items[i];
+            if (retired.value <= completed) {
+                self.free(retired.range);
+                _ = self.retired.swapRemove(i);
+                continue;
+            }
+            i += 1;
+        }
+    }
+
+    fn free(self: *GeometryArena, range: MeshRange) void {
+        self.vertex_ranges.free(self.allocator, @as(u64, @intCast(range.vertex_offset)), range.vertex_count) catch |err| {
+            std.debug.print("Failed to free vertex range: {}\n", .{err});
+        };
+        self.index_ranges.free(self.allocator, range.first_index, range.index_count) catch |err| {
+            std.debug.print("Failed to free index range: {}\n", .{err});
+        };
+    }
+
+    pub fn bind(self: *const GeometryArena, command_buffer: c.VkCommandBuffer) void {
+        const offsets = [_]c.VkDeviceSize{0};
+        c.vkCmdBindVertexBuffers(command_buffer, 0, 1, &self.vertex_buffer.handle, &offsets);
+        c.vkCmdBindIndexBuffer(command_buffer, self.index_buffer.handle, 0, c.VK_INDEX_TYPE_UINT32);
+    }
+};
@@ -0,0 +1,364 @@
+const std = @import("std");
+const builtin = @import("builtin");
+const c = @import("../clibs.zig");
+const data = @import("data.zig");
+const vksh = @import("./shader.zig");
+const vkp = @import("./pipeline.zig");
+const vkcl = @import("./cull.zig");
+const testing = std.testing;
+
+const log = std.log.scoped(.hot_reload);
+
+pub const SHADER_SOURCE_DIR = "shaders";
+const SHADER_OUTPUT_DIR = "zig-out/shaders";
+const POLL_INTERVAL_MS = 250;
+
+/// Pipelines that are rebuilt when one of their stages changes
+pub const PipelineKind = enum {
+    graphics,
+    grid,
+    cull,
+
+    pub fn uses(self: PipelineKind, name: vksh.Name) bool {
+        return switch (self) {
+            .graphics => name == .shader_vert or name == .shader_frag or name == .shader_bindless_frag,
+            .grid => name == .grid_vert or name == .grid_frag,
+            .cull => name == .cull_comp,
+        };
+    }
+};
+
+/// Everything the pipelines were created from, none of it changes while the render pass is alive
+pub const RebuildOpts = struct {
+    device: c.VkDevice,
+    render_pass: c.VkRenderPass,
+    swapchain_extent: c.VkExtent2D,
+    pipeline_cache: c.VkPipelineCache,
+    graphics_layouts: [4]c.VkDescriptorSetLayout,
+    graphics_fragment: vksh.Name,
+    grid_layouts: [1]c.VkDescriptorSetLayout,
+    cull_layout: c.VkDescriptorSetLayout,
+};
+
+/// Pipelines rebuilt on the watcher thread, waiting to be swapped in at the start of a frame
+pub const Reload = struct {
+    /// Copy of the device's registry with the recompiled module in place
+    shaders: vksh.ShaderRegistry,
+    pipelines: std.EnumArray(PipelineKind, ?data.Pipeline) = std.EnumArray(PipelineKind, ?data.Pipeline).initFill(null),
+};
+
+const Retired = struct {
+    pipeline: data.Pipeline,
+    /// Graphics timeline value of the last frame that could have recorded the pipeline
+    value: u64,
+};
+
+/// Watches `shaders/` for edited GLSL, recompiles it with glslangValidator and rebuilds the pipelines that use it
+/// on a background thread. Linux is notified through inotify, other platforms poll the modification times.
+/// The render loop never waits on the watcher, it picks up a finished reload with `takeReload`.
+pub const ShaderReloader = struct {
+    allocator: std.mem.Allocator,
+    opts: RebuildOpts,
+    /// The device's registry, only changed while holding `mutex`
+    shaders: *vksh.ShaderRegistry,
+    thread: ?std.Thread = null,
+    mutex: std.Thread.Mutex = .{},
+    running: bool = true,
+    pending: ?Reload = null,
+    /// Replaced pipelines, destroyed once every frame that could have used them has finished. Main thread only.
+    retired: std.ArrayListUnmanaged(Retired) = .{},
+
+    pub fn init(a: std.mem.Allocator, shaders: *vksh.ShaderRegistry, opts: RebuildOpts) ShaderReloader {
+        return .{
+            .allocator = a,
+            .opts = opts,
+            .shaders = shaders,
+        };
+    }
+
+    /// Start watching, skipped when the shader sources are not next to the executable
+    pub fn start(self: *ShaderReloader) !void {
+        std.fs.cwd().access(SHADER_SOURCE_DIR, .{}) catch {
+            log.info("No {s} directory, shader hot reload is disabled", .{SHADER_SOURCE_DIR});
+            return;
+        };
+        self.thread = try std.Thread.spawn(.{}, watch, .{self});
+    }
+
+    /// The device must be idle
+    pub fn deinit(self: *ShaderReloader) void {
+        {
+            self.mutex.lock();
+            defer self.mutex.unlock();
+            self.running = false;
+        }
+        if (self.thread) |thread| {
+            thread.join();
+        }
+
+        if (self.pending) |*reload| {
+            self.discard(reload);
+        }
+        for (self.retired.items) |retired| {
+            destroyPipeline(self.opts.device, retired.pipeline);
+        }
+        self.retired.deinit(self.allocator);
+    }
+
+    /// Called once a frame after the frame's timeline value has been waited on. Returns the rebuilt pipelines, the
+    /// caller swaps them in and hands the old ones to `retire`.
+    pub fn takeReload(self: *ShaderReloader) ?std.EnumArray(PipelineKind, ?data.Pipeline) {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        const reload = self.pending orelse return null;
+        self.pending = null;
+        self.shaders.adopt(&reload.shaders);
+        return reload.pipelines;
+    }
+
+    /// `value` is the graphics timeline value of the last submitted frame, every frame that could use the
+    /// pipeline signals it or an earlier value
+    pub fn retire(self: *ShaderReloader, pipeline: data.Pipeline, value: u64) void {
+        self.retired.append(self.allocator, .{ .pipeline = pipeline, .value = value }) catch |err| {
+            // Leaking is better than destroying a pipeline a frame in flight still uses
+            std.debug.print("Failed to retire pipeline: {}\n", .{err});
+        };
+    }
+
+    /// Destroy the retired pipelines whose frames have finished, `completed` is the graphics timeline value
+    pub fn collect(self: *ShaderReloader, completed: u64) void {
+        var i: usize = 0;
+        while (i < self.retired.items.len) {
+            const retired = self.retired.items[i];
+            if (retired.value <= completed) {
+                destroyPipeline(self.opts.device, retired.pipeline);
+                _ = self.retired.swapRemove(i);
+                continue;
+            }
+            i += 1;
+        }
+    }
+
+    fn isRunning(self: *ShaderReloader) bool {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        return self.running;
+    }
+
+    fn watch(self: *ShaderReloader) void {
+        const result = if (builtin.os.tag == .linux) self.watchInotify() else self.watchModifiedTimes();
+        result catch |err| {
+            std.debug.print("Failed to watch shaders: {}\n", .{err});
+        };
+    }
+
+    fn watchInotify(self: *ShaderReloader) !void {
+        const linux = std.os.linux;
+        const fd = try std.os.inotify_init1(linux.IN.NONBLOCK | linux.IN.CLOEXEC);
+        defer std.os.close(fd);
+        _ = try std.os.inotify_add_watch(fd, SHADER_SOURCE_DIR, linux.IN.CLOSE_WRITE | linux.IN.MOVED_TO);
+
+        var buffer: [4096]u8 align(@alignOf(linux.inotify_event)) = undefined;
+        while (self.isRunning()) {
+            var fds = [_]std.os.pollfd{.{ .fd = fd, .events = std.os.POLL.IN, .revents = 0 }};
+            if (try std.os.poll(&fds, POLL_INTERVAL_MS) == 0) {
+                continue;
+            }
+
+            const len = std.os.read(fd, &buffer) catch |err| switch (err) {
+                error.WouldBlock => continue,
+                else => return err,
+            };
+
+            var offset: usize = 0;
+            while (offset < len) {
+                const event: *const linux.inotify_event = @ptrCast(@alignCast(&buffer[offset]));
+                if (event.getName()) |name| {
+                    self.reload(name);
+                }
+                offset += @sizeOf(linux.inotify_event) + event.len;
+            }
+        }
+    }
+
+    fn watchModifiedTimes(self: *ShaderReloader) !void {
+        var modified = std.StringHashMap(i128).init(self.allocator);
+        defer {
+            var keys = modified.keyIterator();
+            while (keys.next()) |key| {
+                self.allocator.free(key.*);
+            }
+            modified.deinit();
+        }
+
+        while (self.isRunning()) {
+            var dir = try std.fs.cwd().openDir(SHADER_SOURCE_DIR, .{ .iterate = true });
+            defer dir.close();
+
+            var iterator = dir.iterate();
+            while (try iterator.next()) |item| {
+                if (item.kind != .file or !std.mem.endsWith(u8, item.name, ".glsl")) {
+                    continue;
+                }
+
+                const stat = try dir.statFile(item.name);
+                const entry = try modified.getOrPut(item.name);
+                if (!entry.found_existing) {
+                    entry.key_ptr.* = try self.allocator.dupe(u8, item.name);
+                } else if (entry.value_ptr.* != stat.mtime) {
+                    self.reload(item.name);
+                }
+                entry.value_ptr.* = stat.mtime;
+            }
+
+            std.time.sleep(POLL_INTERVAL_MS * std.time.ns_per_ms);
+        }
+    }
+
+    /// Recompile one shader and rebuild the pipelines that use it. Failures are logged and leave the running
+    /// pipelines alone, so a typo in a shader never takes the app down.
+    fn reload(self: *ShaderReloader, file_name: []const u8) void {
+        const name = shaderName(file_name) orelse return;
+
+        // One reload at a time, the render loop takes the previous one within a frame
+        while (self.isRunning()) {
+            self.mutex.lock();
+            const busy = self.pending != null;
+            self.mutex.unlock();
+            if (!busy) {
+                break;
+            }
+            std.time.sleep(std.time.ns_per_ms);
+        }
+
+        log.info("Reloading {s}", .{file_name});
+        const module = self.compile(file_name, name) catch |err| {
+            std.debug.print("Failed to recompile {s}: {}\n", .{ file_name, err });
+            return;
+        };
+
+        var staged = blk: {
+            self.mutex.lock();
+            defer self.mutex.unlock();
+            break :blk self.shaders.*;
+        };
+        staged.modules.set(name, module);
+
+        var reload_result = Reload{ .shaders = staged };
+        for (std.enums.values(PipelineKind)) |kind| {
+            if (!kind.uses(name)) {
+                continue;
+            }
+
+            const pipeline = self.build(&reload_result.shaders, kind) catch |err| {
+                std.debug.print("Failed to rebuild {s} pipeline: {}\n", .{ @tagName(kind), err });
+                self.discard(&reload_result);
+                return;
+            };
+            reload_result.pipelines.set(kind, pipeline);
+        }
+
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        self.pending = reload_result;
+    }
+
+    fn compile(self: *ShaderReloader, file_name: []const u8, name: vksh.Name) !c.VkShaderModule {
+        try std.fs.cwd().makePath(SHADER_OUTPUT_DIR);
+
+        const source_path = try std.fs.path.join(self.allocator, &.{ SHADER_SOURCE_DIR, file_name });
+        defer self.allocator.free(source_path);
+        const output_path = try std.fmt.allocPrint(self.allocator, "{s}/{s}.spv", .{ SHADER_OUTPUT_DIR, @tagName(name) });
+        defer self.allocator.free(output_path);
+
+        const result = try std.ChildProcess.run(.{
+            .allocator = self.allocator,
+            .argv = &.{ "glslangValidator", "-V", source_path, "-o", output_path },
+        });
+        defer self.allocator.free(result.stdout);
+        defer self.allocator.free(result.stderr);
+
+        if (result.term != .Exited or result.term.Exited != 0) {
+            std.debug.print("{s}{s}\n", .{ result.stdout, result.stderr });
+            return error.ShaderCompilationFailed;
+        }
+
+        const code = try std.fs.cwd().readFileAllocOptions(self.allocator, output_path, std.math.maxInt(u32), null, 4, null);
+        defer self.allocator.free(code);
+        return vksh.createShaderModule(self.opts.device, code);
+    }
+
+    fn build(self: *ShaderReloader, shaders: *vksh.ShaderRegistry, kind: PipelineKind) !data.Pipeline {
+        const opts = self.opts;
+        return switch (kind) {
+            .graphics => vkp.createGraphicsPipeline(.{
+                .device = opts.device,
+                .shaders = shaders,
+                .swapchain_extent = opts.swapchain_extent,
+                .render_pass = opts.render_pass,
+                .pipeline_cache = opts.pipeline_cache,
+                .fragment = opts.graphics_fragment,
+            }, opts.graphics_layouts),
+            .grid => vkp.createGridPipeline(.{
+                .device = opts.device,
+                .shaders = shaders,
+                .swapchain_extent = opts.swapchain_extent,
+                .render_pass = opts.render_pass,
+                .pipeline_cache = opts.pipeline_cache,
+            }, opts.grid_layouts),
+            .cull => vkcl.createCullPipeline(opts.device, shaders, opts.cull_layout, opts.pipeline_cache),
+        };
+    }
+
+    /// Destroy what a reload created without touching the modules it shares with the device's registry
+    fn discard(self: *ShaderReloader, reload_result: *Reload) void {
+        for (reload_result.pipelines.values) |maybe_pipeline| {
+            if (maybe_pipeline) |pipeline| {
+                destroyPipeline(self.opts.device, pipeline);
+            }
+        }
+
+        // The main thread swaps the registry's modules in `takeReload`, read them under the lock like `reload` does
+        const current_modules = blk: {
+            self.mutex.lock();
+            defer self.mutex.unlock();
+            break :blk self.shaders.modules;
+        };
+        for (reload_result.shaders.modules.values, current_modules.values) |staged, current| {
+            if (staged != current and staged != null) {
+                c.vkDestroyShaderModule(self.opts.device, staged, null);
+            }
+        }
+    }
+};
+
+fn destroyPipeline(device: c.VkDevice, pipeline: data.Pipeline) void {
+    c.vkDestroyPipeline(device, pipeline.handle, null);
+    c.vkDestroyPipelineLayout(device, pipeline.layout, null);
+}
+
+/// `grid.frag.glsl` names the `grid_frag` shader, files the build did not embed are ignored
+pub fn shaderName(file_name: []const u8) ?vksh.Name {
+    if (!std.mem.endsWith(u8, file_name, ".glsl")) {
+        return null;
+    }
+
+    var buffer: [64]u8 = undefined;
+    const stem = file_name[0 .. file_name.len - ".glsl".len];
+    if (stem.len > buffer.len) {
+        return null;
+    }
+
+    const decl = buffer[0..stem.len];
+    @memcpy(decl, stem);
+    std.mem.replaceScalar(u8, decl, '.', '_');
+    return std.meta.stringToEnum(vksh.Name, decl);
+}
+
+test "shaderName maps source files onto embedded shaders" {
+    try testing.expectEqual(@as(?vksh.Name, .grid_frag), shaderName("grid.frag.glsl"));
+    try testing.expectEqual(@as(?vksh.Name, .cull_comp), shaderName("cull.comp.glsl"));
+    try testing.expectEqual(@as(?vksh.Name, null), shaderName("grid.frag.glsl.swp"));
+    try testing.expectEqual(@as(?vksh.Name, null), shaderName("unknown.vert.glsl"));
+}
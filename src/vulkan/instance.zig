@@ -39,6 +39,19 @@ pub fn createAppInstance(alloc: std.mem.Allocator, window: *c.SDL_Window) Instan
     return instance;
 }
 
+/// Instance for rendering without a window, needs no surface extensions and so no SDL. Validation is opt in, a
+/// build or benchmark machine rarely has the layers installed.
+pub fn createHeadlessInstance(alloc: std.mem.Allocator, validation: bool) !Instance {
+    return createInstance(alloc, .{
+        .application_name = "Vulkan App",
+        .application_version = c.VK_MAKE_VERSION(0, 1, 0),
+        .engine_name = "Snap Engine",
+        .engine_version = c.VK_MAKE_VERSION(0, 1, 0),
+        .api_version = c.VK_API_VERSION_1_3,
+        .debug = validation,
+    });
+}
+
 pub fn createInstance(alloc: std.mem.Allocator, opts: VkInstanceOpts) !Instance {
     if (opts.api_version > c.VK_MAKE_VERSION(1, 1, 0)) {
         var api_requested = opts.api_version;
@@ -126,13 +139,9 @@ pub fn getDestroyDebugUtilsMessengerFn(instance: c.VkInstance) c.PFN_vkDestroyDe
         c.PFN_vkDestroyDebugUtilsMessengerEXT, instance, "vkDestroyDebugUtilsMessengerEXT");
 }
 
+/// Resolved through the loader the executable links against, which is also the one SDL loads for a window
 fn getInstanceFn(comptime Fn: type, instance: c.VkInstance, name: [*c]const u8) Fn {
-    const get_proc_addr: c.PFN_vkGetInstanceProcAddr = @ptrCast(c.SDL_Vulkan_GetVkGetInstanceProcAddr());
-    if (get_proc_addr) |get_proc_addr_fn| {
-        return @ptrCast(get_proc_addr_fn(instance, name));
-    }
-
-    @panic("SDL_Vulkan_GetVkGetInstanceProcAddr returned null");
+    return @ptrCast(c.vkGetInstanceProcAddr(instance, name));
 }
 
 fn createDebugCallback(instance: c.VkInstance, opts: VkInstanceOpts) !c.VkDebugUtilsMessengerEXT {
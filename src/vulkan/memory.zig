@@ -0,0 +1,339 @@
+const std = @import("std");
+const c = @import("../clibs.zig");
+const vke = @import("./error.zig");
+const testing = std.testing;
+
+const log = std.log.scoped(.vulkan_memory);
+
+/// Size of a single `VkDeviceMemory` page, requests larger than half a page get a dedicated page.
+pub const DEFAULT_PAGE_SIZE: u64 = 64 * 1024 * 1024;
+
+/// Buffers and linear images can share a page, optimal tiled images are kept apart from them so that
+/// neighbouring resources never violate `bufferImageGranularity`.
+pub const ResourceKind = enum(u1) {
+    linear,
+    optimal,
+};
+
+pub const Allocation = struct {
+    memory: c.VkDeviceMemory = null,
+    offset: c.VkDeviceSize = 0,
+    size: c.VkDeviceSize = 0,
+    memory_type_index: u32 = 0,
+    kind: ResourceKind = .linear,
+
+    /// Pointer to the start of this allocation, only set when the memory type is host visible.
+    mapped: ?[*]u8 = null,
+};
+
+pub const Stats = struct {
+    page_count: u32 = 0,
+    allocation_count: u32 = 0,
+    bytes_reserved: u64 = 0,
+    bytes_used: u64 = 0,
+
+    /// Total number of `vkAllocateMemory` calls made over the lifetime of the allocator
+    device_allocations: u64 = 0,
+};
+
+pub const AllocatorOpts = struct {
+    page_size: u64 = DEFAULT_PAGE_SIZE,
+};
+
+/// Sorted list of the free ranges of a page, allocation is first fit and freed ranges are merged with their neighbours.
+pub const FreeList = struct {
+    ranges: std.ArrayListUnmanaged(Range) = .{},
+
+    pub const Range = struct {
+        offset: u64,
+        size: u64,
+    };
+
+    pub fn init(a: std.mem.Allocator, size: u64) !FreeList {
+        var free_list = FreeList{};
+        try free_list.ranges.append(a, .{ .offset = 0, .size = size });
+        return free_list;
+    }
+
+    pub fn deinit(self: *FreeList, a: std.mem.Allocator) void {
+        self.ranges.deinit(a);
+    }
+
+    /// Returns the aligned offset of the new range or null if no free range is large enough.
+    pub fn alloc(self: *FreeList, a: std.mem.Allocator, size: u64, alignment: u64) !?u64 {
+        for (self.ranges.items, 0..) |range, i| {
+            const aligned_offset = std.mem.alignForward(u64, range.offset, alignment);
+            const padding = aligned_offset - range.offset;
+            if (padding + size > range.size) {
+                continue;
+            }
+
+            const tail_offset = aligned_offset + size;
+            const tail_size = range.offset + range.size - tail_offset;
+
+            // The padding in front of the allocation stays behind as its own free range
+            if (padding > 0) {
+                self.ranges.items[i].size = padding;
+                if (tail_size > 0) {
+                    try self.ranges.insert(a, i + 1, .{ .offset = tail_offset, .size = tail_size });
+                }
+            } else if (tail_size > 0) {
+                self.ranges.items[i] = .{ .offset = tail_offset, .size = tail_size };
+            } else {
+                _ = self.ranges.orderedRemove(i);
+            }
+
+            return aligned_offset;
+        }
+
+        return null;
+    }
+
+    pub fn free(self: *FreeList, a: std.mem.Allocator, offset: u64, size: u64) !void {
+        var index: usize = 0;
+        while (index < self.ranges.items.len and self.ranges.items[index].offset < offset) : (index += 1) {}
+
+        const merges_previous = index > 0 and self.ranges.items[index - 1].offset + self.ranges.items[index - 1].size == offset;
+        const merges_next = index < self.ranges.items.len and offset + size == self.ranges.items[index].offset;
+
+        if (merges_previous and merges_next) {
+            self.ranges.items[index - 1].size += size + self.ranges.items[index].size;
+            _ = self.ranges.orderedRemove(index);
+        } else if (merges_previous) {
+            self.ranges.items[index - 1].size += size;
+        } else if (merges_next) {
+            self.ranges.items[index].offset = offset;
+            self.ranges.items[index].size += size;
+        } else {
+            try self.ranges.insert(a, index, .{ .offset = offset, .size = size });
+        }
+    }
+};
+
+const Page = struct {
+    memory: c.VkDeviceMemory,
+    size: u64,
+    used: u64 = 0,
+    allocation_count: u32 = 0,
+    mapped: ?[*]u8 = null,
+    free_list: FreeList,
+};
+
+const Pool = std.ArrayListUnmanaged(Page);
+
+/// Sub-allocates buffers and images out of large `VkDeviceMemory` pages, one set of pages per memory type.
+/// Host visible pages are mapped once when they are created and stay mapped until they are released.
+pub const DeviceAllocator = struct {
+    allocator: std.mem.Allocator,
+    device: c.VkDevice,
+    memory_properties: c.VkPhysicalDeviceMemoryProperties,
+    buffer_image_granularity: u64,
+    page_size: u64,
+    pools: [c.VK_MAX_MEMORY_TYPES][2]Pool,
+    device_allocations: u64 = 0,
+
+    pub fn init(a: std.mem.Allocator, physical_device: c.VkPhysicalDevice, device: c.VkDevice, opts: AllocatorOpts) DeviceAllocator {
+        var memory_properties: c.VkPhysicalDeviceMemoryProperties = undefined;
+        c.vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+
+        var device_properties: c.VkPhysicalDeviceProperties = undefined;
+        c.vkGetPhysicalDeviceProperties(physical_device, &device_properties);
+
+        var self = DeviceAllocator{
+            .allocator = a,
+            .device = device,
+            .memory_properties = memory_properties,
+            .buffer_image_granularity = device_properties.limits.bufferImageGranularity,
+            .page_size = opts.page_size,
+            .pools = undefined,
+        };
+
+        for (&self.pools) |*pools| {
+            pools.* = .{ .{}, .{} };
+        }
+
+        return self;
+    }
+
+    /// Release every page, any allocation still alive becomes invalid.
+    pub fn deinit(self: *DeviceAllocator) void {
+        for (&self.pools) |*pools| {
+            for (pools) |*pool| {
+                for (pool.items) |*page| {
+                    self.releasePage(page);
+                }
+                pool.deinit(self.allocator);
+            }
+        }
+    }
+
+    pub fn alloc(self: *DeviceAllocator, requirements: c.VkMemoryRequirements, properties: c.VkMemoryPropertyFlags, kind: ResourceKind) !Allocation {
+        const memory_type_index = try self.findMemoryType(requirements.memoryTypeBits, properties);
+        const pool = &self.pools[memory_type_index][self.poolIndex(kind)];
+
+        for (pool.items) |*page| {
+            if (page.size - page.used < requirements.size) {
+                continue;
+            }
+
+            if (try page.free_list.alloc(self.allocator, requirements.size, requirements.alignment)) |offset| {
+                return self.commit(page, memory_type_index, kind, offset, requirements.size);
+            }
+        }
+
+        // Large resources get a page of their own so they don't fragment the shared pages
+        const page_size = if (requirements.size > self.page_size / 2) requirements.size else self.page_size;
+        const page = try self.createPage(pool, memory_type_index, page_size);
+        const offset = (try page.free_list.alloc(self.allocator, requirements.size, requirements.alignment)) orelse return error.OutOfDeviceMemory;
+        return self.commit(page, memory_type_index, kind, offset, requirements.size);
+    }
+
+    pub fn free(self: *DeviceAllocator, allocation: Allocation) void {
+        if (allocation.memory == null) {
+            return;
+        }
+
+        const pool = &self.pools[allocation.memory_type_index][self.poolIndex(allocation.kind)];
+        for (pool.items, 0..) |*page, i| {
+            if (page.memory != allocation.memory) {
+                continue;
+            }
+
+            page.free_list.free(self.allocator, allocation.offset, allocation.size) catch |err| {
+                log.err("Failed to return range to the free list: {}", .{err});
+                return;
+            };
+            page.used -= allocation.size;
+            page.allocation_count -= 1;
+
+            // Keep one empty page around per pool to avoid thrashing vkAllocateMemory
+            if (page.allocation_count == 0 and pool.items.len > 1) {
+                self.releasePage(page);
+                _ = pool.swapRemove(i);
+            }
+            return;
+        }
+
+        log.err("Freed an allocation that does not belong to this allocator", .{});
+    }
+
+    pub fn stats(self: *const DeviceAllocator) Stats {
+        var result = Stats{ .device_allocations = self.device_allocations };
+        for (self.pools) |pools| {
+            for (pools) |pool| {
+                for (pool.items) |page| {
+                    result.page_count += 1;
+                    result.allocation_count += page.allocation_count;
+                    result.bytes_reserved += page.size;
+                    result.bytes_used += page.used;
+                }
+            }
+        }
+
+        return result;
+    }
+
+    pub fn findMemoryType(self: *const DeviceAllocator, allowed_types: u32, property_flags: c.VkMemoryPropertyFlags) !u32 {
+        for (0..self.memory_properties.memoryTypeCount) |i| {
+            const value = @as(u32, 1) << @intCast(i);
+            if ((allowed_types & value) != 0 and (self.memory_properties.memoryTypes[i].propertyFlags & property_flags) == property_flags) {
+                return @as(u32, @intCast(i));
+            }
+        }
+
+        return error.NoSuitableMemoryType;
+    }
+
+    fn poolIndex(self: *const DeviceAllocator, kind: ResourceKind) usize {
+        return if (self.buffer_image_granularity > 1) @intFromEnum(kind) else 0;
+    }
+
+    fn commit(_: *DeviceAllocator, page: *Page, memory_type_index: u32, kind: ResourceKind, offset: u64, size: u64) Allocation {
+        page.used += size;
+        page.allocation_count += 1;
+
+        return .{
+            .memory = page.memory,
+            .offset = offset,
+            .size = size,
+            .memory_type_index = memory_type_index,
+            .kind = kind,
+            .mapped = if (page.mapped) |mapped| mapped + offset else null,
+        };
+    }
+
+    fn createPage(self: *DeviceAllocator, pool: *Pool, memory_type_index: u32, size: u64) !*Page {
+        const memory_alloc_info = std.mem.zeroInit(c.VkMemoryAllocateInfo, .{
+            .sType = c.VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+            .allocationSize = size,
+            .memoryTypeIndex = memory_type_index,
+        });
+
+        var memory: c.VkDeviceMemory = undefined;
+        try vke.checkResult(c.vkAllocateMemory(self.device, &memory_alloc_info, null, &memory));
+        errdefer c.vkFreeMemory(self.device, memory, null);
+        self.device_allocations += 1;
+
+        var mapped: ?[*]u8 = null;
+        const property_flags = self.memory_properties.memoryTypes[memory_type_index].propertyFlags;
+        if (property_flags & c.VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT != 0) {
+            var data: ?*anyopaque = undefined;
+            try vke.checkResult(c.vkMapMemory(self.device, memory, 0, c.VK_WHOLE_SIZE, 0, &data));
+            mapped = @as([*]u8, @ptrCast(data orelse return error.MemoryMapFailed));
+        }
+
+        var free_list = try FreeList.init(self.allocator, size);
+        errdefer free_list.deinit(self.allocator);
+
+        try pool.append(self.allocator, .{
+            .memory = memory,
+            .size = size,
+            .mapped = mapped,
+            .free_list = free_list,
+        });
+
+        return &pool.items[pool.items.len - 1];
+    }
+
+    fn releasePage(self: *DeviceAllocator, page: *Page) void {
+        if (page.mapped != null) {
+            c.vkUnmapMemory(self.device, page.memory);
+        }
+        c.vkFreeMemory(self.device, page.memory, null);
+        page.free_list.deinit(self.allocator);
+    }
+};
+
+test "FreeList alloc respects alignment" {
+    var free_list = try FreeList.init(testing.allocator, 1024);
+    defer free_list.deinit(testing.allocator);
+
+    try testing.expectEqual(@as(?u64, 0), try free_list.alloc(testing.allocator, 10, 16));
+    try testing.expectEqual(@as(?u64, 16), try free_list.alloc(testing.allocator, 16, 16));
+    try testing.expectEqual(@as(?u64, 256), try free_list.alloc(testing.allocator, 8, 256));
+}
+
+test "FreeList alloc returns null when full" {
+    var free_list = try FreeList.init(testing.allocator, 64);
+    defer free_list.deinit(testing.allocator);
+
+    try testing.expectEqual(@as(?u64, 0), try free_list.alloc(testing.allocator, 64, 4));
+    try testing.expectEqual(@as(?u64, null), try free_list.alloc(testing.allocator, 1, 1));
+}
+
+test "FreeList free merges neighbouring ranges" {
+    var free_list = try FreeList.init(testing.allocator, 96);
+    defer free_list.deinit(testing.allocator);
+
+    const first = (try free_list.alloc(testing.allocator, 32, 1)).?;
+    const second = (try free_list.alloc(testing.allocator, 32, 1)).?;
+    const third = (try free_list.alloc(testing.allocator, 32, 1)).?;
+
+    try free_list.free(testing.allocator, first, 32);
+    try free_list.free(testing.allocator, third, 32);
+    try testing.expectEqual(@as(usize, 2), free_list.ranges.items.len);
+
+    try free_list.free(testing.allocator, second, 32);
+    try testing.expectEqual(@as(usize, 1), free_list.ranges.items.len);
+    try testing.expectEqual(@as(u64, 96), free_list.ranges.items[0].size);
+}
@@ -0,0 +1,193 @@
+const std = @import("std");
+const c = @import("../clibs.zig");
+const vke = @import("./error.zig");
+const vkb = @import("./buffer.zig");
+const vkm = @import("./memory.zig");
+const vks = @import("./swapchain.zig");
+const testing = std.testing;
+
+/// sRGB like the swapchain formats a window usually gets, so a read back frame looks the same as a presented one
+pub const COLOR_FORMAT = c.VK_FORMAT_R8G8B8A8_SRGB;
+
+/// Layout the render pass leaves an offscreen image in, ready to be copied out
+pub const FINAL_LAYOUT = c.VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+/// Color images a headless device renders into in place of swapchain images, one per frame in flight so a frame
+/// never writes an image a previous frame may still be rendering to
+pub const OffscreenTargets = struct {
+    allocator: std.mem.Allocator,
+    images: []c.VkImage,
+    image_views: []c.VkImageView,
+    allocations: []vkm.Allocation,
+    extent: c.VkExtent2D,
+
+    pub fn init(a: std.mem.Allocator, memory: *vkm.DeviceAllocator, device: c.VkDevice, extent: c.VkExtent2D, count: u32) !OffscreenTargets {
+        var targets = OffscreenTargets{
+            .allocator = a,
+            .images = try a.alloc(c.VkImage, count),
+            .image_views = &.{},
+            .allocations = &.{},
+            .extent = extent,
+        };
+        errdefer a.free(targets.images);
+        targets.image_views = try a.alloc(c.VkImageView, count);
+        errdefer a.free(targets.image_views);
+        targets.allocations = try a.alloc(vkm.Allocation, count);
+        errdefer a.free(targets.allocations);
+
+        var created: usize = 0;
+        errdefer {
+            for (0..created) |i| {
+                destroyTarget(device, memory, targets.images[i], targets.image_views[i], targets.allocations[i]);
+            }
+        }
+
+        for (targets.images, targets.image_views, targets.allocations) |*image, *image_view, *allocation| {
+            const color_image = try vks.createImage(memory, device, extent.width, extent.height, 1, COLOR_FORMAT, c.VK_IMAGE_TILING_OPTIMAL, c.VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | c.VK_IMAGE_USAGE_TRANSFER_SRC_BIT, c.VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            image_view.* = vks.createImageView(device, color_image.handle, COLOR_FORMAT, c.VK_IMAGE_ASPECT_COLOR_BIT, 1) catch |err| {
+                c.vkDestroyImage(device, color_image.handle, null);
+                memory.free(color_image.allocation);
+                return err;
+            };
+            image.* = color_image.handle;
+            allocation.* = color_image.allocation;
+            created += 1;
+        }
+
+        return targets;
+    }
+
+    /// The device must be idle
+    pub fn deinit(self: *OffscreenTargets, device: c.VkDevice, memory: *vkm.DeviceAllocator) void {
+        for (self.images, self.image_views, self.allocations) |image, image_view, allocation| {
+            destroyTarget(device, memory, image, image_view, allocation);
+        }
+        self.allocator.free(self.images);
+        self.allocator.free(self.image_views);
+        self.allocator.free(self.allocations);
+    }
+};
+
+fn destroyTarget(device: c.VkDevice, memory: *vkm.DeviceAllocator, image: c.VkImage, image_view: c.VkImageView, allocation: vkm.Allocation) void {
+    c.vkDestroyImageView(device, image_view, null);
+    c.vkDestroyImage(device, image, null);
+    memory.free(allocation);
+}
+
+pub const ReadbackOpts = struct {
+    allocator: *vkm.DeviceAllocator,
+    device: c.VkDevice,
+    queue: c.VkQueue,
+    /// Primary command buffer of an idle pool, recorded from scratch
+    command_buffer: c.VkCommandBuffer,
+    /// Color image in `FINAL_LAYOUT`
+    image: c.VkImage,
+    extent: c.VkExtent2D,
+};
+
+/// Copy an offscreen image into tightly packed RGBA8 pixels owned by the caller. Waits for the queue to go idle,
+/// meant for the end of a run rather than every frame.
+pub fn readBack(a: std.mem.Allocator, opts: ReadbackOpts) ![]u8 {
+    const size = @as(u64, opts.extent.width) * opts.extent.height * 4;
+    const staging = try vkb.createBuffer(.{
+        .allocator = opts.allocator,
+        .device = opts.device,
+        .buffer_size = size,
+        .buffer_usage = c.VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        .buffer_properties = c.VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | c.VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+    });
+    defer staging.deleteAndFree(opts.device, opts.allocator);
+
+    const begin_info = std.mem.zeroInit(c.VkCommandBufferBeginInfo, .{
+        .sType = c.VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = c.VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    });
+    try vke.checkResult(c.vkBeginCommandBuffer(opts.command_buffer, &begin_info));
+
+    const subresource_range = c.VkImageSubresourceRange{
+        .aspectMask = c.VK_IMAGE_ASPECT_COLOR_BIT,
+        .baseMipLevel = 0,
+        .levelCount = 1,
+        .baseArrayLayer = 0,
+        .layerCount = 1,
+    };
+
+    // The render pass already left the image in the transfer layout, this only orders its writes before the copy
+    const image_barrier = std.mem.zeroInit(c.VkImageMemoryBarrier, .{
+        .sType = c.VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = c.VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        .dstAccessMask = c.VK_ACCESS_TRANSFER_READ_BIT,
+        .oldLayout = FINAL_LAYOUT,
+        .newLayout = FINAL_LAYOUT,
+        .srcQueueFamilyIndex = c.VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = c.VK_QUEUE_FAMILY_IGNORED,
+        .image = opts.image,
+        .subresourceRange = subresource_range,
+    });
+    c.vkCmdPipelineBarrier(opts.command_buffer, c.VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, c.VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, null, 0, null, 1, &image_barrier);
+
+    const region = std.mem.zeroInit(c.VkBufferImageCopy, .{
+        .imageSubresource = .{
+            .aspectMask = c.VK_IMAGE_ASPECT_COLOR_BIT,
+            .mipLevel = 0,
+            .baseArrayLayer = 0,
+            .layerCount = 1,
+        },
+        .imageExtent = .{ .width = opts.extent.width, .height = opts.extent.height, .depth = 1 },
+    });
+    c.vkCmdCopyImageToBuffer(opts.command_buffer, opts.image, FINAL_LAYOUT, staging.handle, 1, &region);
+
+    const host_barrier = std.mem.zeroInit(c.VkBufferMemoryBarrier, .{
+        .sType = c.VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = c.VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = c.VK_ACCESS_HOST_READ_BIT,
+        .srcQueueFamilyIndex = c.VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = c.VK_QUEUE_FAMILY_IGNORED,
+        .buffer = staging.handle,
+        .offset = 0,
+        .size = size,
+    });
+    c.vkCmdPipelineBarrier(opts.command_buffer, c.VK_PIPELINE_STAGE_TRANSFER_BIT, c.VK_PIPELINE_STAGE_HOST_BIT, 0, 0, null, 1, &host_barrier, 0, null);
+
+    try vke.checkResult(c.vkEndCommandBuffer(opts.command_buffer));
+
+    const submit_info = std.mem.zeroInit(c.VkSubmitInfo, .{
+        .sType = c.VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &opts.command_buffer,
+    });
+    try vke.checkResult(c.vkQueueSubmit(opts.queue, 1, &submit_info, null));
+    try vke.checkResult(c.vkQueueWaitIdle(opts.queue));
+
+    const mapped = staging.allocation.mapped orelse return error.MemoryNotMapped;
+    return try a.dupe(u8, mapped[0..size]);
+}
+
+/// Write RGBA8 pixels as a binary PPM, the alpha channel is dropped
+pub fn writePpm(writer: anytype, width: u32, height: u32, rgba: []const u8) !void {
+    std.debug.assert(rgba.len == @as(usize, width) * height * 4);
+
+    try writer.print("P6\n{d} {d}\n255\n", .{ width, height });
+    var pixel: usize = 0;
+    while (pixel < rgba.len) : (pixel += 4) {
+        try writer.writeAll(rgba[pixel .. pixel + 3]);
+    }
+}
+
+pub fn writePpmFile(path: []const u8, width: u32, height: u32, rgba: []const u8) !void {
+    const file = try std.fs.cwd().createFile(path, .{});
+    defer file.close();
+
+    var buffered = std.io.bufferedWriter(file.writer());
+    try writePpm(buffered.writer(), width, height, rgba);
+    try buffered.flush();
+}
+
+test "writePpm drops the alpha channel" {
+    const rgba = [_]u8{ 1, 2, 3, 255, 4, 5, 6, 255 };
+    var ppm = std.ArrayList(u8).init(testing.allocator);
+    defer ppm.deinit();
+
+    try writePpm(ppm.writer(), 2, 1, &rgba);
+    try testing.expectEqualSlices(u8, "P6\n2 1\n255\n\x01\x02\x03\x04\x05\x06", ppm.items);
+}
@@ -0,0 +1,82 @@
+const std = @import("std");
+const testing = std.testing;
+
+/// Weight of the newest sample in the smoothed timings
+const SMOOTHING: f64 = 0.1;
+/// Share of the remaining slack the delay moves by each frame
+const GAIN: f64 = 0.25;
+/// Wait kept in reserve so a slightly slower frame still makes its present
+pub const MARGIN_NS: f64 = 1.0 * std.time.ns_per_ms;
+/// Longest the start of a frame is held back, a stalled GPU should not stall the CPU frame for longer
+pub const MAX_DELAY_NS: f64 = 50.0 * std.time.ns_per_ms;
+
+/// Delays the start of the CPU frame by the time it would otherwise spend blocked on the graphics timeline and on
+/// acquire. Input is then sampled that much closer to present, the GPU stays just as busy.
+///
+/// The delay grows while the frame still waits longer than the margin and backs off fast as soon as it stops
+/// waiting, which means the frame started too late and is about to miss a present. The step uses the raw wait,
+/// steering on the smoothed one lags a frame behind and oscillates.
+pub const FramePacer = struct {
+    /// Smoothed time the CPU blocked on the graphics timeline and on acquire
+    wait_ns: f64 = 0,
+    /// Smoothed time from acquiring an image to presenting it
+    latency_ns: f64 = 0,
+    /// Delay before the next frame starts
+    delay_ns: f64 = 0,
+    acquired_at: i128 = 0,
+
+    /// Call once the image is acquired, with the time spent blocked on the graphics timeline and on acquire
+    pub fn acquired(self: *FramePacer, now: i128, wait_ns: u64) void {
+        self.acquired_at = now;
+        const wait = @as(f64, @floatFromInt(wait_ns));
+        self.wait_ns = smooth(self.wait_ns, wait);
+
+        if (wait < MARGIN_NS * 0.5) {
+            self.delay_ns *= 0.5;
+        } else {
+            self.delay_ns += GAIN * (wait - MARGIN_NS);
+        }
+        self.delay_ns = std.math.clamp(self.delay_ns, 0, MAX_DELAY_NS);
+    }
+
+    /// Call once the image is handed to the presentation engine
+    pub fn presented(self: *FramePacer, now: i128) void {
+        const latency = @as(f64, @floatFromInt(@max(now - self.acquired_at, 0)));
+        self.latency_ns = smooth(self.latency_ns, latency);
+    }
+
+    pub fn frameDelay(self: *const FramePacer) u64 {
+        return @as(u64, @intFromFloat(self.delay_ns));
+    }
+
+    /// Forget the measurements, the timings of another present mode or swapchain say nothing about the new one
+    pub fn reset(self: *FramePacer) void {
+        self.* = .{};
+    }
+};
+
+fn smooth(current: f64, sample: f64) f64 {
+    return current + SMOOTHING * (sample - current);
+}
+
+test "FramePacer converges on the slack minus the margin" {
+    const slack_ns: f64 = 8.0 * std.time.ns_per_ms;
+    var pacer = FramePacer{};
+
+    for (0..200) |_| {
+        const wait = @max(slack_ns - pacer.delay_ns, 0);
+        pacer.acquired(0, @as(u64, @intFromFloat(wait)));
+    }
+
+    try testing.expectApproxEqAbs(slack_ns - MARGIN_NS, pacer.delay_ns, 0.5 * std.time.ns_per_ms);
+}
+
+test "FramePacer backs off once the frame stops waiting" {
+    var pacer = FramePacer{ .delay_ns = 10.0 * std.time.ns_per_ms };
+
+    for (0..8) |_| {
+        pacer.acquired(0, 0);
+    }
+
+    try testing.expect(pacer.frameDelay() < std.time.ns_per_ms);
+}
@@ -10,19 +10,19 @@ const Pipeline = data.Pipeline;
 
 const GraphicsPipelineOpts = struct {
     device: c.VkDevice,
+    shaders: *shader.ShaderRegistry,
     render_pass: c.VkRenderPass,
     // descriptor_set_layout: c.VkDescriptorSetLayout,
     // sampler_descriptor_set_layout: c.VkDescriptorSetLayout,
     swapchain_extent: c.VkExtent2D,
-    push_constant_range: c.VkPushConstantRange,
+    pipeline_cache: c.VkPipelineCache = null,
+    /// `shader_bindless_frag` samples the texture table instead of a set per texture
+    fragment: shader.Name = .shader_frag,
 };
 
-pub fn createGraphicsPipeline(a: std.mem.Allocator, opts: GraphicsPipelineOpts, layouts: [3]c.VkDescriptorSetLayout) !Pipeline {
-    const vertex_shader = try shader.createShaderModule(a, opts.device, "zig-out/shaders/shader.vert.spv");
-    const fragment_shader = try shader.createShaderModule(a, opts.device, "zig-out/shaders/shader.frag.spv");
-
-    defer c.vkDestroyShaderModule(opts.device, fragment_shader, null);
-    defer c.vkDestroyShaderModule(opts.device, vertex_shader, null);
+pub fn createGraphicsPipeline(opts: GraphicsPipelineOpts, layouts: [4]c.VkDescriptorSetLayout) !Pipeline {
+    const vertex_shader = try opts.shaders.get(.shader_vert);
+    const fragment_shader = try opts.shaders.get(opts.fragment);
 
     const vertex_shader_create_info = std.mem.zeroInit(c.VkPipelineShaderStageCreateInfo, .{
         .sType = c.VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
@@ -159,8 +159,8 @@ pub fn createGraphicsPipeline(a: std.mem.Allocator, opts: GraphicsPipelineOpts,
         .sType = c.VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
         .setLayoutCount = @as(u32, @intCast(layouts.len)),
         .pSetLayouts = &layouts,
-        .pushConstantRangeCount = 1,
-        .pPushConstantRanges = &opts.push_constant_range,
+        .pushConstantRangeCount = 0,
+        .pPushConstantRanges = null,
     });
 
     var pipeline_layout: c.VkPipelineLayout = undefined;
@@ -195,7 +195,7 @@ pub fn createGraphicsPipeline(a: std.mem.Allocator, opts: GraphicsPipelineOpts,
     });
 
     var graphics_pipeline: c.VkPipeline = undefined;
-    try vke.checkResult(c.vkCreateGraphicsPipelines(opts.device, null, 1, &graphics_pipeline_create_info, null, &graphics_pipeline));
+    try vke.checkResult(c.vkCreateGraphicsPipelines(opts.device, opts.pipeline_cache, 1, &graphics_pipeline_create_info, null, &graphics_pipeline));
 
    
 
@@ -205,12 +205,9 @@ pub fn createGraphicsPipeline(a: std.mem.Allocator, opts: GraphicsPipelineOpts,
     };
 }
 
-pub fn createGridPipeline(a: std.mem.Allocator, opts: GraphicsPipelineOpts, layouts: [1]c.VkDescriptorSetLayout) !Pipeline {
-    const vertex_shader = try shader.createShaderModule(a, opts.device, "zig-out/shaders/grid.vert.spv");
-    const fragment_shader = try shader.createShaderModule(a, opts.device, "zig-out/shaders/grid.frag.spv");
-
-    defer c.vkDestroyShaderModule(opts.device, fragment_shader, null);
-    defer c.vkDestroyShaderModule(opts.device, vertex_shader, null);
+pub fn createGridPipeline(opts: GraphicsPipelineOpts, layouts: [1]c.VkDescriptorSetLayout) !Pipeline {
+    const vertex_shader = try opts.shaders.get(.grid_vert);
+    const fragment_shader = try opts.shaders.get(.grid_frag);
 
     const vertex_shader_create_info = std.mem.zeroInit(c.VkPipelineShaderStageCreateInfo, .{
         .sType = c.VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
@@ -354,7 +351,7 @@ pub fn createGridPipeline(a: std.mem.Allocator, opts: GraphicsPipelineOpts, layo
     });
 
     var graphics_pipeline: c.VkPipeline = undefined;
-    try vke.checkResult(c.vkCreateGraphicsPipelines(opts.device, null, 1, &graphics_pipeline_create_info, null, &graphics_pipeline));
+    try vke.checkResult(c.vkCreateGraphicsPipelines(opts.device, opts.pipeline_cache, 1, &graphics_pipeline_create_info, null, &graphics_pipeline));
 
     return .{
         .handle = graphics_pipeline,
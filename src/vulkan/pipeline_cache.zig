@@ -0,0 +1,152 @@
+const std = @import("std");
+const c = @import("../clibs.zig");
+const vke = @import("./error.zig");
+const testing = std.testing;
+
+const log = std.log.scoped(.pipeline_cache);
+
+pub const DEFAULT_CACHE_PATH = "zig-out/pipeline.cache";
+
+const CACHE_MAGIC = [4]u8{ 'G', 'X', 'P', 'C' };
+const CACHE_VERSION: u32 = 1;
+
+/// Written in front of the driver's cache data. Drivers reject foreign data on their own, but only by the
+/// cache UUID, the driver version is checked here as well so an updated driver starts from a clean cache.
+pub const CacheHeader = extern struct {
+    magic: [4]u8 = CACHE_MAGIC,
+    version: u32 = CACHE_VERSION,
+    vendor_id: u32,
+    device_id: u32,
+    driver_version: u32,
+    pipeline_cache_uuid: [c.VK_UUID_SIZE]u8,
+    /// Keeps the header free of implicit padding so it can be compared byte for byte
+    padding: u32 = 0,
+    data_size: u64,
+    data_hash: u64,
+
+    pub fn init(properties: *const c.VkPhysicalDeviceProperties, cache_data: []const u8) CacheHeader {
+        return .{
+            .vendor_id = properties.vendorID,
+            .device_id = properties.deviceID,
+            .driver_version = properties.driverVersion,
+            .pipeline_cache_uuid = properties.pipelineCacheUUID,
+            .data_size = cache_data.len,
+            .data_hash = std.hash.Wyhash.hash(0, cache_data),
+        };
+    }
+
+    /// The cache was written by this device and driver and its data arrived intact
+    pub fn matches(self: *const CacheHeader, properties: *const c.VkPhysicalDeviceProperties, cache_data: []const u8) bool {
+        const expected = CacheHeader.init(properties, cache_data);
+        return std.mem.eql(u8, std.mem.asBytes(self), std.mem.asBytes(&expected));
+    }
+};
+
+pub const PipelineCache = struct {
+    handle: c.VkPipelineCache,
+    /// Whether valid data was loaded from disk
+    warm: bool,
+};
+
+/// Create the pipeline cache, seeded with the data at `path` when it was written by the same device and driver.
+/// A missing or stale file is not an error, the cache simply starts out empty.
+pub fn loadPipelineCache(a: std.mem.Allocator, physical_device: c.VkPhysicalDevice, device: c.VkDevice, path: []const u8) !PipelineCache {
+    var properties: c.VkPhysicalDeviceProperties = undefined;
+    c.vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+    const contents: ?[]u8 = std.fs.cwd().readFileAlloc(a, path, std.math.maxInt(u32)) catch |err| switch (err) {
+        error.FileNotFound => null,
+        else => blk: {
+            log.warn("Failed to read pipeline cache {s}: {}", .{ path, err });
+            break :blk null;
+        },
+    };
+    defer if (contents) |bytes| a.free(bytes);
+
+    const initial_data = if (contents) |bytes| validCacheData(bytes, &properties) else null;
+    if (contents != null and initial_data == null) {
+        log.info("Discarding pipeline cache {s}, it was written by another device or driver", .{path});
+    }
+
+    const create_info = std.mem.zeroInit(c.VkPipelineCacheCreateInfo, .{
+        .sType = c.VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .initialDataSize = if (initial_data) |bytes| bytes.len else 0,
+        .pInitialData = if (initial_data) |bytes| bytes.ptr else null,
+    });
+
+    var cache: c.VkPipelineCache = undefined;
+    try vke.checkResult(c.vkCreatePipelineCache(device, &create_info, null, &cache));
+
+    return .{
+        .handle = cache,
+        .warm = initial_data != null,
+    };
+}
+
+/// Write the cache back to `path` through a temporary file, so a crash while saving leaves the old cache intact
+pub fn savePipelineCache(a: std.mem.Allocator, physical_device: c.VkPhysicalDevice, device: c.VkDevice, cache: c.VkPipelineCache, path: []const u8) !void {
+    var properties: c.VkPhysicalDeviceProperties = undefined;
+    c.vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+    var size: usize = 0;
+    try vke.checkResult(c.vkGetPipelineCacheData(device, cache, &size, null));
+
+    const cache_data = try a.alloc(u8, size);
+    defer a.free(cache_data);
+    try vke.checkResult(c.vkGetPipelineCacheData(device, cache, &size, cache_data.ptr));
+
+    const header = CacheHeader.init(&properties, cache_data[0..size]);
+
+    if (std.fs.path.dirname(path)) |dir| {
+        try std.fs.cwd().makePath(dir);
+    }
+
+    var buffer: [std.fs.MAX_PATH_BYTES]u8 = undefined;
+    const temp_path = try std.fmt.bufPrint(&buffer, "{s}.tmp", .{path});
+    {
+        const file = try std.fs.cwd().createFile(temp_path, .{});
+        defer file.close();
+        try file.writeAll(std.mem.asBytes(&header));
+        try file.writeAll(cache_data[0..size]);
+    }
+    try std.fs.cwd().rename(temp_path, path);
+}
+
+/// Driver data following a matching header, or null when the file has to be thrown away
+fn validCacheData(contents: []const u8, properties: *const c.VkPhysicalDeviceProperties) ?[]const u8 {
+    if (contents.len < @sizeOf(CacheHeader)) {
+        return null;
+    }
+
+    var header: CacheHeader = undefined;
+    @memcpy(std.mem.asBytes(&header), contents[0..@sizeOf(CacheHeader)]);
+    const cache_data = contents[@sizeOf(CacheHeader)..];
+    if (header.data_size != cache_data.len or !header.matches(properties, cache_data)) {
+        return null;
+    }
+    return cache_data;
+}
+
+test "validCacheData rejects caches from another driver" {
+    var properties = std.mem.zeroes(c.VkPhysicalDeviceProperties);
+    properties.vendorID = 0x10de;
+    properties.deviceID = 0x2684;
+    properties.driverVersion = 1;
+    properties.pipelineCacheUUID[0] = 7;
+
+    const cache_data = "driver data";
+    const header = CacheHeader.init(&properties, cache_data);
+    var contents: [@sizeOf(CacheHeader) + cache_data.len]u8 = undefined;
+    @memcpy(contents[0..@sizeOf(CacheHeader)], std.mem.asBytes(&header));
+    @memcpy(contents[@sizeOf(CacheHeader)..], cache_data);
+
+    try testing.expectEqualStrings(cache_data, validCacheData(&contents, &properties).?);
+    try testing.expect(validCacheData(contents[0 .. contents.len - 1], &properties) == null);
+
+    properties.driverVersion = 2;
+    try testing.expect(validCacheData(&contents, &properties) == null);
+
+    properties.driverVersion = 1;
+    properties.pipelineCacheUUID[0] = 8;
+    try testing.expect(validCacheData(&contents, &properties) == null);
+}
@@ -0,0 +1,194 @@
+const std = @import("std");
+const c = @import("../clibs.zig");
+const vke = @import("./error.zig");
+const testing = std.testing;
+
+/// Passes a frame can time, including the frame itself
+pub const MAX_SCOPES: u32 = 16;
+
+/// Name of the scope `beginFrame` opens around the whole command buffer
+pub const FRAME_SCOPE = "frame";
+
+/// Pair of timestamps around a pass. Written from whichever command buffer records the pass, secondary command
+/// buffers included, as long as it executes in the frame's graphics submission.
+pub const Scope = struct {
+    pool: c.VkQueryPool,
+    index: u32,
+
+    pub fn begin(self: Scope, command_buffer: c.VkCommandBuffer) void {
+        c.vkCmdWriteTimestamp(command_buffer, c.VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, self.pool, self.index * 2);
+    }
+
+    pub fn end(self: Scope, command_buffer: c.VkCommandBuffer) void {
+        c.vkCmdWriteTimestamp(command_buffer, c.VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, self.pool, self.index * 2 + 1);
+    }
+};
+
+pub const PassTiming = struct {
+    name: []const u8 = "",
+    ms: f32 = 0,
+};
+
+/// GPU time of every pass of the last resolved frame, in the order the passes were opened
+pub const GpuTimings = struct {
+    passes: [MAX_SCOPES]PassTiming = [_]PassTiming{.{}} ** MAX_SCOPES,
+    count: u32 = 0,
+    /// Frames resolved so far, tells a consumer whether the timings changed since it last looked
+    frame: u64 = 0,
+
+    pub fn slice(self: *const GpuTimings) []const PassTiming {
+        return self.passes[0..self.count];
+    }
+
+    pub fn get(self: *const GpuTimings, name: []const u8) ?f32 {
+        for (self.slice()) |pass| {
+            if (std.mem.eql(u8, pass.name, name)) {
+                return pass.ms;
+            }
+        }
+        return null;
+    }
+};
+
+const FrameQueries = struct {
+    pool: c.VkQueryPool,
+    /// Scope names must outlive the frame, in practice they are literals
+    names: [MAX_SCOPES][]const u8 = undefined,
+    count: u32 = 0,
+};
+
+/// Timestamp profiler with one query pool per frame in flight. A frame's pool is reset at the start of its command
+/// buffer and read back once the frame's timeline value has been reached, so reading never waits on the GPU.
+pub const GpuProfiler = struct {
+    allocator: std.mem.Allocator,
+    device: c.VkDevice,
+    /// Nanoseconds per tick
+    period: f32,
+    frames: []FrameQueries,
+    resolved: u64 = 0,
+
+    pub fn init(a: std.mem.Allocator, device: c.VkDevice, frame_count: u32, period: f32) !GpuProfiler {
+        const frames = try a.alloc(FrameQueries, frame_count);
+        errdefer a.free(frames);
+
+        var created: usize = 0;
+        errdefer {
+            for (frames[0..created]) |frame| {
+                c.vkDestroyQueryPool(device, frame.pool, null);
+            }
+        }
+
+        const create_info = std.mem.zeroInit(c.VkQueryPoolCreateInfo, .{
+            .sType = c.VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .queryType = c.VK_QUERY_TYPE_TIMESTAMP,
+            .queryCount = MAX_SCOPES * 2,
+        });
+
+        for (frames) |*frame| {
+            var pool: c.VkQueryPool = undefined;
+            try vke.checkResult(c.vkCreateQueryPool(device, &create_info, null, &pool));
+            frame.* = .{ .pool = pool };
+            created += 1;
+        }
+
+        return .{
+            .allocator = a,
+            .device = device,
+            .period = period,
+            .frames = frames,
+        };
+    }
+
+    pub fn deinit(self: *GpuProfiler) void {
+        for (self.frames) |frame| {
+            c.vkDestroyQueryPool(self.device, frame.pool, null);
+        }
+        self.allocator.free(self.frames);
+    }
+
+    /// Reset the frame's queries and open the frame scope. Record first into the primary command buffer, outside
+    /// any render pass, after the previous results have been resolved.
+    pub fn beginFrame(self: *GpuProfiler, command_buffer: c.VkCommandBuffer, frame_index: u32) void {
+        const frame = &self.frames[frame_index];
+        c.vkCmdResetQueryPool(command_buffer, frame.pool, 0, MAX_SCOPES * 2);
+        frame.count = 0;
+
+        if (self.reserve(frame_index, FRAME_SCOPE)) |scope| {
+            scope.begin(command_buffer);
+        }
+    }
+
+    /// Close the frame scope, record last into the primary command buffer
+    pub fn endFrame(self: *const GpuProfiler, command_buffer: c.VkCommandBuffer, frame_index: u32) void {
+        const frame = &self.frames[frame_index];
+        if (frame.count > 0) {
+            (Scope{ .pool = frame.pool, .index = 0 }).end(command_buffer);
+        }
+    }
+
+    /// Claim a scope without writing it, for a pass recorded into another command buffer. Null once the frame
+    /// has used up its scopes, the pass then goes untimed.
+    pub fn reserve(self: *GpuProfiler, frame_index: u32, name: []const u8) ?Scope {
+        const frame = &self.frames[frame_index];
+        if (frame.count == MAX_SCOPES) {
+            return null;
+        }
+
+        frame.names[frame.count] = name;
+        frame.count += 1;
+        return .{ .pool = frame.pool, .index = frame.count - 1 };
+    }
+
+    /// Claim a scope and write its begin timestamp into `command_buffer`
+    pub fn begin(self: *GpuProfiler, command_buffer: c.VkCommandBuffer, frame_index: u32, name: []const u8) ?Scope {
+        const scope = self.reserve(frame_index, name) orelse return null;
+        scope.begin(command_buffer);
+        return scope;
+    }
+
+    /// Read the frame's timestamps into `timings`. Only call once the frame's timeline value has been reached,
+    /// returns false when the frame has nothing to read yet.
+    pub fn resolve(self: *GpuProfiler, frame_index: u32, timings: *GpuTimings) bool {
+        const frame = &self.frames[frame_index];
+        if (frame.count == 0) {
+            return false;
+        }
+
+        var ticks: [MAX_SCOPES * 2]u64 = undefined;
+        const query_count = frame.count * 2;
+        const result = c.vkGetQueryPoolResults(self.device, frame.pool, 0, query_count, query_count * @sizeOf(u64), &ticks, @sizeOf(u64), c.VK_QUERY_RESULT_64_BIT);
+        if (result != c.VK_SUCCESS) {
+            return false;
+        }
+
+        self.resolved += 1;
+        fillTimings(timings, frame.names[0..frame.count], ticks[0..query_count], self.period);
+        timings.frame = self.resolved;
+        return true;
+    }
+};
+
+fn fillTimings(timings: *GpuTimings, names: []const []const u8, ticks: []const u64, period: f32) void {
+    for (names, 0..) |name, i| {
+        const elapsed = ticks[i * 2 + 1] -| ticks[i * 2];
+        timings.passes[i] = .{
+            .name = name,
+            .ms = @as(f32, @floatFromInt(elapsed)) * period / std.time.ns_per_ms,
+        };
+    }
+    timings.count = @as(u32, @intCast(names.len));
+}
+
+test "fillTimings converts tick pairs into milliseconds by name" {
+    var timings = GpuTimings{};
+    const names = [_][]const u8{ FRAME_SCOPE, "grid", "meshes" };
+    const ticks = [_]u64{ 0, 4_000, 100, 600, 600, 3_600 };
+
+    fillTimings(&timings, &names, &ticks, 1_000);
+
+    try testing.expectEqual(@as(usize, 3), timings.slice().len);
+    try testing.expectApproxEqAbs(@as(f32, 4), timings.get(FRAME_SCOPE).?, 0.001);
+    try testing.expectApproxEqAbs(@as(f32, 0.5), timings.get("grid").?, 0.001);
+    try testing.expectApproxEqAbs(@as(f32, 3), timings.get("meshes").?, 0.001);
+    try testing.expectEqual(@as(?f32, null), timings.get("cull"));
+}
@@ -0,0 +1,228 @@
+const std = @import("std");
+const c = @import("../clibs.zig");
+const vke = @import("./error.zig");
+const trace = @import("../trace.zig");
+const testing = std.testing;
+
+/// Fewest draws worth handing to a worker, below this the cost of waking a thread outweighs the recording
+pub const MIN_CHUNK_SIZE: u32 = 256;
+
+pub const RecorderOpts = struct {
+    device: c.VkDevice,
+    queue_family_index: u32,
+    frame_count: u32,
+    /// Zero uses one chunk per logical core
+    max_chunks: u32 = 0,
+};
+
+/// Render pass state the secondary command buffers continue from
+pub const Inheritance = struct {
+    render_pass: c.VkRenderPass,
+    framebuffer: c.VkFramebuffer,
+    subpass: u32 = 0,
+};
+
+/// First and one past the last unit of work of a chunk
+pub const Range = struct {
+    begin: u32,
+    end: u32,
+};
+
+/// Records a frame's draws into secondary command buffers in parallel. Every chunk of a frame owns a command
+/// pool, so whichever thread picks up a chunk records it without sharing a pool with another thread. Each frame
+/// in flight has its own pools, they are reset when the frame's chunks are recorded again.
+pub const CommandRecorder = struct {
+    allocator: std.mem.Allocator,
+    device: c.VkDevice,
+    thread_pool: std.Thread.Pool,
+    max_chunks: u32,
+    frame_count: u32,
+    /// `frame_count * max_chunks` pools and buffers, grouped by frame
+    command_pools: []c.VkCommandPool,
+    command_buffers: []c.VkCommandBuffer,
+    /// Written by the chunk that owns the slot, read once every chunk has finished
+    chunk_failed: []bool,
+
+    /// Initialized in place, the worker threads keep a pointer to the thread pool
+    pub fn init(self: *CommandRecorder, a: std.mem.Allocator, opts: RecorderOpts) !void {
+        const cpu_count = @as(u32, @intCast(std.Thread.getCpuCount() catch 1));
+        const max_chunks = if (opts.max_chunks == 0) cpu_count else opts.max_chunks;
+        const slot_count = opts.frame_count * max_chunks;
+
+        const command_pools = try a.alloc(c.VkCommandPool, slot_count);
+        errdefer a.free(command_pools);
+        const command_buffers = try a.alloc(c.VkCommandBuffer, slot_count);
+        errdefer a.free(command_buffers);
+
+        const chunk_failed = try a.alloc(bool, max_chunks);
+        errdefer a.free(chunk_failed);
+
+        var created: usize = 0;
+        errdefer {
+            for (command_pools[0..created]) |pool| {
+                c.vkDestroyCommandPool(opts.device, pool, null);
+            }
+        }
+
+        for (command_pools, command_buffers) |*pool, *buffer| {
+            const pool_create_info = std.mem.zeroInit(c.VkCommandPoolCreateInfo, .{
+                .sType = c.VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                .flags = c.VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+                .queueFamilyIndex = opts.queue_family_index,
+            });
+            try vke.checkResult(c.vkCreateCommandPool(opts.device, &pool_create_info, null, pool));
+            created += 1;
+
+            const alloc_info = std.mem.zeroInit(c.VkCommandBufferAllocateInfo, .{
+                .sType = c.VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                .commandPool = pool.*,
+                .level = c.VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+                .commandBufferCount = 1,
+            });
+            try vke.checkResult(c.vkAllocateCommandBuffers(opts.device, &alloc_info, buffer));
+        }
+
+        self.* = .{
+            .allocator = a,
+            .device = opts.device,
+            .thread_pool = undefined,
+            .max_chunks = max_chunks,
+            .frame_count = opts.frame_count,
+            .command_pools = command_pools,
+            .command_buffers = command_buffers,
+            .chunk_failed = chunk_failed,
+        };
+
+        // The calling thread records the first chunk itself
+        try self.thread_pool.init(.{ .allocator = a, .n_jobs = @max(max_chunks - 1, 1) });
+    }
+
+    /// The device must be idle, destroying the pools frees their command buffers
+    pub fn deinit(self: *CommandRecorder) void {
+        self.thread_pool.deinit();
+        for (self.command_pools) |pool| {
+            c.vkDestroyCommandPool(self.device, pool, null);
+        }
+        self.allocator.free(self.command_pools);
+        self.allocator.free(self.command_buffers);
+        self.allocator.free(self.chunk_failed);
+    }
+
+    /// Chunks `record` splits `total` units of work into, the last chunk index is one less
+    pub fn chunkCountFor(self: *const CommandRecorder, total: u32) u32 {
+        return chunkCount(total, self.max_chunks, MIN_CHUNK_SIZE);
+    }
+
+    /// Split `total` units of work into chunks and call `recordChunk(context, command_buffer, range, chunk_index)`
+    /// for each one on the thread pool. Returns the secondary command buffers in chunk order, ready for
+    /// `vkCmdExecuteCommands`. `context` is shared by every thread and must only be read.
+    pub fn record(
+        self: *CommandRecorder,
+        frame_index: u32,
+        inheritance: Inheritance,
+        total: u32,
+        context: anytype,
+        comptime recordChunk: fn (@TypeOf(context), c.VkCommandBuffer, Range, u32) void,
+    ) ![]const c.VkCommandBuffer {
+        const Context = @TypeOf(context);
+        const chunk_count = self.chunkCountFor(total);
+        const first_slot = (frame_index % self.frame_count) * self.max_chunks;
+        const pools = self.command_pools[first_slot .. first_slot + chunk_count];
+        const buffers = self.command_buffers[first_slot .. first_slot + chunk_count];
+
+        const failed = self.chunk_failed[0..chunk_count];
+        @memset(failed, false);
+        var wait_group = std.Thread.WaitGroup{};
+
+        const Job = struct {
+            fn run(recorder: *const CommandRecorder, ctx: Context, pool: c.VkCommandPool, buffer: c.VkCommandBuffer, info: Inheritance, range: Range, chunk_index: u32, failure: *bool, group: ?*std.Thread.WaitGroup) void {
+                defer if (group) |g| g.finish();
+                // Ends before the wait group is released, so the zone is in the thread's buffer once the frame joins
+                const zone = trace.begin("RecordDrawChunk");
+                defer zone.end();
+
+                recorder.beginChunk(pool, buffer, info) catch |err| {
+                    std.debug.print("Failed to begin secondary command buffer: {}\n", .{err});
+                    failure.* = true;
+                    return;
+                };
+
+                recordChunk(ctx, buffer, range, chunk_index);
+
+                vke.checkResult(c.vkEndCommandBuffer(buffer)) catch |err| {
+                    std.debug.print("Failed to end secondary command buffer: {}\n", .{err});
+                    failure.* = true;
+                };
+            }
+        };
+
+        for (1..chunk_count) |i| {
+            const chunk_index = @as(u32, @intCast(i));
+            wait_group.start();
+            self.thread_pool.spawn(Job.run, .{ self, context, pools[i], buffers[i], inheritance, chunkRange(total, chunk_count, chunk_index), chunk_index, &failed[i], &wait_group }) catch |err| {
+                wait_group.finish();
+                wait_group.wait();
+                return err;
+            };
+        }
+
+        Job.run(self, context, pools[0], buffers[0], inheritance, chunkRange(total, chunk_count, 0), 0, &failed[0], null);
+        wait_group.wait();
+
+        if (std.mem.indexOfScalar(bool, failed, true) != null) {
+            return error.SecondaryRecordingFailed;
+        }
+        return buffers;
+    }
+
+    fn beginChunk(self: *const CommandRecorder, pool: c.VkCommandPool, buffer: c.VkCommandBuffer, info: Inheritance) !void {
+        // The frame's timeline value has been reached, nothing recorded from this pool is still in flight
+        try vke.checkResult(c.vkResetCommandPool(self.device, pool, 0));
+
+        const inheritance_info = std.mem.zeroInit(c.VkCommandBufferInheritanceInfo, .{
+            .sType = c.VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+            .renderPass = info.render_pass,
+            .subpass = info.subpass,
+            .framebuffer = info.framebuffer,
+        });
+
+        const begin_info = std.mem.zeroInit(c.VkCommandBufferBeginInfo, .{
+            .sType = c.VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = c.VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | c.VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+            .pInheritanceInfo = &inheritance_info,
+        });
+        try vke.checkResult(c.vkBeginCommandBuffer(buffer, &begin_info));
+    }
+};
+
+/// Number of chunks to split `total` units into, at least one so the render pass always gets a secondary buffer
+pub fn chunkCount(total: u32, max_chunks: u32, min_chunk_size: u32) u32 {
+    const wanted = (total + min_chunk_size - 1) / min_chunk_size;
+    return std.math.clamp(wanted, 1, @max(max_chunks, 1));
+}
+
+/// Even split of `total` units, the first `total % count` chunks take one extra unit
+pub fn chunkRange(total: u32, count: u32, index: u32) Range {
+    const size = total / count;
+    const extra = total % count;
+    const begin = index * size + @min(index, extra);
+    return .{ .begin = begin, .end = begin + size + @intFromBool(index < extra) };
+}
+
+test "chunkCount keeps small frames on one chunk" {
+    try testing.expectEqual(@as(u32, 1), chunkCount(0, 8, 256));
+    try testing.expectEqual(@as(u32, 1), chunkCount(256, 8, 256));
+    try testing.expectEqual(@as(u32, 2), chunkCount(257, 8, 256));
+    try testing.expectEqual(@as(u32, 8), chunkCount(100_000, 8, 256));
+}
+
+test "chunkRange covers the work without gaps" {
+    var next: u32 = 0;
+    for (0..3) |i| {
+        const range = chunkRange(10, 3, @as(u32, @intCast(i)));
+        try testing.expectEqual(next, range.begin);
+        next = range.end;
+    }
+    try testing.expectEqual(@as(u32, 10), next);
+    try testing.expectEqual(Range{ .begin = 0, .end = 4 }, chunkRange(10, 3, 0));
+}
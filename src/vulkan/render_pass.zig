@@ -7,7 +7,8 @@ pub const RenderPass = struct {
     handle: c.VkRenderPass = null,
 };
 
-pub fn createRenderPass(physical_device: c.VkPhysicalDevice, device: c.VkDevice, swapchain_format: c.VkFormat) !RenderPass {
+/// `final_layout` is what the color image is used for next, presenting it or copying it out of an offscreen target
+pub fn createRenderPass(physical_device: c.VkPhysicalDevice, device: c.VkDevice, swapchain_format: c.VkFormat, final_layout: c.VkImageLayout) !RenderPass {
     const color_attachment = std.mem.zeroInit(c.VkAttachmentDescription, .{
         .format = swapchain_format,
         .samples = c.VK_SAMPLE_COUNT_1_BIT,
@@ -16,7 +17,7 @@ pub fn createRenderPass(physical_device: c.VkPhysicalDevice, device: c.VkDevice,
         .stencilLoadOp = c.VK_ATTACHMENT_LOAD_OP_DONT_CARE,
         .stencilStoreOp = c.VK_ATTACHMENT_STORE_OP_DONT_CARE,
         .initialLayout = c.VK_IMAGE_LAYOUT_UNDEFINED,
-        .finalLayout = c.VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+        .finalLayout = final_layout,
     });
 
     const color_attachment_ref = c.VkAttachmentReference{
@@ -1,38 +1,67 @@
 const std = @import("std");
 const c = @import("../clibs.zig");
 const vke = @import ("./error.zig");
+const shaders = @import("shaders");
 
 const log = std.log.scoped(.shader);
 
-pub fn createShaderModule(a: std.mem.Allocator, device: c.VkDevice, filename: []const u8) !c.VkShaderModule {
-    const file = std.fs.cwd().openFile(filename, .{}) catch |err| {
-        log.err("Failed to open file {s} received error: {}", .{filename, err});
-        return err;
-    };
-    defer file.close();
-
-    const stat = try file.stat();
-    const file_size = stat.size;
-    const buffer = try a.alloc(u8, file_size);
-    const data: *const u32 = @alignCast(@ptrCast(buffer.ptr));
+/// Shaders compiled by `compileShaders` in build.zig
+pub const Name = shaders.Name;
 
-    _ = try file.readAll(buffer);
-    defer a.free(buffer);
-    
+pub fn createShaderModule(device: c.VkDevice, code: []align(4) const u8) !c.VkShaderModule {
     var create_info = c.VkShaderModuleCreateInfo{
         .sType = c.VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
         .pNext = null,
         .flags = 0,
-        .codeSize = file_size,
-        .pCode = data,
+        .codeSize = code.len,
+        .pCode = @ptrCast(code.ptr),
     };
 
     var shader_module: c.VkShaderModule = undefined;
-    vke.checkResult(c.vkCreateShaderModule(device, &create_info, null, &shader_module)) catch |err| {
-        log.err("Failed to create shader module for {s} received error: {}", .{filename, err});
-        return err;
-    };
- 
+    try vke.checkResult(c.vkCreateShaderModule(device, &create_info, null, &shader_module));
     return shader_module;
 }
 
+/// Creates the module of every embedded shader on first use and keeps it for the lifetime of the device, so
+/// pipelines that share a stage share its module.
+pub const ShaderRegistry = struct {
+    device: c.VkDevice,
+    modules: std.EnumArray(Name, c.VkShaderModule) = std.EnumArray(Name, c.VkShaderModule).initFill(null),
+
+    pub fn init(device: c.VkDevice) ShaderRegistry {
+        return .{ .device = device };
+    }
+
+    pub fn deinit(self: *ShaderRegistry) void {
+        for (&self.modules.values) |*module| {
+            if (module.* != null) {
+                c.vkDestroyShaderModule(self.device, module.*, null);
+                module.* = null;
+            }
+        }
+    }
+
+    /// Take over the modules of a copy of this registry that replaced some of them, the replaced modules are
+    /// destroyed. Pipelines keep working after their modules are gone.
+    pub fn adopt(self: *ShaderRegistry, staged: *const ShaderRegistry) void {
+        for (&self.modules.values, staged.modules.values) |*module, staged_module| {
+            if (module.* != staged_module) {
+                if (module.* != null) {
+                    c.vkDestroyShaderModule(self.device, module.*, null);
+                }
+                module.* = staged_module;
+            }
+        }
+    }
+
+    pub fn get(self: *ShaderRegistry, name: Name) !c.VkShaderModule {
+        const module = self.modules.getPtr(name);
+        if (module.* == null) {
+            module.* = createShaderModule(self.device, shaders.spirv(name)) catch |err| {
+                log.err("Failed to create shader module for {s} received error: {}", .{ @tagName(name), err });
+                return err;
+            };
+        }
+        return module.*;
+    }
+};
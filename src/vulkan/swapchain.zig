@@ -2,13 +2,53 @@ const std = @import("std");
 const c = @import("../clibs.zig");
 const vke = @import("./error.zig");
 const vkb = @import("./buffer.zig");
+const vkm = @import("./memory.zig");
 const engine = @import("./engine.zig");
+const testing = std.testing;
+
+/// How finished images reach the screen
+pub const PresentMode = enum {
+    /// Waits for vblank, never tears, the CPU blocks once every image is queued
+    fifo,
+    /// Waits for vblank unless the image is late, then tears instead of waiting a whole refresh
+    fifo_relaxed,
+    /// Waits for vblank but replaces the queued image, lowest latency without tearing
+    mailbox,
+    /// Presents right away and tears
+    immediate,
+
+    pub fn toVk(self: PresentMode) c.VkPresentModeKHR {
+        return switch (self) {
+            .fifo => c.VK_PRESENT_MODE_FIFO_KHR,
+            .fifo_relaxed => c.VK_PRESENT_MODE_FIFO_RELAXED_KHR,
+            .mailbox => c.VK_PRESENT_MODE_MAILBOX_KHR,
+            .immediate => c.VK_PRESENT_MODE_IMMEDIATE_KHR,
+        };
+    }
+};
+
+/// Presentation settings of the swapchain, changing them at runtime recreates the swapchain
+pub const PresentPolicy = struct {
+    mode: PresentMode = .mailbox,
+    /// Swapchain images to ask for, zero asks for one more than the surface minimum
+    image_count: u32 = 0,
+    /// Hold back the start of each frame by the time it would spend waiting on the GPU
+    pacing: bool = false,
+
+    /// Pacing only changes when frames start, the mode and image count are baked into the swapchain
+    pub fn needsNewSwapchain(self: PresentPolicy, applied: PresentPolicy) bool {
+        return self.mode != applied.mode or self.image_count != applied.image_count;
+    }
+};
 
 pub const SwapchainOpts = struct {
     graphics_queue_index: u32,
     presentation_queue_index: u32,
     window_width: u32,
     window_height: u32,
+    policy: PresentPolicy = .{},
+    /// Swapchain being replaced, its images stay presentable until the new swapchain takes over
+    old_swapchain: c.VkSwapchainKHR = null,
 };
 
 pub const Swapchain = struct {
@@ -27,7 +67,7 @@ pub const SwapchainImage = struct {
 pub const DepthImage = struct {
     image: c.VkImage,
     image_view: c.VkImageView,
-    memory: c.VkDeviceMemory,
+    allocation: vkm.Allocation,
 };
 
 pub const SwapchainFramebuffers = struct {
@@ -36,7 +76,8 @@ pub const SwapchainFramebuffers = struct {
 
 pub const Image = struct {
     handle: c.VkImage = null,
-    memory: c.VkDeviceMemory = null,
+    allocation: vkm.Allocation = .{},
+    mip_levels: u32 = 1,
 };
 
 pub const SwapchainDetails = struct {
@@ -81,15 +122,9 @@ pub fn createSwapchain(a: std.mem.Allocator, physical_device: c.VkPhysicalDevice
     defer swapchain_details.deinit(a);
 
     const surface_format = selectSurfaceFormat(swapchain_details.surface_formats);
-    const presentation_mode = selectPresentationMode(swapchain_details.presentation_modes);
+    const presentation_mode = selectPresentationMode(swapchain_details.presentation_modes, opts.policy.mode);
     const image_extent = getImageExtent(swapchain_details.surface_capabilities, opts.window_width, opts.window_height);
-    
-    var image_count: u32 = swapchain_details.surface_capabilities.minImageCount + 1;
-
-    // If max count is zero then it is unlimited
-    if (swapchain_details.surface_capabilities.maxImageCount > 0) {
-        image_count = @min(image_count, swapchain_details.surface_capabilities.maxImageCount);
-    }
+    const image_count = selectImageCount(swapchain_details.surface_capabilities, opts.policy.image_count);
 
     var swapchain_info = std.mem.zeroInit(c.VkSwapchainCreateInfoKHR, .{
         .sType = c.VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
@@ -104,7 +139,7 @@ pub fn createSwapchain(a: std.mem.Allocator, physical_device: c.VkPhysicalDevice
         .preTransform = swapchain_details.surface_capabilities.currentTransform,
         .compositeAlpha = c.VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
         .clipped = c.VK_TRUE,
-        .oldSwapchain = null,
+        .oldSwapchain = opts.old_swapchain,
     });
 
     if (opts.graphics_queue_index == opts.presentation_queue_index) {
@@ -135,7 +170,7 @@ pub fn createSwapchain(a: std.mem.Allocator, physical_device: c.VkPhysicalDevice
     errdefer a.free(image_views);
 
     for (images, image_views) |image, *image_view| {
-        image_view.* = try createImageView(device, image, surface_format.format, c.VK_IMAGE_ASPECT_COLOR_BIT);
+        image_view.* = try createImageView(device, image, surface_format.format, c.VK_IMAGE_ASPECT_COLOR_BIT, 1);
     }
 
     return Swapchain{
@@ -147,19 +182,19 @@ pub fn createSwapchain(a: std.mem.Allocator, physical_device: c.VkPhysicalDevice
     };
 }
 
-pub fn createDepthBufferImage(physical_device: c.VkPhysicalDevice, device: c.VkDevice, image_extent: c.VkExtent2D) !DepthImage {
+pub fn createDepthBufferImage(physical_device: c.VkPhysicalDevice, allocator: *vkm.DeviceAllocator, device: c.VkDevice, image_extent: c.VkExtent2D) !DepthImage {
     const depth_format = selectedSupportedFormat(physical_device, &.{
         c.VK_FORMAT_D32_SFLOAT_S8_UINT,
         c.VK_FORMAT_D32_SFLOAT,
         c.VK_FORMAT_D24_UNORM_S8_UINT,
     }, c.VK_IMAGE_TILING_OPTIMAL, c.VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
-    const depth_image = try createImage(physical_device, device, image_extent.width, image_extent.height, depth_format, c.VK_IMAGE_TILING_OPTIMAL, c.VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, c.VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    const depth_image_view = try createImageView(device, depth_image.handle, depth_format, c.VK_IMAGE_ASPECT_DEPTH_BIT);
+    const depth_image = try createImage(allocator, device, image_extent.width, image_extent.height, 1, depth_format, c.VK_IMAGE_TILING_OPTIMAL, c.VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, c.VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    const depth_image_view = try createImageView(device, depth_image.handle, depth_format, c.VK_IMAGE_ASPECT_DEPTH_BIT, 1);
 
     return DepthImage{
         .image = depth_image.handle,
         .image_view = depth_image_view,
-        .memory = depth_image.memory,
+        .allocation = depth_image.allocation,
     };
 }
 
@@ -226,7 +261,7 @@ pub fn createFramebuffer2(a: std.mem.Allocator, opts: CreateFrameBufferOpts) !Sw
     };
 }
 
-pub fn createImageView(device: c.VkDevice, image: c.VkImage, format: c.VkFormat, aspectFlags: c.VkImageAspectFlags) !c.VkImageView {
+pub fn createImageView(device: c.VkDevice, image: c.VkImage, format: c.VkFormat, aspectFlags: c.VkImageAspectFlags, mip_levels: u32) !c.VkImageView {
     const image_view_info = std.mem.zeroInit(c.VkImageViewCreateInfo, .{
         .sType = c.VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
         .image = image,
@@ -241,7 +276,7 @@ pub fn createImageView(device: c.VkDevice, image: c.VkImage, format: c.VkFormat,
         .subresourceRange = .{
             .aspectMask = aspectFlags,
             .baseMipLevel = 0,
-            .levelCount = 1,
+            .levelCount = mip_levels,
             .baseArrayLayer = 0,
             .layerCount = 1,
         },
@@ -270,9 +305,10 @@ fn selectSurfaceFormat(formats: []c.VkSurfaceFormatKHR) c.VkSurfaceFormatKHR {
     return formats[0];
 }
 
-fn selectPresentationMode(modes: []c.VkPresentModeKHR) c.VkPresentModeKHR {
+/// FIFO is the one mode every surface supports, so it stands in for any mode the surface lacks
+fn selectPresentationMode(modes: []const c.VkPresentModeKHR, wanted: PresentMode) c.VkPresentModeKHR {
     for (modes) |mode| {
-        if (mode == c.VK_PRESENT_MODE_MAILBOX_KHR) {
+        if (mode == wanted.toVk()) {
             return mode;
         }
     }
@@ -280,6 +316,17 @@ fn selectPresentationMode(modes: []c.VkPresentModeKHR) c.VkPresentModeKHR {
     return c.VK_PRESENT_MODE_FIFO_KHR;
 }
 
+fn selectImageCount(surface_capabilities: c.VkSurfaceCapabilitiesKHR, requested: u32) u32 {
+    var image_count = if (requested == 0) surface_capabilities.minImageCount + 1 else @max(requested, surface_capabilities.minImageCount);
+
+    // If max count is zero then it is unlimited
+    if (surface_capabilities.maxImageCount > 0) {
+        image_count = @min(image_count, surface_capabilities.maxImageCount);
+    }
+
+    return image_count;
+}
+
 pub fn selectedSupportedFormat(physical_device: c.VkPhysicalDevice, candidates: []const c.VkFormat, tiling: c.VkImageTiling, features: c.VkFormatFeatureFlags) c.VkFormat {
     for (candidates) |format| {
         var props = std.mem.zeroInit(c.VkFormatProperties, .{});
@@ -317,7 +364,7 @@ fn getImageExtent(surface_capabilities: c.VkSurfaceCapabilitiesKHR, window_width
     return extent;
 }
 
-pub fn createImage(physical_device: c.VkPhysicalDevice, device: c.VkDevice, width: u32, height: u32, format: c.VkFormat, tiling: c.VkImageTiling, usage: c.VkImageUsageFlags, properties: c.VkMemoryPropertyFlags) !Image {
+pub fn createImage(allocator: *vkm.DeviceAllocator, device: c.VkDevice, width: u32, height: u32, mip_levels: u32, format: c.VkFormat, tiling: c.VkImageTiling, usage: c.VkImageUsageFlags, properties: c.VkMemoryPropertyFlags) !Image {
     var image_info = std.mem.zeroInit(c.VkImageCreateInfo, .{
         .sType = c.VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
         .imageType = c.VK_IMAGE_TYPE_2D,
@@ -326,7 +373,7 @@ pub fn createImage(physical_device: c.VkPhysicalDevice, device: c.VkDevice, widt
             .height = height,
             .depth = 1,
         },
-        .mipLevels = 1,
+        .mipLevels = mip_levels,
         .arrayLayers = 1,
         .format = format,
         .tiling = tiling,
@@ -338,69 +385,36 @@ pub fn createImage(physical_device: c.VkPhysicalDevice, device: c.VkDevice, widt
 
     var image: c.VkImage = undefined;
     try vke.checkResult(c.vkCreateImage(device, &image_info, null, &image));
+    errdefer c.vkDestroyImage(device, image, null);
 
     var memory_requirements = std.mem.zeroInit(c.VkMemoryRequirements, .{});
     c.vkGetImageMemoryRequirements(device, image, &memory_requirements);
 
-    const memory_type_index: u32 = vkb.findMemoryTypeIndex(physical_device, memory_requirements.memoryTypeBits, properties);
-    var memory_info = std.mem.zeroInit(c.VkMemoryAllocateInfo, .{
-        .sType = c.VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = memory_requirements.size,
-        .memoryTypeIndex = memory_type_index,
-    });
-
-    var memory: c.VkDeviceMemory = undefined;
-    try vke.checkResult(c.vkAllocateMemory(device, &memory_info, null, &memory));
-    try vke.checkResult(c.vkBindImageMemory(device, image, memory, 0));
+    const kind: vkm.ResourceKind = if (tiling == c.VK_IMAGE_TILING_OPTIMAL) .optimal else .linear;
+    const allocation = try allocator.alloc(memory_requirements, properties, kind);
+    errdefer allocator.free(allocation);
+    try vke.checkResult(c.vkBindImageMemory(device, image, allocation.memory, allocation.offset));
 
     return Image{
         .handle = image,
-        .memory = memory,
+        .allocation = allocation,
+        .mip_levels = mip_levels,
     };
 }
 
-pub fn transitionImageLayout(device: c.VkDevice, command_pool: c.VkCommandPool, queue: c.VkQueue, image: c.VkImage, old_layout: c.VkImageLayout, new_layout: c.VkImageLayout) !void {
-    const command_buffer = try vkb.allocAndBeginCommandBuffer(device, command_pool);
-    var barrier = std.mem.zeroInit(c.VkImageMemoryBarrier, .{
-        .sType = c.VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-        .oldLayout = old_layout,
-        .newLayout = new_layout,
-        .srcQueueFamilyIndex = c.VK_QUEUE_FAMILY_IGNORED,
-        .dstQueueFamilyIndex = c.VK_QUEUE_FAMILY_IGNORED,
-        .image = image,
-        .subresourceRange = .{
-            .aspectMask = c.VK_IMAGE_ASPECT_COLOR_BIT,
-            .baseMipLevel = 0,
-            .levelCount = 1,
-            .baseArrayLayer = 0,
-            .layerCount = 1,
-        },
-    });
-
-    var srcStage: c.VkPipelineStageFlags = 0;
-    var dstStage: c.VkPipelineStageFlags = 0;
-
-    if (old_layout == c.VK_IMAGE_LAYOUT_UNDEFINED and new_layout == c.VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-        // Memory barrier access stage transition must happen after...
-        barrier.srcAccessMask = 0;
-        // ...and before the transfer write stage
-        barrier.dstAccessMask = c.VK_ACCESS_TRANSFER_WRITE_BIT;
-
-        srcStage = c.VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-        dstStage = c.VK_PIPELINE_STAGE_TRANSFER_BIT;
-    } else if (old_layout == c.VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL and new_layout == c.VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-        barrier.srcAccessMask = c.VK_ACCESS_TRANSFER_WRITE_BIT;
-        barrier.dstAccessMask = c.VK_ACCESS_SHADER_READ_BIT;
-
-        srcStage = c.VK_PIPELINE_STAGE_TRANSFER_BIT;
-        dstStage = c.VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-    } else {
-        return error.UnsupportedLayoutTransition;
-    }
-
-    c.vkCmdPipelineBarrier(command_buffer, srcStage, dstStage, 0, 0, null, 0, null, 1, &barrier);
-
-    try vkb.endAndFreeCommandBuffer(device, command_pool, command_buffer, queue);
+test "selectPresentationMode falls back to FIFO" {
+    const modes = [_]c.VkPresentModeKHR{ c.VK_PRESENT_MODE_FIFO_KHR, c.VK_PRESENT_MODE_IMMEDIATE_KHR };
+    try testing.expectEqual(@as(c.VkPresentModeKHR, c.VK_PRESENT_MODE_IMMEDIATE_KHR), selectPresentationMode(&modes, .immediate));
+    try testing.expectEqual(@as(c.VkPresentModeKHR, c.VK_PRESENT_MODE_FIFO_KHR), selectPresentationMode(&modes, .mailbox));
+    try testing.expectEqual(@as(c.VkPresentModeKHR, c.VK_PRESENT_MODE_FIFO_KHR), selectPresentationMode(&modes, .fifo_relaxed));
 }
 
+test "selectImageCount stays within the surface limits" {
+    var capabilities = std.mem.zeroInit(c.VkSurfaceCapabilitiesKHR, .{ .minImageCount = 2, .maxImageCount = 4 });
+    try testing.expectEqual(@as(u32, 3), selectImageCount(capabilities, 0));
+    try testing.expectEqual(@as(u32, 2), selectImageCount(capabilities, 1));
+    try testing.expectEqual(@as(u32, 4), selectImageCount(capabilities, 8));
 
+    capabilities.maxImageCount = 0;
+    try testing.expectEqual(@as(u32, 8), selectImageCount(capabilities, 8));
+}
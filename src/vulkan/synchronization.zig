@@ -1,6 +1,7 @@
 const std = @import("std");
 const c = @import("../clibs.zig");
 const vke = @import("./error.zig");
+const testing = std.testing;
 
 pub const Semaphore = struct {
     handle: c.VkSemaphore = null,
@@ -10,10 +11,6 @@ pub const Semaphores = struct {
     handles: []c.VkSemaphore = &.{}
 };
 
-pub const Fences = struct {
-    handles: []c.VkFence = &.{}
-};
-
 pub fn createSemaphore(device: c.VkDevice) !Semaphore {
     const create_info = std.mem.zeroInit(c.VkSemaphoreCreateInfo, .{
         .sType = c.VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
@@ -43,19 +40,116 @@ pub fn createSemaphores(a: std.mem.Allocator, device: c.VkDevice, semaphore_coun
     };
 }
 
-pub fn createFences(a: std.mem.Allocator, device: c.VkDevice, semaphore_count: usize) !Fences {
-    const fences: []c.VkFence = try a.alloc(c.VkFence, semaphore_count);
+/// Timeline semaphore counting the submissions of one queue. Every submission signals the next value, so whether
+/// work has finished is a comparison against the counter instead of a fence per submission, and other queues
+/// depend on it by waiting for a value.
+pub const Timeline = struct {
+    handle: c.VkSemaphore = null,
+    /// Last value handed to a submission
+    submitted: u64 = 0,
+    /// Highest value seen signaled, refreshed by `poll` and `wait`
+    completed: u64 = 0,
 
-    for (fences) |*fence| {
-        const create_info = std.mem.zeroInit(c.VkFenceCreateInfo, .{
-            .sType = c.VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-            .flags = c.VK_FENCE_CREATE_SIGNALED_BIT,
+    pub fn init(device: c.VkDevice) !Timeline {
+        const type_info = std.mem.zeroInit(c.VkSemaphoreTypeCreateInfo, .{
+            .sType = c.VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+            .semaphoreType = c.VK_SEMAPHORE_TYPE_TIMELINE,
+            .initialValue = 0,
         });
 
-        try vke.checkResult(c.vkCreateFence(device, &create_info, null, fence));
+        const create_info = std.mem.zeroInit(c.VkSemaphoreCreateInfo, .{
+            .sType = c.VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+            .pNext = &type_info,
+        });
+
+        var semaphore: c.VkSemaphore = undefined;
+        try vke.checkResult(c.vkCreateSemaphore(device, &create_info, null, &semaphore));
+
+        return .{
+            .handle = semaphore,
+        };
     }
 
-    return .{
-        .handles = fences,
-    };
-}
\ No newline at end of file
+    pub fn deinit(self: *Timeline, device: c.VkDevice) void {
+        c.vkDestroySemaphore(device, self.handle, null);
+    }
+
+    /// Value the next submission on the queue signals
+    pub fn next(self: *Timeline) u64 {
+        self.submitted += 1;
+        return self.submitted;
+    }
+
+    pub fn isComplete(self: *const Timeline, value: u64) bool {
+        return value <= self.completed;
+    }
+
+    /// Read the counter without blocking
+    pub fn poll(self: *Timeline, device: c.VkDevice) !u64 {
+        var value: u64 = undefined;
+        try vke.checkResult(c.vkGetSemaphoreCounterValue(device, self.handle, &value));
+        self.completed = @max(self.completed, value);
+        return self.completed;
+    }
+
+    /// Block until the counter reaches `value`, returns right away when it is already known to have
+    pub fn wait(self: *Timeline, device: c.VkDevice, value: u64, timeout: u64) !void {
+        if (self.isComplete(value)) {
+            return;
+        }
+
+        const wait_info = std.mem.zeroInit(c.VkSemaphoreWaitInfo, .{
+            .sType = c.VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+            .semaphoreCount = 1,
+            .pSemaphores = &self.handle,
+            .pValues = &value,
+        });
+        try vke.checkResult(c.vkWaitSemaphores(device, &wait_info, timeout));
+        self.completed = @max(self.completed, value);
+    }
+
+    /// Wait for everything submitted so far, used before tearing down what the submissions reference
+    pub fn drain(self: *Timeline, device: c.VkDevice) !void {
+        try self.wait(device, self.submitted, std.math.maxInt(u64));
+    }
+};
+
+/// One timeline per kind of submission. Queues a device does not have separately share the queue of another
+/// kind, they still count their own submissions.
+pub const QueueTimelines = struct {
+    graphics: Timeline,
+    transfer: Timeline,
+    compute: Timeline,
+
+    pub fn init(device: c.VkDevice) !QueueTimelines {
+        var graphics = try Timeline.init(device);
+        errdefer graphics.deinit(device);
+        var transfer = try Timeline.init(device);
+        errdefer transfer.deinit(device);
+        const compute = try Timeline.init(device);
+
+        return .{
+            .graphics = graphics,
+            .transfer = transfer,
+            .compute = compute,
+        };
+    }
+
+    pub fn deinit(self: *QueueTimelines, device: c.VkDevice) void {
+        self.graphics.deinit(device);
+        self.transfer.deinit(device);
+        self.compute.deinit(device);
+    }
+};
+
+test "Timeline values only move forward" {
+    var timeline = Timeline{};
+    try testing.expectEqual(@as(u64, 1), timeline.next());
+    try testing.expectEqual(@as(u64, 2), timeline.next());
+    try testing.expect(timeline.isComplete(0));
+    try testing.expect(!timeline.isComplete(1));
+
+    timeline.completed = 2;
+    try testing.expect(timeline.isComplete(1));
+    try testing.expect(!timeline.isComplete(3));
+}
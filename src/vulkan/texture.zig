@@ -3,7 +3,10 @@ const vkb = @import("./buffer.zig");
 const vke = @import("./error.zig");
 const vks = @import("./swapchain.zig");
 const vkds = @import("./descriptor_set.zig");
+const vkm = @import("./memory.zig");
+const vku = @import("./upload.zig");
 const c = @import("../clibs.zig");
+const testing = std.testing;
 
 // pub const AllocatedImage = struct {
 //     image: c.VkImage,
@@ -11,10 +14,10 @@ const c = @import("../clibs.zig");
 // };
 
 pub const ImageOpts = struct {
+    allocator: *vkm.DeviceAllocator,
     physical_device: c.VkPhysicalDevice,
     device: c.VkDevice,
-    transfer_queue: c.VkQueue,
-    command_pool: c.VkCommandPool,
+    uploader: *vku.UploadBatcher,
 };
 
 pub const SamplerImageView = struct {
@@ -22,6 +25,66 @@ pub const SamplerImageView = struct {
     descriptor_sets: []c.VkDescriptorSet,
 };
 
+/// Levels of a full mip chain, down to a single texel
+pub fn mipLevelCount(width: u32, height: u32) u32 {
+    return @as(u32, std.math.log2_int(u32, @max(width, height, 1))) + 1;
+}
+
+/// Whether the mip chain of a format can be generated with linear blits on the GPU
+pub fn supportsLinearBlit(physical_device: c.VkPhysicalDevice, format: c.VkFormat) bool {
+    var properties: c.VkFormatProperties = undefined;
+    c.vkGetPhysicalDeviceFormatProperties(physical_device, format, &properties);
+
+    const required = c.VK_FORMAT_FEATURE_BLIT_SRC_BIT | c.VK_FORMAT_FEATURE_BLIT_DST_BIT | c.VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return properties.optimalTilingFeatures & required == required;
+}
+
+/// Build every level of a mip chain from RGBA8 pixels with a 2x2 box filter. The levels are tightly packed from the
+/// largest down, the first one is a copy of `rgba`. An odd edge repeats its last texel. The caller owns the result.
+pub fn generateMipChain(a: std.mem.Allocator, rgba: []const u8, width: u32, height: u32, mip_levels: u32) ![]u8 {
+    std.debug.assert(rgba.len == @as(usize, width) * height * 4);
+
+    var size: usize = 0;
+    for (0..mip_levels) |level| {
+        size += @as(usize, vku.mipExtent(width, @intCast(level))) * vku.mipExtent(height, @intCast(level)) * 4;
+    }
+
+    const chain = try a.alloc(u8, size);
+    @memcpy(chain[0..rgba.len], rgba);
+
+    var src_offset: usize = 0;
+    var dst_offset: usize = rgba.len;
+    for (1..mip_levels) |level| {
+        const src_width = vku.mipExtent(width, @intCast(level - 1));
+        const src_height = vku.mipExtent(height, @intCast(level - 1));
+        const dst_width = vku.mipExtent(width, @intCast(level));
+        const dst_height = vku.mipExtent(height, @intCast(level));
+
+        for (0..dst_height) |y| {
+            const y0 = @min(y * 2, src_height - 1);
+            const y1 = @min(y * 2 + 1, src_height - 1);
+            for (0..dst_width) |x| {
+                const x0 = @min(x * 2, src_width - 1);
+                const x1 = @min(x * 2 + 1, src_width - 1);
+                for (0..4) |channel| {
+                    const sum = @as(u32, chain[src_offset + (y0 * src_width + x0) * 4 + channel]) +
+                        chain[src_offset + (y0 * src_width + x1) * 4 + channel] +
+                        chain[src_offset + (y1 * src_width + x0) * 4 + channel] +
+                        chain[src_offset + (y1 * src_width + x1) * 4 + channel];
+                    chain[dst_offset + (y * dst_width + x) * 4 + channel] = @intCast((sum + 2) / 4);
+                }
+            }
+        }
+
+        src_offset = dst_offset;
+        dst_offset += @as(usize, dst_width) * dst_height * 4;
+    }
+
+    return chain;
+}
+
+/// Load an image with a full mip chain. The chain is blitted on the GPU when the format supports linear blits and
+/// built on the CPU otherwise.
 pub fn loadImageFromFile(filepath: []const u8, opts: ImageOpts) !vks.Image {
     var width: c_int = undefined;
     var height: c_int = undefined;
@@ -36,43 +99,34 @@ pub fn loadImageFromFile(filepath: []const u8, opts: ImageOpts) !vks.Image {
     const image_size = @as(c.VkDeviceSize, @as(u64, @intCast(width)) * @as(u64, @intCast(height)) * 4);
     const format = c.VK_FORMAT_R8G8B8A8_UNORM;
 
-    const staging_buffer = try vkb.createBuffer(.{
-        .physical_device = opts.physical_device,
-        .device = opts.device,
-        .buffer_size = image_size,
-        .buffer_usage = c.VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        .buffer_properties = c.VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | c.VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-    });
-    defer staging_buffer.deleteAndFree(opts.device);
-
-
     var image_data_slice: []const u8 = undefined;
     image_data_slice.ptr = @as([*]const u8, @ptrCast(image_data));
     image_data_slice.len = image_size;
 
-    var staging_data: ?*align(@alignOf(u8)) anyopaque = undefined;
-    try vke.checkResult(c.vkMapMemory(opts.device, staging_buffer.memory, 0, image_size, 0, &staging_data));
-    @memcpy(@as([*]u8, @ptrCast(staging_data orelse unreachable)), image_data_slice);
-    c.vkUnmapMemory(opts.device, staging_buffer.memory);
-
     const w = @as(u32, @intCast(width));
     const h = @as(u32, @intCast(height));
-    const image = try vks.createImage(opts.physical_device, opts.device, w, h, format, c.VK_IMAGE_TILING_OPTIMAL, c.VK_IMAGE_USAGE_TRANSFER_DST_BIT | c.VK_IMAGE_USAGE_SAMPLED_BIT, c.VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-    try vks.transitionImageLayout(opts.device, opts.command_pool, opts.transfer_queue, image.handle, c.VK_IMAGE_LAYOUT_UNDEFINED, c.VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-    try vkb.copyImageBuffer(staging_buffer.handle, image.handle, w, h, vkb.TransferBufferOpts{
-        .device = opts.device,
-        .transfer_queue = opts.transfer_queue,
-        .command_pool = opts.command_pool,
-    });
+    const mip_levels = mipLevelCount(w, h);
+    // Blits read the level above, so the image is a transfer source as well
+    const image = try vks.createImage(opts.allocator, opts.device, w, h, mip_levels, format, c.VK_IMAGE_TILING_OPTIMAL, c.VK_IMAGE_USAGE_TRANSFER_SRC_BIT | c.VK_IMAGE_USAGE_TRANSFER_DST_BIT | c.VK_IMAGE_USAGE_SAMPLED_BIT, c.VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    errdefer {
+        c.vkDestroyImage(opts.device, image.handle, null);
+        opts.allocator.free(image.allocation);
+    }
 
-    try vks.transitionImageLayout(opts.device, opts.command_pool, opts.transfer_queue, image.handle, c.VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, c.VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    // The pixels are copied into the staging ring here, so stb's buffer can be released before the upload runs
+    if (supportsLinearBlit(opts.physical_device, format)) {
+        try opts.uploader.uploadImage(image_data_slice, image.handle, w, h, mip_levels, .blit);
+    } else {
+        const chain = try generateMipChain(opts.uploader.allocator, image_data_slice, w, h, mip_levels);
+        defer opts.uploader.allocator.free(chain);
+        try opts.uploader.uploadImage(chain, image.handle, w, h, mip_levels, .packed_levels);
+    }
 
     return image;
 }
 
-pub fn createTextureSampler(device: c.VkDevice) !c.VkSampler {
+/// Sampler that can reach every level of a chain of `mip_levels`
+pub fn createTextureSampler(device: c.VkDevice, mip_levels: u32) !c.VkSampler {
     const sampler_info = c.VkSamplerCreateInfo{
         .sType = c.VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
         .magFilter = c.VK_FILTER_LINEAR,
@@ -89,7 +143,7 @@ pub fn createTextureSampler(device: c.VkDevice) !c.VkSampler {
         .mipmapMode = c.VK_SAMPLER_MIPMAP_MODE_LINEAR,
         .mipLodBias = 0.0,
         .minLod = 0.0,
-        .maxLod = 0.0,
+        .maxLod = @floatFromInt(mip_levels),
     };
 
     var sampler: c.VkSampler = undefined;
@@ -97,11 +151,32 @@ pub fn createTextureSampler(device: c.VkDevice) !c.VkSampler {
     return sampler;
 }
 
-pub fn createTextureImageView(a: std.mem.Allocator, device: c.VkDevice, image: c.VkImage, descriptor_pool: c.VkDescriptorPool, descriptor_set_layout: c.VkDescriptorSetLayout, texture_sampler: c.VkSampler) !SamplerImageView {
-    const image_view = try vks.createImageView(device, image, c.VK_FORMAT_R8G8B8A8_UNORM, c.VK_IMAGE_ASPECT_COLOR_BIT);
+pub fn createTextureImageView(a: std.mem.Allocator, device: c.VkDevice, image: vks.Image, descriptor_pool: c.VkDescriptorPool, descriptor_set_layout: c.VkDescriptorSetLayout, texture_sampler: c.VkSampler) !SamplerImageView {
+    const image_view = try vks.createImageView(device, image.handle, c.VK_FORMAT_R8G8B8A8_UNORM, c.VK_IMAGE_ASPECT_COLOR_BIT, image.mip_levels);
     const descriptor_sets = try vkds.createTextureDescriptorSets(a, device, descriptor_pool, descriptor_set_layout, image_view, texture_sampler);
     return .{
         .image_view = image_view,
         .descriptor_sets = descriptor_sets,
     };
-}
\ No newline at end of file
+}
+
+test "mipLevelCount reaches a single texel" {
+    try testing.expectEqual(@as(u32, 1), mipLevelCount(1, 1));
+    try testing.expectEqual(@as(u32, 10), mipLevelCount(512, 512));
+    try testing.expectEqual(@as(u32, 10), mipLevelCount(512, 3));
+    try testing.expectEqual(@as(u32, 11), mipLevelCount(1024, 1000));
+}
+
+test "generateMipChain averages 2x2 blocks into packed levels" {
+    // 2x2 image, the second level is the mean of all four texels
+    const rgba = [_]u8{
+        0,   0,   0,   255, 100, 0,   0,   255,
+        0,   200, 0,   255, 0,   0,   40,  255,
+    };
+    const chain = try generateMipChain(testing.allocator, &rgba, 2, 2, mipLevelCount(2, 2));
+    defer testing.allocator.free(chain);
+
+    try testing.expectEqual(@as(usize, 20), chain.len);
+    try testing.expectEqualSlices(u8, &rgba, chain[0..16]);
+    try testing.expectEqualSlices(u8, &[_]u8{ 25, 50, 10, 255 }, chain[16..20]);
+}
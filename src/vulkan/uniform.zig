@@ -0,0 +1,167 @@
+const std = @import("std");
+const c = @import("../clibs.zig");
+const vkb = @import("./buffer.zig");
+const vkm = @import("./memory.zig");
+const testing = std.testing;
+
+/// Bytes of uniform data that can be written for a single frame
+pub const DEFAULT_FRAME_SIZE: u64 = 64 * 1024;
+
+pub const UniformRingOpts = struct {
+    allocator: *vkm.DeviceAllocator,
+    device: c.VkDevice,
+    frame_count: u32,
+    min_offset_alignment: u64,
+    frame_size: u64 = DEFAULT_FRAME_SIZE,
+    usage: c.VkBufferUsageFlags = c.VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+    /// Families reading or writing the ring, several make it concurrent so no queue has to transfer ownership
+    queue_families: []const u32 = &.{},
+};
+
+pub const Block = struct {
+    /// Dynamic offset to pass to `vkCmdBindDescriptorSets`
+    offset: u32,
+    data: []u8,
+};
+
+/// Host visible uniform buffer split into one region per frame in flight. The buffer stays mapped, every
+/// frame bump allocates its uniform blocks from the start of its own region and hands out dynamic offsets.
+pub const UniformRing = struct {
+    buffer: vkb.Buffer,
+    alignment: u64,
+    frame_size: u64,
+    frame_count: u32,
+    frame_start: u64 = 0,
+    head: u64 = 0,
+
+    pub fn init(opts: UniformRingOpts) !UniformRing {
+        const frame_size = std.mem.alignForward(u64, opts.frame_size, opts.min_offset_alignment);
+        const buffer = try vkb.createBuffer(.{
+            .allocator = opts.allocator,
+            .device = opts.device,
+            .buffer_size = frame_size * opts.frame_count,
+            .buffer_usage = opts.usage,
+            .buffer_properties = c.VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | c.VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            .queue_families = opts.queue_families,
+        });
+
+        return .{
+            .buffer = buffer,
+            .alignment = opts.min_offset_alignment,
+            .frame_size = frame_size,
+            .frame_count = opts.frame_count,
+        };
+    }
+
+    pub fn deinit(self: *UniformRing, device: c.VkDevice, allocator: *vkm.DeviceAllocator) void {
+        self.buffer.deleteAndFree(device, allocator);
+    }
+
+    /// Start writing into the region of the frame, the caller must have waited on that frame's timeline value.
+    pub fn beginFrame(self: *UniformRing, frame_index: u32) void {
+        self.frame_start = self.frame_size * (frame_index % self.frame_count);
+        self.head = 0;
+    }
+
+    /// Dynamic offset of the current frame's region, used when the shader indexes into the region itself
+    pub fn frameOffset(self: *const UniformRing) u32 {
+        return @as(u32, @intCast(self.frame_start));
+    }
+
+    pub fn alloc(self: *UniformRing, size: u64) !Block {
+        return self.allocAligned(size, self.alignment);
+    }
+
+    /// `alignment` is counted from the start of the frame's region, which is aligned to the ring's alignment
+    fn allocAligned(self: *UniformRing, size: u64, alignment: u64) !Block {
+        const start = std.mem.alignForward(u64, self.head, alignment);
+        if (start + size > self.frame_size) {
+            return error.UniformRingFull;
+        }
+
+        self.head = start + size;
+        const offset = self.frame_start + start;
+        return .{
+            .offset = @as(u32, @intCast(offset)),
+            .data = self.buffer.allocation.mapped.?[offset .. offset + size],
+        };
+    }
+
+    /// Copy the value into the current frame and return its dynamic offset.
+    pub fn push(self: *UniformRing, comptime T: type, value: *const T) !u32 {
+        const block = try self.alloc(@sizeOf(T));
+        @memcpy(block.data, std.mem.asBytes(value));
+        return block.offset;
+    }
+
+    /// Reserve `count` tightly packed values, returning them along with the index of the first one in the frame.
+    /// The first value starts on a multiple of both `@sizeOf(T)` and the ring's alignment, so the index is exact
+    /// whatever was pushed before it.
+    pub fn pushArray(self: *UniformRing, comptime T: type, count: usize) !struct { first: u32, items: []T } {
+        const stride: u64 = @sizeOf(T);
+        const alignment = self.alignment / std.math.gcd(self.alignment, stride) * stride;
+        const block = try self.allocAligned(stride * count, alignment);
+        const relative = block.offset - self.frameOffset();
+
+        return .{
+            .first = @as(u32, @intCast(relative / @sizeOf(T))),
+            .items = @as([*]T, @ptrCast(@alignCast(block.data.ptr)))[0..count],
+        };
+    }
+};
+
+test "UniformRing alloc aligns blocks inside the frame region" {
+    var backing: [512]u8 = undefined;
+    var ring = UniformRing{
+        .buffer = .{ .allocation = .{ .mapped = &backing } },
+        .alignment = 64,
+        .frame_size = 256,
+        .frame_count = 2,
+    };
+
+    ring.beginFrame(1);
+    const first = try ring.alloc(16);
+    const second = try ring.alloc(16);
+    try testing.expectEqual(@as(u32, 256), first.offset);
+    try testing.expectEqual(@as(u32, 320), second.offset);
+
+    _ = try ring.alloc(64);
+    try testing.expectError(error.UniformRingFull, ring.alloc(128));
+
+    ring.beginFrame(2);
+    try testing.expectEqual(@as(u32, 0), (try ring.alloc(16)).offset);
+}
+
+test "UniformRing pushArray indexes elements from the frame start" {
+    var backing: [1024]u8 align(64) = undefined;
+    var ring = UniformRing{
+        .buffer = .{ .allocation = .{ .mapped = &backing } },
+        .alignment = 64,
+        .frame_size = 512,
+        .frame_count = 2,
+    };
+
+    ring.beginFrame(1);
+    const first = try ring.pushArray([4]f32, 3);
+    const second = try ring.pushArray([4]f32, 2);
+    try testing.expectEqual(@as(u32, 0), first.first);
+    try testing.expectEqual(@as(u32, 4), second.first);
+    try testing.expectEqual(@as(usize, 2), second.items.len);
+}
+
+test "UniformRing pushArray keeps the index exact for sizes that are not a multiple of the alignment" {
+    var backing: [1024]u8 align(64) = undefined;
+    var ring = UniformRing{
+        .buffer = .{ .allocation = .{ .mapped = &backing } },
+        .alignment = 16,
+        .frame_size = 512,
+        .frame_count = 2,
+    };
+
+    ring.beginFrame(1);
+    // 20 bytes like `VkDrawIndexedIndirectCommand`, pushed after something else has taken the start of the frame
+    _ = try ring.alloc(16);
+    const commands = try ring.pushArray([5]u32, 2);
+    try testing.expectEqual(@as(u32, 4), commands.first);
+    try testing.expectEqual(@as(u64, 120), ring.head);
+}
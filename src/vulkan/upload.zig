@@ -0,0 +1,682 @@
+const std = @import("std");
+const c = @import("../clibs.zig");
+const vke = @import("./error.zig");
+const vkb = @import("./buffer.zig");
+const vkc = @import("./command.zig");
+const vkm = @import("./memory.zig");
+const vksync = @import("./synchronization.zig");
+const testing = std.testing;
+
+/// Size of the persistently mapped staging buffer shared by every upload
+pub const STAGING_RING_SIZE: u64 = 32 * 1024 * 1024;
+
+/// Number of upload command buffers that can be in flight at once
+pub const UPLOAD_SLOT_COUNT = 3;
+
+/// Stages of the graphics queue that read uploaded data. Acquire barriers and the wait on the transfer timeline
+/// both use them, so the acquire is ordered after the wait.
+pub const ACQUIRE_STAGES: c.VkPipelineStageFlags = c.VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | c.VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | c.VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+/// Stages the graphics submission waits on the transfer timeline at. Mip chains the transfer queue could not blit
+/// are blitted from the acquired first level on the graphics queue, so transfer is waited on as well.
+pub const TRANSFER_WAIT_STAGES: c.VkPipelineStageFlags = ACQUIRE_STAGES | c.VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+/// Byte ring over the staging buffer. Head and tail only ever grow, the offset into the buffer is the
+/// position modulo the size, so the distance between the two is always the number of bytes still in use.
+pub const Ring = struct {
+    size: u64,
+    head: u64 = 0,
+    tail: u64 = 0,
+
+    /// Returns the offset into the staging buffer or null if the ring has no room left.
+    /// A region never wraps around the end of the buffer, the unused bytes at the end are skipped instead.
+    pub fn alloc(self: *Ring, size: u64, alignment: u64) ?u64 {
+        if (size > self.size) {
+            return null;
+        }
+
+        var start = std.mem.alignForward(u64, self.head, alignment);
+        if (start % self.size + size > self.size) {
+            start = (start / self.size + 1) * self.size;
+        }
+
+        if (start + size - self.tail > self.size) {
+            return null;
+        }
+
+        self.head = start + size;
+        return start % self.size;
+    }
+
+    /// Everything written before `position` has been consumed by the GPU.
+    pub fn release(self: *Ring, position: u64) void {
+        self.tail = @max(self.tail, position);
+    }
+
+    /// Whether a region of `size` bytes could ever be handed out, even by an empty ring
+    pub fn holds(self: *const Ring, size: u64) bool {
+        return size <= self.size;
+    }
+};
+
+/// Where the bytes of one upload were staged
+const Staged = struct {
+    buffer: c.VkBuffer,
+    offset: u64,
+};
+
+pub const UploadOpts = struct {
+    allocator: *vkm.DeviceAllocator,
+    device: c.VkDevice,
+    queue: c.VkQueue,
+    queue_family_index: u32,
+    /// Family of the queue that uses the uploaded data, ownership is transferred to it when it differs from
+    /// `queue_family_index`
+    dst_queue_family_index: u32,
+    /// Transfer timeline every batch signals
+    timeline: *vksync.Timeline,
+    ring_size: u64 = STAGING_RING_SIZE,
+};
+
+/// Where the levels of an uploaded image below the first come from
+pub const MipSource = enum {
+    /// The staged bytes hold every level, tightly packed from the largest down
+    packed_levels,
+    /// The staged bytes hold the first level, the others are blitted down from it on the GPU
+    blit,
+};
+
+/// Second half of a queue family ownership transfer, recorded on the destination queue
+const Acquire = struct {
+    /// Ticket of the batch holding the release
+    ticket: u64,
+    resource: union(enum) {
+        buffer: struct {
+            handle: c.VkBuffer,
+            offset: c.VkDeviceSize,
+            size: c.VkDeviceSize,
+        },
+        image: struct {
+            handle: c.VkImage,
+            width: u32,
+            height: u32,
+            mip_levels: u32,
+            /// The mip chain still has to be blitted, the transfer queue cannot
+            blit: bool,
+        },
+    },
+};
+
+const Slot = struct {
+    command_buffer: c.VkCommandBuffer,
+    /// Transfer timeline value the batch signals
+    ticket: u64 = 0,
+    ring_head: u64 = 0,
+    recording: bool = false,
+    in_flight: bool = false,
+    wrote_buffers: bool = false,
+    /// Staging buffers of uploads too large for the ring, freed once the batch has completed
+    dedicated: std.ArrayListUnmanaged(vkb.Buffer) = .{},
+};
+
+/// Records buffer and image uploads into one command buffer and submits them together. Every submission
+/// is identified by a ticket, the transfer timeline value it signals, so a ticket has completed once the
+/// timeline has reached it.
+///
+/// On a dedicated transfer queue, every copy ends with a release barrier to the destination family. The matching
+/// acquire barrier is handed to the destination queue through `recordAcquires`.
+pub const UploadBatcher = struct {
+    allocator: std.mem.Allocator,
+    memory: *vkm.DeviceAllocator,
+    device: c.VkDevice,
+    queue: c.VkQueue,
+    src_family: u32,
+    dst_family: u32,
+    timeline: *vksync.Timeline,
+    acquires: std.ArrayListUnmanaged(Acquire) = .{},
+    command_pool: c.VkCommandPool,
+    staging: vkb.Buffer,
+    ring: Ring,
+    slots: [UPLOAD_SLOT_COUNT]Slot,
+    current: usize = 0,
+    /// Bytes staged since the batcher was created
+    bytes_uploaded: u64 = 0,
+
+    pub fn init(a: std.mem.Allocator, opts: UploadOpts) !UploadBatcher {
+        const staging = try vkb.createBuffer(.{
+            .allocator = opts.allocator,
+            .device = opts.device,
+            .buffer_size = opts.ring_size,
+            .buffer_usage = c.VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            .buffer_properties = c.VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | c.VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        });
+        errdefer staging.deleteAndFree(opts.device, opts.allocator);
+
+        const command_pool = try vkc.createCommandPool(opts.device, opts.queue_family_index);
+        errdefer c.vkDestroyCommandPool(opts.device, command_pool.handle, null);
+
+        const alloc_info = std.mem.zeroInit(c.VkCommandBufferAllocateInfo, .{
+            .sType = c.VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = command_pool.handle,
+            .level = c.VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = UPLOAD_SLOT_COUNT,
+        });
+
+        var command_buffers: [UPLOAD_SLOT_COUNT]c.VkCommandBuffer = undefined;
+        try vke.checkResult(c.vkAllocateCommandBuffers(opts.device, &alloc_info, &command_buffers));
+
+        var slots: [UPLOAD_SLOT_COUNT]Slot = undefined;
+        for (&slots, command_buffers) |*slot, command_buffer| {
+            slot.* = .{ .command_buffer = command_buffer };
+        }
+
+        return .{
+            .allocator = a,
+            .memory = opts.allocator,
+            .device = opts.device,
+            .queue = opts.queue,
+            .src_family = opts.queue_family_index,
+            .dst_family = opts.dst_queue_family_index,
+            .timeline = opts.timeline,
+            .command_pool = command_pool.handle,
+            .staging = staging,
+            .ring = .{ .size = opts.ring_size },
+            .slots = slots,
+        };
+    }
+
+    /// Waits for every submitted upload before releasing the staging buffer and command buffers.
+    pub fn deinit(self: *UploadBatcher, allocator: *vkm.DeviceAllocator) void {
+        self.timeline.drain(self.device) catch |err| {
+            std.debug.print("Failed to wait for uploads: {}\n", .{err});
+        };
+        self.acquires.deinit(self.allocator);
+        for (&self.slots) |*slot| {
+            self.freeDedicated(slot);
+            slot.dedicated.deinit(self.allocator);
+        }
+
+        c.vkDestroyCommandPool(self.device, self.command_pool, null);
+        self.staging.deleteAndFree(self.device, allocator);
+    }
+
+    /// Ticket of the batch that is currently being recorded, it completes once `completed_ticket` reaches it.
+    pub fn pendingTicket(self: *const UploadBatcher) u64 {
+        return self.timeline.submitted + 1;
+    }
+
+    pub fn isComplete(self: *const UploadBatcher, ticket: u64) bool {
+        return self.timeline.isComplete(ticket);
+    }
+
+    /// Whether copies run on another queue family than the one using the data
+    pub fn transfersOwnership(self: *const UploadBatcher) bool {
+        return self.src_family != self.dst_family;
+    }
+
+    /// Record the acquire barriers of finished ownership transfers into a command buffer of the destination queue.
+    /// Buffers are acquired once their batch has completed, meshes are not drawn before then, so a large upload never
+    /// stalls a frame. Images are acquired as soon as their batch is submitted because textures are sampled right
+    /// away. Returns the transfer timeline value the submission has to wait on at `TRANSFER_WAIT_STAGES`.
+    /// Must be recorded outside a render pass, mip chains left to generate are blitted here after their acquire.
+    pub fn recordAcquires(self: *UploadBatcher, command_buffer: c.VkCommandBuffer) u64 {
+        var wait_value: u64 = 0;
+        var i: usize = 0;
+        while (i < self.acquires.items.len) {
+            const acquire = self.acquires.items[i];
+            const ready = switch (acquire.resource) {
+                .buffer => self.timeline.isComplete(acquire.ticket),
+                .image => acquire.ticket <= self.timeline.submitted,
+            };
+            if (!ready) {
+                i += 1;
+                continue;
+            }
+
+            switch (acquire.resource) {
+                .buffer => |buffer| {
+                    const barrier = self.bufferOwnershipBarrier(buffer.handle, buffer.offset, buffer.size, 0, c.VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | c.VK_ACCESS_INDEX_READ_BIT | c.VK_ACCESS_SHADER_READ_BIT);
+                    c.vkCmdPipelineBarrier(command_buffer, ACQUIRE_STAGES, ACQUIRE_STAGES, 0, 0, null, 1, &barrier, 0, null);
+                },
+                .image => |image| {
+                    if (image.blit) {
+                        const barrier = self.imageOwnershipBarrier(image.handle, image.mip_levels, c.VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, c.VK_ACCESS_TRANSFER_READ_BIT | c.VK_ACCESS_TRANSFER_WRITE_BIT);
+                        // The blit reads the first level, so the acquire is ordered after the wait at the transfer stage
+                        c.vkCmdPipelineBarrier(command_buffer, c.VK_PIPELINE_STAGE_TRANSFER_BIT, c.VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, null, 0, null, 1, &barrier);
+                        recordMipBlits(command_buffer, image.handle, image.width, image.height, image.mip_levels, ACQUIRE_STAGES);
+                    } else {
+                        const barrier = self.imageOwnershipBarrier(image.handle, image.mip_levels, c.VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 0, c.VK_ACCESS_SHADER_READ_BIT);
+                        c.vkCmdPipelineBarrier(command_buffer, ACQUIRE_STAGES, ACQUIRE_STAGES, 0, 0, null, 0, null, 1, &barrier);
+                    }
+                },
+            }
+
+            wait_value = @max(wait_value, acquire.ticket);
+            _ = self.acquires.swapRemove(i);
+        }
+
+        return wait_value;
+    }
+
+    pub fn uploadBuffer(self: *UploadBatcher, bytes: []const u8, dst_buffer: c.VkBuffer, dst_offset: c.VkDeviceSize) !void {
+        const staged = try self.stage(bytes, 4);
+        const command_buffer = try self.begin();
+
+        const copy_region = c.VkBufferCopy{
+            .srcOffset = staged.offset,
+            .dstOffset = dst_offset,
+            .size = bytes.len,
+        };
+        c.vkCmdCopyBuffer(command_buffer, staged.buffer, dst_buffer, 1, &copy_region);
+        self.slots[self.current].wrote_buffers = true;
+
+        if (self.transfersOwnership()) {
+            const barrier = self.bufferOwnershipBarrier(dst_buffer, dst_offset, bytes.len, c.VK_ACCESS_TRANSFER_WRITE_BIT, 0);
+            c.vkCmdPipelineBarrier(command_buffer, c.VK_PIPELINE_STAGE_TRANSFER_BIT, c.VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, null, 1, &barrier, 0, null);
+            try self.acquires.append(self.allocator, .{
+                .ticket = self.pendingTicket(),
+                .resource = .{ .buffer = .{ .handle = dst_buffer, .offset = dst_offset, .size = bytes.len } },
+            });
+        }
+    }
+
+    /// Copies RGBA8 pixels into an image with `mip_levels` levels and leaves every level ready to be sampled in the
+    /// fragment shader. With `.blit` only the first level is copied and the rest of the chain is generated from it.
+    pub fn uploadImage(self: *UploadBatcher, bytes: []const u8, image: c.VkImage, width: u32, height: u32, mip_levels: u32, mip_source: MipSource) !void {
+        const staged = try self.stage(bytes, 16);
+        const command_buffer = try self.begin();
+
+        recordImageLayoutTransition(command_buffer, image, mip_levels, c.VK_IMAGE_LAYOUT_UNDEFINED, c.VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+        const copied_levels = if (mip_source == .packed_levels) mip_levels else 1;
+        var level_offset = staged.offset;
+        for (0..copied_levels) |level| {
+            const level_width = mipExtent(width, @intCast(level));
+            const level_height = mipExtent(height, @intCast(level));
+            recordCopyBufferToImage(command_buffer, staged.buffer, level_offset, image, @intCast(level), level_width, level_height);
+            level_offset += @as(u64, level_width) * level_height * 4;
+        }
+
+        const blit = mip_source == .blit and mip_levels > 1;
+        if (!self.transfersOwnership()) {
+            if (blit) {
+                recordMipBlits(command_buffer, image, width, height, mip_levels, c.VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+            } else {
+                recordImageLayoutTransition(command_buffer, image, mip_levels, c.VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, c.VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+            }
+            return;
+        }
+
+        // The layout transition happens once, between the release here and the acquire on the destination queue.
+        // Blits need a graphics queue, so a chain left to generate stays in the transfer layout and is blitted
+        // by `recordAcquires`.
+        const new_layout: c.VkImageLayout = if (blit) c.VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL else c.VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        const barrier = self.imageOwnershipBarrier(image, mip_levels, new_layout, c.VK_ACCESS_TRANSFER_WRITE_BIT, 0);
+        c.vkCmdPipelineBarrier(command_buffer, c.VK_PIPELINE_STAGE_TRANSFER_BIT, c.VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, null, 0, null, 1, &barrier);
+        try self.acquires.append(self.allocator, .{
+            .ticket = self.pendingTicket(),
+            .resource = .{ .image = .{ .handle = image, .width = width, .height = height, .mip_levels = mip_levels, .blit = blit } },
+        });
+    }
+
+    fn bufferOwnershipBarrier(self: *const UploadBatcher, buffer: c.VkBuffer, offset: c.VkDeviceSize, size: c.VkDeviceSize, src_access: c.VkAccessFlags, dst_access: c.VkAccessFlags) c.VkBufferMemoryBarrier {
+        return std.mem.zeroInit(c.VkBufferMemoryBarrier, .{
+            .sType = c.VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .srcAccessMask = src_access,
+            .dstAccessMask = dst_access,
+            .srcQueueFamilyIndex = self.src_family,
+            .dstQueueFamilyIndex = self.dst_family,
+            .buffer = buffer,
+            .offset = offset,
+            .size = size,
+        });
+    }
+
+    fn imageOwnershipBarrier(self: *const UploadBatcher, image: c.VkImage, mip_levels: u32, new_layout: c.VkImageLayout, src_access: c.VkAccessFlags, dst_access: c.VkAccessFlags) c.VkImageMemoryBarrier {
+        return std.mem.zeroInit(c.VkImageMemoryBarrier, .{
+            .sType = c.VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = src_access,
+            .dstAccessMask = dst_access,
+            .oldLayout = c.VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            .newLayout = new_layout,
+            .srcQueueFamilyIndex = self.src_family,
+            .dstQueueFamilyIndex = self.dst_family,
+            .image = image,
+            .subresourceRange = .{
+                .aspectMask = c.VK_IMAGE_ASPECT_COLOR_BIT,
+                .baseMipLevel = 0,
+                .levelCount = mip_levels,
+                .baseArrayLayer = 0,
+                .layerCount = 1,
+            },
+        });
+    }
+
+    /// Submit everything recorded since the last flush, returns the ticket of the submission or null if nothing was recorded.
+    pub fn flush(self: *UploadBatcher) !?u64 {
+        const slot = &self.slots[self.current];
+        if (!slot.recording) {
+            return null;
+        }
+
+        // Make the copied vertex and index data visible to the vertex input stage of later submissions, on a
+        // dedicated transfer queue the release and acquire barriers do this instead
+        if (slot.wrote_buffers and !self.transfersOwnership()) {
+            const barrier = std.mem.zeroInit(c.VkMemoryBarrier, .{
+                .sType = c.VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                .srcAccessMask = c.VK_ACCESS_TRANSFER_WRITE_BIT,
+                .dstAccessMask = c.VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | c.VK_ACCESS_INDEX_READ_BIT | c.VK_ACCESS_SHADER_READ_BIT,
+            });
+            c.vkCmdPipelineBarrier(slot.command_buffer, c.VK_PIPELINE_STAGE_TRANSFER_BIT, c.VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | c.VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 1, &barrier, 0, null, 0, null);
+        }
+
+        try vke.checkResult(c.vkEndCommandBuffer(slot.command_buffer));
+
+        const ticket = self.timeline.submitted + 1;
+        const timeline_info = std.mem.zeroInit(c.VkTimelineSemaphoreSubmitInfo, .{
+            .sType = c.VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+            .signalSemaphoreValueCount = 1,
+            .pSignalSemaphoreValues = &ticket,
+        });
+
+        const submit_info = std.mem.zeroInit(c.VkSubmitInfo, .{
+            .sType = c.VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = &timeline_info,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &slot.command_buffer,
+            .signalSemaphoreCount = 1,
+            .pSignalSemaphores = &self.timeline.handle,
+        });
+        try vke.checkResult(c.vkQueueSubmit(self.queue, 1, &submit_info, null));
+        _ = self.timeline.next();
+
+        slot.ticket = ticket;
+        slot.ring_head = self.ring.head;
+        slot.recording = false;
+        slot.in_flight = true;
+        slot.wrote_buffers = false;
+
+        self.current = (self.current + 1) % UPLOAD_SLOT_COUNT;
+        return slot.ticket;
+    }
+
+    /// Read the transfer timeline without blocking and release the staging memory of the batches it has passed.
+    pub fn retire(self: *UploadBatcher) !u64 {
+        const completed = try self.timeline.poll(self.device);
+
+        for (0..UPLOAD_SLOT_COUNT) |i| {
+            // Oldest submission first so the ring tail only moves forward
+            const slot = &self.slots[(self.current + i) % UPLOAD_SLOT_COUNT];
+            if (!slot.in_flight) {
+                continue;
+            }
+
+            if (slot.ticket > completed) {
+                break;
+            }
+
+            self.release(slot);
+        }
+
+        return completed;
+    }
+
+    fn release(self: *UploadBatcher, slot: *Slot) void {
+        slot.in_flight = false;
+        self.ring.release(slot.ring_head);
+        self.freeDedicated(slot);
+    }
+
+    fn freeDedicated(self: *UploadBatcher, slot: *Slot) void {
+        for (slot.dedicated.items) |buffer| {
+            buffer.deleteAndFree(self.device, self.memory);
+        }
+        slot.dedicated.clearRetainingCapacity();
+    }
+
+    /// Block until the oldest in flight batch has retired, only used when the ring or the slots run out.
+    fn waitOldest(self: *UploadBatcher) !bool {
+        for (0..UPLOAD_SLOT_COUNT) |i| {
+            const slot = &self.slots[(self.current + i) % UPLOAD_SLOT_COUNT];
+            if (!slot.in_flight) {
+                continue;
+            }
+
+            try self.timeline.wait(self.device, slot.ticket, std.math.maxInt(u64));
+            self.release(slot);
+            return true;
+        }
+
+        return false;
+    }
+
+    fn stage(self: *UploadBatcher, bytes: []const u8, alignment: u64) !Staged {
+        if (!self.ring.holds(bytes.len)) {
+            return self.stageDedicated(bytes);
+        }
+
+        while (true) {
+            if (self.ring.alloc(bytes.len, alignment)) |offset| {
+                @memcpy(self.staging.allocation.mapped.?[offset .. offset + bytes.len], bytes);
+                self.bytes_uploaded += bytes.len;
+                return .{ .buffer = self.staging.handle, .offset = offset };
+            }
+
+            // Out of staging space, submit what we have and wait for the oldest batch to hand its space back
+            _ = try self.flush();
+            if (!try self.waitOldest()) {
+                return error.StagingRingFull;
+            }
+        }
+    }
+
+    /// Stage an upload the ring could never hold in a buffer of its own. It belongs to the batch being recorded and
+    /// is freed when that batch retires.
+    fn stageDedicated(self: *UploadBatcher, bytes: []const u8) !Staged {
+        // Begun first, starting a batch releases what its slot held last time around
+        _ = try self.begin();
+
+        const buffer = try vkb.createBuffer(.{
+            .allocator = self.memory,
+            .device = self.device,
+            .buffer_size = bytes.len,
+            .buffer_usage = c.VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            .buffer_properties = c.VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | c.VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        });
+        errdefer buffer.deleteAndFree(self.device, self.memory);
+
+        const mapped = buffer.allocation.mapped orelse return error.MemoryNotMapped;
+        @memcpy(mapped[0..bytes.len], bytes);
+        try self.slots[self.current].dedicated.append(self.allocator, buffer);
+        self.bytes_uploaded += bytes.len;
+        return .{ .buffer = buffer.handle, .offset = 0 };
+    }
+
+    fn begin(self: *UploadBatcher) !c.VkCommandBuffer {
+        const slot = &self.slots[self.current];
+        if (slot.recording) {
+            return slot.command_buffer;
+        }
+
+        if (slot.in_flight) {
+            try self.timeline.wait(self.device, slot.ticket, std.math.maxInt(u64));
+            self.release(slot);
+        }
+
+        const begin_info = std.mem.zeroInit(c.VkCommandBufferBeginInfo, .{
+            .sType = c.VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = c.VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        });
+        try vke.checkResult(c.vkBeginCommandBuffer(slot.command_buffer, &begin_info));
+        slot.recording = true;
+        return slot.command_buffer;
+    }
+};
+
+pub fn recordCopyBufferToImage(command_buffer: c.VkCommandBuffer, src_buffer: c.VkBuffer, src_offset: c.VkDeviceSize, dst_image: c.VkImage, mip_level: u32, width: u32, height: u32) void {
+    const image_region = std.mem.zeroInit(c.VkBufferImageCopy, .{
+        .bufferOffset = src_offset,
+        .bufferRowLength = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource = c.VkImageSubresourceLayers{
+            .aspectMask = c.VK_IMAGE_ASPECT_COLOR_BIT,
+            .mipLevel = mip_level,
+            .baseArrayLayer = 0,
+            .layerCount = 1,
+        },
+        .imageOffset = .{ .x = 0, .y = 0, .z = 0 },
+        .imageExtent = .{ .width = width, .height = height, .depth = 1 },
+    });
+
+    c.vkCmdCopyBufferToImage(command_buffer, src_buffer, dst_image, c.VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &image_region);
+}
+
+pub fn recordImageLayoutTransition(command_buffer: c.VkCommandBuffer, image: c.VkImage, mip_levels: u32, old_layout: c.VkImageLayout, new_layout: c.VkImageLayout) void {
+    var barrier = std.mem.zeroInit(c.VkImageMemoryBarrier, .{
+        .sType = c.VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .oldLayout = old_layout,
+        .newLayout = new_layout,
+        .srcQueueFamilyIndex = c.VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = c.VK_QUEUE_FAMILY_IGNORED,
+        .image = image,
+        .subresourceRange = .{
+            .aspectMask = c.VK_IMAGE_ASPECT_COLOR_BIT,
+            .baseMipLevel = 0,
+            .levelCount = mip_levels,
+            .baseArrayLayer = 0,
+            .layerCount = 1,
+        },
+    });
+
+    var src_stage: c.VkPipelineStageFlags = c.VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    var dst_stage: c.VkPipelineStageFlags = c.VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+    if (old_layout == c.VK_IMAGE_LAYOUT_UNDEFINED and new_layout == c.VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = c.VK_ACCESS_TRANSFER_WRITE_BIT;
+    } else if (old_layout == c.VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL and new_layout == c.VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
+        barrier.srcAccessMask = c.VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = c.VK_ACCESS_SHADER_READ_BIT;
+
+        src_stage = c.VK_PIPELINE_STAGE_TRANSFER_BIT;
+        dst_stage = c.VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    } else {
+        std.debug.panic("Unsupported layout transition {d} -> {d}", .{ old_layout, new_layout });
+    }
+
+    c.vkCmdPipelineBarrier(command_buffer, src_stage, dst_stage, 0, 0, null, 0, null, 1, &barrier);
+}
+
+/// Size of a mip level along one axis, never below a texel
+pub fn mipExtent(extent: u32, level: u32) u32 {
+    return @max(extent >> @intCast(level), 1);
+}
+
+/// Fill the mip chain of an image from its first level with a cascade of linear blits, each level halving the one
+/// above it. Every level must be in the transfer destination layout, they all end up shader readable for `dst_stage`.
+/// Needs a graphics queue and a format that supports linear filtering of blits.
+pub fn recordMipBlits(command_buffer: c.VkCommandBuffer, image: c.VkImage, width: u32, height: u32, mip_levels: u32, dst_stage: c.VkPipelineStageFlags) void {
+    var barrier = std.mem.zeroInit(c.VkImageMemoryBarrier, .{
+        .sType = c.VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcQueueFamilyIndex = c.VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = c.VK_QUEUE_FAMILY_IGNORED,
+        .image = image,
+        .subresourceRange = .{
+            .aspectMask = c.VK_IMAGE_ASPECT_COLOR_BIT,
+            .baseMipLevel = 0,
+            .levelCount = 1,
+            .baseArrayLayer = 0,
+            .layerCount = 1,
+        },
+    });
+
+    for (1..mip_levels) |i| {
+        const level: u32 = @intCast(i);
+        const src_level = level - 1;
+
+        // The level above has been written, by the copy or the previous blit, and becomes the source
+        barrier.subresourceRange.baseMipLevel = src_level;
+        barrier.oldLayout = c.VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = c.VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.srcAccessMask = c.VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = c.VK_ACCESS_TRANSFER_READ_BIT;
+        c.vkCmdPipelineBarrier(command_buffer, c.VK_PIPELINE_STAGE_TRANSFER_BIT, c.VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, null, 0, null, 1, &barrier);
+
+        const blit = c.VkImageBlit{
+            .srcSubresource = .{
+                .aspectMask = c.VK_IMAGE_ASPECT_COLOR_BIT,
+                .mipLevel = src_level,
+                .baseArrayLayer = 0,
+                .layerCount = 1,
+            },
+            .srcOffsets = .{
+                .{ .x = 0, .y = 0, .z = 0 },
+                .{ .x = @intCast(mipExtent(width, src_level)), .y = @intCast(mipExtent(height, src_level)), .z = 1 },
+            },
+            .dstSubresource = .{
+                .aspectMask = c.VK_IMAGE_ASPECT_COLOR_BIT,
+                .mipLevel = level,
+                .baseArrayLayer = 0,
+                .layerCount = 1,
+            },
+            .dstOffsets = .{
+                .{ .x = 0, .y = 0, .z = 0 },
+                .{ .x = @intCast(mipExtent(width, level)), .y = @intCast(mipExtent(height, level)), .z = 1 },
+            },
+        };
+        c.vkCmdBlitImage(command_buffer, image, c.VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, c.VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, c.VK_FILTER_LINEAR);
+
+        barrier.oldLayout = c.VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.newLayout = c.VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = c.VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.dstAccessMask = c.VK_ACCESS_SHADER_READ_BIT;
+        c.vkCmdPipelineBarrier(command_buffer, c.VK_PIPELINE_STAGE_TRANSFER_BIT, dst_stage, 0, 0, null, 0, null, 1, &barrier);
+    }
+
+    // The last level is only ever written
+    barrier.subresourceRange.baseMipLevel = mip_levels - 1;
+    barrier.oldLayout = c.VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = c.VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = c.VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = c.VK_ACCESS_SHADER_READ_BIT;
+    c.vkCmdPipelineBarrier(command_buffer, c.VK_PIPELINE_STAGE_TRANSFER_BIT, dst_stage, 0, 0, null, 0, null, 1, &barrier);
+}
+
+test "mipExtent halves down to one texel" {
+    try testing.expectEqual(@as(u32, 512), mipExtent(512, 0));
+    try testing.expectEqual(@as(u32, 128), mipExtent(512, 2));
+    try testing.expectEqual(@as(u32, 2), mipExtent(5, 1));
+    try testing.expectEqual(@as(u32, 1), mipExtent(5, 8));
+}
+
+test "Ring alloc respects alignment" {
+    var ring = Ring{ .size = 256 };
+    try testing.expectEqual(@as(?u64, 0), ring.alloc(10, 4));
+    try testing.expectEqual(@as(?u64, 16), ring.alloc(8, 16));
+    try testing.expectEqual(@as(u64, 24), ring.head);
+}
+
+test "Ring alloc skips the tail of the buffer instead of wrapping a region" {
+    var ring = Ring{ .size = 100 };
+    try testing.expectEqual(@as(?u64, 0), ring.alloc(80, 1));
+    ring.release(80);
+    try testing.expectEqual(@as(?u64, 0), ring.alloc(40, 1));
+    try testing.expectEqual(@as(u64, 140), ring.head);
+}
+
+test "Ring never holds an upload larger than itself, even empty" {
+    var ring = Ring{ .size = 64 };
+    try testing.expect(ring.holds(64));
+    try testing.expect(!ring.holds(65));
+    // Such an upload goes to a dedicated staging buffer, waiting on the ring would never make room for it
+    try testing.expectEqual(@as(?u64, null), ring.alloc(65, 1));
+    try testing.expectEqual(@as(u64, 0), ring.head);
+}
+
+test "Ring alloc returns null until space is released" {
+    var ring = Ring{ .size = 64 };
+    try testing.expectEqual(@as(?u64, 0), ring.alloc(48, 1));
+    try testing.expectEqual(@as(?u64, null), ring.alloc(32, 1));
+    ring.release(48);
+    try testing.expectEqual(@as(?u64, 0), ring.alloc(32, 1));
+    try testing.expectEqual(@as(?u64, null), ring.alloc(65, 1));
+}